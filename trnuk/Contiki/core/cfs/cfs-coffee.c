@@ -68,6 +68,17 @@
 #define INVALID_PAGE		((coffee_page_t)-1)
 #define UNKNOWN_OFFSET		((cfs_offset_t)-1)
 
+/*
+ * The directory cache maps hashes of file names to the pages where
+ * the files start, so that find_file() does not have to scan the
+ * flash for files that have been looked up before. An entry with the
+ * page INVALID_PAGE records that no file has a name with the hash.
+ * A platform enables the cache by setting COFFEE_DIR_CACHE_ENTRIES.
+ */
+#ifndef COFFEE_DIR_CACHE_ENTRIES
+#define COFFEE_DIR_CACHE_ENTRIES	0
+#endif
+
 /* "Greedy" garbage collection erases as many sectors as possible. */
 #define GC_GREEDY		0
 /* "Reluctant" garbage collection stops after erasing one sector. */
@@ -141,6 +152,14 @@ struct file_header {
   char name[COFFEE_NAME_LENGTH];
 } __attribute__((packed));
 
+#if COFFEE_DIR_CACHE_ENTRIES
+/* A hash of 0 marks an unused entry. */
+struct dir_cache_entry {
+  uint16_t hash;
+  coffee_page_t page;
+};
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
+
 /* This is needed because of a buggy compiler. */
 struct log_param {
   cfs_offset_t offset;
@@ -153,11 +172,18 @@ static struct protected_mem_t {
   struct file_desc coffee_fd_set[COFFEE_FD_SET_SIZE];
   coffee_page_t next_free;
   char gc_wait;
+#if COFFEE_DIR_CACHE_ENTRIES
+  struct dir_cache_entry dir_cache[COFFEE_DIR_CACHE_ENTRIES];
+  uint8_t dir_cache_next;
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
 } protected_mem;
 static struct file *coffee_files = protected_mem.coffee_files;
 static struct file_desc *coffee_fd_set = protected_mem.coffee_fd_set;
 static coffee_page_t *next_free = &protected_mem.next_free;
 static char *gc_wait = &protected_mem.gc_wait;
+#if COFFEE_DIR_CACHE_ENTRIES
+static struct dir_cache_entry *dir_cache = protected_mem.dir_cache;
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
 
 /*---------------------------------------------------------------------------*/
 static void
@@ -335,6 +361,68 @@ next_file(coffee_page_t page, struct file_header *hdr)
   return page + hdr->max_pages;    
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_DIR_CACHE_ENTRIES
+static uint16_t
+name_hash(const char *name)
+{
+  uint16_t hash;
+
+  for(hash = 5381; *name != '\0'; name++) {
+    hash = (hash << 5) + hash + (unsigned char)*name;
+  }
+  return hash == 0 ? 1 : hash;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dir_cache_remove(coffee_page_t page)
+{
+  int i;
+
+  for(i = 0; i < COFFEE_DIR_CACHE_ENTRIES; i++) {
+    if(dir_cache[i].hash != 0 && dir_cache[i].page == page) {
+      dir_cache[i].hash = 0;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Adds a file, or a miss if page is INVALID_PAGE. Entries are only
+ * evicted, in round-robin order, if evict is set: the files that a
+ * scan passes by are only added to unused entries.
+ */
+static void
+dir_cache_add(uint16_t hash, coffee_page_t page, int evict)
+{
+  int i, free;
+
+  free = -1;
+  for(i = 0; i < COFFEE_DIR_CACHE_ENTRIES; i++) {
+    if(dir_cache[i].hash == hash) {
+      if(dir_cache[i].page == page) {
+	return;
+      }
+      if(dir_cache[i].page == INVALID_PAGE || page == INVALID_PAGE) {
+	/* A file and a miss for the same hash cannot both be right. */
+	dir_cache[i].hash = 0;
+      }
+    }
+    if(dir_cache[i].hash == 0 && free < 0) {
+      free = i;
+    }
+  }
+
+  if(free < 0) {
+    if(!evict) {
+      return;
+    }
+    free = protected_mem.dir_cache_next;
+    protected_mem.dir_cache_next = (free + 1) % COFFEE_DIR_CACHE_ENTRIES;
+  }
+  dir_cache[free].hash = hash;
+  dir_cache[free].page = page;
+}
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
+/*---------------------------------------------------------------------------*/
 static struct file *
 load_file(coffee_page_t start, struct file_header *hdr)
 {
@@ -382,6 +470,10 @@ find_file(const char *name)
   int i;
   struct file_header hdr;
   coffee_page_t page;
+#if COFFEE_DIR_CACHE_ENTRIES
+  uint16_t hash, scan_hash;
+  int hash_seen;
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
   
   /* First check if the file metadata is cached. */
   for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
@@ -394,15 +486,58 @@ find_file(const char *name)
       return &coffee_files[i];
     }
   }
+
+#if COFFEE_DIR_CACHE_ENTRIES
+  /* Then look for the file at the pages that the directory cache has
+     for its name hash. A header that no longer matches drops the
+     entry. */
+  hash = name_hash(name);
+  for(i = 0; i < COFFEE_DIR_CACHE_ENTRIES; i++) {
+    if(dir_cache[i].hash != hash) {
+      continue;
+    }
+    page = dir_cache[i].page;
+    if(page == INVALID_PAGE) {
+      return NULL;
+    }
+    read_header(&hdr, page);
+    if(!HDR_ACTIVE(hdr) || HDR_LOG(hdr) || name_hash(hdr.name) != hash) {
+      dir_cache[i].hash = 0;
+      continue;
+    }
+    if(strcmp(name, hdr.name) == 0) {
+      return load_file(page, &hdr);
+    }
+  }
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
   
   /* Scan the flash memory sequentially otherwise. */
+#if COFFEE_DIR_CACHE_ENTRIES
+  hash_seen = 0;
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
   for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
     read_header(&hdr, page);
-    if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr) && strcmp(name, hdr.name) == 0) {
-      return load_file(page, &hdr);
+    if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr)) {
+#if COFFEE_DIR_CACHE_ENTRIES
+      scan_hash = name_hash(hdr.name);
+      if(scan_hash == hash) {
+	hash_seen = 1;
+      }
+      dir_cache_add(scan_hash, page, strcmp(name, hdr.name) == 0);
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
+      if(strcmp(name, hdr.name) == 0) {
+	return load_file(page, &hdr);
+      }
     }
   }
 
+#if COFFEE_DIR_CACHE_ENTRIES
+  /* A miss is only remembered if no file has the same name hash. */
+  if(!hash_seen) {
+    dir_cache_add(hash, INVALID_PAGE, 1);
+  }
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
+
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
@@ -493,6 +628,10 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds)
 
   *gc_wait = 0;
 
+#if COFFEE_DIR_CACHE_ENTRIES
+  dir_cache_remove(page);
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
+
   /* Close all file descriptors that reference the removed file. */
   if(close_fds) {
     for(i = 0; i < COFFEE_FD_SET_SIZE; i++) {
@@ -560,6 +699,12 @@ reserve(const char *name, coffee_page_t pages,
   hdr.flags = HDR_FLAG_ALLOCATED | flags;
   write_header(&hdr, page);
 
+#if COFFEE_DIR_CACHE_ENTRIES
+  if(!(flags & HDR_FLAG_LOG)) {
+    dir_cache_add(name_hash(hdr.name), page, 1);
+  }
+#endif /* COFFEE_DIR_CACHE_ENTRIES */
+
   PRINTF("Coffee: Reserved %u pages starting from %u for file %s\n",
       pages, page, name);
 
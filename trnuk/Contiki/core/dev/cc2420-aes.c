@@ -108,3 +108,40 @@ cc2420_aes_cipher(uint8_t *data, int len, int key_index)
   }
 }
 /*---------------------------------------------------------------------------*/
+/* The CC2420 keeps keys and blocks in its RAM with the most
+   significant byte at the highest address, so they are reversed on
+   the way in and out. */
+static void
+reverse(uint8_t *to, const uint8_t *from)
+{
+  int i;
+
+  for(i = 0; i < KEYLEN; i++) {
+    to[i] = from[KEYLEN - 1 - i];
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+aes_128_set_key(const uint8_t *key)
+{
+  uint8_t reversed[KEYLEN];
+
+  reverse(reversed, key);
+  cc2420_aes_set_key(reversed, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+aes_128_encrypt(uint8_t *plaintext_and_result)
+{
+  uint8_t block[MAX_DATALEN];
+
+  reverse(block, plaintext_and_result);
+  cc2420_aes_cipher(block, MAX_DATALEN, 0);
+  reverse(plaintext_and_result, block);
+}
+/*---------------------------------------------------------------------------*/
+const struct aes_128_driver cc2420_aes_128_driver = {
+  aes_128_set_key,
+  aes_128_encrypt
+};
+/*---------------------------------------------------------------------------*/
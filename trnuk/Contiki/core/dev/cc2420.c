@@ -79,11 +79,85 @@
 
 #define AUX_LEN (CHECKSUM_LEN + TIMESTAMP_LEN + FOOTER_LEN)
 
+/* With CC2420_CONF_AUTOACK, the CC2420 filters out frames that are
+   not addressed to us and acknowledges the frames that request an
+   ACK. This only works with a MAC layer that sends IEEE 802.15.4
+   frames, such as sicslowmac: the address recognition drops all
+   other frames. */
+#ifndef CC2420_CONF_AUTOACK
+#define CC2420_CONF_AUTOACK 0
+#endif /* CC2420_CONF_AUTOACK */
+
+#if CC2420_CONF_AUTOACK
+#define FCF0_TYPE        0x07
+#define FCF0_ACK_REQUEST 0x20
+#define FCF_TYPE_ACK     2
+/* An ACK frame is the FCF, the sequence number and the FCS. */
+#define ACK_LEN          5
+/* The 802.15.4 macAckWaitDuration is 54 symbols, or 864 us. */
+#define ACK_WAIT_TIME    (RTIMER_SECOND / 1000 + 1)
+#endif /* CC2420_CONF_AUTOACK */
+
+/* With CC2420_CONF_SECURITY, the in-line security of the CC2420 can
+   encrypt and authenticate frames: see cc2420_set_tx_security() and
+   cc2420_set_rx_security(). The MIC must be at the end of the frame,
+   so the checksum and the timestamp cannot be used with it. */
+#ifndef CC2420_CONF_SECURITY
+#define CC2420_CONF_SECURITY 0
+#endif /* CC2420_CONF_SECURITY */
+
+#if CC2420_CONF_SECURITY
+#if CC2420_CONF_CHECKSUM || CC2420_CONF_TIMESTAMPS
+#error CC2420_CONF_SECURITY cannot be used with CC2420_CONF_CHECKSUM or CC2420_CONF_TIMESTAMPS
+#endif
+#define FCF0_SECURITY    0x08
+#define KEY_LEN          16
+#define NONCE_BLOCK_LEN  16
+/* Bits of SECCTRL0 that are not about the in-line security. */
+#define SECCTRL0_KEEP    (CC2420_SECCTRL0_SAKEYSEL1 |        \
+			  CC2420_SECCTRL0_SEC_CBC_HEAD |     \
+			  CC2420_SECCTRL0_RXFIFO_PROTECTION)
+#define SEC_TXL(n)       ((n) << 8)
+#define SEC_RXL(n)       (n)
+#endif /* CC2420_CONF_SECURITY */
+
 struct timestamp {
   uint16_t time;
   uint8_t authority_level;
 };
 
+/* The number of received frames that the driver keeps between the
+   RXFIFO and cc2420_read(). Each takes about 135 bytes of RAM. */
+#ifdef CC2420_CONF_RX_FRAMES
+#define RX_FRAMES CC2420_CONF_RX_FRAMES
+#else /* CC2420_CONF_RX_FRAMES */
+#define RX_FRAMES 3
+#endif /* CC2420_CONF_RX_FRAMES */
+
+#if CC2420_CONF_TIMESTAMPS
+#define ARRIVAL_TIME() timesynch_time()
+#else /* CC2420_CONF_TIMESTAMPS */
+#define ARRIVAL_TIME() RTIMER_NOW()
+#endif /* CC2420_CONF_TIMESTAMPS */
+
+/* The time it takes to receive a frame of len bytes, with the
+   preamble, SFD, and length byte: 32 us per byte. */
+#define FRAME_TIME(len) ((rtimer_clock_t)(((unsigned long)(len) + 6) * \
+					  RTIMER_SECOND / 31250))
+
+struct rxframe {
+  rtimer_clock_t time;
+  uint8_t len;
+  uint8_t footer[FOOTER_LEN];
+#if CC2420_CONF_CHECKSUM
+  uint16_t checksum;
+#endif /* CC2420_CONF_CHECKSUM */
+#if CC2420_CONF_TIMESTAMPS
+  struct timestamp t;
+#endif /* CC2420_CONF_TIMESTAMPS */
+  uint8_t data[CC2420_MAX_PACKET_LEN - AUX_LEN];
+};
+
 
 #define FOOTER1_CRC_OK      0x80
 #define FOOTER1_CORRELATION 0x7f
@@ -157,6 +231,36 @@ getrxbyte(uint8_t *byte)
   FASTSPI_READ_FIFO_BYTE(*byte);
   rxptr = (rxptr + 1) & 0x7f;
 }
+static uint8_t
+peekrxbyte(void)
+{
+  uint8_t byte, n;
+
+  FASTSPI_READ_RAM_LE(&byte, (CC2420RAM_RXFIFO + rxptr), 1, n);
+  return byte;
+}
+#if CC2420_CONF_SECURITY
+/* Reads bytes of the frames in the RXFIFO without taking them out of
+   it. */
+static void
+peekrx(uint8_t *buf, uint8_t offset, uint8_t len)
+{
+  uint8_t pos, n, i;
+  uint16_t addr;
+
+  pos = (rxptr + offset) & 0x7f;
+  n = 128 - pos;
+  if(n > len) {
+    n = len;
+  }
+  addr = CC2420RAM_RXFIFO + pos;
+  FASTSPI_READ_RAM_LE(buf, addr, n, i);
+  if(n < len) {
+    addr = CC2420RAM_RXFIFO;
+    FASTSPI_READ_RAM_LE(buf + n, addr, len - n, i);
+  }
+}
+#endif /* CC2420_CONF_SECURITY */
 static void
 flushrx(void)
 {
@@ -236,6 +340,84 @@ setreg(enum cc2420_register regname, unsigned value)
   FASTSPI_SETREG(regname, value);
 }
 /*---------------------------------------------------------------------------*/
+#if CC2420_CONF_SECURITY
+static struct cc2420_security tx_security;
+static uint8_t tx_secure;
+static int (* rx_security)(const uint8_t *hdr, uint8_t len,
+			   struct cc2420_security *s);
+
+/* The in-line security uses key 1 both to send and to receive, and
+   leaves key 0 to the stand-alone encryption of cc2420-aes. The key
+   is only written to the CC2420 when it changes. */
+static uint8_t key1[KEY_LEN], key1_set;
+
+/* The CC2420 keeps keys and nonces in its RAM with the most
+   significant byte at the highest address. */
+static void
+write_reversed(const uint8_t *from, unsigned addr, uint8_t len)
+{
+  uint8_t reversed[NONCE_BLOCK_LEN];
+  uint8_t i;
+
+  for(i = 0; i < len; i++) {
+    reversed[i] = from[len - 1 - i];
+  }
+  FASTSPI_WRITE_RAM_LE(reversed, addr, len, i);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Runs the in-line security on the frame in the TXFIFO (with
+ * STXENC) or the first frame in the RXFIFO (with SRXDEC), and turns
+ * the in-line security off again so that STXON does not encrypt the
+ * frame once more.
+ */
+static void
+secure(const struct cc2420_security *s, unsigned nonce_addr,
+       unsigned secctrl1, enum cc2420_register command)
+{
+  uint8_t block[NONCE_BLOCK_LEN];
+  unsigned reg;
+
+  if(!key1_set || memcmp(key1, s->key, KEY_LEN) != 0) {
+    memcpy(key1, s->key, KEY_LEN);
+    key1_set = 1;
+    write_reversed(key1, CC2420RAM_KEY1, KEY_LEN);
+  }
+
+  /* The nonce goes into the first counter block, after the flags of
+     the 2-byte block counter. */
+  block[0] = 0x01;
+  memcpy(block + 1, s->nonce, sizeof(s->nonce));
+  block[14] = block[15] = 0;
+  write_reversed(block, nonce_addr, NONCE_BLOCK_LEN);
+
+  reg = getreg(CC2420_SECCTRL0) & SECCTRL0_KEEP;
+  setreg(CC2420_SECCTRL0, reg | CC2420_SECCTRL0_CCM |
+	 (((s->mic_len - 2) >> 1) << CC2420_SECCTRL0_SEC_M_IDX) |
+	 CC2420_SECCTRL0_TXKEYSEL1 | CC2420_SECCTRL0_RXKEYSEL1);
+  setreg(CC2420_SECCTRL1, secctrl1);
+
+  strobe(command);
+  while(status() & BV(CC2420_ENC_BUSY));
+
+  setreg(CC2420_SECCTRL0, reg);
+}
+/*---------------------------------------------------------------------------*/
+void
+cc2420_set_tx_security(const struct cc2420_security *s)
+{
+  tx_security = *s;
+  tx_secure = 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+cc2420_set_rx_security(int (* f)(const uint8_t *hdr, uint8_t len,
+				 struct cc2420_security *s))
+{
+  rx_security = f;
+}
+#endif /* CC2420_CONF_SECURITY */
+/*---------------------------------------------------------------------------*/
 #define AUTOACK (1 << 4)
 #define ADR_DECODE (1 << 11)
 #define RXFIFO_PROTECTION (1 << 9)
@@ -273,6 +455,12 @@ cc2420_init(void)
   /* Turn on the crystal oscillator. */
   strobe(CC2420_SXOSCON);
 
+#if CC2420_CONF_AUTOACK
+  /* Turn on address decoding and automatic packet acknowledgment. */
+  reg = getreg(CC2420_MDMCTRL0);
+  reg |= ADR_DECODE | AUTOACK;
+  setreg(CC2420_MDMCTRL0, reg);
+#else /* CC2420_CONF_AUTOACK */
   /* Turn off automatic packet acknowledgment. */
   reg = getreg(CC2420_MDMCTRL0);
   reg &= ~AUTOACK;
@@ -282,6 +470,7 @@ cc2420_init(void)
   reg = getreg(CC2420_MDMCTRL0);
   reg &= ~ADR_DECODE;
   setreg(CC2420_MDMCTRL0, reg);
+#endif /* CC2420_CONF_AUTOACK */
 
   /* Change default values as recomended in the data sheet, */
   /* correlation threshold = 20, RX bandpass filter = 1.3uA. */
@@ -304,11 +493,226 @@ cc2420_init(void)
   process_start(&cc2420_process, NULL);
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Received frames are kept in a ring of RX_FRAMES frames. The ring is
+ * filled by drain() and emptied by cc2420_read().
+ */
+static struct rxframe rxframes[RX_FRAMES];
+static uint8_t rxframes_first, rxframes_num;
+/* Counts the frames taken out of the ring. */
+static uint8_t rxframes_taken;
+
+static volatile rtimer_clock_t interrupt_time;
+static volatile int interrupt_time_set;
+
+#if CC2420_CONF_AUTOACK
+static uint8_t ack_pending, ack_seqno, got_ack;
+#endif /* CC2420_CONF_AUTOACK */
+
+static void
+drop_frame(void)
+{
+  rxframes_first = (rxframes_first + 1) % RX_FRAMES;
+  rxframes_num--;
+  rxframes_taken++;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads all complete frames out of the RXFIFO and into the frame
+ * ring, so that the RXFIFO has room for the frames that come in while
+ * the upper layers work through the ones we already have. Frames
+ * with a bad CRC are dropped here. Must be called with the lock held.
+ *
+ * When the RXFIFO has overflowed (FIFOP = 1 and FIFO = 0), the CC2420
+ * stops receiving until the RXFIFO is flushed. The complete frames in
+ * the 128 bytes that the RXFIFO holds are read out before the flush,
+ * so that only the frame that overflowed it is lost.
+ */
+static void
+drain(void)
+{
+  struct rxframe *f;
+  rtimer_clock_t now, t;
+  uint8_t len, overflow, room, first;
+#if CC2420_CONF_SECURITY
+  struct cc2420_security s;
+  uint8_t hdr[CC2420_SECURITY_HDR_LEN];
+  uint8_t hdr_len, mic_len;
+#endif /* CC2420_CONF_SECURITY */
+
+  overflow = 0;
+  room = 0;
+  first = 1;
+  t = 0;
+  while(1) {
+    if(!overflow && FIFOP_IS_1 && !FIFO_IS_1) {
+      overflow = 1;
+      room = 128;
+    }
+    if(overflow) {
+      if(room == 0) {
+	break;
+      }
+      len = peekrxbyte();
+      if(len >= room) {
+	break;
+      }
+      room -= len + 1;
+    } else if(!FIFOP_IS_1) {
+      break;
+    }
+    if(rxframes_num == RX_FRAMES) {
+      break;
+    }
+
+#if CC2420_CONF_SECURITY
+    /* A secured frame is decrypted while it is first in the RXFIFO.
+       mic_len is 0 for frames in the clear and 0xff for secured
+       frames that are dropped. */
+    mic_len = 0;
+    len = peekrxbyte();
+    if(rx_security != NULL && len > FOOTER_LEN + 2 &&
+       len <= CC2420_MAX_PACKET_LEN) {
+      hdr_len = len - FOOTER_LEN;
+      if(hdr_len > CC2420_SECURITY_HDR_LEN) {
+	hdr_len = CC2420_SECURITY_HDR_LEN;
+      }
+      peekrx(hdr, 1, hdr_len);
+      if(hdr[0] & FCF0_SECURITY) {
+	mic_len = 0xff;
+	if(rx_security(hdr, hdr_len, &s) &&
+	   s.a_len + s.mic_len <= len - FOOTER_LEN) {
+	  secure(&s, CC2420RAM_RXNONCE, SEC_RXL(s.a_len), CC2420_SRXDEC);
+	  mic_len = s.mic_len;
+	}
+      }
+    }
+#endif /* CC2420_CONF_SECURITY */
+
+    getrxbyte(&len);
+    if(len > CC2420_MAX_PACKET_LEN) {
+      /* Oops, we must be out of sync. */
+      flushrx();
+      RIMESTATS_ADD(badsynch);
+      return;
+    }
+
+    f = &rxframes[(rxframes_first + rxframes_num) % RX_FRAMES];
+
+#if CC2420_CONF_AUTOACK
+    if(len == ACK_LEN) {
+      /* The address recognition lets all ACKs through, but only
+	 cc2420_send() has any use for them. */
+      getrxdata(f->data, ACK_LEN);
+      if(ack_pending && (f->data[0] & FCF0_TYPE) == FCF_TYPE_ACK &&
+	 f->data[2] == ack_seqno && (f->data[ACK_LEN - 1] & FOOTER1_CRC_OK)) {
+	got_ack = 1;
+      }
+      continue;
+    }
+#endif /* CC2420_CONF_AUTOACK */
+
+    if(len <= AUX_LEN) {
+      getrxdata(f->data, len);
+      RIMESTATS_ADD(tooshort);
+      continue;
+    }
+
+    f->len = len - AUX_LEN;
+    getrxdata(f->data, f->len);
+#if CC2420_CONF_CHECKSUM
+    getrxdata(&f->checksum, CHECKSUM_LEN);
+#endif /* CC2420_CONF_CHECKSUM */
+#if CC2420_CONF_TIMESTAMPS
+    getrxdata(&f->t, TIMESTAMP_LEN);
+#endif /* CC2420_CONF_TIMESTAMPS */
+    getrxdata(f->footer, FOOTER_LEN);
+
+#if CC2420_CONF_CHECKSUM
+    if(!(f->footer[1] & FOOTER1_CRC_OK) ||
+       f->checksum != crc16_data(f->data, f->len, 0)) {
+#else
+    if(!(f->footer[1] & FOOTER1_CRC_OK)) {
+#endif /* CC2420_CONF_CHECKSUM */
+      RIMESTATS_ADD(badcrc);
+      continue;
+    }
+
+#if CC2420_CONF_SECURITY
+    /* The CC2420 has replaced the last byte of the MIC with the result
+       of checking it: zero if the MIC was right. */
+    if(mic_len == 0xff ||
+       (mic_len > 0 && f->data[f->len - 1] != 0)) {
+      PRINTF("cc2420: dropped a secured frame\n");
+      continue;
+    }
+    f->len -= mic_len;
+#endif /* CC2420_CONF_SECURITY */
+
+    /* The first frame after an interrupt gets the time of the
+       interrupt. The frames behind it came in no earlier than one
+       frame time after the frame before them, and no later than
+       now. */
+    now = ARRIVAL_TIME();
+    if(interrupt_time_set) {
+      t = interrupt_time;
+      interrupt_time_set = 0;
+    } else if(first) {
+      t = now;
+    } else {
+      t += FRAME_TIME(len);
+      if(RTIMER_CLOCK_LT(now, t)) {
+	t = now;
+      }
+    }
+    first = 0;
+    f->time = t;
+    rxframes_num++;
+  }
+
+  if(overflow) {
+    flushrx();
+    if(room > 0) {
+      RIMESTATS_ADD(llrxoverflow);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if CC2420_CONF_AUTOACK
+/* Waits for the ACK of the frame that was just sent. Frames that come
+   in before the ACK are drained into the frame ring. */
+static int
+wait_for_ack(uint8_t seqno)
+{
+  rtimer_clock_t t0;
+
+  ack_seqno = seqno;
+  got_ack = 0;
+  ack_pending = 1;
+
+  t0 = RTIMER_NOW();
+  while(!got_ack && !RTIMER_CLOCK_LT(t0 + ACK_WAIT_TIME, RTIMER_NOW())) {
+    if(FIFOP_IS_1) {
+      drain();
+    }
+  }
+  ack_pending = 0;
+
+  if(rxframes_num > 0 || FIFOP_IS_1) {
+    process_poll(&cc2420_process);
+  }
+  return got_ack;
+}
+#endif /* CC2420_CONF_AUTOACK */
+/*---------------------------------------------------------------------------*/
 int
 cc2420_send(const void *payload, unsigned short payload_len)
 {
   int i;
   uint8_t total_len;
+#if CC2420_CONF_AUTOACK
+  uint8_t ack_request;
+#endif /* CC2420_CONF_AUTOACK */
 #if CC2420_CONF_TIMESTAMPS
   struct timestamp timestamp;
 #endif /* CC2420_CONF_TIMESTAMPS */
@@ -350,6 +754,25 @@ cc2420_send(const void *payload, unsigned short payload_len)
   FASTSPI_WRITE_FIFO(&timestamp, TIMESTAMP_LEN);
 #endif /* CC2420_CONF_TIMESTAMPS */
 
+#if CC2420_CONF_SECURITY
+  if(tx_secure) {
+    tx_secure = 0;
+    secure(&tx_security, CC2420RAM_TXNONCE, SEC_TXL(tx_security.a_len),
+	   CC2420_STXENC);
+  }
+#endif /* CC2420_CONF_SECURITY */
+
+#if CC2420_CONF_AUTOACK
+  /* If the frame requests an ACK, we need to be in receive mode after
+     the transmission to hear the ACK. */
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 0);
+  ack_request = payload_len >= 3 &&
+    (((uint8_t *)payload)[0] & FCF0_ACK_REQUEST);
+  if(ack_request && !receive_on) {
+    strobe(CC2420_SRXON);
+  }
+#endif /* CC2420_CONF_AUTOACK */
+
   /* The TX FIFO can only hold one packet. Make sure to not overrun
    * FIFO by waiting for transmission to start here and synchronizing
    * with the CC2420_TX_ACTIVE check in cc2420_send.
@@ -405,6 +828,16 @@ cc2420_send(const void *payload, unsigned short payload_len)
 	ENERGEST_ON(ENERGEST_TYPE_LISTEN);
       }
 
+#if CC2420_CONF_AUTOACK
+      if(ack_request) {
+	packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK,
+			   wait_for_ack(((uint8_t *)payload)[2]));
+	if(!receive_on) {
+	  strobe(CC2420_SRFOFF);
+	}
+      }
+#endif /* CC2420_CONF_AUTOACK */
+
       RELEASE_LOCK();
       return 0;
     }
@@ -414,6 +847,11 @@ cc2420_send(const void *payload, unsigned short payload_len)
      transmitted because of other channel activity. */
   RIMESTATS_ADD(contentiondrop);
   PRINTF("cc2420: do_send() transmission never started\n");
+#if CC2420_CONF_AUTOACK
+  if(ack_request && !receive_on) {
+    strobe(CC2420_SRFOFF);
+  }
+#endif /* CC2420_CONF_AUTOACK */
   RELEASE_LOCK();
   return -3;			/* Transmission never started! */
 }
@@ -503,6 +941,7 @@ cc2420_set_pan_addr(unsigned pan,
 			   const uint8_t *ieee_addr)
 {
   uint16_t f = 0;
+  uint8_t reversed[8];
   /*
    * Writing RAM requires crystal oscillator to be stable.
    */
@@ -512,17 +951,18 @@ cc2420_set_pan_addr(unsigned pan,
   FASTSPI_WRITE_RAM_LE(&pan, CC2420RAM_PANID, 2, f);
   FASTSPI_WRITE_RAM_LE(&addr, CC2420RAM_SHORTADDR, 2, f);
   if(ieee_addr != NULL) {
-    FASTSPI_WRITE_RAM_LE(ieee_addr, CC2420RAM_IEEEADDR, 8, f);
+    /* The address recognition compares the RAM with the address as it
+       is sent over the air, least significant byte first. */
+    for(f = 0; f < 8; f++) {
+      reversed[f] = ieee_addr[7 - f];
+    }
+    FASTSPI_WRITE_RAM_LE(reversed, CC2420RAM_IEEEADDR, 8, f);
   }
 }
 /*---------------------------------------------------------------------------*/
 /*
  * Interrupt leaves frame intact in FIFO.
  */
-#if CC2420_CONF_TIMESTAMPS
-static volatile rtimer_clock_t interrupt_time;
-static volatile int interrupt_time_set;
-#endif /* CC2420_CONF_TIMESTAMPS */
 #if CC2420_TIMETABLE_PROFILING
 #define cc2420_timetable_size 16
 TIMETABLE(cc2420_timetable);
@@ -531,10 +971,8 @@ TIMETABLE_AGGREGATE(aggregate_time, 10);
 int
 cc2420_interrupt(void)
 {
-#if CC2420_CONF_TIMESTAMPS
-  interrupt_time = timesynch_time();
+  interrupt_time = ARRIVAL_TIME();
   interrupt_time_set = 1;
-#endif /* CC2420_CONF_TIMESTAMPS */
 
   CLEAR_FIFOP_INT();
   process_poll(&cc2420_process);
@@ -547,6 +985,8 @@ cc2420_interrupt(void)
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(cc2420_process, ev, data)
 {
+  uint8_t taken;
+
   PROCESS_BEGIN();
 
   PRINTF("cc2420_process: started\n");
@@ -557,18 +997,36 @@ PROCESS_THREAD(cc2420_process, ev, data)
     TIMETABLE_TIMESTAMP(cc2420_timetable, "poll");
 #endif /* CC2420_TIMETABLE_PROFILING */
         
-    if(receiver_callback != NULL) {
-      PRINTF("cc2420_process: calling receiver callback\n");
-      receiver_callback(&cc2420_driver);
+
+    /* Take all frames that have come in out of the RXFIFO at once,
+       and hand them up one after the other. */
+    GET_LOCK();
+    drain();
+    RELEASE_LOCK();
+
+    while(rxframes_num > 0) {
+      taken = rxframes_taken;
+      if(receiver_callback != NULL) {
+	PRINTF("cc2420_process: calling receiver callback\n");
+	receiver_callback(&cc2420_driver);
 #if CC2420_TIMETABLE_PROFILING
-      TIMETABLE_TIMESTAMP(cc2420_timetable, "end");
-      timetable_aggregate_compute_detailed(&aggregate_time,
-					   &cc2420_timetable);
-      timetable_clear(&cc2420_timetable);
+	TIMETABLE_TIMESTAMP(cc2420_timetable, "end");
+	timetable_aggregate_compute_detailed(&aggregate_time,
+					     &cc2420_timetable);
+	timetable_clear(&cc2420_timetable);
 #endif /* CC2420_TIMETABLE_PROFILING */
-    } else {
-      PRINTF("cc2420_process not receiving function\n");
-      flushrx();
+      } else {
+	PRINTF("cc2420_process not receiving function\n");
+      }
+      if(rxframes_taken == taken) {
+	/* Nobody read the frame. */
+	drop_frame();
+      }
+      if(FIFOP_IS_1) {
+	GET_LOCK();
+	drain();
+	RELEASE_LOCK();
+      }
     }
   }
 
@@ -578,118 +1036,64 @@ PROCESS_THREAD(cc2420_process, ev, data)
 int
 cc2420_read(void *buf, unsigned short bufsize)
 {
-  uint8_t footer[2];
+  struct rxframe *f;
   uint8_t len;
-#if CC2420_CONF_CHECKSUM
-  uint16_t checksum;
-#endif /* CC2420_CONF_CHECKSUM */
-#if CC2420_CONF_TIMESTAMPS
-  struct timestamp t;
-#endif /* CC2420_CONF_TIMESTAMPS */
-  
-  if(!FIFOP_IS_1) {
-    /* If FIFOP is 0, there is no packet in the RXFIFO. */
-    return 0;
+
+  if(rxframes_num == 0) {
+    if(!FIFOP_IS_1) {
+      /* If FIFOP is 0, there is no packet in the RXFIFO. */
+      return 0;
+    }
+    GET_LOCK();
+    drain();
+    RELEASE_LOCK();
+    if(rxframes_num == 0) {
+      return 0;
+    }
   }
-  
+
+  f = &rxframes[rxframes_first];
+  len = f->len;
+
+  cc2420_time_of_arrival = f->time;
 #if CC2420_CONF_TIMESTAMPS
-  if(interrupt_time_set) {
-    cc2420_time_of_arrival = interrupt_time;
-    interrupt_time_set = 0;
-  } else {
-    cc2420_time_of_arrival = 0;
-  }
   cc2420_time_of_departure = 0;
 #endif /* CC2420_CONF_TIMESTAMPS */
-  GET_LOCK();
-
-  getrxbyte(&len);
 
-  if(len > CC2420_MAX_PACKET_LEN) {
-    /* Oops, we must be out of sync. */
-    flushrx();
-    RIMESTATS_ADD(badsynch);
-    RELEASE_LOCK();
-    return 0;
-  }
-
-  if(len <= AUX_LEN) {
-    flushrx();
-    RIMESTATS_ADD(tooshort);
-    RELEASE_LOCK();
-    return 0;
-  }
-  
-  if(len - AUX_LEN > bufsize) {
-    flushrx();
+  if(len > bufsize) {
     RIMESTATS_ADD(toolong);
-    RELEASE_LOCK();
+    drop_frame();
     return 0;
   }
 
-  getrxdata(buf, len - AUX_LEN);
-#if CC2420_CONF_CHECKSUM
-  getrxdata(&checksum, CHECKSUM_LEN);
-#endif /* CC2420_CONF_CHECKSUM */
-#if CC2420_CONF_TIMESTAMPS
-  getrxdata(&t, TIMESTAMP_LEN);
-#endif /* CC2420_CONF_TIMESTAMPS */
-  getrxdata(footer, FOOTER_LEN);
-  
-#if CC2420_CONF_CHECKSUM
-  if(checksum != crc16_data(buf, len - AUX_LEN, 0)) {
-    PRINTF("checksum failed 0x%04x != 0x%04x\n",
-	   checksum, crc16_data(buf, len - AUX_LEN, 0));
-  }
-  
-  if(footer[1] & FOOTER1_CRC_OK &&
-     checksum == crc16_data(buf, len - AUX_LEN, 0)) {
-#else
-  if(footer[1] & FOOTER1_CRC_OK) {
-#endif /* CC2420_CONF_CHECKSUM */
-    cc2420_last_rssi = footer[0];
-    cc2420_last_correlation = footer[1] & FOOTER1_CORRELATION;
+  memcpy(buf, f->data, len);
+  cc2420_last_rssi = f->footer[0];
+  cc2420_last_correlation = f->footer[1] & FOOTER1_CORRELATION;
+
+  packetbuf_set_attr(PACKETBUF_ATTR_RSSI, cc2420_last_rssi);
+  packetbuf_set_attr(PACKETBUF_ATTR_LINK_QUALITY, cc2420_last_correlation);
+#if CC2420_CONF_AUTOACK
+  /* The CC2420 has acknowledged the frame if it requested an ACK. */
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK,
+		     (f->data[0] & FCF0_ACK_REQUEST) != 0);
+#endif /* CC2420_CONF_AUTOACK */
 
+  RIMESTATS_ADD(llrx);
 
-    packetbuf_set_attr(PACKETBUF_ATTR_RSSI, cc2420_last_rssi);
-    packetbuf_set_attr(PACKETBUF_ATTR_LINK_QUALITY, cc2420_last_correlation);
-    
-    RIMESTATS_ADD(llrx);
-    
 #if CC2420_CONF_TIMESTAMPS
-    cc2420_time_of_departure =
-      t.time +
-      setup_time_for_transmission +
-      (total_time_for_transmission * (len - 2)) / total_transmission_len;
-  
-    cc2420_authority_level_of_sender = t.authority_level;
+  cc2420_time_of_departure =
+    f->t.time +
+    setup_time_for_transmission +
+    (total_time_for_transmission * (len + AUX_LEN - 2)) /
+    total_transmission_len;
+
+  cc2420_authority_level_of_sender = f->t.authority_level;
 
-    packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, t.time);
+  packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, f->t.time);
 #endif /* CC2420_CONF_TIMESTAMPS */
-  
-  } else {
-    RIMESTATS_ADD(badcrc);
-    len = AUX_LEN;
-  }
-  
-  /* Clean up in case of FIFO overflow!  This happens for every full
-   * length frame and is signaled by FIFOP = 1 and FIFO = 0.
-   */
-  if(FIFOP_IS_1 && !FIFO_IS_1) {
-    /*    printf("cc2420_read: FIFOP_IS_1 1\n");*/
-    flushrx();
-  } else if(FIFOP_IS_1) {
-    /* Another packet has been received and needs attention. */
-    process_poll(&cc2420_process);
-  }
-  
-  RELEASE_LOCK();
-  
-  if(len < AUX_LEN) {
-    return 0;
-  }
 
-  return len - AUX_LEN;
+  drop_frame();
+  return len;
 }
 /*---------------------------------------------------------------------------*/
 void
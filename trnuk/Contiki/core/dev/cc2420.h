@@ -51,6 +51,12 @@ void cc2420_init(void);
 void cc2420_set_channel(int channel);
 int cc2420_get_channel(void);
 
+/**
+ * Set the PAN ID, the short address and the IEEE address that the
+ * address recognition of CC2420_CONF_AUTOACK accepts frames for. The
+ * IEEE address is given most significant byte first, as in a
+ * rimeaddr_t, and may be NULL.
+ */
 void cc2420_set_pan_addr(unsigned pan,
 				unsigned addr,
 				const uint8_t *ieee_addr);
@@ -84,4 +90,40 @@ extern int cc2420_authority_level_of_sender;
 int cc2420_on(void);
 int cc2420_off(void);
 
+/**
+ * The in-line security of a frame, with CC2420_CONF_SECURITY. The
+ * CC2420 encrypts and authenticates the frame in its FIFO with CCM,
+ * which with a MIC of 4, 8, or 16 bytes is the CCM* of IEEE
+ * 802.15.4-2006 at security levels 5, 6, and 7.
+ */
+struct cc2420_security {
+  const uint8_t *key;   /**< The 16-byte key */
+  uint8_t nonce[13];    /**< The CCM nonce */
+  uint8_t a_len;        /**< The number of bytes at the start of the frame that are authenticated but not encrypted */
+  uint8_t mic_len;      /**< The length of the MIC: 4, 8, or 16 */
+};
+
+/** The largest number of bytes of a frame that the function of
+    cc2420_set_rx_security() is called with: the longest 802.15.4
+    header. */
+#define CC2420_SECURITY_HDR_LEN 37
+
+/**
+ * Secure the next frame that cc2420_send() sends. The frame ends with
+ * mic_len bytes that the CC2420 overwrites with the MIC.
+ */
+void cc2420_set_tx_security(const struct cc2420_security *s);
+
+/**
+ * Set the function that decides how received frames with the
+ * security enabled bit set are decrypted. The function is called with
+ * the start of the frame, at most CC2420_SECURITY_HDR_LEN bytes, and
+ * returns non-zero after filling in s if the frame is to be decrypted.
+ * Other secured frames, and frames with a MIC that does not match,
+ * are dropped. The rest are passed up decrypted and without their
+ * MIC.
+ */
+void cc2420_set_rx_security(int (* f)(const uint8_t *hdr, uint8_t len,
+				      struct cc2420_security *s));
+
 #endif /* __CC2420_H__ */
@@ -0,0 +1,93 @@
+/** \addtogroup lib
+ * @{ */
+
+/**
+ * \defgroup aes-128 AES-128 block cipher
+ *
+ * The AES-128 module encrypts 16-byte blocks with a 128-bit key. Only
+ * encryption is provided: the CCM* mode that uses the cipher needs
+ * nothing else.
+ *
+ * The cipher is reached through the AES_128 driver, which is a
+ * portable software implementation unless the platform sets
+ * AES_128_CONF to a driver for a hardware cipher, such as
+ * cc2420_aes_128_driver.
+ *
+ * @{
+ */
+
+/**
+ * \file
+ *         Header file for the AES-128 block cipher
+ */
+
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+#ifndef __AES_128_H__
+#define __AES_128_H__
+
+#include "contiki-conf.h"
+
+#define AES_128_BLOCK_SIZE 16
+#define AES_128_KEY_LENGTH 16
+
+/**
+ * The structure of an AES-128 driver.
+ */
+struct aes_128_driver {
+  /**
+   * \brief      Set the key that the following blocks are encrypted with
+   * \param key  A pointer to the 16-byte key
+   */
+  void (* set_key)(const uint8_t *key);
+
+  /**
+   * \brief      Encrypt a block in place
+   * \param plaintext_and_result A pointer to the 16-byte block
+   */
+  void (* encrypt)(uint8_t *plaintext_and_result);
+};
+
+extern const struct aes_128_driver aes_128_driver;
+
+#ifdef AES_128_CONF
+#define AES_128 AES_128_CONF
+#else /* AES_128_CONF */
+#define AES_128 aes_128_driver
+#endif /* AES_128_CONF */
+
+extern const struct aes_128_driver AES_128;
+
+#endif /* __AES_128_H__ */
+
+/** @} */
+/** @} */
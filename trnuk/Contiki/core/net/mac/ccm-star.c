@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         CCM* mode of IEEE 802.15.4-2006, on top of the AES_128 driver
+ */
+
+#include <string.h>
+
+#include "net/mac/ccm-star.h"
+#include "lib/aes-128.h"
+
+/* The flags of the counter blocks: L - 1, with the 2-byte length
+   field that 802.15.4 uses. */
+#define CTR_FLAGS 0x01
+
+/*---------------------------------------------------------------------------*/
+/* Builds block number i of the counter blocks, or the first block of
+   the CBC-MAC, which has the same layout. */
+static void
+set_block(uint8_t *block, uint8_t flags, const uint8_t *nonce, uint8_t i)
+{
+  block[0] = flags;
+  memcpy(block + 1, nonce, CCM_STAR_NONCE_LENGTH);
+  block[14] = 0;
+  block[15] = i;
+}
+/*---------------------------------------------------------------------------*/
+void
+ccm_star_set_key(const uint8_t *key)
+{
+  AES_128.set_key(key);
+}
+/*---------------------------------------------------------------------------*/
+void
+ccm_star_mic(const uint8_t *nonce,
+             const uint8_t *a, uint8_t a_len,
+             const uint8_t *m, uint8_t m_len,
+             uint8_t *result, uint8_t mic_len)
+{
+  uint8_t x[AES_128_BLOCK_SIZE];
+  uint8_t s[AES_128_BLOCK_SIZE];
+  uint8_t i;
+  uint16_t pos;
+
+  if(mic_len == 0) {
+    return;
+  }
+
+  /* The first block holds the flags, the nonce, and the length of
+     m. */
+  set_block(x, (a_len > 0 ? 0x40 : 0) | (((mic_len - 2) >> 1) << 3) |
+	    CTR_FLAGS, nonce, m_len);
+  AES_128.encrypt(x);
+
+  /* The length of a and then a, padded with zeros to a full block. */
+  if(a_len > 0) {
+    x[1] ^= a_len;
+    i = 2;
+    for(pos = 0; pos < a_len; pos++) {
+      x[i++] ^= a[pos];
+      if(i == AES_128_BLOCK_SIZE) {
+	AES_128.encrypt(x);
+	i = 0;
+      }
+    }
+    if(i > 0) {
+      AES_128.encrypt(x);
+    }
+  }
+
+  /* m, padded with zeros to a full block. */
+  for(pos = 0; pos < m_len; pos += AES_128_BLOCK_SIZE) {
+    for(i = 0; i < AES_128_BLOCK_SIZE && pos + i < m_len; i++) {
+      x[i] ^= m[pos + i];
+    }
+    AES_128.encrypt(x);
+  }
+
+  /* The MIC is encrypted with counter block 0. */
+  set_block(s, CTR_FLAGS, nonce, 0);
+  AES_128.encrypt(s);
+  for(i = 0; i < mic_len; i++) {
+    result[i] = x[i] ^ s[i];
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+ccm_star_ctr(const uint8_t *nonce, uint8_t *m, uint8_t m_len)
+{
+  uint8_t s[AES_128_BLOCK_SIZE];
+  uint8_t i, counter;
+  uint16_t pos;
+
+  counter = 1;
+  for(pos = 0; pos < m_len; pos += AES_128_BLOCK_SIZE) {
+    set_block(s, CTR_FLAGS, nonce, counter++);
+    AES_128.encrypt(s);
+    for(i = 0; i < AES_128_BLOCK_SIZE && pos + i < m_len; i++) {
+      m[pos + i] ^= s[i];
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         CCM* mode of IEEE 802.15.4-2006, Annex B
+ */
+
+#ifndef __CCM_STAR_H__
+#define __CCM_STAR_H__
+
+#include "contiki-conf.h"
+
+/* The length of the nonce: the source address, the frame counter,
+   and the security level. */
+#define CCM_STAR_NONCE_LENGTH 13
+
+/**
+ * \brief      Set the key of the following operations
+ * \param key  A pointer to the 16-byte key
+ *
+ *             The blocks are encrypted with the AES_128 driver, so
+ *             the key is the key of that driver.
+ */
+void ccm_star_set_key(const uint8_t *key);
+
+/**
+ * \brief      Generate the MIC of a frame
+ * \param nonce The 13-byte nonce
+ * \param a    The data that is authenticated but not encrypted
+ * \param a_len The length of a
+ * \param m    The data that is authenticated and encrypted, before
+ *             it is encrypted
+ * \param m_len The length of m
+ * \param result Where the MIC is stored
+ * \param mic_len The length of the MIC: 0, 4, 8, or 16
+ */
+void ccm_star_mic(const uint8_t *nonce,
+                  const uint8_t *a, uint8_t a_len,
+                  const uint8_t *m, uint8_t m_len,
+                  uint8_t *result, uint8_t mic_len);
+
+/**
+ * \brief      Encrypt or decrypt data in place
+ * \param nonce The 13-byte nonce
+ * \param m    The data
+ * \param m_len The length of the data
+ *
+ *             The data is combined with a key stream, so the same
+ *             call both encrypts and decrypts it.
+ */
+void ccm_star_ctr(const uint8_t *nonce, uint8_t *m, uint8_t m_len);
+
+#endif /* __CCM_STAR_H__ */
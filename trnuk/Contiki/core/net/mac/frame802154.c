@@ -78,33 +78,23 @@ typedef struct {
   uint8_t aux_sec_len;     /**<  Length (in bytes) of aux security header field */
 } field_length_t;
 
-/*----------------------------------------------------------------------------*/
-CC_INLINE static uint8_t
-addr_len(uint8_t mode)
-{
-  switch(mode) {
-  case FRAME802154_SHORTADDRMODE:  /* 16-bit address */
-    return 2;
-  case FRAME802154_LONGADDRMODE:   /* 64-bit address */
-    return 8;
-  default:
-    return 0;
-  }
-}
+/** The length of an address, indexed by addressing mode. */
+static const uint8_t addr_lens[4] = { 0, 0, 2, 8 };
+#define addr_len(mode) addr_lens[(mode) & 3]
+
+/** The length of the aux security header, indexed by key identifier
+    mode: the security control, the frame counter, and the key
+    identifier. */
+static const uint8_t aux_hdr_lens[4] = { 5, 6, 10, 14 };
+#define aux_hdr_len(key_id_mode) aux_hdr_lens[(key_id_mode) & 3]
 /*----------------------------------------------------------------------------*/
 static void
 field_len(frame802154_t *p, field_length_t *flen)
 {
-  /* init flen to zeros */
-  memset(flen, 0, sizeof(field_length_t));
-
   /* Determine lengths of each field based on fcf and other args */
-  if(p->fcf.dest_addr_mode & 3) {
-    flen->dest_pid_len = 2;
-  }
-  if(p->fcf.src_addr_mode & 3) {
-    flen->src_pid_len = 2;
-  }
+  flen->dest_pid_len = p->fcf.dest_addr_mode & 3 ? 2 : 0;
+  flen->src_pid_len = p->fcf.src_addr_mode & 3 ? 2 : 0;
+  flen->aux_sec_len = 0;
 
   /* Set PAN ID compression bit if src pan id matches dest pan id. */
   if(p->fcf.dest_addr_mode & 3 && p->fcf.src_addr_mode & 3 &&
@@ -118,30 +108,12 @@ field_len(frame802154_t *p, field_length_t *flen)
   }
 
   /* determine address lengths */
-  flen->dest_addr_len = addr_len(p->fcf.dest_addr_mode & 3);
-  flen->src_addr_len = addr_len(p->fcf.src_addr_mode & 3);
+  flen->dest_addr_len = addr_len(p->fcf.dest_addr_mode);
+  flen->src_addr_len = addr_len(p->fcf.src_addr_mode);
 
   /* Aux security header */
   if(p->fcf.security_enabled & 1) {
-    /* TODO Aux security header not yet implemented */
-#if 0
-    switch(p->aux_hdr.security_control.key_id_mode) {
-    case 0:
-      flen->aux_sec_len = 5; /* minimum value */
-      break;
-    case 1:
-      flen->aux_sec_len = 6;
-      break;
-    case 2:
-      flen->aux_sec_len = 10;
-      break;
-    case 3:
-      flen->aux_sec_len = 14;
-      break;
-    default:
-      break;
-    }
-#endif
+    flen->aux_sec_len = aux_hdr_len(p->aux_hdr.security_control.key_id_mode);
   }
 }
 /*----------------------------------------------------------------------------*/
@@ -231,126 +203,202 @@ frame802154_create(frame802154_t *p, uint8_t *buf, uint8_t buf_len)
     tx_frame_buffer[pos++] = p->src_addr.u8[c - 1];
   }
 
-  /* Aux header */
+  /* Aux header: the security control, the frame counter, least
+     significant byte first, and the key identifier. */
   if(flen.aux_sec_len) {
-    /* TODO Aux security header not yet implemented */
-/*     pos += flen.aux_sec_len; */
+    tx_frame_buffer[pos++] = (p->aux_hdr.security_control.security_level & 7) |
+      ((p->aux_hdr.security_control.key_id_mode & 3) << 3);
+    tx_frame_buffer[pos++] = p->aux_hdr.frame_counter & 0xff;
+    tx_frame_buffer[pos++] = (p->aux_hdr.frame_counter >> 8) & 0xff;
+    tx_frame_buffer[pos++] = (p->aux_hdr.frame_counter >> 16) & 0xff;
+    tx_frame_buffer[pos++] = (p->aux_hdr.frame_counter >> 24) & 0xff;
+    for(c = 0; c < flen.aux_sec_len - 5; c++) {
+      tx_frame_buffer[pos++] = p->aux_hdr.key[c];
+    }
   }
 
   return pos;
 }
 /*----------------------------------------------------------------------------*/
 /**
- *   \brief Parses an input frame.  Scans the input frame to find each
- *   section, and stores the information of each section in a
- *   frame802154_t structure.
+ *   \brief Finds the fields of an input frame in a single pass, without
+ *   copying them out of the frame.
  *
  *   \param data The input data from the radio chip.
  *   \param len The size of the input data
- *   \param pf The frame802154_t struct to store the parsed frame information.
+ *   \param v The frame802154_view_t struct to store the offsets of the
+ *   fields in.
+ *
+ *   \return The length of the frame header, or 0 if the frame is too
+ *   short for its header.
  */
 uint8_t
-frame802154_parse(uint8_t *data, uint8_t len, frame802154_t *pf)
+frame802154_parse_view(uint8_t *data, uint8_t len, frame802154_view_t *v)
 {
-  uint8_t *p;
-  frame802154_fcf_t fcf;
-  uint8_t c;
+  uint8_t pos;
+  uint8_t mode;
 
   if(len < 3) {
     return 0;
   }
 
-  p = data;
+  v->data = data;
 
-  /* decode the FCF */
-  fcf.frame_type = p[0] & 7;
-  fcf.security_enabled = (p[0] >> 3) & 1;
-  fcf.frame_pending = (p[0] >> 4) & 1;
-  fcf.ack_required = (p[0] >> 5) & 1;
-  fcf.panid_compression = (p[0] >> 6) & 1;
-
-  fcf.dest_addr_mode = (p[1] >> 2) & 3;
-  fcf.frame_version = (p[1] >> 4) & 3;
-  fcf.src_addr_mode = (p[1] >> 6) & 3;
-
-  /* copy fcf and seqNum */
-  pf->fcf = fcf;
-  pf->seq = p[2];
-  p += 3;                             /* Skip first three bytes */
-
-  /* Destination address, if any */
-  if(fcf.dest_addr_mode) {
-    /* Destination PAN */
-    pf->dest_pid = p[0] + (p[1] << 8);
-    p += 2;
-
-    /* Destination address */
-/*     l = addr_len(fcf.dest_addr_mode); */
-/*     for(c = 0; c < l; c++) { */
-/*       pf->dest_addr.u8[c] = p[l - c - 1]; */
-/*     } */
-/*     p += l; */
-    if(fcf.dest_addr_mode == FRAME802154_SHORTADDRMODE) {
-      rimeaddr_copy(&(pf->dest_addr), &rimeaddr_null);
-      pf->dest_addr.u8[0] = p[1];
-      pf->dest_addr.u8[1] = p[0];
-      p += 2;
-    } else if(fcf.dest_addr_mode == FRAME802154_LONGADDRMODE) {
-      for(c = 0; c < 8; c++) {
-        pf->dest_addr.u8[c] = p[7 - c];
-      }
-      p += 8;
+  /* Fast paths for the frames that we send ourselves: PAN ID
+     compression, no security, and short or long addresses at both
+     ends. */
+  if((data[0] & 0x48) == 0x40) {
+    pos = 0;
+    switch(data[1] & 0xcc) {
+    case 0x88:                  /* Short destination, short source. */
+      v->src_addr = 7;
+      pos = 9;
+      break;
+    case 0xc8:                  /* Short destination, long source. */
+      v->src_addr = 7;
+      pos = 15;
+      break;
+    case 0x8c:                  /* Long destination, short source. */
+      v->src_addr = 13;
+      pos = 15;
+      break;
+    case 0xcc:                  /* Long destination, long source. */
+      v->src_addr = 13;
+      pos = 21;
+      break;
+    }
+    if(pos != 0) {
+      v->dest_pid = v->src_pid = 3;
+      v->dest_addr = 5;
+      v->aux_hdr = 0;
+      goto done;
     }
+  }
+
+  pos = 3;
+
+  /* Destination PAN ID and address, if any */
+  mode = (data[1] >> 2) & 3;
+  if(mode) {
+    v->dest_pid = pos;
+    v->dest_addr = pos + 2;
+    pos += 2 + addr_len(mode);
   } else {
-    rimeaddr_copy(&(pf->dest_addr), &rimeaddr_null);
-    pf->dest_pid = 0;
+    v->dest_pid = v->dest_addr = 0;
   }
 
-  /* Source address, if any */
-  if(fcf.src_addr_mode) {
-    /* Source PAN */
-    if(!fcf.panid_compression) {
-      pf->src_pid = p[0] + (p[1] << 8);
-      p += 2;
+  /* Source PAN ID and address, if any */
+  mode = (data[1] >> 6) & 3;
+  if(mode) {
+    if(data[0] & 0x40) {
+      /* PAN ID compression: the source PAN ID is the destination PAN
+         ID. */
+      v->src_pid = v->dest_pid;
     } else {
-      pf->src_pid = pf->dest_pid;
+      v->src_pid = pos;
+      pos += 2;
     }
+    v->src_addr = pos;
+    pos += addr_len(mode);
+  } else {
+    v->src_pid = v->src_addr = 0;
+  }
 
-    /* Source address */
-/*     l = addr_len(fcf.src_addr_mode); */
-/*     for(c = 0; c < l; c++) { */
-/*       pf->src_addr.u8[c] = p[l - c - 1]; */
-/*     } */
-/*     p += l; */
-    if(fcf.src_addr_mode == FRAME802154_SHORTADDRMODE) {
-      rimeaddr_copy(&(pf->src_addr), &rimeaddr_null);
-      pf->src_addr.u8[0] = p[1];
-      pf->src_addr.u8[1] = p[0];
-      p += 2;
-    } else if(fcf.src_addr_mode == FRAME802154_LONGADDRMODE) {
-      for(c = 0; c < 8; c++) {
-        pf->src_addr.u8[c] = p[7 - c];
-      }
-      p += 8;
+  if(data[0] & 0x08) {
+    if(pos >= len) {
+      return 0;
     }
+    v->aux_hdr = pos;
+    pos += aux_hdr_len(data[pos] >> 3);
   } else {
-    rimeaddr_copy(&(pf->src_addr), &rimeaddr_null);
-    pf->src_pid = 0;
+    v->aux_hdr = 0;
   }
 
-  if(fcf.security_enabled) {
-    /* TODO aux security header, not yet implemented */
-/*     return 0; */
+ done:
+  if(pos > len) {
+    return 0;
+  }
+  v->hdr_len = pos;
+  v->payload_len = len - pos;
+  return pos;
+}
+/*----------------------------------------------------------------------------*/
+/**
+ *   \brief Copies an address out of a frame.  The address is stored
+ *   least significant byte first in the frame and most significant
+ *   byte first in the rimeaddr_t.
+ *
+ *   \param field A pointer to the address in the frame.
+ *   \param mode The addressing mode of the address.
+ *   \param addr The rimeaddr_t to copy the address to.  It is set to
+ *   rimeaddr_null if the mode has no address.
+ */
+void
+frame802154_copy_addr(const uint8_t *field, uint8_t mode, rimeaddr_t *addr)
+{
+  uint8_t c;
+
+  if(mode == FRAME802154_SHORTADDRMODE) {
+    rimeaddr_copy(addr, &rimeaddr_null);
+    addr->u8[0] = field[1];
+    addr->u8[1] = field[0];
+  } else if(mode == FRAME802154_LONGADDRMODE) {
+    for(c = 0; c < 8 && c < sizeof(rimeaddr_t); c++) {
+      addr->u8[c] = field[7 - c];
+    }
+  } else {
+    rimeaddr_copy(addr, &rimeaddr_null);
+  }
+}
+/*----------------------------------------------------------------------------*/
+/**
+ *   \brief Parses an input frame.  Scans the input frame to find each
+ *   section, and stores the information of each section in a
+ *   frame802154_t structure.
+ *
+ *   \param data The input data from the radio chip.
+ *   \param len The size of the input data
+ *   \param pf The frame802154_t struct to store the parsed frame information.
+ */
+uint8_t
+frame802154_parse(uint8_t *data, uint8_t len, frame802154_t *pf)
+{
+  frame802154_view_t v;
+
+  if(frame802154_parse_view(data, len, &v) == 0) {
+    return 0;
+  }
+
+  /* decode the FCF */
+  pf->fcf.frame_type = FRAME802154_VIEW_TYPE(&v);
+  pf->fcf.security_enabled = FRAME802154_VIEW_SECURITY(&v);
+  pf->fcf.frame_pending = FRAME802154_VIEW_PENDING(&v);
+  pf->fcf.ack_required = FRAME802154_VIEW_ACK_REQUIRED(&v);
+  pf->fcf.panid_compression = FRAME802154_VIEW_PANID_COMP(&v);
+  pf->fcf.dest_addr_mode = FRAME802154_VIEW_DEST_ADDR_MODE(&v);
+  pf->fcf.frame_version = FRAME802154_VIEW_VERSION(&v);
+  pf->fcf.src_addr_mode = FRAME802154_VIEW_SRC_ADDR_MODE(&v);
+  pf->seq = FRAME802154_VIEW_SEQ(&v);
+
+  pf->dest_pid = FRAME802154_VIEW_PID(&v, dest_pid);
+  FRAME802154_VIEW_DEST_ADDR(&v, &pf->dest_addr);
+  pf->src_pid = FRAME802154_VIEW_PID(&v, src_pid);
+  FRAME802154_VIEW_SRC_ADDR(&v, &pf->src_addr);
+
+  if(v.aux_hdr != 0) {
+    pf->aux_hdr.security_control.security_level =
+      FRAME802154_VIEW_SECURITY_LEVEL(&v);
+    pf->aux_hdr.security_control.key_id_mode =
+      FRAME802154_VIEW_KEY_ID_MODE(&v);
+    pf->aux_hdr.frame_counter = FRAME802154_VIEW_FRAME_COUNTER(&v);
+    memcpy(pf->aux_hdr.key, v.data + v.aux_hdr + 5,
+           aux_hdr_len(pf->aux_hdr.security_control.key_id_mode) - 5);
   }
 
-  /* header length */
-  c = p - data;
-  /* payload length */
-  pf->payload_len = len - c;
-  /* payload */
-  pf->payload = p;
+  pf->payload_len = v.payload_len;
+  pf->payload = FRAME802154_VIEW_PAYLOAD(&v);
 
   /* return header length if successful */
-  return c > len ? 0 : c;
+  return v.hdr_len;
 }
 /** \}   */
@@ -159,11 +159,66 @@ typedef struct {
   uint8_t payload_len;  /**< Length of payload field */
 } frame802154_t;
 
+/** \brief A parsed frame that refers to the fields of the frame in
+ *  place, instead of copying them out.  The offsets are counted from
+ *  the start of the frame, and an offset of zero means that the field
+ *  is not present.  The fields are left in over-the-air byte order.
+ */
+typedef struct {
+  uint8_t *data;        /**< The frame, starting with the FCF */
+  uint8_t dest_pid;     /**< Offset of the destination PAN ID */
+  uint8_t dest_addr;    /**< Offset of the destination address */
+  uint8_t src_pid;      /**< Offset of the source PAN ID, which is the destination PAN ID with PAN ID compression */
+  uint8_t src_addr;     /**< Offset of the source address */
+  uint8_t aux_hdr;      /**< Offset of the aux security header */
+  uint8_t hdr_len;      /**< Length of the header, which is the offset of the payload */
+  uint8_t payload_len;  /**< Length of the payload */
+} frame802154_view_t;
+
+/** \name Accessors for the fields of a frame802154_view_t
+ *  @{
+ */
+#define FRAME802154_VIEW_TYPE(v)           ((v)->data[0] & 7)
+#define FRAME802154_VIEW_SECURITY(v)       (((v)->data[0] >> 3) & 1)
+#define FRAME802154_VIEW_PENDING(v)        (((v)->data[0] >> 4) & 1)
+#define FRAME802154_VIEW_ACK_REQUIRED(v)   (((v)->data[0] >> 5) & 1)
+#define FRAME802154_VIEW_PANID_COMP(v)     (((v)->data[0] >> 6) & 1)
+#define FRAME802154_VIEW_DEST_ADDR_MODE(v) (((v)->data[1] >> 2) & 3)
+#define FRAME802154_VIEW_VERSION(v)        (((v)->data[1] >> 4) & 3)
+#define FRAME802154_VIEW_SRC_ADDR_MODE(v)  (((v)->data[1] >> 6) & 3)
+#define FRAME802154_VIEW_SEQ(v)            ((v)->data[2])
+#define FRAME802154_VIEW_PAYLOAD(v)        ((v)->data + (v)->hdr_len)
+/** The fields of the aux security header, which must be present. */
+#define FRAME802154_VIEW_SECURITY_LEVEL(v) ((v)->data[(v)->aux_hdr] & 7)
+#define FRAME802154_VIEW_KEY_ID_MODE(v)    (((v)->data[(v)->aux_hdr] >> 3) & 3)
+#define FRAME802154_VIEW_FRAME_COUNTER(v)                               \
+  ((v)->data[(v)->aux_hdr + 1] |                                        \
+   ((uint16_t)(v)->data[(v)->aux_hdr + 2] << 8) |                       \
+   ((uint32_t)(v)->data[(v)->aux_hdr + 3] << 16) |                      \
+   ((uint32_t)(v)->data[(v)->aux_hdr + 4] << 24))
+/** The destination or source PAN ID (field is dest_pid or src_pid), or 0 if there is none. */
+#define FRAME802154_VIEW_PID(v, field)                                  \
+  ((v)->field == 0 ? 0 :                                                \
+   (uint16_t)((v)->data[(v)->field] | ((v)->data[(v)->field + 1] << 8)))
+/** Copy the destination address of a frame into a rimeaddr_t. */
+#define FRAME802154_VIEW_DEST_ADDR(v, addr)                             \
+  frame802154_copy_addr((v)->data + (v)->dest_addr,                     \
+                        FRAME802154_VIEW_DEST_ADDR_MODE(v), addr)
+/** Copy the source address of a frame into a rimeaddr_t. */
+#define FRAME802154_VIEW_SRC_ADDR(v, addr)                              \
+  frame802154_copy_addr((v)->data + (v)->src_addr,                      \
+                        FRAME802154_VIEW_SRC_ADDR_MODE(v), addr)
+/** @} */
+
 /* Prototypes */
 
 uint8_t frame802154_hdrlen(frame802154_t *p);
 uint8_t frame802154_create(frame802154_t *p, uint8_t *buf, uint8_t buf_len);
 uint8_t frame802154_parse(uint8_t *data, uint8_t length, frame802154_t *pf);
+uint8_t frame802154_parse_view(uint8_t *data, uint8_t length,
+                               frame802154_view_t *v);
+void frame802154_copy_addr(const uint8_t *field, uint8_t mode,
+                           rimeaddr_t *addr);
 
 /** @} */
 #endif /* FRAME_802154_H */
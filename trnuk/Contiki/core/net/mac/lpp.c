@@ -77,9 +77,19 @@
 #define WITH_PROBE_AFTER_RECEPTION    0
 #define WITH_PROBE_AFTER_TRANSMISSION 0
 #define WITH_ENCOUNTER_OPTIMIZATION   1
-#define WITH_ADAPTIVE_OFF_TIME        0
 #define WITH_PENDING_BROADCAST        1
 
+/* With an adaptive off time, a node whose probes bring in packets
+   probes more often, down to LOWEST_OFF_TIME, and a node whose probes
+   do not backs off to MAX_OFF_TIME. This lowers the latency through
+   busy nodes at the cost of the energy for the extra probes, while
+   idle nodes spend as little as with a fixed off time. */
+#ifdef LPP_CONF_ADAPTIVE_OFF_TIME
+#define WITH_ADAPTIVE_OFF_TIME LPP_CONF_ADAPTIVE_OFF_TIME
+#else /* LPP_CONF_ADAPTIVE_OFF_TIME */
+#define WITH_ADAPTIVE_OFF_TIME        1
+#endif /* LPP_CONF_ADAPTIVE_OFF_TIME */
+
 #ifdef LPP_CONF_LISTEN_TIME
 #define LISTEN_TIME LPP_CONF_LISTEN_TIME
 #else
@@ -98,6 +108,21 @@
 
 #define LOWEST_OFF_TIME (CLOCK_SECOND / 8)
 
+#ifdef LPP_CONF_MAX_OFF_TIME
+#define MAX_OFF_TIME LPP_CONF_MAX_OFF_TIME
+#else /* LPP_CONF_MAX_OFF_TIME */
+#define MAX_OFF_TIME OFF_TIME
+#endif /* LPP_CONF_MAX_OFF_TIME */
+
+/* With an adaptive off time, probes are sent on a grid of GRID_SLOTS
+   slots per PROBE_INTERVAL, and the interval between two probes is
+   PROBE_INTERVAL divided by 1, 2, 4 or 8. Since the probes at a short
+   interval include the probes at all longer intervals, a neighbor
+   that predicts our probes from a longer interval than we currently
+   use still finds us probing when it expects to. */
+#define PROBE_INTERVAL (LISTEN_TIME + MAX_OFF_TIME)
+#define GRID_SLOTS 8
+
 #define ENCOUNTER_LIFETIME (16 * OFF_TIME)
 
 #ifdef QUEUEBUF_CONF_NUM
@@ -116,6 +141,12 @@
 #define OFF_TIME 1
 #endif
 
+/* Probes carry the probe interval in eighths of a clock tick in 16
+   bits, so it must not be longer than 8191 ticks. */
+#if LISTEN_TIME + MAX_OFF_TIME > 8191 || LISTEN_TIME + OFF_TIME > 8191
+#error LPP_CONF_LISTEN_TIME plus LPP_CONF_MAX_OFF_TIME must be at most 8191 clock ticks
+#endif
+
 struct announcement_data {
   uint16_t id;
   uint16_t value;
@@ -127,6 +158,8 @@ struct announcement_msg {
   struct announcement_data data[];
 };
 
+/* A probe carries the current off time of its sender, in eighths of
+   a clock tick, before the announcements. */
 #define LPP_PROBE_HEADERLEN 2
 
 #define TYPE_PROBE        1
@@ -146,7 +179,11 @@ static struct ctimer timer;
 
 static uint8_t is_listening = 0;
 static clock_time_t off_time_adjustment = 0;
-static clock_time_t off_time = OFF_TIME;
+#if WITH_ADAPTIVE_OFF_TIME
+static clock_time_t grid_start;
+static uint8_t grid_slot, grid_step = GRID_SLOTS;
+static uint8_t packets_received;
+#endif /* WITH_ADAPTIVE_OFF_TIME */
 
 struct queue_list_item {
   struct queue_list_item *next;
@@ -171,6 +208,7 @@ struct encounter {
   struct encounter *next;
   rimeaddr_t neighbor;
   clock_time_t time;
+  uint16_t period;            /* In eighths of a clock tick. */
   struct ctimer remove_timer;
   struct ctimer turn_on_radio_timer;
 };
@@ -205,7 +243,7 @@ remove_encounter(void *encounter)
 }
 /*---------------------------------------------------------------------------*/
 static void
-register_encounter(rimeaddr_t *neighbor, clock_time_t time)
+register_encounter(rimeaddr_t *neighbor, clock_time_t time, uint16_t period)
 {
   struct encounter *e;
 
@@ -213,6 +251,7 @@ register_encounter(rimeaddr_t *neighbor, clock_time_t time)
   for(e = list_head(encounter_list); e != NULL; e = e->next) {
     if(rimeaddr_cmp(neighbor, &e->neighbor)) {
       e->time = time;
+      e->period = period;
       ctimer_set(&e->remove_timer, ENCOUNTER_LIFETIME, remove_encounter, e);
       break;
     }
@@ -226,6 +265,7 @@ register_encounter(rimeaddr_t *neighbor, clock_time_t time)
     }
     rimeaddr_copy(&e->neighbor, neighbor);
     e->time = time;
+    e->period = period;
     ctimer_set(&e->remove_timer, ENCOUNTER_LIFETIME, remove_encounter, e);
     list_add(encounter_list, e);
   }
@@ -276,15 +316,18 @@ turn_radio_on_for_neighbor(rimeaddr_t *neighbor, struct queue_list_item *i)
     if(rimeaddr_cmp(neighbor, &e->neighbor)) {
       clock_time_t wait, now;
 
-      /* We expect encounters to happen roughly every OFF_TIME time
-	 units. The next expected encounter is at time e->time +
-	 OFF_TIME. To compute a relative offset, we subtract with
-	 clock_time(). Because we are only interested in turning on
-	 the radio within the OFF_TIME period, we compute the waiting
-	 time with modulo OFF_TIME. */
+      /* We expect encounters to happen every e->period, the probe
+	 interval that the neighbor told us about in its last probe.
+	 The next expected encounter is at time e->time + e->period.
+	 Because we are only interested in turning on the radio
+	 within the period, we compute the waiting time modulo the
+	 period. The period is in eighths of a clock tick, and we
+	 round the waiting time down so that we rather turn on the
+	 radio early than late. */
 
       now = clock_time();
-      wait = ((clock_time_t)(e->time - now)) % (OFF_TIME);
+      wait = (e->period -
+	      (uint32_t)(clock_time_t)(now - e->time) * 8 % e->period) / 8;
 
       /*      printf("now %d e %d e-n %d w %d %d\n", now, e->time, e->time - now, (e->time - now) % (OFF_TIME), wait);
       
@@ -362,6 +405,7 @@ send_probe(void)
   struct lpp_hdr *hdr;
   struct announcement_msg *adata;
   struct announcement *a;
+  uint16_t *probe_off_time;
 
   /* Set up the probe header. */
   packetbuf_clear();
@@ -372,8 +416,17 @@ send_probe(void)
   rimeaddr_copy(&hdr->receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
 
 
+  /* Tell our neighbors when we will probe next. */
+  probe_off_time = (uint16_t *)((char *)hdr + sizeof(struct lpp_hdr));
+#if WITH_ADAPTIVE_OFF_TIME
+  *probe_off_time = (uint32_t)PROBE_INTERVAL * grid_step - LISTEN_TIME * 8;
+#else /* WITH_ADAPTIVE_OFF_TIME */
+  *probe_off_time = OFF_TIME * 8;
+#endif /* WITH_ADAPTIVE_OFF_TIME */
+
   /* Construct the announcements */
-  adata = (struct announcement_msg *)((char *)hdr + sizeof(struct lpp_hdr));
+  adata = (struct announcement_msg *)((char *)hdr + sizeof(struct lpp_hdr) +
+				      LPP_PROBE_HEADERLEN);
   
   adata->num = 0;
   for(a = announcement_list(); a != NULL; a = a->next) {
@@ -382,7 +435,7 @@ send_probe(void)
     adata->num++;
   }
 
-  packetbuf_set_datalen(sizeof(struct lpp_hdr) +
+  packetbuf_set_datalen(sizeof(struct lpp_hdr) + LPP_PROBE_HEADERLEN +
 		      ANNOUNCEMENT_MSG_HEADERLEN +
 		      sizeof(struct announcement_data) * adata->num);
 
@@ -417,6 +470,79 @@ num_packets_to_send(void)
 #endif /* WITH_PENDING_BROADCAST */
 }
 /*---------------------------------------------------------------------------*/
+#if WITH_ADAPTIVE_OFF_TIME
+/**
+ * Adapt the probe interval before a probe. We keep a moving average
+ * of the number of packets that our probes bring in, in 64ths of a
+ * packet. If a probe brings in more than an eighth of a packet on
+ * average, we halve the interval; if it brings in less than a 32nd of
+ * a packet, we double it. A node that packets flow through thus
+ * probes a few times per packet, and an idle node falls back to
+ * PROBE_INTERVAL. The interval is kept for at least ADAPT_HOLD
+ * probes, and it is only doubled on a probe that is on the grid of
+ * the doubled interval.
+ *
+ * We do not speed up while our own queue is half full: the packets
+ * that we would attract would only wait in our queue.
+ */
+#define ADAPT_HOLD 4
+#define LOAD_HIGH  8
+#define LOAD_LOW   2
+static void
+adapt_off_time(void)
+{
+  static uint16_t load;
+  static uint8_t hold;
+
+  load = load - (load + 3) / 4 + packets_received * 16;
+  packets_received = 0;
+
+  if(hold > 0) {
+    hold--;
+  } else if(load > LOAD_HIGH &&
+	    list_length(queued_packets_list) < MAX_QUEUED_PACKETS / 2 &&
+	    (uint32_t)PROBE_INTERVAL * (grid_step / 2) >=
+	    (uint32_t)LOWEST_OFF_TIME * GRID_SLOTS) {
+    grid_step /= 2;
+    load /= 2;
+    hold = ADAPT_HOLD;
+  } else if(load < LOAD_LOW && grid_step < GRID_SLOTS &&
+	    grid_slot % (grid_step * 2) == 0) {
+    grid_step *= 2;
+    load *= 2;
+    hold = ADAPT_HOLD;
+  }
+}
+#endif /* WITH_ADAPTIVE_OFF_TIME */
+/*---------------------------------------------------------------------------*/
+/**
+ * Compute the time from the end of a listen period to the next probe.
+ */
+static clock_time_t
+off_time(void)
+{
+#if WITH_ADAPTIVE_OFF_TIME
+  clock_time_t next, now;
+
+  grid_slot += grid_step;
+  if(grid_slot >= GRID_SLOTS) {
+    grid_slot -= GRID_SLOTS;
+    grid_start += PROBE_INTERVAL;
+  }
+  next = grid_start + (uint32_t)PROBE_INTERVAL * grid_slot / GRID_SLOTS;
+  now = clock_time();
+  if((clock_time_t)(next - now) > PROBE_INTERVAL) {
+    /* We have fallen behind the grid, so we start a new one. */
+    grid_start = now;
+    grid_slot = 0;
+    return 0;
+  }
+  return next - now;
+#else /* WITH_ADAPTIVE_OFF_TIME */
+  return OFF_TIME;
+#endif /* WITH_ADAPTIVE_OFF_TIME */
+}
+/*---------------------------------------------------------------------------*/
 /**
  * Duty cycle the radio and send probes. This function is called
  * repeatedly by a ctimer. The function restart_dutycycle() is used to
@@ -447,6 +573,12 @@ dutycycle(void *ptr)
       }
 #endif /* WITH_PENDING_BROADCAST */
 
+#if WITH_ADAPTIVE_OFF_TIME
+    /* Adapt the probe interval before the probe so that the probe
+       tells our neighbors the interval that we will actually use. */
+    adapt_off_time();
+#endif /* WITH_ADAPTIVE_OFF_TIME */
+
     /* Send a probe packet. */
     send_probe();
     
@@ -486,28 +618,21 @@ dutycycle(void *ptr)
       if(is_listening == 0) {
 	turn_radio_off();
 	compower_accumulate(&compower_idle_activity);
-	ctimer_set(t, off_time + off_time_adjustment, (void (*)(void *))dutycycle, t);
+	ctimer_set(t, off_time() + off_time_adjustment, (void (*)(void *))dutycycle, t);
 	off_time_adjustment = 0;
 	PT_YIELD(&dutycycle_pt);
 
-#if WITH_ADAPTIVE_OFF_TIME
-	off_time += LOWEST_OFF_TIME;
-	if(off_time > OFF_TIME) {
-	  off_time = OFF_TIME;
-	}
-#endif /* WITH_ADAPTIVE_OFF_TIME */
-
       } else {
 	/* We are listening for annonucements, so we count down the
 	   listen time, and keep the radio on. */
 	is_listening--;
-	ctimer_set(t, OFF_TIME, (void (*)(void *))dutycycle, t);
+	ctimer_set(t, off_time(), (void (*)(void *))dutycycle, t);
 	PT_YIELD(&dutycycle_pt);
       }
     } else {
       /* We had pending packets to send, so we do not turn the radio off. */
 
-      ctimer_set(t, off_time, (void (*)(void *))dutycycle, t);
+      ctimer_set(t, off_time(), (void (*)(void *))dutycycle, t);
       PT_YIELD(&dutycycle_pt);
     }
   }
@@ -519,6 +644,10 @@ static void
 restart_dutycycle(clock_time_t initial_wait)
 {
   PT_INIT(&dutycycle_pt);
+#if WITH_ADAPTIVE_OFF_TIME
+  grid_start = clock_time() + initial_wait;
+  grid_slot = 0;
+#endif /* WITH_ADAPTIVE_OFF_TIME */
   ctimer_set(&timer, initial_wait, (void (*)(void *))dutycycle, &timer);  
 }
 /*---------------------------------------------------------------------------*/
@@ -566,11 +695,6 @@ send_packet(void)
   }
 #endif /* WITH_ACK_OPTIMIZATION */
 
-#if WITH_ADAPTIVE_OFF_TIME
-  off_time = LOWEST_OFF_TIME;
-  restart_dutycycle(off_time);
-#endif /* WITH_ADAPTIVE_OFF_TIME */
-
   {
     struct queue_list_item *i;
     i = memb_alloc(&queued_packets_memb);
@@ -638,8 +762,13 @@ read_packet(void)
 
     if(hdr->type == TYPE_PROBE) {
       /* Parse incoming announcements */
-      struct announcement_msg *adata = packetbuf_dataptr();
+      struct announcement_msg *adata;
+      uint16_t probe_interval;
       int i;
+
+      probe_interval = LISTEN_TIME * 8 + *(uint16_t *)packetbuf_dataptr();
+      adata = (struct announcement_msg *)((char *)packetbuf_dataptr() +
+					  LPP_PROBE_HEADERLEN);
 	
       /*	PRINTF("%d.%d: probe from %d.%d with %d announcements\n",
 		rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
@@ -658,7 +787,7 @@ read_packet(void)
 
       /* Register the encounter with the sending node. We now know the
 	 neighbor's phase. */
-      register_encounter(&hdr->sender, reception_time);
+      register_encounter(&hdr->sender, reception_time, probe_interval);
 
       /* Go through the list of packets to be sent to see if any of
 	 them match the sender of the probe, or if they are a
@@ -783,10 +912,15 @@ read_packet(void)
 #endif /* WITH_PROBE_AFTER_RECEPTION */
 
 #if WITH_ADAPTIVE_OFF_TIME
-      off_time = LOWEST_OFF_TIME;
-      restart_dutycycle(off_time);
+      /* Only count packets that were sent to us, not broadcasts: if
+	 the neighbors that overhear a packet sped up too, their
+	 probes would fall into step with ours. */
+      if(rimeaddr_cmp(&hdr->receiver, &rimeaddr_node_addr) &&
+	 packets_received < 0xff) {
+	packets_received++;
+      }
 #endif /* WITH_ADAPTIVE_OFF_TIME */
-      
+
     }
 
     len = packetbuf_datalen();
@@ -61,6 +61,109 @@
 #define PRINTADDR(addr)
 #endif
 
+/* The security level of the frames that are sent and received: 0 for
+   no security, 1-3 for a MIC of 4, 8, or 16 bytes, 4 for encryption,
+   and 5-7 for encryption and a MIC of 4, 8, or 16 bytes. */
+#ifdef SICSLOWMAC_CONF_SECURITY_LEVEL
+#define SECURITY_LEVEL SICSLOWMAC_CONF_SECURITY_LEVEL
+#else /* SICSLOWMAC_CONF_SECURITY_LEVEL */
+#define SECURITY_LEVEL 0
+#endif /* SICSLOWMAC_CONF_SECURITY_LEVEL */
+
+/* With SICSLOWMAC_CONF_CC2420_SECURITY, the frames are encrypted and
+   decrypted by the in-line security of the CC2420 as they pass
+   through its FIFOs, instead of in software. The radio must be the
+   CC2420, built with CC2420_CONF_SECURITY. */
+#ifdef SICSLOWMAC_CONF_CC2420_SECURITY
+#define CC2420_SECURITY SICSLOWMAC_CONF_CC2420_SECURITY
+#else /* SICSLOWMAC_CONF_CC2420_SECURITY */
+#define CC2420_SECURITY 0
+#endif /* SICSLOWMAC_CONF_CC2420_SECURITY */
+
+/* The number of neighbors that can have keys of their own. */
+#ifdef SICSLOWMAC_CONF_KEYS
+#define KEYS SICSLOWMAC_CONF_KEYS
+#else /* SICSLOWMAC_CONF_KEYS */
+#define KEYS 4
+#endif /* SICSLOWMAC_CONF_KEYS */
+
+/* The number of neighbors whose frame counters are remembered. */
+#ifdef SICSLOWMAC_CONF_COUNTERS
+#define COUNTERS SICSLOWMAC_CONF_COUNTERS
+#else /* SICSLOWMAC_CONF_COUNTERS */
+#define COUNTERS 8
+#endif /* SICSLOWMAC_CONF_COUNTERS */
+
+/* The frame counter is kept in this CFS file across reboots. */
+#ifdef SICSLOWMAC_CONF_COUNTER_FILE
+#define COUNTER_FILE SICSLOWMAC_CONF_COUNTER_FILE
+#else /* SICSLOWMAC_CONF_COUNTER_FILE */
+#define COUNTER_FILE "6mac-counter"
+#endif /* SICSLOWMAC_CONF_COUNTER_FILE */
+
+/* The number of frame counters that are reserved in the file at a
+   time. The file is written once per block, and up to a block of
+   counters is skipped when the node reboots. */
+#ifdef SICSLOWMAC_CONF_COUNTER_BLOCK
+#define COUNTER_BLOCK SICSLOWMAC_CONF_COUNTER_BLOCK
+#else /* SICSLOWMAC_CONF_COUNTER_BLOCK */
+#define COUNTER_BLOCK 1024
+#endif /* SICSLOWMAC_CONF_COUNTER_BLOCK */
+
+#if SECURITY_LEVEL
+#include "net/mac/ccm-star.h"
+#include "net/rime/addrtable.h"
+#include "cfs/cfs.h"
+#if CC2420_SECURITY
+#include "dev/cc2420.h"
+#if SECURITY_LEVEL < 5
+#error SICSLOWMAC_CONF_CC2420_SECURITY needs a SICSLOWMAC_CONF_SECURITY_LEVEL of 5, 6, or 7
+#endif
+#endif /* CC2420_SECURITY */
+
+#define MIC_LEN  ((SECURITY_LEVEL & 3) == 0 ? 0 : 2 << (SECURITY_LEVEL & 3))
+#define ENCRYPT  (SECURITY_LEVEL & 4)
+#define KEY_LEN  16
+
+struct key {
+  rimeaddr_t addr;
+  uint8_t key[KEY_LEN];
+};
+static struct key key_entries[KEYS];
+ADDRTABLE(keys, struct key, key_entries, addr);
+
+static uint8_t network_key[KEY_LEN];
+static uint8_t network_key_set;
+
+/* The key that the cipher was last set up with. */
+static const uint8_t *current_key;
+
+/* The highest frame counter received from each neighbor, under the
+   network key and under the pairwise key of the neighbor. When the
+   table is full, the neighbor that was heard from longest ago is
+   forgotten, and old frames from it would be accepted again: the
+   table should have room for all neighbors. When a key is changed,
+   the counters of the frames under the old key are forgotten, so
+   that a neighbor that has been given a new key is heard from again
+   even if its frame counter has started over. */
+#define NETWORK_KEY  0
+#define PAIRWISE_KEY 1
+struct counter {
+  rimeaddr_t addr;
+  uint32_t counter[2];
+  uint8_t valid;
+};
+static struct counter counter_entries[COUNTERS];
+ADDRTABLE(counters, struct counter, counter_entries, addr);
+
+/* The frame counter of the next frame that we send, and the first
+   one that is not reserved in the counter file. No frame is sent
+   with a counter that has not been reserved, so that a counter is
+   never used twice with the same key, even across reboots. */
+static uint32_t frame_counter;
+static uint32_t counter_limit;
+#endif /* SECURITY_LEVEL */
+
 /**  \brief The sequence number (0x00 - 0xff) added to the transmitted
  *   data or MAC command frame. The default is a random value within
  *   the range.
@@ -94,24 +197,384 @@ is_broadcast_addr(uint8_t mode, uint8_t *addr)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+#if SECURITY_LEVEL
+/* Returns the key of the frames to or from a neighbor, or NULL if
+   there is none. */
+static const uint8_t *
+get_key(const rimeaddr_t *neighbor, int broadcast)
+{
+  struct key *k;
+
+  if(!broadcast) {
+    k = addrtable_find(&keys, neighbor);
+    if(k != NULL) {
+      return k->key;
+    }
+  }
+  return network_key_set ? network_key : NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Reserves the next block of frame counters in the counter file, and
+   returns zero if the file cannot be written. */
+static int
+reserve_counters(void)
+{
+  uint8_t buf[4];
+  uint32_t limit;
+  int fd, n;
+
+  if(frame_counter > 0xffffffffUL - COUNTER_BLOCK) {
+    limit = 0xffffffffUL;
+  } else {
+    limit = frame_counter + COUNTER_BLOCK;
+  }
+  buf[0] = limit;
+  buf[1] = limit >> 8;
+  buf[2] = limit >> 16;
+  buf[3] = limit >> 24;
+  fd = cfs_open(COUNTER_FILE, CFS_WRITE);
+  if(fd < 0) {
+    return 0;
+  }
+  n = cfs_write(fd, buf, sizeof(buf));
+  cfs_close(fd);
+  if(n != sizeof(buf)) {
+    PRINTF("6MAC: cannot write the frame counter\n");
+    return 0;
+  }
+  counter_limit = limit;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Continues from the limit that was reserved before the node
+   rebooted. The counter is stored least significant byte first, and
+   the buffer is cleared first, as a file system may not keep the
+   trailing zeros of a file. */
+static void
+restore_counter(void)
+{
+  uint8_t buf[4];
+  int fd;
+
+  memset(buf, 0, sizeof(buf));
+  fd = cfs_open(COUNTER_FILE, CFS_READ);
+  if(fd >= 0) {
+    cfs_read(fd, buf, sizeof(buf));
+    cfs_close(fd);
+  }
+  frame_counter = buf[0] | ((uint32_t)buf[1] << 8) |
+    ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+  counter_limit = frame_counter;
+  reserve_counters();
+}
+/*---------------------------------------------------------------------------*/
+#if !CC2420_SECURITY
+static void
+use_key(const uint8_t *key)
+{
+  if(key != current_key) {
+    ccm_star_set_key(key);
+    current_key = key;
+  }
+}
+#endif /* !CC2420_SECURITY */
+/*---------------------------------------------------------------------------*/
+/* The nonce is the extended address of the sender, the frame counter,
+   and the security level, all most significant byte first. */
+static void
+set_nonce(uint8_t *nonce, const rimeaddr_t *sender, uint32_t counter)
+{
+  memset(nonce, 0, 8);
+  memcpy(nonce, sender, sizeof(rimeaddr_t) < 8 ? sizeof(rimeaddr_t) : 8);
+  nonce[8] = counter >> 24;
+  nonce[9] = counter >> 16;
+  nonce[10] = counter >> 8;
+  nonce[11] = counter;
+  nonce[12] = SECURITY_LEVEL;
+}
+/*---------------------------------------------------------------------------*/
+/* Checks the aux security header of a received frame, and that the
+   frame is newer than the last one from its sender under the same
+   key. Returns the key of the frame, or NULL. */
+static const uint8_t *
+check_frame(frame802154_view_t *frame, int broadcast,
+	    rimeaddr_t *sender, uint32_t *counter)
+{
+  struct counter *c;
+  const uint8_t *key;
+  uint8_t kind;
+
+  if(frame->aux_hdr == 0 ||
+     FRAME802154_VIEW_SECURITY_LEVEL(frame) != SECURITY_LEVEL ||
+     FRAME802154_VIEW_KEY_ID_MODE(frame) != 0 ||
+     FRAME802154_VIEW_SRC_ADDR_MODE(frame) != FRAME802154_LONGADDRMODE) {
+    PRINTF("6MAC: not secured at level %u\n", SECURITY_LEVEL);
+    return NULL;
+  }
+  FRAME802154_VIEW_SRC_ADDR(frame, sender);
+  *counter = FRAME802154_VIEW_FRAME_COUNTER(frame);
+  key = get_key(sender, broadcast);
+  if(key == NULL) {
+    return NULL;
+  }
+  kind = key == network_key ? NETWORK_KEY : PAIRWISE_KEY;
+  c = addrtable_find(&counters, sender);
+  if(c != NULL && (c->valid & (1 << kind)) && *counter <= c->counter[kind]) {
+    PRINTF("6MAC: replayed frame %lu\n", (unsigned long)*counter);
+    return NULL;
+  }
+  return key;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_counter(const rimeaddr_t *sender, const uint8_t *key,
+	       uint32_t counter)
+{
+  struct counter *c;
+  uint8_t kind;
+
+  kind = key == network_key ? NETWORK_KEY : PAIRWISE_KEY;
+  c = addrtable_find(&counters, sender);
+  if(c == NULL) {
+    c = addrtable_add(&counters, sender);
+    c->valid = 0;
+  } else {
+    addrtable_refresh(&counters, c);
+  }
+  c->counter[kind] = counter;
+  c->valid |= 1 << kind;
+}
+/*---------------------------------------------------------------------------*/
+/* Forgets the counters of the frames under a key that is changed:
+   the network key if neighbor is NULL, else the pairwise key of the
+   neighbor. */
+static void
+forget_counters(const rimeaddr_t *neighbor)
+{
+  struct counter *c;
+
+  if(neighbor == NULL) {
+    for(c = addrtable_next(&counters, NULL); c != NULL;
+	c = addrtable_next(&counters, c)) {
+      c->valid &= ~(1 << NETWORK_KEY);
+    }
+  } else {
+    c = addrtable_find(&counters, neighbor);
+    if(c != NULL) {
+      c->valid &= ~(1 << PAIRWISE_KEY);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Secures the frame in the packetbuf, which has a header of hdr_len
+   bytes, and appends the MIC to it. */
+static void
+secure_frame(uint8_t hdr_len, const uint8_t *key, uint32_t counter)
+{
+  uint8_t *m;
+  uint8_t m_len;
+#if CC2420_SECURITY
+  struct cc2420_security s;
+#else /* CC2420_SECURITY */
+  uint8_t nonce[CCM_STAR_NONCE_LENGTH];
+#endif /* CC2420_SECURITY */
+
+  m = packetbuf_dataptr();
+  m_len = packetbuf_datalen();
+  packetbuf_set_datalen(m_len + MIC_LEN);
+
+#if CC2420_SECURITY
+  /* The CC2420 encrypts the frame in its TXFIFO and writes the MIC
+     over the zeros. */
+  memset(m + m_len, 0, MIC_LEN);
+  s.key = key;
+  set_nonce(s.nonce, &rimeaddr_node_addr, counter);
+  s.a_len = hdr_len;
+  s.mic_len = MIC_LEN;
+  cc2420_set_tx_security(&s);
+#else /* CC2420_SECURITY */
+  set_nonce(nonce, &rimeaddr_node_addr, counter);
+  use_key(key);
+#if ENCRYPT
+  ccm_star_mic(nonce, packetbuf_hdrptr(), hdr_len, m, m_len,
+	       m + m_len, MIC_LEN);
+  ccm_star_ctr(nonce, m, m_len);
+#else /* ENCRYPT */
+  ccm_star_mic(nonce, packetbuf_hdrptr(), hdr_len + m_len, NULL, 0,
+	       m + m_len, MIC_LEN);
+#endif /* ENCRYPT */
+#endif /* CC2420_SECURITY */
+}
+/*---------------------------------------------------------------------------*/
+/* Checks and removes the security of the received frame, whose
+   payload is in the packetbuf. */
+static int
+unsecure_frame(frame802154_view_t *frame, int broadcast)
+{
+  rimeaddr_t sender;
+  uint32_t counter;
+  const uint8_t *key;
+#if !CC2420_SECURITY
+  uint8_t nonce[CCM_STAR_NONCE_LENGTH];
+  uint8_t mic[16];
+  uint8_t *m;
+  uint8_t m_len, i, diff;
+#endif /* !CC2420_SECURITY */
+
+  key = check_frame(frame, broadcast, &sender, &counter);
+  if(key == NULL) {
+    return 0;
+  }
+
+#if !CC2420_SECURITY
+  if(frame->payload_len < MIC_LEN) {
+    return 0;
+  }
+  set_nonce(nonce, &sender, counter);
+  use_key(key);
+  m = FRAME802154_VIEW_PAYLOAD(frame);
+  m_len = frame->payload_len - MIC_LEN;
+#if ENCRYPT
+  ccm_star_ctr(nonce, m, m_len);
+  ccm_star_mic(nonce, frame->data, frame->hdr_len, m, m_len, mic, MIC_LEN);
+#else /* ENCRYPT */
+  ccm_star_mic(nonce, frame->data, frame->hdr_len + m_len, NULL, 0,
+	       mic, MIC_LEN);
+#endif /* ENCRYPT */
+  diff = 0;
+  for(i = 0; i < MIC_LEN; i++) {
+    diff |= mic[i] ^ m[m_len + i];
+  }
+  if(diff != 0) {
+    PRINTF("6MAC: wrong MIC\n");
+    return 0;
+  }
+  packetbuf_set_datalen(m_len);
+#endif /* !CC2420_SECURITY */
+
+  /* With the in-line security, the CC2420 has already checked the
+     MIC and removed it. */
+  update_counter(&sender, key, counter);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+#if CC2420_SECURITY
+/* Called by the CC2420 driver with the start of each secured frame
+   that it receives, before the frame is decrypted in the RXFIFO. */
+static int
+cc2420_rx_security(const uint8_t *hdr, uint8_t len, struct cc2420_security *s)
+{
+  frame802154_view_t frame;
+  rimeaddr_t sender;
+  uint32_t counter;
+  uint8_t mode;
+
+  if(frame802154_parse_view((uint8_t *)hdr, len, &frame) == 0) {
+    return 0;
+  }
+  mode = FRAME802154_VIEW_DEST_ADDR_MODE(&frame);
+  s->key = check_frame(&frame, mode == 0 ||
+		       is_broadcast_addr(mode, frame.data + frame.dest_addr),
+		       &sender, &counter);
+  if(s->key == NULL) {
+    return 0;
+  }
+  set_nonce(s->nonce, &sender, counter);
+  s->a_len = frame.hdr_len;
+  s->mic_len = MIC_LEN;
+  return 1;
+}
+#endif /* CC2420_SECURITY */
+/*---------------------------------------------------------------------------*/
+int
+sicslowmac_set_key(const rimeaddr_t *neighbor, const uint8_t *key)
+{
+  struct key *k;
+
+  current_key = NULL;
+  if(neighbor == NULL) {
+    if(key == NULL || !network_key_set ||
+       memcmp(network_key, key, KEY_LEN) != 0) {
+      forget_counters(NULL);
+    }
+    if(key != NULL) {
+      memcpy(network_key, key, KEY_LEN);
+    }
+    network_key_set = key != NULL;
+    return 1;
+  }
+
+  k = addrtable_find(&keys, neighbor);
+  if(key == NULL) {
+    if(k != NULL) {
+      addrtable_remove(&keys, k);
+      forget_counters(neighbor);
+    }
+    return 1;
+  }
+  if(k != NULL && memcmp(k->key, key, KEY_LEN) == 0) {
+    return 1;
+  }
+  if(k == NULL) {
+    /* The keys of other neighbors are never evicted to make room. */
+    if(addrtable_full(&keys)) {
+      return 0;
+    }
+    k = addrtable_add(&keys, neighbor);
+  }
+  memcpy(k->key, key, KEY_LEN);
+  forget_counters(neighbor);
+  return 1;
+}
+#else /* SECURITY_LEVEL */
+int
+sicslowmac_set_key(const rimeaddr_t *neighbor, const uint8_t *key)
+{
+  return 0;
+}
+#endif /* SECURITY_LEVEL */
+/*---------------------------------------------------------------------------*/
 static int
 send_packet(void)
 {
   frame802154_t params;
   uint8_t len;
+#if SECURITY_LEVEL
+  const uint8_t *key;
+#endif /* SECURITY_LEVEL */
 
-  /* init to zeros */
-  memset(&params, 0, sizeof(params));
-
-  /* Build the FCF. */
+  /* Build the FCF. Only the fields that frame802154_create() uses are
+     set, and the header is then built in place in the header area of
+     the packetbuf. */
   params.fcf.frame_type = FRAME802154_DATAFRAME;
-  params.fcf.security_enabled = 0;
   params.fcf.frame_pending = 0;
   params.fcf.ack_required = packetbuf_attr(PACKETBUF_ATTR_RELIABLE);
   params.fcf.panid_compression = 0;
 
+#if SECURITY_LEVEL
+  /* Secured frames are IEEE 802.15.4 (2006) frames, and the key is
+     implicit: the pairwise key of the receiver, or the network
+     key. */
+  key = get_key(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+		rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+			     &rimeaddr_null));
+  if(key == NULL || frame_counter == 0xffffffffUL ||
+     (frame_counter == counter_limit && !reserve_counters()) ||
+     packetbuf_datalen() + MIC_LEN > PACKETBUF_SIZE) {
+    PRINTF("6MAC: cannot secure the frame\n");
+    return 0;
+  }
+  params.fcf.security_enabled = 1;
+  params.fcf.frame_version = FRAME802154_IEEE802154_2006;
+  params.aux_hdr.security_control.security_level = SECURITY_LEVEL;
+  params.aux_hdr.security_control.key_id_mode = 0;
+  params.aux_hdr.frame_counter = frame_counter++;
+#else /* SECURITY_LEVEL */
+  params.fcf.security_enabled = 0;
+
   /* Insert IEEE 802.15.4 (2003) version bit. */
   params.fcf.frame_version = FRAME802154_IEEE802154_2003;
+#endif /* SECURITY_LEVEL */
 
   /* Increment and set the data sequence number. */
   params.seq = mac_dsn++;
@@ -148,11 +611,12 @@ send_packet(void)
    */
   rimeaddr_copy(&params.src_addr, &rimeaddr_node_addr);
 
-  params.payload = packetbuf_dataptr();
-  params.payload_len = packetbuf_datalen();
   len = frame802154_hdrlen(&params);
   if(packetbuf_hdralloc(len)) {
     frame802154_create(&params, packetbuf_hdrptr(), len);
+#if SECURITY_LEVEL
+    secure_frame(len, key, params.aux_hdr.frame_counter);
+#endif /* SECURITY_LEVEL */
 
     PRINTF("6MAC-UT: %2X", params.fcf.frame_type);
     PRINTADDR(params.dest_addr.u8);
@@ -176,29 +640,52 @@ input_packet(const struct radio_driver *d)
 static int
 read_packet(void)
 {
-  frame802154_t frame;
+  frame802154_view_t frame;
+  rimeaddr_t addr;
+  uint16_t pid;
+  uint8_t mode;
+#if SECURITY_LEVEL
+  uint8_t broadcast;
+#endif /* SECURITY_LEVEL */
   int len;
   packetbuf_clear();
   len = radio->read(packetbuf_dataptr(), PACKETBUF_SIZE);
   if(len > 0) {
     packetbuf_set_datalen(len);
-    if(frame802154_parse(packetbuf_dataptr(), len, &frame) &&
-       packetbuf_hdrreduce(len - frame.payload_len)) {
-      if(frame.fcf.dest_addr_mode) {
-        if(frame.dest_pid != mac_src_pan_id &&
-           frame.dest_pid != FRAME802154_BROADCASTPANDID) {
+    /* The frame is parsed in place, and only the addresses are copied
+       out of it. */
+    if(frame802154_parse_view(packetbuf_dataptr(), len, &frame) &&
+       packetbuf_hdrreduce(frame.hdr_len)) {
+      mode = FRAME802154_VIEW_DEST_ADDR_MODE(&frame);
+#if SECURITY_LEVEL
+      broadcast = 1;
+#endif /* SECURITY_LEVEL */
+      if(mode) {
+        pid = FRAME802154_VIEW_PID(&frame, dest_pid);
+        if(pid != mac_src_pan_id &&
+           pid != FRAME802154_BROADCASTPANDID) {
           /* Not broadcast or for our PAN */
-          PRINTF("6MAC: for another pan %u\n", frame.dest_pid);
+          PRINTF("6MAC: for another pan %u\n", pid);
           return 0;
 
         }
-        if(!is_broadcast_addr(frame.fcf.dest_addr_mode, frame.dest_addr.u8)) {
-          packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &frame.dest_addr);
+        if(!is_broadcast_addr(mode, frame.data + frame.dest_addr)) {
+          FRAME802154_VIEW_DEST_ADDR(&frame, &addr);
+          packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &addr);
+#if SECURITY_LEVEL
+          broadcast = 0;
+#endif /* SECURITY_LEVEL */
         }
       }
-      packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &frame.src_addr);
+#if SECURITY_LEVEL
+      if(!unsecure_frame(&frame, broadcast)) {
+        return 0;
+      }
+#endif /* SECURITY_LEVEL */
+      FRAME802154_VIEW_SRC_ADDR(&frame, &addr);
+      packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &addr);
 
-      PRINTF("6MAC-IN: %2X", frame.fcf.frame_type);
+      PRINTF("6MAC-IN: %2X", FRAME802154_VIEW_TYPE(&frame));
       PRINTADDR(packetbuf_addr(PACKETBUF_ADDR_SENDER));
       PRINTADDR(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
       PRINTF("%u\n", packetbuf_datalen());
@@ -248,6 +735,14 @@ sicslowmac_init(const struct radio_driver *d)
   mac_dsn = random_rand() % 256;
 
   radio = d;
+#if SECURITY_LEVEL
+  addrtable_init(&keys, 0, NULL);
+  addrtable_init(&counters, 0, NULL);
+  restore_counter();
+#if CC2420_SECURITY
+  cc2420_set_rx_security(cc2420_rx_security);
+#endif /* CC2420_SECURITY */
+#endif /* SECURITY_LEVEL */
   radio->set_receive_function(input_packet);
   radio->on();
   return &sicslowmac_driver;
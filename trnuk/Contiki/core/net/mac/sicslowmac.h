@@ -47,10 +47,38 @@
 #define __SICSLOWMAC_H__
 
 #include "net/mac/mac.h"
+#include "net/rime/rimeaddr.h"
 #include "dev/radio.h"
 
 extern const struct mac_driver sicslowmac_driver;
 
 const struct mac_driver *sicslowmac_init(const struct radio_driver *r);
 
+/**
+ * \brief      Set a key of the link-layer security
+ * \param neighbor The neighbor that the key is shared with, or NULL
+ *             for the network key
+ * \param key  A pointer to the 16-byte key, or NULL to remove the key
+ * \return     Non-zero if the key was set, zero if the table of
+ *             keys is full
+ *
+ *             With SICSLOWMAC_CONF_SECURITY_LEVEL set, sicslowmac
+ *             secures the frames it sends with the CCM* of IEEE
+ *             802.15.4-2006. Broadcast frames use the network key,
+ *             and unicast frames the key of their receiver, or the
+ *             network key if the receiver has no key of its own.
+ *             Frames that are not secured at the configured level
+ *             are dropped.
+ *
+ *             The frame counter of the frames that are sent is kept
+ *             in a CFS file, SICSLOWMAC_CONF_COUNTER_FILE, so that it
+ *             never starts over. No frames are sent while the file
+ *             cannot be written. Setting a key that differs from the
+ *             one it replaces makes this node forget the frame
+ *             counters that it has received under the old key, so
+ *             that a neighbor that has been given the new key is
+ *             accepted even if its frame counter has started over.
+ */
+int sicslowmac_set_key(const rimeaddr_t *neighbor, const uint8_t *key);
+
 #endif /* __SICSLOWMAC_H__ */
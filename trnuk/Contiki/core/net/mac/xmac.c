@@ -44,8 +44,11 @@
 #include "dev/leds.h"
 #include "net/rime.h"
 #include "net/rime/timesynch.h"
+#include "net/rime/addrtable.h"
 #include "dev/radio.h"
 #include "dev/watchdog.h"
+#include "lib/list.h"
+#include "lib/memb.h"
 #include "lib/random.h"
 
 #include "sys/compower.h"
@@ -56,10 +59,51 @@
 
 #define WITH_CHANNEL_CHECK           0    /* Seems to work badly when enabled */
 #define WITH_TIMESYNCH               0
-#define WITH_QUEUE                   0
 #define WITH_ACK_OPTIMIZATION        1
 #define WITH_RANDOM_WAIT_BEFORE_SEND 0
 
+/* With burst mode, outgoing packets are queued, and all packets that
+   are queued for a receiver are sent back to back after a single
+   strobe train. Every packet but the last has the FLAG_MORE flag set,
+   and the receiver stays awake as long as it sees the flag. */
+#ifdef XMAC_CONF_BURST
+#define WITH_BURST XMAC_CONF_BURST
+#else /* XMAC_CONF_BURST */
+#define WITH_BURST 1
+#endif /* XMAC_CONF_BURST */
+
+/* With phase optimization, we remember when each of our recent
+   neighbors woke up to acknowledge our strobes, and start strobing to
+   a neighbor just before it next wakes up instead of strobing for a
+   whole cycle. A packet waits for the neighbor in the send queue of
+   burst mode. */
+#ifdef XMAC_CONF_PHASE_OPTIMIZATION
+#define WITH_PHASE_OPTIMIZATION XMAC_CONF_PHASE_OPTIMIZATION
+#else /* XMAC_CONF_PHASE_OPTIMIZATION */
+#define WITH_PHASE_OPTIMIZATION WITH_BURST
+#endif /* XMAC_CONF_PHASE_OPTIMIZATION */
+
+#if WITH_PHASE_OPTIMIZATION && !WITH_BURST
+#error XMAC_CONF_PHASE_OPTIMIZATION needs XMAC_CONF_BURST
+#endif
+
+/* The maximum number of packets that are queued for one receiver. */
+#ifdef XMAC_CONF_BURST_LEN
+#define BURST_LEN XMAC_CONF_BURST_LEN
+#else /* XMAC_CONF_BURST_LEN */
+#define BURST_LEN 4
+#endif /* XMAC_CONF_BURST_LEN */
+
+#ifdef QUEUEBUF_CONF_NUM
+#if QUEUEBUF_CONF_NUM < 2
+#define MAX_QUEUED_PACKETS 1
+#else /* QUEUEBUF_CONF_NUM < 2 */
+#define MAX_QUEUED_PACKETS (QUEUEBUF_CONF_NUM / 2)
+#endif /* QUEUEBUF_CONF_NUM < 2 */
+#else /* QUEUEBUF_CONF_NUM */
+#define MAX_QUEUED_PACKETS 4
+#endif /* QUEUEBUF_CONF_NUM */
+
 struct announcement_data {
   uint16_t id;
   uint16_t value;
@@ -84,8 +128,11 @@ struct announcement_msg {
 #define TYPE_ANNOUNCEMENT 2
 #define TYPE_STROBE_ACK   3
 
+#define FLAG_MORE         0x01
+
 struct xmac_hdr {
-  uint16_t type;
+  uint8_t type;
+  uint8_t flags;
   rimeaddr_t sender;
   rimeaddr_t receiver;
 };
@@ -118,6 +165,60 @@ struct xmac_config xmac_config = {
   DEFAULT_STROBE_WAIT_TIME
 };
 
+#if WITH_PHASE_OPTIMIZATION
+
+#ifdef XMAC_CONF_MAX_PHASES
+#define MAX_PHASES XMAC_CONF_MAX_PHASES
+#else /* XMAC_CONF_MAX_PHASES */
+#define MAX_PHASES 8
+#endif /* XMAC_CONF_MAX_PHASES */
+
+/* A phase is forgotten after this many seconds. It must be less
+   than half the wrap-around time of clock_time(). */
+#ifdef XMAC_CONF_PHASE_MAX_AGE
+#define PHASE_MAX_AGE XMAC_CONF_PHASE_MAX_AGE
+#else /* XMAC_CONF_PHASE_MAX_AGE */
+#define PHASE_MAX_AGE 240
+#endif /* XMAC_CONF_PHASE_MAX_AGE */
+
+/* We start strobing this long before the neighbor is expected to
+   wake up, to cover the time between two strobes, plus the time that
+   the clocks may have drifted apart: one tick per 2^PHASE_DRIFT_SHIFT
+   ticks, about 60 ppm. */
+#define PHASE_GUARD_TIME (2 * xmac_config.on_time)
+#define PHASE_DRIFT_SHIFT 14
+
+struct phase {
+  rimeaddr_t neighbor;
+  /* The time at which we sent the strobe that the neighbor
+     acknowledged, in rtimer ticks and in clock ticks. */
+  rtimer_clock_t time;
+  clock_time_t clock;
+};
+
+static struct phase phases_mem[MAX_PHASES];
+ADDRTABLE(phases, struct phase, phases_mem, neighbor);
+
+/* Set while the packet at the head of the queue waits for its
+   receiver to wake up. */
+static uint8_t waiting_for_phase;
+#endif /* WITH_PHASE_OPTIMIZATION */
+
+#if WITH_BURST
+/* Give the receiver time to read a packet out of its radio before we
+   send the next packet of a burst. */
+#define BURST_GAP (RTIMER_ARCH_SECOND / 1000)
+
+struct queued_packet {
+  struct queued_packet *next;
+  struct queuebuf *buf;
+};
+
+MEMB(queued_packets_memb, struct queued_packet, MAX_QUEUED_PACKETS);
+LIST(queued_packets);
+static struct ctimer send_timer;
+#endif /* WITH_BURST */
+
 #include <stdio.h>
 static struct rtimer rt;
 static struct pt pt;
@@ -341,6 +442,135 @@ format_announcement(char *hdr)
   }
 }
 #endif /* XMAC_CONF_ANNOUNCEMENTS */
+#if WITH_PHASE_OPTIMIZATION
+/*---------------------------------------------------------------------------*/
+static void
+phase_update(const rimeaddr_t *neighbor, rtimer_clock_t time)
+{
+  struct phase *p;
+
+  p = addrtable_find(&phases, neighbor);
+  if(p == NULL) {
+    p = addrtable_add(&phases, neighbor);
+  } else {
+    addrtable_refresh(&phases, p);
+  }
+  p->time = time;
+  p->clock = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+static void
+phase_remove(const rimeaddr_t *neighbor)
+{
+  struct phase *p;
+
+  p = addrtable_find(&phases, neighbor);
+  if(p != NULL) {
+    addrtable_remove(&phases, p);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns how long to wait before we start strobing to a neighbor, or
+   zero if we do not know when it wakes up. */
+static rtimer_clock_t
+phase_wait(const rimeaddr_t *neighbor)
+{
+  struct phase *p;
+  uint32_t elapsed;
+  rtimer_clock_t now, cycle, guard, until;
+
+  p = addrtable_find(&phases, neighbor);
+  if(p == NULL || addrtable_expire(&phases, p)) {
+    return 0;
+  }
+
+  /* The rtimer wraps around every few seconds, so we first estimate
+     the time since the neighbor woke up with the clock, and then use
+     the rtimer to get it exact. */
+  now = RTIMER_NOW();
+  elapsed = (uint32_t)(clock_time_t)(clock_time() - p->clock) *
+    RTIMER_ARCH_SECOND / CLOCK_SECOND;
+  elapsed += (int16_t)((rtimer_clock_t)(now - p->time) -
+		       (rtimer_clock_t)elapsed);
+
+  cycle = xmac_config.on_time + xmac_config.off_time;
+  guard = PHASE_GUARD_TIME + (elapsed >> PHASE_DRIFT_SHIFT);
+  if(guard >= cycle / 2) {
+    /* The phase is too uncertain to be of use. */
+    return 0;
+  }
+
+  until = cycle - elapsed % cycle;
+  return until > guard ? until - guard : 0;
+}
+#endif /* WITH_PHASE_OPTIMIZATION */
+/*---------------------------------------------------------------------------*/
+#if WITH_BURST
+/* Returns the oldest packet that is queued for a receiver. Reference
+   queuebufs have no receiver address, so they are never part of a
+   burst: they are sent on their own when they reach the head of the
+   queue. */
+static struct queued_packet *
+next_queued(const rimeaddr_t *receiver)
+{
+  struct queued_packet *q;
+  const rimeaddr_t *addr;
+
+  for(q = list_head(queued_packets); q != NULL; q = q->next) {
+    addr = queuebuf_addr(q->buf, PACKETBUF_ADDR_RECEIVER);
+    if(addr != NULL && rimeaddr_cmp(addr, receiver)) {
+      break;
+    }
+  }
+  return q;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dequeue(struct queued_packet *q)
+{
+  list_remove(queued_packets, q);
+  queuebuf_free(q->buf);
+  memb_free(&queued_packets_memb, q);
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the rest of the packets that are queued for a receiver, after
+   the first packet of the burst has been sent. The receiver is
+   awake, so we need no strobes. */
+static void
+send_burst(const rimeaddr_t *receiver)
+{
+  struct queued_packet *q;
+  struct xmac_hdr hdr;
+  rtimer_clock_t t;
+
+  while((q = next_queued(receiver)) != NULL) {
+    queuebuf_to_packetbuf(q->buf);
+    dequeue(q);
+
+    hdr.type = TYPE_DATA;
+    hdr.flags = next_queued(receiver) != NULL ? FLAG_MORE : 0;
+    rimeaddr_copy(&hdr.sender, &rimeaddr_node_addr);
+    rimeaddr_copy(&hdr.receiver, receiver);
+    packetbuf_hdralloc(sizeof(struct xmac_hdr));
+    memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct xmac_hdr));
+    packetbuf_compact();
+
+    t = RTIMER_NOW();
+    while(RTIMER_CLOCK_LT(RTIMER_NOW(), t + BURST_GAP));
+
+    radio->send(packetbuf_hdrptr(), packetbuf_totlen());
+  }
+
+#if WITH_ACK_OPTIMIZATION
+  if(packetbuf_attr(PACKETBUF_ATTR_RELIABLE) ||
+     packetbuf_attr(PACKETBUF_ATTR_ERELIABLE)) {
+    /* The last packet of the burst needs an upper layer ACK. */
+    on();
+    waiting_for_packet = 1;
+  }
+#endif /* WITH_ACK_OPTIMIZATION */
+}
+#endif /* WITH_BURST */
 /*---------------------------------------------------------------------------*/
 static int
 send_packet(void)
@@ -392,11 +622,17 @@ send_packet(void)
      in-place in the packet buffer, because we cannot be sure of the
      alignment of the header in the packet buffer. */
   hdr.type = TYPE_DATA;
+  hdr.flags = 0;
   rimeaddr_copy(&hdr.sender, &rimeaddr_node_addr);
   rimeaddr_copy(&hdr.receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
   if(rimeaddr_cmp(&hdr.receiver, &rimeaddr_null)) {
     is_broadcast = 1;
   }
+#if WITH_BURST
+  if(next_queued(&hdr.receiver) != NULL) {
+    hdr.flags = FLAG_MORE;
+  }
+#endif /* WITH_BURST */
 
   /* Copy the X-MAC header to the header portion of the packet
      buffer. */
@@ -404,6 +640,8 @@ send_packet(void)
   memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct xmac_hdr));
   packetbuf_compact();
 
+  watchdog_stop();
+
   t0 = RTIMER_NOW();
   strobes = 0;
 
@@ -416,7 +654,6 @@ send_packet(void)
     on();
   }
 
-  watchdog_stop();
   got_strobe_ack = 0;
   for(strobes = 0;
       got_strobe_ack == 0 &&
@@ -426,6 +663,7 @@ send_packet(void)
     t = RTIMER_NOW();
 
     strobe.hdr.type = TYPE_STROBE;
+    strobe.hdr.flags = 0;
     rimeaddr_copy(&strobe.hdr.sender, &rimeaddr_node_addr);
     rimeaddr_copy(&strobe.hdr.receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
 
@@ -481,9 +719,26 @@ send_packet(void)
   if(is_broadcast || got_strobe_ack) {
 
     radio->send(packetbuf_hdrptr(), packetbuf_totlen());
+#if WITH_BURST
+    if(hdr.flags & FLAG_MORE) {
+      send_burst(&hdr.receiver);
+    }
+#endif /* WITH_BURST */
   }
   watchdog_start();
 
+#if WITH_PHASE_OPTIMIZATION
+  /* The receiver woke up shortly before the strobe that it
+     acknowledged, which was sent at time t. */
+  if(!is_broadcast) {
+    if(got_strobe_ack) {
+      phase_update(&hdr.receiver, t);
+    } else {
+      phase_remove(&hdr.receiver);
+    }
+  }
+#endif /* WITH_PHASE_OPTIMIZATION */
+
   PRINTF("xmac: send (strobes=%u,len=%u,%s), done\n", strobes,
 	 packetbuf_totlen(), got_strobe_ack ? "ack" : "no ack");
 
@@ -509,30 +764,120 @@ send_packet(void)
 
 }
 /*---------------------------------------------------------------------------*/
-static struct queuebuf *queued_packet;
+#if WITH_BURST
+/* Sends the oldest queued packet, together with all other packets
+   that are queued for the same receiver. */
+static void
+send_queued(void *ptr)
+{
+  struct queued_packet *q;
+#if WITH_PHASE_OPTIMIZATION
+  const rimeaddr_t *addr;
+  clock_time_t wait;
+#endif /* WITH_PHASE_OPTIMIZATION */
+
+  if(someone_is_sending) {
+    /* Someone else is strobing, so we wait for a cycle and see if
+       they are done. */
+    ctimer_set(&send_timer, (clock_time_t)((uint32_t)CLOCK_SECOND *
+					   (xmac_config.on_time +
+					    xmac_config.off_time) /
+					   RTIMER_ARCH_SECOND) + 1,
+	       send_queued, NULL);
+    return;
+  }
+
+  q = list_head(queued_packets);
+  if(q != NULL) {
+#if WITH_PHASE_OPTIMIZATION
+    /* If we know when the receiver wakes up, we leave the packet in
+       the queue until just before it does, and let the rest of the
+       system run in the meantime. The wait is rounded down to clock
+       ticks, so strobing starts at most a tick early. A packet only
+       waits once, so that a late timer does not make it wait for
+       another cycle. */
+    if(!waiting_for_phase) {
+      addr = queuebuf_addr(q->buf, PACKETBUF_ADDR_RECEIVER);
+      if(addr != NULL && !rimeaddr_cmp(addr, &rimeaddr_null)) {
+	wait = (clock_time_t)((uint32_t)phase_wait(addr) * CLOCK_SECOND /
+			      RTIMER_ARCH_SECOND);
+	if(wait > 0) {
+	  waiting_for_phase = 1;
+	  ctimer_set(&send_timer, wait, send_queued, NULL);
+	  return;
+	}
+      }
+    }
+    waiting_for_phase = 0;
+#endif /* WITH_PHASE_OPTIMIZATION */
+    queuebuf_to_packetbuf(q->buf);
+    dequeue(q);
+    send_packet();
+  }
+
+  if(list_head(queued_packets) != NULL) {
+    ctimer_set(&send_timer, 0, send_queued, NULL);
+  }
+}
+#endif /* WITH_BURST */
+/*---------------------------------------------------------------------------*/
 static int
 qsend_packet(void)
 {
+#if WITH_BURST
+  struct queued_packet *q;
+  const rimeaddr_t *addr;
+  int n;
+
+  /* Queue the packet, and send it when the upper layers are done for
+     now, so that the packets that they send to the same receiver in
+     the meantime go out in the same burst. */
+  n = 0;
+  for(q = list_head(queued_packets); q != NULL; q = q->next) {
+    addr = queuebuf_addr(q->buf, PACKETBUF_ADDR_RECEIVER);
+    if(addr != NULL &&
+       rimeaddr_cmp(addr, packetbuf_addr(PACKETBUF_ADDR_RECEIVER))) {
+      n++;
+    }
+  }
+  if(n >= BURST_LEN) {
+    PRINTF("xmac: too many packets queued for the receiver, dropping.\n");
+    RIMESTATS_ADD(sendingdrop);
+    return 0;
+  }
+
+  q = memb_alloc(&queued_packets_memb);
+  if(q == NULL) {
+    RIMESTATS_ADD(sendingdrop);
+    return 0;
+  }
+  q->buf = queuebuf_new_from_packetbuf();
+  if(q->buf == NULL) {
+    memb_free(&queued_packets_memb, q);
+    RIMESTATS_ADD(sendingdrop);
+    return 0;
+  }
+  list_add(queued_packets, q);
+#if WITH_PHASE_OPTIMIZATION
+  if(waiting_for_phase) {
+    /* The packet goes out when the head of the queue is done
+       waiting. */
+    return 1;
+  }
+#endif /* WITH_PHASE_OPTIMIZATION */
+  ctimer_set(&send_timer, 0, send_queued, NULL);
+  return 1;
+#else /* WITH_BURST */
   if(someone_is_sending) {
-    PRINTF("xmac: should queue packet, now just dropping %d %d %d %d.\n",
+    PRINTF("xmac: someone is sending, dropping %d %d %d %d.\n",
 	   waiting_for_packet, someone_is_sending, we_are_sending, radio_is_on);
-    if(queued_packet != NULL) {
-      RIMESTATS_ADD(sendingdrop);
-      return 0;
-    } else {
-#if WITH_QUEUE
-      queued_packet = queuebuf_new_from_packetbuf();
-      return 1;
-#else
-      RIMESTATS_ADD(sendingdrop);
-      return 0;
-#endif
-    }
+    RIMESTATS_ADD(sendingdrop);
+    return 0;
   } else {
     PRINTF("xmac: send immediately.\n");
     return send_packet();
   }
-
+#endif /* WITH_BURST */
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -578,6 +923,7 @@ read_packet(void)
 	     the same address as both sender and receiver, we flag the
 	     message is a strobe ack. */
 	  msg.type = TYPE_STROBE_ACK;
+	  msg.flags = 0;
 	  rimeaddr_copy(&msg.receiver, &hdr->sender);
 	  rimeaddr_copy(&msg.sender, &hdr->sender);
 	  /* We turn on the radio in anticipation of the incoming
@@ -609,10 +955,17 @@ read_packet(void)
 	 rimeaddr_cmp(&hdr->receiver, &rimeaddr_null)) {
 	/* This is a regular packet that is destined to us or to the
 	   broadcast address. */
-	
-	/* We have received the final packet, so we can go back to being
-	   asleep. */
-	off();
+
+	if(hdr->flags & FLAG_MORE) {
+	  /* The sender has more packets for us, so we stay awake. */
+	  someone_is_sending = 1;
+	  waiting_for_packet = 1;
+	} else {
+	  /* We have received the final packet, so we can go back to
+	     being asleep. */
+	  waiting_for_packet = 0;
+	  off();
+	}
 
 #if XMAC_CONF_COMPOWER
 	/* Accumulate the power consumption for the packet reception. */
@@ -627,15 +980,7 @@ read_packet(void)
 	   for the next packet. */
 	compower_clear(&current_packet);
 #endif /* XMAC_CONF_COMPOWER */
-	
-	waiting_for_packet = 0;
-	
-	/* XXX should set timer to send queued packet later. */
-	if(queued_packet != NULL) {
-	  queuebuf_free(queued_packet);
-	  queued_packet = NULL;
-	}
-	
+
 	return packetbuf_totlen();
       }
 #if XMAC_CONF_ANNOUNCEMENTS
@@ -659,6 +1004,7 @@ send_announcement(void *ptr)
   packetbuf_set_datalen(sizeof(struct xmac_hdr));
   hdr = packetbuf_dataptr();
   hdr->type = TYPE_ANNOUNCEMENT;
+  hdr->flags = 0;
   rimeaddr_copy(&hdr->sender, &rimeaddr_node_addr);
   rimeaddr_copy(&hdr->receiver, &rimeaddr_null);
 
@@ -707,6 +1053,13 @@ xmac_init(const struct radio_driver *d)
   radio_is_on = 0;
   waiting_for_packet = 0;
   PT_INIT(&pt);
+#if WITH_PHASE_OPTIMIZATION
+  addrtable_init(&phases, PHASE_MAX_AGE, NULL);
+#endif /* WITH_PHASE_OPTIMIZATION */
+#if WITH_BURST
+  memb_init(&queued_packets_memb);
+  list_init(queued_packets);
+#endif /* WITH_BURST */
   rtimer_set(&rt, RTIMER_NOW() + xmac_config.off_time, 1,
 	     (void (*)(struct rtimer *, void *))powercycle, NULL);
 
@@ -0,0 +1,392 @@
+/**
+ * \addtogroup addrtable
+ * @{
+ */
+
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Rime address tables, shared by the neighbor and route tables
+ */
+
+#include <string.h>
+
+#include "contiki.h"
+#include "lib/list.h"
+#include "net/rime/addrtable.h"
+#include "net/rime/ctimer.h"
+
+/* The shared timer keeps the seconds counter running and checks
+   TICK_CHECKS entries of each table every TICK_SECONDS. */
+#define TICK_SECONDS 16
+#define TICK_CHECKS  4
+
+#define ENTRY(t, i) ((uint8_t *)(t)->entries + (uint16_t)(i) * (t)->entrysize)
+#define KEY(t, i)   ((rimeaddr_t *)(ENTRY(t, i) + (t)->keyoff))
+#define INDEX(t, e) ((uint8_t)(((uint8_t *)(e) - (uint8_t *)(t)->entries) / (t)->entrysize))
+
+/* The list sentinel. */
+#define HEAD(t) ((t)->size)
+
+LIST(tables);
+
+static struct ctimer timer;
+static uint16_t seconds;
+static clock_time_t last;
+static uint8_t started;
+
+/*---------------------------------------------------------------------------*/
+uint16_t
+addrtable_seconds(void)
+{
+  clock_time_t n;
+
+  n = (clock_time_t)(clock_time() - last) / CLOCK_SECOND;
+  seconds += n;
+  last += n * CLOCK_SECOND;
+  return seconds;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+hash(struct addrtable *t, const rimeaddr_t *addr)
+{
+  uint16_t h;
+  uint8_t i;
+
+  h = 0;
+  for(i = 0; i < sizeof(rimeaddr_t); ++i) {
+    h = (h << 5) + h + addr->u8[i];
+  }
+  h ^= h >> 8;
+  return h & (t->hashsize - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+unlink_entry(struct addrtable *t, uint8_t i)
+{
+  t->newer[t->older[i]] = t->newer[i];
+  t->older[t->newer[i]] = t->older[i];
+}
+/*---------------------------------------------------------------------------*/
+static void
+link_after(struct addrtable *t, uint8_t pos, uint8_t i)
+{
+  t->older[i] = pos;
+  t->newer[i] = t->newer[pos];
+  t->older[t->newer[pos]] = i;
+  t->newer[pos] = i;
+}
+/*---------------------------------------------------------------------------*/
+/* Find the hash slot that points to entry i, or return hashsize if
+   the entry is free. */
+static uint16_t
+find_slot(struct addrtable *t, uint8_t i)
+{
+  uint16_t h;
+
+  for(h = hash(t, KEY(t, i)); t->hash[h] != 0; h = (h + 1) & (t->hashsize - 1)) {
+    if(t->hash[h] == i + 1) {
+      return h;
+    }
+  }
+  return t->hashsize;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_remove(struct addrtable *t, uint16_t h)
+{
+  uint16_t j, home;
+
+  /* Shift later entries of the probe sequence back into the hole so
+     that lookups do not need tombstones. */
+  t->hash[h] = 0;
+  for(j = (h + 1) & (t->hashsize - 1); t->hash[j] != 0;
+      j = (j + 1) & (t->hashsize - 1)) {
+    home = hash(t, KEY(t, t->hash[j] - 1));
+    if(((j - home) & (t->hashsize - 1)) >= ((j - h) & (t->hashsize - 1))) {
+      t->hash[h] = t->hash[j];
+      t->hash[j] = 0;
+      h = j;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_index(struct addrtable *t, uint8_t i, uint16_t h)
+{
+  hash_remove(t, h);
+
+  /* Free entries are kept at the head of the list. */
+  unlink_entry(t, i);
+  link_after(t, HEAD(t), i);
+  t->nfree++;
+}
+/*---------------------------------------------------------------------------*/
+static int
+aged(struct addrtable *t, uint8_t i)
+{
+  return t->maxage != 0 && (uint16_t)(seconds - t->time[i]) >= t->maxage;
+}
+/*---------------------------------------------------------------------------*/
+static void
+drop(struct addrtable *t, uint8_t i, uint16_t h)
+{
+  if(t->removed != NULL) {
+    t->removed(ENTRY(t, i));
+  }
+  remove_index(t, i, h);
+}
+/*---------------------------------------------------------------------------*/
+/* Find the first live entry with the address, starting at hash slot
+   h. Aged entries on the way are dropped. */
+static void *
+find_from(struct addrtable *t, uint16_t h, const rimeaddr_t *addr)
+{
+  uint8_t i;
+
+  while(t->hash[h] != 0) {
+    i = t->hash[h] - 1;
+    if(rimeaddr_cmp(KEY(t, i), addr)) {
+      if(!aged(t, i)) {
+	return ENTRY(t, i);
+      }
+      /* Dropping the entry may shift a later one into slot h. */
+      drop(t, i, h);
+    } else {
+      h = (h + 1) & (t->hashsize - 1);
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+periodic(void *ptr)
+{
+  struct addrtable *t;
+  uint16_t h;
+  uint8_t i, n;
+
+  addrtable_seconds();
+  for(t = list_head(tables); t != NULL; t = t->next) {
+    for(n = 0; n < TICK_CHECKS && n < t->size; ++n) {
+      i = t->hand;
+      t->hand = (i + 1 == t->size) ? 0 : i + 1;
+      if(aged(t, i)) {
+	h = find_slot(t, i);
+	if(h != t->hashsize) {
+	  drop(t, i, h);
+	}
+      }
+    }
+  }
+  ctimer_set(&timer, CLOCK_SECOND * TICK_SECONDS, periodic, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+addrtable_init(struct addrtable *t, uint16_t maxage,
+	       void (* removed)(void *entry))
+{
+  uint8_t i;
+
+  memset(t->hash, 0, t->hashsize);
+  t->older[HEAD(t)] = t->newer[HEAD(t)] = HEAD(t);
+  for(i = 0; i < t->size; ++i) {
+    link_after(t, t->older[HEAD(t)], i);
+  }
+  t->nfree = t->size;
+  t->hand = 0;
+  t->maxage = maxage;
+  t->removed = removed;
+
+  if(!started) {
+    started = 1;
+    list_init(tables);
+    last = clock_time();
+  }
+  /* The table may already be on the list if it is initialized
+     again. */
+  list_remove(tables, t);
+  list_add(tables, t);
+  ctimer_set(&timer, CLOCK_SECOND * TICK_SECONDS, periodic, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+addrtable_set_maxage(struct addrtable *t, uint16_t maxage)
+{
+  t->maxage = maxage;
+}
+/*---------------------------------------------------------------------------*/
+void *
+addrtable_find(struct addrtable *t, const rimeaddr_t *addr)
+{
+  addrtable_seconds();
+  return find_from(t, hash(t, addr), addr);
+}
+/*---------------------------------------------------------------------------*/
+void *
+addrtable_find_next(struct addrtable *t, void *entry)
+{
+  uint16_t h;
+  uint8_t i;
+
+  i = INDEX(t, entry);
+  h = find_slot(t, i);
+  if(h == t->hashsize) {
+    return NULL;
+  }
+  addrtable_seconds();
+  return find_from(t, (h + 1) & (t->hashsize - 1), KEY(t, i));
+}
+/*---------------------------------------------------------------------------*/
+void *
+addrtable_add(struct addrtable *t, const rimeaddr_t *addr)
+{
+  uint16_t h;
+  uint8_t i;
+
+  addrtable_seconds();
+  if(t->nfree == 0) {
+    i = t->newer[HEAD(t)];
+    drop(t, i, find_slot(t, i));
+  }
+  i = t->newer[HEAD(t)];
+  t->nfree--;
+
+  rimeaddr_copy(KEY(t, i), addr);
+  for(h = hash(t, addr); t->hash[h] != 0; h = (h + 1) & (t->hashsize - 1));
+  t->hash[h] = i + 1;
+  t->time[i] = seconds;
+  unlink_entry(t, i);
+  link_after(t, t->older[HEAD(t)], i);
+  return ENTRY(t, i);
+}
+/*---------------------------------------------------------------------------*/
+void
+addrtable_refresh(struct addrtable *t, void *entry)
+{
+  uint8_t i;
+
+  i = INDEX(t, entry);
+  if(find_slot(t, i) != t->hashsize) {
+    t->time[i] = addrtable_seconds();
+    unlink_entry(t, i);
+    link_after(t, t->older[HEAD(t)], i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+addrtable_remove(struct addrtable *t, void *entry)
+{
+  uint16_t h;
+  uint8_t i;
+
+  i = INDEX(t, entry);
+  h = find_slot(t, i);
+  if(h != t->hashsize) {
+    remove_index(t, i, h);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+addrtable_expire(struct addrtable *t, void *entry)
+{
+  uint16_t h;
+  uint8_t i;
+
+  i = INDEX(t, entry);
+  addrtable_seconds();
+  if(aged(t, i)) {
+    h = find_slot(t, i);
+    if(h != t->hashsize) {
+      drop(t, i, h);
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void *
+addrtable_next(struct addrtable *t, void *entry)
+{
+  uint8_t i, next, n;
+
+  if(entry == NULL) {
+    addrtable_seconds();
+    /* Skip the free entries at the head of the list. */
+    i = t->newer[HEAD(t)];
+    for(n = t->nfree; n > 0; --n) {
+      i = t->newer[i];
+    }
+  } else {
+    i = t->newer[INDEX(t, entry)];
+  }
+
+  while(i != HEAD(t)) {
+    next = t->newer[i];
+    if(!aged(t, i)) {
+      return ENTRY(t, i);
+    }
+    drop(t, i, find_slot(t, i));
+    i = next;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+addrtable_num(struct addrtable *t)
+{
+  void *e;
+
+  /* Drop the entries that have aged out, so that the count matches
+     what addrtable_next() returns. */
+  for(e = addrtable_next(t, NULL); e != NULL; e = addrtable_next(t, e));
+  return t->size - t->nfree;
+}
+/*---------------------------------------------------------------------------*/
+int
+addrtable_full(struct addrtable *t)
+{
+  uint8_t i;
+
+  if(t->nfree == 0) {
+    i = t->newer[HEAD(t)];
+    addrtable_seconds();
+    if(aged(t, i)) {
+      drop(t, i, find_slot(t, i));
+    }
+  }
+  return t->nfree == 0;
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,208 @@
+/**
+ * \addtogroup rime
+ * @{
+ */
+
+/**
+ * \defgroup addrtable Address tables
+ * @{
+ *
+ * The addrtable module indexes tables of entries, such as the
+ * neighbor table and the route table, by Rime address.
+ *
+ */
+
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Header file for the Rime address tables
+ */
+
+#ifndef __ADDRTABLE_H__
+#define __ADDRTABLE_H__
+
+#include <stddef.h>
+
+#include "net/rime/rimeaddr.h"
+
+/*
+ * An address table maps Rime addresses to entries of a
+ * caller-provided array of structures. The structures are never
+ * moved, so pointers to them stay valid until the entry is removed
+ * or reused. Several entries may have the same address.
+ *
+ * Lookups go through an open-addressed hash table indexed by the
+ * address. Entries are kept in a list ordered by when they were last
+ * added or refreshed; a new entry takes a free entry if there is one
+ * and otherwise evicts the least recently added or refreshed one.
+ *
+ * Entries age lazily: each entry is stamped with the time, in
+ * seconds, when it is added or refreshed, and an entry that is older
+ * than the maximum age of its table is dropped when it is next looked
+ * at. A slow timer, shared by all tables, checks a few entries per
+ * tick so that entries that are never looked at are dropped before
+ * the 16-bit timestamps wrap around.
+ *
+ * A table holds at most 255 entries.
+ */
+
+/**
+ * The size of the hash table for a table of n entries: a power of
+ * two that is at least twice as large as the table.
+ *
+ * \hideinitializer
+ */
+#define ADDRTABLE_HASHSIZE(n) ((n) <= 2 ? 4 : (n) <= 4 ? 8 :          \
+                               (n) <= 8 ? 16 : (n) <= 16 ? 32 :       \
+                               (n) <= 32 ? 64 : (n) <= 64 ? 128 :     \
+                               (n) <= 128 ? 256 : 512)
+
+struct addrtable {
+  struct addrtable *next;
+  void *entries;
+  uint16_t entrysize;
+  uint16_t keyoff;
+  uint8_t size;
+  uint8_t nfree;
+  uint8_t hand;
+  uint16_t hashsize;
+  uint16_t maxage;
+  uint8_t *hash;
+  uint8_t *older, *newer;
+  uint16_t *time;
+  void (* removed)(void *entry);
+};
+
+/**
+ * Declare an address table.
+ *
+ * \param name The name of the table.
+ *
+ * \param structure The type of the entries.
+ *
+ * \param entries An array of structures that holds the table's
+ * entries. The array must be declared before the table.
+ *
+ * \param field The name of the rimeaddr_t field of the structure
+ * that holds the address of an entry.
+ *
+ * \hideinitializer
+ */
+#define ADDRTABLE(name, structure, entries, field)                      \
+  static uint8_t name##_hash[ADDRTABLE_HASHSIZE(sizeof(entries) /       \
+                                                sizeof(entries[0]))];   \
+  static uint8_t name##_older[sizeof(entries) / sizeof(entries[0]) + 1]; \
+  static uint8_t name##_newer[sizeof(entries) / sizeof(entries[0]) + 1]; \
+  static uint16_t name##_time[sizeof(entries) / sizeof(entries[0])];    \
+  static struct addrtable name = {                                      \
+    NULL, entries, sizeof(entries[0]), offsetof(structure, field),      \
+    sizeof(entries) / sizeof(entries[0]), 0, 0,                         \
+    ADDRTABLE_HASHSIZE(sizeof(entries) / sizeof(entries[0])),           \
+    0, name##_hash, name##_older, name##_newer, name##_time, NULL }
+
+/**
+ * \brief      Initialize an address table, removing all entries
+ * \param t    The table
+ * \param maxage The maximum age of an entry, in seconds. Zero means
+ *             that entries never age.
+ * \param removed A function that is called with an entry before the
+ *             table drops it on its own, because it aged out or was
+ *             evicted. May be NULL.
+ */
+void addrtable_init(struct addrtable *t, uint16_t maxage,
+		    void (* removed)(void *entry));
+
+void addrtable_set_maxage(struct addrtable *t, uint16_t maxage);
+
+/**
+ * \brief      Find the first entry with an address
+ * \return     The entry, or NULL if there is none
+ */
+void *addrtable_find(struct addrtable *t, const rimeaddr_t *addr);
+
+/**
+ * \brief      Find the next entry with the same address as an entry
+ * \return     The entry, or NULL if there is none
+ */
+void *addrtable_find_next(struct addrtable *t, void *entry);
+
+/**
+ * \brief      Add an entry for an address
+ * \return     The entry
+ *
+ *             A free entry is used if there is one, otherwise the
+ *             least recently added or refreshed entry is evicted.
+ *             Only the address field of the entry is set; the caller
+ *             fills in the rest. An existing entry for the address
+ *             is not looked for.
+ */
+void *addrtable_add(struct addrtable *t, const rimeaddr_t *addr);
+
+void addrtable_refresh(struct addrtable *t, void *entry);
+void addrtable_remove(struct addrtable *t, void *entry);
+
+/**
+ * \brief      Check if an entry has aged out, and drop it if it has
+ * \return     Non-zero if the entry was dropped
+ */
+int addrtable_expire(struct addrtable *t, void *entry);
+
+/**
+ * \brief      Iterate over the entries of a table
+ * \param entry The previous entry, or NULL to get the first one
+ * \return     The next entry, or NULL if there are no more
+ *
+ *             Entries are returned from the least to the most
+ *             recently added or refreshed one.
+ */
+void *addrtable_next(struct addrtable *t, void *entry);
+
+int addrtable_num(struct addrtable *t);
+
+/**
+ * \brief      Check if adding an entry would evict another one
+ *
+ *             The least recently added or refreshed entry is dropped
+ *             first if it has aged out.
+ */
+int addrtable_full(struct addrtable *t);
+
+/**
+ * \brief      The time that entries are stamped with, in seconds
+ */
+uint16_t addrtable_seconds(void);
+
+#endif /* __ADDRTABLE_H__ */
+/** @} */
+/** @} */
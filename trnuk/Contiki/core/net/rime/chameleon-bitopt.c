@@ -216,14 +216,351 @@ printhdr(uint8_t *hdr, int len)
 }
 #endif
 /*---------------------------------------------------------------------------*/
+/*
+ * Pack one attribute into the header. This produces the same bits as
+ * set_bits(), but handles the field sizes that the Rime primitives
+ * use without going through set_bits_in_byte() for each byte: a field
+ * of at most eight bits is one shift of a 16-bit word and a whole
+ * number of bytes is copied, or shifted byte by byte if it is not
+ * byte aligned.
+ */
+static void
+pack_field(uint8_t *ptr, int bitpos, const uint8_t *val, int vallen)
+{
+  uint16_t shifted_val;
+  int i;
+
+  if(vallen <= 8) {
+    shifted_val = val[0] << (16 - bitpos - vallen);
+    ptr[0] |= shifted_val >> 8;
+    if(bitpos + vallen > 8) {
+      ptr[1] |= shifted_val & 0xff;
+    }
+  } else if((vallen & 7) != 0) {
+    set_bits(ptr, bitpos, (uint8_t *)val, vallen);
+  } else if(bitpos == 0) {
+    for(i = 0; i < vallen / 8; ++i) {
+      ptr[i] = val[i];
+    }
+  } else {
+    for(i = 0; i < vallen / 8; ++i) {
+      ptr[i] |= val[i] >> bitpos;
+      ptr[i + 1] |= val[i] << (8 - bitpos);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Unpack one attribute from the header, with the same result as
+ * get_bits().
+ */
+static void
+unpack_field(uint8_t *to, const uint8_t *from, int bitpos, int vallen)
+{
+  uint16_t shifted_val;
+  int i;
+
+  if(vallen <= 8) {
+    shifted_val = (from[0] << 8) | from[1];
+    to[0] = (shifted_val >> (16 - bitpos - vallen)) & (0xff >> (8 - vallen));
+  } else if((vallen & 7) != 0) {
+    get_bits(to, (uint8_t *)from, bitpos, vallen);
+  } else if(bitpos == 0) {
+    for(i = 0; i < vallen / 8; ++i) {
+      to[i] = from[i];
+    }
+  } else {
+    for(i = 0; i < vallen / 8; ++i) {
+      to[i] = (from[i] << bitpos) | (from[i + 1] >> (8 - bitpos));
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#ifdef CHAMELEON_BITOPT_CONF_CODECS
+#define CODECS CHAMELEON_BITOPT_CONF_CODECS
+#else /* CHAMELEON_BITOPT_CONF_CODECS */
+#define CODECS 1
+#endif /* CHAMELEON_BITOPT_CONF_CODECS */
+
+#if CODECS
+/*
+ * Codecs for the attribute lists of the Rime primitives. A codec
+ * packs and unpacks the fields of its list at constant bit positions,
+ * without walking the list, so that the compiler can reduce each
+ * field to its shifts. The encoding is that of pack_header() and
+ * unpack_header().
+ *
+ * Each codec has its list spelled out below, and is only bound to a
+ * channel whose attribute list is equal to it. If the attributes of a
+ * primitive change, its channels fall back to the generic code until
+ * the codec is updated.
+ */
+#define ADDR PACKETBUF_ADDRSIZE
+
+static const struct packetbuf_attrlist broadcast_attrs[] = {
+  { PACKETBUF_ADDR_SENDER, ADDR },
+  PACKETBUF_ATTR_LAST
+};
+static const struct packetbuf_attrlist unicast_attrs[] = {
+  { PACKETBUF_ADDR_RECEIVER, ADDR },
+  { PACKETBUF_ADDR_SENDER, ADDR },
+  PACKETBUF_ATTR_LAST
+};
+static const struct packetbuf_attrlist runicast_attrs[] = {
+  { PACKETBUF_ATTR_PACKET_TYPE, 1 },
+  { PACKETBUF_ATTR_PACKET_ID, 2 },
+  { PACKETBUF_ATTR_MAC_ACK_EXPECTED, 1 },
+  { PACKETBUF_ADDR_RECEIVER, ADDR },
+  { PACKETBUF_ADDR_SENDER, ADDR },
+  PACKETBUF_ATTR_LAST
+};
+static const struct packetbuf_attrlist trickle_attrs[] = {
+  { PACKETBUF_ATTR_EPACKET_ID, 8 },
+  { PACKETBUF_ADDR_SENDER, ADDR },
+  PACKETBUF_ATTR_LAST
+};
+static const struct packetbuf_attrlist multihop_attrs[] = {
+  { PACKETBUF_ADDR_ESENDER, ADDR },
+  { PACKETBUF_ADDR_ERECEIVER, ADDR },
+  { PACKETBUF_ATTR_HOPS, 5 },
+  { PACKETBUF_ADDR_RECEIVER, ADDR },
+  { PACKETBUF_ADDR_SENDER, ADDR },
+  PACKETBUF_ATTR_LAST
+};
+static const struct packetbuf_attrlist collect_attrs[] = {
+  { PACKETBUF_ADDR_ESENDER, ADDR },
+  { PACKETBUF_ATTR_EPACKET_ID, 4 },
+  { PACKETBUF_ATTR_TTL, 4 },
+  { PACKETBUF_ATTR_HOPS, 4 },
+  { PACKETBUF_ATTR_MAX_REXMIT, 3 },
+  { PACKETBUF_ATTR_PACKET_TYPE, 1 },
+  { PACKETBUF_ATTR_PACKET_ID, 2 },
+  { PACKETBUF_ATTR_MAC_ACK_EXPECTED, 1 },
+  { PACKETBUF_ADDR_RECEIVER, ADDR },
+  { PACKETBUF_ADDR_SENDER, ADDR },
+  PACKETBUF_ATTR_LAST
+};
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+pack_attr(uint8_t *hdr, int bitpos, uint8_t type, int len)
+{
+  packetbuf_attr_t attr;
+
+  attr = packetbuf_attr(type);
+  pack_field(&hdr[bitpos >> 3], bitpos & 7, (const uint8_t *)&attr, len);
+}
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+pack_addr(uint8_t *hdr, int bitpos, uint8_t type)
+{
+  pack_field(&hdr[bitpos >> 3], bitpos & 7,
+	     (const uint8_t *)packetbuf_addr(type), ADDR);
+}
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+unpack_attr(const uint8_t *hdr, int bitpos, uint8_t type, int len)
+{
+  packetbuf_attr_t attr;
+
+  attr = 0;
+  unpack_field((uint8_t *)&attr, &hdr[bitpos >> 3], bitpos & 7, len);
+  packetbuf_set_attr(type, attr);
+}
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+unpack_addr(const uint8_t *hdr, int bitpos, uint8_t type)
+{
+  rimeaddr_t addr;
+
+  unpack_field((uint8_t *)&addr, &hdr[bitpos >> 3], bitpos & 7, ADDR);
+  packetbuf_set_addr(type, &addr);
+}
+/*---------------------------------------------------------------------------*/
+/* The fields of a primitive followed by those of the primitive below
+   it, as in the *_ATTRIBUTES macros. */
+static CC_INLINE void
+pack_broadcast_at(uint8_t *hdr, int bitpos)
+{
+  pack_addr(hdr, bitpos, PACKETBUF_ADDR_SENDER);
+}
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+pack_unicast_at(uint8_t *hdr, int bitpos)
+{
+  pack_addr(hdr, bitpos, PACKETBUF_ADDR_RECEIVER);
+  pack_broadcast_at(hdr, bitpos + ADDR);
+}
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+pack_runicast_at(uint8_t *hdr, int bitpos)
+{
+  pack_attr(hdr, bitpos, PACKETBUF_ATTR_PACKET_TYPE, 1);
+  pack_attr(hdr, bitpos + 1, PACKETBUF_ATTR_PACKET_ID, 2);
+  pack_attr(hdr, bitpos + 3, PACKETBUF_ATTR_MAC_ACK_EXPECTED, 1);
+  pack_unicast_at(hdr, bitpos + 4);
+}
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+unpack_broadcast_at(const uint8_t *hdr, int bitpos)
+{
+  unpack_addr(hdr, bitpos, PACKETBUF_ADDR_SENDER);
+}
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+unpack_unicast_at(const uint8_t *hdr, int bitpos)
+{
+  unpack_addr(hdr, bitpos, PACKETBUF_ADDR_RECEIVER);
+  unpack_broadcast_at(hdr, bitpos + ADDR);
+}
+/*---------------------------------------------------------------------------*/
+static CC_INLINE void
+unpack_runicast_at(const uint8_t *hdr, int bitpos)
+{
+  unpack_attr(hdr, bitpos, PACKETBUF_ATTR_PACKET_TYPE, 1);
+  unpack_attr(hdr, bitpos + 1, PACKETBUF_ATTR_PACKET_ID, 2);
+  unpack_attr(hdr, bitpos + 3, PACKETBUF_ATTR_MAC_ACK_EXPECTED, 1);
+  unpack_unicast_at(hdr, bitpos + 4);
+}
+/*---------------------------------------------------------------------------*/
+static void
+pack_broadcast(uint8_t *hdr)
+{
+  pack_broadcast_at(hdr, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+unpack_broadcast(const uint8_t *hdr)
+{
+  unpack_broadcast_at(hdr, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+pack_unicast(uint8_t *hdr)
+{
+  pack_unicast_at(hdr, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+unpack_unicast(const uint8_t *hdr)
+{
+  unpack_unicast_at(hdr, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+pack_runicast(uint8_t *hdr)
+{
+  pack_runicast_at(hdr, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+unpack_runicast(const uint8_t *hdr)
+{
+  unpack_runicast_at(hdr, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+pack_trickle(uint8_t *hdr)
+{
+  pack_attr(hdr, 0, PACKETBUF_ATTR_EPACKET_ID, 8);
+  pack_broadcast_at(hdr, 8);
+}
+/*---------------------------------------------------------------------------*/
+static void
+unpack_trickle(const uint8_t *hdr)
+{
+  unpack_attr(hdr, 0, PACKETBUF_ATTR_EPACKET_ID, 8);
+  unpack_broadcast_at(hdr, 8);
+}
+/*---------------------------------------------------------------------------*/
+static void
+pack_multihop(uint8_t *hdr)
+{
+  pack_addr(hdr, 0, PACKETBUF_ADDR_ESENDER);
+  pack_addr(hdr, ADDR, PACKETBUF_ADDR_ERECEIVER);
+  pack_attr(hdr, 2 * ADDR, PACKETBUF_ATTR_HOPS, 5);
+  pack_unicast_at(hdr, 2 * ADDR + 5);
+}
+/*---------------------------------------------------------------------------*/
+static void
+unpack_multihop(const uint8_t *hdr)
+{
+  unpack_addr(hdr, 0, PACKETBUF_ADDR_ESENDER);
+  unpack_addr(hdr, ADDR, PACKETBUF_ADDR_ERECEIVER);
+  unpack_attr(hdr, 2 * ADDR, PACKETBUF_ATTR_HOPS, 5);
+  unpack_unicast_at(hdr, 2 * ADDR + 5);
+}
+/*---------------------------------------------------------------------------*/
+static void
+pack_collect(uint8_t *hdr)
+{
+  pack_addr(hdr, 0, PACKETBUF_ADDR_ESENDER);
+  pack_attr(hdr, ADDR, PACKETBUF_ATTR_EPACKET_ID, 4);
+  pack_attr(hdr, ADDR + 4, PACKETBUF_ATTR_TTL, 4);
+  pack_attr(hdr, ADDR + 8, PACKETBUF_ATTR_HOPS, 4);
+  pack_attr(hdr, ADDR + 12, PACKETBUF_ATTR_MAX_REXMIT, 3);
+  pack_runicast_at(hdr, ADDR + 15);
+}
+/*---------------------------------------------------------------------------*/
+static void
+unpack_collect(const uint8_t *hdr)
+{
+  unpack_addr(hdr, 0, PACKETBUF_ADDR_ESENDER);
+  unpack_attr(hdr, ADDR, PACKETBUF_ATTR_EPACKET_ID, 4);
+  unpack_attr(hdr, ADDR + 4, PACKETBUF_ATTR_TTL, 4);
+  unpack_attr(hdr, ADDR + 8, PACKETBUF_ATTR_HOPS, 4);
+  unpack_attr(hdr, ADDR + 12, PACKETBUF_ATTR_MAX_REXMIT, 3);
+  unpack_runicast_at(hdr, ADDR + 15);
+}
+/*---------------------------------------------------------------------------*/
+static const struct {
+  const struct packetbuf_attrlist *attrlist;
+  struct chameleon_codec codec;
+} codecs[] = {
+  { broadcast_attrs, { pack_broadcast, unpack_broadcast } },
+  { unicast_attrs, { pack_unicast, unpack_unicast } },
+  { runicast_attrs, { pack_runicast, unpack_runicast } },
+  { trickle_attrs, { pack_trickle, unpack_trickle } },
+  { multihop_attrs, { pack_multihop, unpack_multihop } },
+  { collect_attrs, { pack_collect, unpack_collect } },
+};
+/*---------------------------------------------------------------------------*/
+static int
+same_attrlist(const struct packetbuf_attrlist *a,
+	      const struct packetbuf_attrlist *b)
+{
+  for(; a->type == b->type && a->len == b->len; ++a, ++b) {
+    if(a->type == PACKETBUF_ATTR_NONE) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Called by channel_set_attributes() to bind a codec to a channel. */
+static const struct chameleon_codec *
+header_codec(const struct packetbuf_attrlist *a)
+{
+  int i;
+
+  for(i = 0; i < (int)(sizeof(codecs) / sizeof(codecs[0])); ++i) {
+    if(same_attrlist(a, codecs[i].attrlist)) {
+      return &codecs[i].codec;
+    }
+  }
+  return NULL;
+}
+#endif /* CODECS */
+/*---------------------------------------------------------------------------*/
 static int
 pack_header(struct channel *c)
 {
   const struct packetbuf_attrlist *a;
   int hdrbytesize;
-  int byteptr, bitptr, len;
+  int bitptr, len;
   uint8_t *hdrptr;
   struct bitopt_hdr *hdr;
+  const uint8_t *val;
+  packetbuf_attr_t attr;
   
   /* Compute the total size of the final header by summing the size of
      all attributes that are used on this channel. */
@@ -233,38 +570,31 @@ pack_header(struct channel *c)
   hdrptr = packetbuf_hdrptr();
   memset(hdrptr, 0, hdrbytesize);
   
-  byteptr = bitptr = 0;
+  bitptr = 0;
   
-  for(a = c->attrlist; a->type != PACKETBUF_ATTR_NONE; ++a) {
-    PRINTF("%d.%d: pack_header type %s, len %d, bitptr %d, ",
-	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-	   packetbuf_attr_strings[a->type], a->len, bitptr);
-    /*    len = (a->len & 0xf8) + ((a->len & 7) ? 8: 0);*/
-    len = a->len;
-    byteptr = bitptr / 8;
-    if(a->type == PACKETBUF_ADDR_SENDER ||
-       a->type == PACKETBUF_ADDR_RECEIVER ||
-       a->type == PACKETBUF_ADDR_ESENDER ||
-       a->type == PACKETBUF_ADDR_ERECEIVER) {
-      set_bits(&hdrptr[byteptr], bitptr & 7,
-	       (uint8_t *)packetbuf_addr(a->type), len);
-      PRINTF("address %d.%d\n",
-	    /*	    rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],*/
-	    ((uint8_t *)packetbuf_addr(a->type))[0],
-	    ((uint8_t *)packetbuf_addr(a->type))[1]);
-    } else {
-      packetbuf_attr_t val;
-      val = packetbuf_attr(a->type);
-      set_bits(&hdrptr[byteptr], bitptr & 7,
-	       (uint8_t *)&val, len);
-      PRINTF("value %d\n",
-	    /*rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],*/
-	    val);
+  if(c->codec != NULL) {
+    c->codec->pack(hdrptr);
+  } else {
+    for(a = c->attrlist; a->type != PACKETBUF_ATTR_NONE; ++a) {
+      PRINTF("%d.%d: pack_header type %s, len %d, bitptr %d, ",
+	     rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	     packetbuf_attr_strings[a->type], a->len, bitptr);
+      /*    len = (a->len & 0xf8) + ((a->len & 7) ? 8: 0);*/
+      len = a->len;
+      if(a->type >= PACKETBUF_ADDR_FIRST) {
+	val = (const uint8_t *)packetbuf_addr(a->type);
+	PRINTF("address %d.%d\n", val[0], val[1]);
+      } else {
+	attr = packetbuf_attr(a->type);
+	val = (const uint8_t *)&attr;
+	PRINTF("value %d\n", attr);
+      }
+      pack_field(&hdrptr[bitptr >> 3], bitptr & 7, val, len);
+      /*    printhdr(hdrptr, hdrbytesize);*/
+      bitptr += len;
     }
-    /*    printhdr(hdrptr, hdrbytesize);*/
-    bitptr += len;
+    /*  printhdr(hdrptr, hdrbytesize);*/
   }
-  /*  printhdr(hdrptr, hdrbytesize);*/
 
   packetbuf_hdralloc(sizeof(struct bitopt_hdr));
   hdr = (struct bitopt_hdr *)packetbuf_hdrptr();
@@ -278,11 +608,13 @@ static struct channel *
 unpack_header(void)
 {
   const struct packetbuf_attrlist *a;
-  int byteptr, bitptr, len;
+  int bitptr, len;
   int hdrbytesize;
   uint8_t *hdrptr;
   struct bitopt_hdr *hdr;
   struct channel *c;
+  rimeaddr_t addr;
+  packetbuf_attr_t val;
   
 
   /* The packet has a header that tells us what channel the packet is
@@ -298,28 +630,27 @@ unpack_header(void)
   hdrptr = packetbuf_dataptr();
   hdrbytesize = c->hdrsize / 8 + ((c->hdrsize & 7) == 0? 0: 1);
   packetbuf_hdrreduce(hdrbytesize);
-  byteptr = bitptr = 0;
+  if(c->codec != NULL) {
+    c->codec->unpack(hdrptr);
+    return c;
+  }
+  bitptr = 0;
   for(a = c->attrlist; a->type != PACKETBUF_ATTR_NONE; ++a) {
     PRINTF("%d.%d: unpack_header type %s, len %d, bitptr %d\n",
 	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	   packetbuf_attr_strings[a->type], a->len, bitptr);
     /*    len = (a->len & 0xf8) + ((a->len & 7) ? 8: 0);*/
     len = a->len;
-    byteptr = bitptr / 8;
-    if(a->type == PACKETBUF_ADDR_SENDER ||
-       a->type == PACKETBUF_ADDR_RECEIVER ||
-       a->type == PACKETBUF_ADDR_ESENDER ||
-       a->type == PACKETBUF_ADDR_ERECEIVER) {
-      rimeaddr_t addr;
-      get_bits((uint8_t *)&addr, &hdrptr[byteptr], bitptr & 7, len);
+    if(a->type >= PACKETBUF_ADDR_FIRST) {
+      unpack_field((uint8_t *)&addr, &hdrptr[bitptr >> 3], bitptr & 7, len);
       PRINTF("%d.%d: unpack_header type %s, addr %d.%d\n",
 	     rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	     packetbuf_attr_strings[a->type],
 	     addr.u8[0], addr.u8[1]);
       packetbuf_set_addr(a->type, &addr);
     } else {
-      packetbuf_attr_t val = 0;
-      get_bits((uint8_t *)&val, &hdrptr[byteptr], bitptr & 7, len);
+      val = 0;
+      unpack_field((uint8_t *)&val, &hdrptr[bitptr >> 3], bitptr & 7, len);
 
       packetbuf_set_attr(a->type, val);
       PRINTF("%d.%d: unpack_header type %s, val %d\n",
@@ -337,6 +668,11 @@ CC_CONST_FUNCTION struct chameleon_module chameleon_bitopt = {
   unpack_header,
   pack_header,
   header_size,
+  NULL,
+#if CODECS
+  header_codec
+#else /* CODECS */
   NULL
+#endif /* CODECS */
 };
 /*---------------------------------------------------------------------------*/
@@ -117,6 +117,7 @@ chameleon_input(void)
 	     rimeaddr_node_addr.u8[0],rimeaddr_node_addr.u8[1],
 	     c->channelno);
       packetbuf_set_attr(PACKETBUF_ATTR_CHANNEL, c->channelno);
+      RIMESTATS_INPUT();
       abc_input(c);
     } else {
       PRINTF("%d.%d: chameleon_input channel not found for incoming packet\n",
@@ -141,6 +142,7 @@ chameleon_output(struct channel *c)
     printhdr(packetbuf_hdrptr(), packetbuf_hdrlen());
 #endif /* DEBUG */
     if(ret) {
+      RIMESTATS_OUTPUT();
       rime_output();
       return 1;
     }
@@ -159,3 +161,14 @@ chameleon_hdrsize(const struct packetbuf_attrlist attrlist[])
   }
 }
 /*---------------------------------------------------------------------------*/
+const struct chameleon_codec *
+chameleon_codec(const struct packetbuf_attrlist attrlist[])
+{
+  if(header_module != NULL &&
+     header_module->codec != NULL) {
+    return header_module->codec(attrlist);
+  } else {
+    return NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -46,16 +46,29 @@
 #include "net/rime/chameleon-bitopt.h"
 #include "net/rime/chameleon-raw.h"
 
+/**
+ * Header code specialized for one attribute list. pack() writes the
+ * attributes into the zeroed header at hdr, and unpack() reads them
+ * back into the packetbuf.
+ */
+struct chameleon_codec {
+  void (* pack)(uint8_t *hdr);
+  void (* unpack)(const uint8_t *hdr);
+};
+
 struct chameleon_module {
   struct channel *(* input)(void);
   int (* output)(struct channel *);
   int (* hdrsize)(const struct packetbuf_attrlist *);
   void (* init)(void);
+  const struct chameleon_codec *(* codec)(const struct packetbuf_attrlist *);
 };
 
 void chameleon_init(const struct chameleon_module *header_processing_module);
 
 int chameleon_hdrsize(const struct packetbuf_attrlist attrlist[]);
+const struct chameleon_codec *
+chameleon_codec(const struct packetbuf_attrlist attrlist[]);
 void chameleon_input(void);
 int chameleon_output(struct channel *c);
 
@@ -60,6 +60,7 @@ channel_set_attributes(uint16_t channelno,
   if(c != NULL) {
     c->attrlist = attrlist;
     c->hdrsize = chameleon_hdrsize(attrlist);
+    c->codec = chameleon_codec(attrlist);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -51,7 +51,8 @@ struct channel {
   struct channel *next;
   uint16_t channelno;
   const struct packetbuf_attrlist *attrlist;
-  uint8_t hdrsize;
+  const struct chameleon_codec *codec;
+  uint16_t hdrsize;
 };
 
 struct channel *channel_lookup(uint16_t channelno);
@@ -70,20 +70,49 @@ static const struct packetbuf_attrlist attributes[] =
     PACKETBUF_ATTR_LAST
   };
 
-#define NUM_RECENT_PACKETS 2
+#ifndef COLLECT_CONF_NUM_RECENT_PACKETS
+#define NUM_RECENT_PACKETS 4
+#else
+#define NUM_RECENT_PACKETS COLLECT_CONF_NUM_RECENT_PACKETS
+#endif /* COLLECT_CONF_NUM_RECENT_PACKETS */
 
 struct recent_packet {
   rimeaddr_t originator;
   uint8_t seqno;
+  uint8_t hops;
 };
 
 static struct recent_packet recent_packets[NUM_RECENT_PACKETS];
 static uint8_t recent_packet_ptr;
 
 #define FORWARD_PACKET_LIFETIME (CLOCK_SECOND * 16)
+#ifndef COLLECT_CONF_MAX_FORWARDING_QUEUE
 #define MAX_FORWARDING_QUEUE 4
+#else
+#define MAX_FORWARDING_QUEUE COLLECT_CONF_MAX_FORWARDING_QUEUE
+#endif /* COLLECT_CONF_MAX_FORWARDING_QUEUE */
 PACKETQUEUE(forwarding_queue, MAX_FORWARDING_QUEUE);
 
+/* The forwarding queue is congested when it holds
+   CONGESTION_THRESHOLD packets, and is no longer congested when it
+   has drained below CONGESTION_THRESHOLD - 1 packets. */
+#ifndef COLLECT_CONF_CONGESTION_THRESHOLD
+#define CONGESTION_THRESHOLD (MAX_FORWARDING_QUEUE - MAX_FORWARDING_QUEUE / 4)
+#else
+#define CONGESTION_THRESHOLD COLLECT_CONF_CONGESTION_THRESHOLD
+#endif /* COLLECT_CONF_CONGESTION_THRESHOLD */
+
+/* The congestion bit is advertised together with the rtmetric. */
+#define RTMETRIC_CONGESTED 0x8000
+
+/* A packet that is to be sent to a congested parent is held back for
+   CONGESTION_BACKOFF. */
+#define CONGESTION_BACKOFF (CLOCK_SECOND / 32)
+
+#define THROTTLE_NONE 0
+#define THROTTLE_WAIT 1
+#define THROTTLE_DONE 2
+
 #define SINK 0
 #define RTMETRIC_MAX COLLECT_MAX_DEPTH
 
@@ -103,6 +132,68 @@ PACKETQUEUE(forwarding_queue, MAX_FORWARDING_QUEUE);
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static uint16_t
+advertised_rtmetric(struct collect_conn *tc)
+{
+  if(tc->congested) {
+    return tc->rtmetric | RTMETRIC_CONGESTED;
+  }
+  return tc->rtmetric;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_congestion(struct collect_conn *tc)
+{
+  int len;
+
+  len = list_length(forwarding_queue_list);
+  if((!tc->congested && len >= CONGESTION_THRESHOLD) ||
+     (tc->congested && len < CONGESTION_THRESHOLD - 1)) {
+    tc->congested = !tc->congested;
+    PRINTF("%d.%d: congested %d, queue length %d\n",
+	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	   tc->congested, len);
+#if COLLECT_ANNOUNCEMENTS
+    announcement_set_value(&tc->announcement, advertised_rtmetric(tc));
+#else
+    neighbor_discovery_set_val(&tc->neighbor_discovery_conn,
+			       advertised_rtmetric(tc));
+#endif /* COLLECT_ANNOUNCEMENTS */
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+queued_from(const rimeaddr_t *originator)
+{
+  struct packetqueue_item *i;
+  const rimeaddr_t *addr;
+  int n;
+
+  /* Packets that have been moved out of their queuebuf are not
+     counted. */
+  n = 0;
+  for(i = list_head(forwarding_queue_list); i != NULL; i = i->next) {
+    if(i->buf != NULL) {
+      addr = queuebuf_addr(i->buf, PACKETBUF_ADDR_ESENDER);
+      if(addr != NULL && rimeaddr_cmp(addr, originator)) {
+	++n;
+      }
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void send_queued_packet(void);
+/*---------------------------------------------------------------------------*/
+static void
+throttle_timeout(void *ptr)
+{
+  struct collect_conn *c = ptr;
+
+  c->throttled = THROTTLE_DONE;
+  send_queued_packet();
+}
 /*---------------------------------------------------------------------------*/
 static void
 send_queued_packet(void)
@@ -146,6 +237,22 @@ send_queued_packet(void)
     /* Don't send to the neighbor if it is the same neighbor that sent
        us the packet. */
     if(n != NULL && !rimeaddr_cmp(&n->addr, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
+      /* If the neighbor is congested, we hold the packet back for a
+	 while before sending it. */
+      if(n->congested && c->throttled != THROTTLE_DONE) {
+	if(c->throttled == THROTTLE_NONE) {
+	  PRINTF("%d.%d: %d.%d is congested, holding packet\n",
+		 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+		 n->addr.u8[0], n->addr.u8[1]);
+	  c->throttled = THROTTLE_WAIT;
+	  ctimer_set(&c->t, CONGESTION_BACKOFF, throttle_timeout, c);
+	}
+	return;
+      }
+      if(c->throttled == THROTTLE_WAIT) {
+	ctimer_stop(&c->t);
+      }
+      c->throttled = THROTTLE_NONE;
 #if CONTIKI_TARGET_NETSIM
       ether_set_line(n->addr.u8[0], n->addr.u8[1]);
 #endif /* CONTIKI_TARGET_NETSIM */
@@ -184,7 +291,7 @@ update_rtmetric(struct collect_conn *tc)
 	       rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1]);
       }
       tc->rtmetric = RTMETRIC_MAX;
-      announcement_set_value(&tc->announcement, tc->rtmetric);
+      announcement_set_value(&tc->announcement, advertised_rtmetric(tc));
     } else {
 
       /* We set our rtmetric to the rtmetric of our best neighbor plus
@@ -195,9 +302,10 @@ update_rtmetric(struct collect_conn *tc)
 	tc->rtmetric = n->rtmetric + neighbor_etx(n);
 
 #if !COLLECT_ANNOUNCEMENTS
-	neighbor_discovery_start(&tc->neighbor_discovery_conn, tc->rtmetric);
+	neighbor_discovery_start(&tc->neighbor_discovery_conn,
+				 advertised_rtmetric(tc));
 #else
-	announcement_set_value(&tc->announcement, tc->rtmetric);
+	announcement_set_value(&tc->announcement, advertised_rtmetric(tc));
 #endif /* !COLLECT_ANNOUNCEMENTS */
 
 	PRINTF("%d.%d: new rtmetric %d\n",
@@ -235,10 +343,13 @@ node_packet_received(struct runicast_conn *c, rimeaddr_t *from, uint8_t seqno)
 
   /* To protect against forwarding duplicate packets, we keep a list
      of recently forwarded packet seqnos. If the seqno of the current
-     packet exists in the list, we drop the packet. */
+     packet exists in the list, we drop the packet. The hop count is
+     part of the key, so that a packet that comes back to us through
+     a routing loop is not mistaken for a duplicate. */
 
   for(i = 0; i < NUM_RECENT_PACKETS; i++) {
     if(recent_packets[i].seqno == packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID) &&
+       recent_packets[i].hops == packetbuf_attr(PACKETBUF_ATTR_HOPS) &&
        rimeaddr_cmp(&recent_packets[i].originator,
 		    packetbuf_addr(PACKETBUF_ADDR_ESENDER))) {
       PRINTF("%d.%d: dropping duplicate packet from %d.%d with seqno %d\n",
@@ -250,6 +361,7 @@ node_packet_received(struct runicast_conn *c, rimeaddr_t *from, uint8_t seqno)
     }
   }
   recent_packets[recent_packet_ptr].seqno = packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID);
+  recent_packets[recent_packet_ptr].hops = packetbuf_attr(PACKETBUF_ATTR_HOPS);
   rimeaddr_copy(&recent_packets[recent_packet_ptr].originator,
 		packetbuf_addr(PACKETBUF_ADDR_ESENDER));
   recent_packet_ptr = (recent_packet_ptr + 1) % NUM_RECENT_PACKETS;
@@ -285,8 +397,21 @@ node_packet_received(struct runicast_conn *c, rimeaddr_t *from, uint8_t seqno)
 	   packetbuf_addr(PACKETBUF_ADDR_ESENDER)->u8[1],
 	   from->u8[0], from->u8[1], tc->forwarding);
 
+    /* When we are congested, no originator may hold more than half
+       of the forwarding queue. */
+    if(tc->congested &&
+       queued_from(packetbuf_addr(PACKETBUF_ADDR_ESENDER)) >=
+       MAX_FORWARDING_QUEUE / 2) {
+      PRINTF("%d.%d: congested, dropping packet from %d.%d\n",
+	     rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	     packetbuf_addr(PACKETBUF_ADDR_ESENDER)->u8[0],
+	     packetbuf_addr(PACKETBUF_ADDR_ESENDER)->u8[1]);
+      return;
+    }
+
     if(packetqueue_enqueue_packetbuf(&forwarding_queue, FORWARD_PACKET_LIFETIME,
 				     tc)) {
+      update_congestion(tc);
       send_queued_packet();
     }
   }
@@ -312,6 +437,7 @@ node_packet_sent(struct runicast_conn *c, rimeaddr_t *to, uint8_t transmissions)
 
   /* Remove the first packet on the queue, the packet that was just sent. */
   packetqueue_dequeue(&forwarding_queue);
+  update_congestion(tc);
 
   /* Send the next packet in the queue, if any. */
   send_queued_packet();
@@ -332,6 +458,7 @@ node_packet_timedout(struct runicast_conn *c, rimeaddr_t *to, uint8_t transmissi
 
   /* Remove the first packet on the queue, the packet that just timed out. */
   packetqueue_dequeue(&forwarding_queue);
+  update_congestion(tc);
 
   /* Send the next packet in the queue, if any. */
   send_queued_packet();
@@ -348,13 +475,17 @@ adv_received(struct neighbor_discovery_conn *c, rimeaddr_t *from, uint16_t rtmet
   n = neighbor_find(from);
 
   if(n == NULL) {
-    neighbor_add(from, rtmetric, 1);
+    neighbor_add(from, rtmetric & ~RTMETRIC_CONGESTED, 1);
+    n = neighbor_find(from);
   } else {
-    neighbor_update(n, rtmetric);
+    neighbor_update(n, rtmetric & ~RTMETRIC_CONGESTED);
     PRINTF("%d.%d: updating neighbor %d.%d, etx %d\n",
 	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	   n->addr.u8[0], n->addr.u8[1], rtmetric);
   }
+  if(n != NULL) {
+    n->congested = (rtmetric & RTMETRIC_CONGESTED) != 0;
+  }
 
   update_rtmetric(tc);
 }
@@ -370,16 +501,21 @@ received_announcement(struct announcement *a, rimeaddr_t *from,
   n = neighbor_find(from);
 
   if(n == NULL) {
-    neighbor_add(from, value, 1);
+    neighbor_add(from, value & ~RTMETRIC_CONGESTED, 1);
     PRINTF("%d.%d: new neighbor %d.%d, etx %d\n",
 	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	   from->u8[0], from->u8[1], value);
+    n = neighbor_find(from);
   } else {
-    neighbor_update(n, value);
+    neighbor_update(n, value & ~RTMETRIC_CONGESTED);
     PRINTF("%d.%d: updating neighbor %d.%d, etx %d\n",
 	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	   n->addr.u8[0], n->addr.u8[1], value);
   }
+  if(n != NULL) {
+    /* The neighbor advertises if its forwarding queue is congested. */
+    n->congested = (value & RTMETRIC_CONGESTED) != 0;
+  }
 
   update_rtmetric(tc);  
 }
@@ -407,6 +543,8 @@ collect_open(struct collect_conn *tc, uint16_t channels,
   runicast_open(&tc->runicast_conn, channels + 1, &runicast_callbacks);
   channel_set_attributes(channels + 1, attributes);
   tc->rtmetric = RTMETRIC_MAX;
+  tc->congested = 0;
+  tc->throttled = THROTTLE_NONE;
   tc->cb = cb;
 #if COLLECT_ANNOUNCEMENTS
   announcement_register(&tc->announcement, channels, tc->rtmetric,
@@ -426,6 +564,8 @@ collect_close(struct collect_conn *tc)
   neighbor_discovery_close(&tc->neighbor_discovery_conn);
 #endif /* COLLECT_ANNOUNCEMENTS */
   runicast_close(&tc->runicast_conn);
+  ctimer_stop(&tc->t);
+  tc->throttled = THROTTLE_NONE;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -440,7 +580,7 @@ collect_set_sink(struct collect_conn *tc, int should_be_sink)
     tc->rtmetric = RTMETRIC_MAX;
   }
 #if COLLECT_ANNOUNCEMENTS
-  announcement_set_value(&tc->announcement, tc->rtmetric);
+  announcement_set_value(&tc->announcement, advertised_rtmetric(tc));
 #endif /* COLLECT_ANNOUNCEMENTS */
   update_rtmetric(tc);
 }
@@ -449,6 +589,14 @@ int
 collect_send(struct collect_conn *tc, int rexmits)
 {
   struct neighbor *n;
+
+  /* If our forwarding queue is congested, new packets are refused
+     here rather than dropped somewhere on the way to the sink. */
+  if(tc->congested) {
+    PRINTF("%d.%d: congested, not sending\n",
+	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1]);
+    return 0;
+  }
   
   packetbuf_set_attr(PACKETBUF_ATTR_EPACKET_ID, tc->seqno++);
   packetbuf_set_addr(PACKETBUF_ADDR_ESENDER, &rimeaddr_node_addr);
@@ -475,6 +623,7 @@ collect_send(struct collect_conn *tc, int rexmits)
 	     n->addr.u8[0], n->addr.u8[1]);
       if(packetqueue_enqueue_packetbuf(&forwarding_queue, FORWARD_PACKET_LIFETIME,
 				       tc)) {
+	update_congestion(tc);
 	send_queued_packet();
 	return 1;
       }
@@ -485,6 +634,7 @@ collect_send(struct collect_conn *tc, int rexmits)
       announcement_listen(1);
       if(packetqueue_enqueue_packetbuf(&forwarding_queue, FORWARD_PACKET_LIFETIME,
 				       tc)) {
+	update_congestion(tc);
 	return 1;
       }
     }
@@ -83,6 +83,8 @@ struct collect_conn {
   uint16_t rtmetric;
   uint8_t forwarding;
   uint8_t seqno;
+  uint8_t congested;
+  uint8_t throttled;
 };
 
 void collect_open(struct collect_conn *c, uint16_t channels,
@@ -0,0 +1,179 @@
+/**
+ * \addtogroup dupcache
+ * @{
+ */
+
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         The flood duplicate cache
+ */
+
+#include "contiki.h"
+#include "net/rime/dupcache.h"
+#include "net/rime/rimestats.h"
+
+/* The entries are kept in a ring and are reused in the order they
+   were added. They are found through an open-addressed hash table
+   that holds the index of an entry plus one, or zero for an empty
+   slot. The hash table is at least twice as large as the ring, so
+   lookups stay short. */
+#define HASHSIZE (DUPCACHE_SIZE * 2 + 1)
+
+struct dupcache_entry {
+  rimeaddr_t originator;
+  uint16_t channel;
+  uint16_t seqno;
+  uint16_t time;
+};
+
+static struct dupcache_entry entries[DUPCACHE_SIZE];
+static uint8_t hash[HASHSIZE];
+static uint8_t next, used;
+static uint16_t last_time;
+
+/*---------------------------------------------------------------------------*/
+static uint8_t
+hash_key(uint16_t channel, const rimeaddr_t *originator, uint16_t seqno)
+{
+  uint16_t h;
+  uint8_t i;
+
+  h = channel ^ (seqno * 31);
+  for(i = 0; i < RIMEADDR_SIZE; ++i) {
+    h = h * 31 + originator->u8[i];
+  }
+  return h % HASHSIZE;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+find_slot(uint8_t i)
+{
+  struct dupcache_entry *e = &entries[i];
+  uint8_t h;
+
+  for(h = hash_key(e->channel, &e->originator, e->seqno);
+      hash[h] != i + 1;
+      h = (h + 1) % HASHSIZE);
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+/* Empty a slot of the hash table. Entries that follow it in the same
+   run are moved back, so that lookups can stop at an empty slot. */
+static void
+clear_slot(uint8_t h)
+{
+  uint8_t j, k;
+  struct dupcache_entry *e;
+
+  hash[h] = 0;
+  for(j = (h + 1) % HASHSIZE; hash[j] != 0; j = (j + 1) % HASHSIZE) {
+    e = &entries[hash[j] - 1];
+    k = hash_key(e->channel, &e->originator, e->seqno);
+    /* Move the entry to the empty slot if that slot lies on its
+       probe path, between its home slot k and its current slot j. */
+    if((h < j) ? (k <= h || k > j) : (k <= h && k > j)) {
+      hash[h] = hash[j];
+      hash[j] = 0;
+      h = j;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+dupcache_flush(void)
+{
+  uint8_t h;
+
+  for(h = 0; h < HASHSIZE; ++h) {
+    hash[h] = 0;
+  }
+  next = used = 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+dupcache_check(uint16_t channel, const rimeaddr_t *originator,
+	       uint16_t seqno)
+{
+  struct dupcache_entry *e;
+  uint16_t now;
+  uint8_t h;
+
+  now = (uint16_t)clock_seconds();
+  if((uint16_t)(now - last_time) >= DUPCACHE_LIFETIME) {
+    /* All entries have expired. Flushing them here also keeps the
+       16-bit timestamps from wrapping around. */
+    dupcache_flush();
+  }
+  last_time = now;
+
+  for(h = hash_key(channel, originator, seqno);
+      hash[h] != 0;
+      h = (h + 1) % HASHSIZE) {
+    e = &entries[hash[h] - 1];
+    if(e->seqno == seqno && e->channel == channel &&
+       rimeaddr_cmp(&e->originator, originator)) {
+      if((uint16_t)(now - e->time) < DUPCACHE_LIFETIME) {
+	RIMESTATS_ADD(dupcachehit);
+	return 1;
+      }
+      /* The entry has expired; start over with the flood. */
+      e->time = now;
+      RIMESTATS_ADD(dupcachemiss);
+      return 0;
+    }
+  }
+  RIMESTATS_ADD(dupcachemiss);
+
+  /* Reuse the oldest entry if the ring is full. */
+  if(used == DUPCACHE_SIZE) {
+    clear_slot(find_slot(next));
+  } else {
+    used++;
+  }
+  e = &entries[next];
+  rimeaddr_copy(&e->originator, originator);
+  e->channel = channel;
+  e->seqno = seqno;
+  e->time = now;
+
+  for(h = hash_key(channel, originator, seqno);
+      hash[h] != 0;
+      h = (h + 1) % HASHSIZE);
+  hash[h] = next + 1;
+  next = (next + 1) % DUPCACHE_SIZE;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,97 @@
+/**
+ * \addtogroup rime
+ * @{
+ */
+
+/**
+ * \defgroup dupcache Flood duplicate cache
+ * @{
+ *
+ * The dupcache module remembers the floods that a node has recently
+ * seen, by the originator and sequence number of each flood, so that
+ * a node handles and forwards every flood once. The cache is shared
+ * by all netflood connections, including the route requests of the
+ * route discovery module.
+ *
+ */
+
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Header file for the flood duplicate cache
+ */
+
+#ifndef __DUPCACHE_H__
+#define __DUPCACHE_H__
+
+#include "net/rime/rimeaddr.h"
+
+/* The number of floods remembered, at most 127. */
+#ifdef DUPCACHE_CONF_SIZE
+#define DUPCACHE_SIZE DUPCACHE_CONF_SIZE
+#else
+#define DUPCACHE_SIZE 16
+#endif /* DUPCACHE_CONF_SIZE */
+
+/* An entry is forgotten DUPCACHE_LIFETIME seconds after it was
+   added, so that an originator that has rebooted, or whose sequence
+   numbers have wrapped, is not ignored for long. */
+#ifdef DUPCACHE_CONF_LIFETIME
+#define DUPCACHE_LIFETIME DUPCACHE_CONF_LIFETIME
+#else
+#define DUPCACHE_LIFETIME 8
+#endif /* DUPCACHE_CONF_LIFETIME */
+
+/**
+ * \brief      Check if a flood has been seen, and remember it if not
+ * \param channel The channel that the flood was received on
+ * \param originator The node that started the flood
+ * \param seqno The sequence number of the flood
+ * \return     Non-zero if the flood has been seen within the last
+ *             DUPCACHE_LIFETIME seconds
+ *
+ *             Hits and misses are counted in the dupcachehit and
+ *             dupcachemiss rimestats.
+ */
+int dupcache_check(uint16_t channel, const rimeaddr_t *originator,
+		   uint16_t seqno);
+
+/**
+ * \brief      Forget all floods
+ */
+void dupcache_flush(void);
+
+#endif /* __DUPCACHE_H__ */
+/** @} */
+/** @} */
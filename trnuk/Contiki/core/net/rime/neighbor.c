@@ -47,22 +47,27 @@
 #include <stdio.h>
 
 #include "contiki.h"
-#include "lib/memb.h"
-#include "lib/list.h"
+#include "net/rime/addrtable.h"
 #include "net/rime/neighbor.h"
-#include "net/rime/ctimer.h"
 #include "net/rime/collect.h"
 
+#ifdef NEIGHBOR_CONF_MAX_NEIGHBORS
+#define MAX_NEIGHBORS NEIGHBOR_CONF_MAX_NEIGHBORS
+#else /* NEIGHBOR_CONF_MAX_NEIGHBORS */
 #define MAX_NEIGHBORS 8
+#endif /* NEIGHBOR_CONF_MAX_NEIGHBORS */
 
 #define RTMETRIC_MAX COLLECT_MAX_DEPTH
 
-MEMB(neighbors_mem, struct neighbor, MAX_NEIGHBORS);
-LIST(neighbors_list);
+static struct neighbor neighbors_mem[MAX_NEIGHBORS];
+ADDRTABLE(neighbors, struct neighbor, neighbors_mem, addr);
 
-/*static struct neighbor neighbors[MAX_NEIGHBORS];*/
-
-static struct ctimer t;
+/* The best neighbor is kept as neighbors are added and updated, and
+   is only searched for when it has become worse or has been
+   removed. */
+static struct neighbor *best;
+static uint16_t best_rtmetric;
+static uint8_t best_valid;
 
 static int max_time = 120;
 
@@ -75,61 +80,62 @@ static int max_time = 120;
 #endif
 
 
+/*---------------------------------------------------------------------------*/
+static uint16_t
+path_rtmetric(struct neighbor *n)
+{
+  return n->rtmetric + neighbor_etx(n);
+}
 /*---------------------------------------------------------------------------*/
 static void
-periodic(void *ptr)
-{  
-  struct neighbor *n, *next;
+update_best(struct neighbor *n)
+{
+  uint16_t rtmetric;
 
-  /* Go through all neighbors and remove old ones. */
-  for(n = list_head(neighbors_list); n != NULL; n = next) {
-    next = NULL;
-    /*  for(i = 0; i < MAX_NEIGHBORS; ++i) {*/
-    if(!rimeaddr_cmp(&n->addr, &rimeaddr_null) &&
-       n->time < max_time) {
-      n->time++;
-      if(n->time == max_time) {
-	n->rtmetric = RTMETRIC_MAX;
-	PRINTF("%d.%d: removing old neighbor %d.%d\n",
-	       rimeaddr_node_addr.u8[0],rimeaddr_node_addr.u8[1],
-	       n->addr.u8[0], n->addr.u8[1]);
-	rimeaddr_copy(&n->addr, &rimeaddr_null);
-	next = n->next;
-	list_remove(neighbors_list, n);
-	memb_free(&neighbors_mem, n);
-      }
-    }
-    if(next == NULL) {
-      next = n->next;
+  if(!best_valid) {
+    return;
+  }
+  rtmetric = path_rtmetric(n);
+  if(n == best) {
+    if(rtmetric > best_rtmetric) {
+      /* Another neighbor may now be better. */
+      best_valid = 0;
+    } else {
+      best_rtmetric = rtmetric;
     }
+  } else if(rtmetric < best_rtmetric) {
+    best = n;
+    best_rtmetric = rtmetric;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+removed(void *ptr)
+{
+  struct neighbor *n = ptr;
+
+  PRINTF("%d.%d: removing old neighbor %d.%d\n",
+	 rimeaddr_node_addr.u8[0],rimeaddr_node_addr.u8[1],
+	 n->addr.u8[0], n->addr.u8[1]);
+  n->rtmetric = RTMETRIC_MAX;
+  if(n == best) {
+    best_valid = 0;
   }
-  /*  PRINTF("neighbor periodic\n");*/
-  ctimer_set(&t, CLOCK_SECOND, periodic, NULL);
 }
 /*---------------------------------------------------------------------------*/
 void
 neighbor_init(void)
 {
-  
-  memb_init(&neighbors_mem);
-  list_init(neighbors_list);
-  /*  for(i = 0; i < MAX_NEIGHBORS; ++i) {
-    rimeaddr_copy(&neighbors[i].addr, &rimeaddr_null);
-    }*/
-  
-  ctimer_set(&t, CLOCK_SECOND, periodic, NULL);
+  addrtable_init(&neighbors, max_time, removed);
+  best = NULL;
+  best_rtmetric = RTMETRIC_MAX;
+  best_valid = 1;
 }
 /*---------------------------------------------------------------------------*/
 struct neighbor *
 neighbor_find(rimeaddr_t *addr)
 {
-  struct neighbor *n;
-  for(n = list_head(neighbors_list); n != NULL; n = n->next) {
-    if(rimeaddr_cmp(&n->addr, addr)) {
-      return n;
-    }
-  }
-  return NULL;
+  return addrtable_find(&neighbors, addr);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -137,7 +143,8 @@ neighbor_update(struct neighbor *n, uint8_t rtmetric)
 {
   if(n != NULL) {
     n->rtmetric = rtmetric;
-    n->time = 0;
+    addrtable_refresh(&neighbors, n);
+    update_best(n);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -147,6 +154,7 @@ neighbor_timedout_etx(struct neighbor *n, uint8_t etx)
   if(n != NULL) {
     n->etxs[n->etxptr] += etx;
     n->etxptr = (n->etxptr + 1) % NEIGHBOR_NUM_ETXS;
+    update_best(n);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -156,7 +164,8 @@ neighbor_update_etx(struct neighbor *n, uint8_t etx)
   if(n != NULL) {
     n->etxs[n->etxptr] = etx;
     n->etxptr = (n->etxptr + 1) % NEIGHBOR_NUM_ETXS;
-    n->time = 0;
+    addrtable_refresh(&neighbors, n);
+    update_best(n);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -182,67 +191,55 @@ neighbor_add(rimeaddr_t *addr, uint8_t nrtmetric, uint8_t netx)
 
   PRINTF("neighbor_add: adding %d.%d\n", addr->u8[0], addr->u8[1]);
   
-  /* Check if the neighbor is already on the list. */
-  for(n = list_head(neighbors_list); n != NULL; n = n->next) {
-    if(rimeaddr_cmp(&n->addr, &rimeaddr_null) ||
-       rimeaddr_cmp(&n->addr, addr)) {
-      PRINTF("neighbor_add: already on list %d.%d\n", addr->u8[0], addr->u8[1]);
-      break;
-    }
-  }
+  /* Check if the neighbor is already in the table. */
+  n = addrtable_find(&neighbors, addr);
 
-  /* If the neighbor was not on the list, we try to allocate memory
-     for it. */
-  if(n == NULL) {
-    PRINTF("neighbor_add: not on list, allocating %d.%d\n", addr->u8[0], addr->u8[1]);
-    n = memb_alloc(&neighbors_mem);
-    if(n != NULL) {
-      list_add(neighbors_list, n);
-    }
-  }
-  
-  /* If we could not allocate memory, we try to recycle an old
-     neighbor */
-  if(n == NULL) {
-    PRINTF("neighbor_add: not on list, not allocated, recycling %d.%d\n", addr->u8[0], addr->u8[1]);
-   /* Find the first unused entry or the used entry with the highest
-     rtmetric and highest etx. */
+  /* If the table is full, we try to recycle the neighbor with the
+     highest rtmetric and highest etx. */
+  if(n == NULL && addrtable_full(&neighbors)) {
+    PRINTF("neighbor_add: not in table, table full, recycling %d.%d\n", addr->u8[0], addr->u8[1]);
     rtmetric = 0;
     etx = 0;
     max = NULL;
 
-    for(n = list_head(neighbors_list); n != NULL; n = n->next) {
-      if(!rimeaddr_cmp(&n->addr, &rimeaddr_null)) {
-	if(n->rtmetric > rtmetric) {
+    for(n = addrtable_next(&neighbors, NULL); n != NULL;
+	n = addrtable_next(&neighbors, n)) {
+      if(n->rtmetric > rtmetric) {
+	rtmetric = n->rtmetric;
+	etx = neighbor_etx(n);
+	max = n;
+      } else if(n->rtmetric == rtmetric) {
+	if(neighbor_etx(n) > etx) {
 	  rtmetric = n->rtmetric;
 	  etx = neighbor_etx(n);
 	  max = n;
-	} else if(n->rtmetric == rtmetric) {
-	  if(neighbor_etx(n) > etx) {
-	    rtmetric = n->rtmetric;
-	    etx = neighbor_etx(n);
-	    max = n;
-	    /*	PRINTF("%d: found worst neighbor %d with rtmetric %d, signal %d\n",
-		node_id, neighbors[n].nodeid, rtmetric, signal);*/
-	  }
 	}
       }
     }
-    n = max;
+    /* Looking through the table may have dropped neighbors that had
+       aged out. */
+    if(addrtable_full(&neighbors)) {
+      if(max == NULL) {
+	return;
+      }
+      removed(max);
+      addrtable_remove(&neighbors, max);
+    }
+    n = NULL;
   }
 
+  if(n == NULL) {
+    n = addrtable_add(&neighbors, addr);
+  }
 
-  /*  PRINTF("%d: adding neighbor %d with rtmetric %d, signal %d at %d\n",
-      node_id, neighbors[n].nodeid, rtmetric, signal, n);*/
-  if(n != NULL) {
-    n->time = 0;
-    rimeaddr_copy(&n->addr, addr);
-    n->rtmetric = nrtmetric;
-    for(i = 0; i < NEIGHBOR_NUM_ETXS; ++i) {
-      n->etxs[i] = netx;
-    }
-    n->etxptr = 0;
+  n->rtmetric = nrtmetric;
+  n->congested = 0;
+  for(i = 0; i < NEIGHBOR_NUM_ETXS; ++i) {
+    n->etxs[i] = netx;
   }
+  n->etxptr = 0;
+  addrtable_refresh(&neighbors, n);
+  update_best(n);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -250,51 +247,41 @@ neighbor_remove(rimeaddr_t *addr)
 {
   struct neighbor *n;
 
-  for(n = list_head(neighbors_list); n != NULL; n = n->next) {
-    if(rimeaddr_cmp(&n->addr, addr)) {
-      PRINTF("%d.%d: removing %d.%d\n",
-	     rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-	     addr->u8[0], addr->u8[1]);
-      rimeaddr_copy(&n->addr, &rimeaddr_null);
-      n->rtmetric = RTMETRIC_MAX;
-      list_remove(neighbors_list, n);
-      memb_free(&neighbors_mem, n);
-      return;
+  n = addrtable_find(&neighbors, addr);
+  if(n != NULL) {
+    PRINTF("%d.%d: removing %d.%d\n",
+	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	   addr->u8[0], addr->u8[1]);
+    n->rtmetric = RTMETRIC_MAX;
+    if(n == best) {
+      best_valid = 0;
     }
+    addrtable_remove(&neighbors, n);
   }
-  /*  int i;
-
-  for(i = 0; i < MAX_NEIGHBORS; ++i) {
-    if(rimeaddr_cmp(&neighbors[i].addr, addr)) {
-      PRINTF("%d: removing %d @ %d\n", rimeaddr_node_addr.u16[0], addr->u16[0], i);
-      rimeaddr_copy(&neighbors[i].addr, &rimeaddr_null);
-      neighbors[i].rtmetric = RTMETRIC_MAX;
-      return;
-    }
-    }*/
 }
 /*---------------------------------------------------------------------------*/
 struct neighbor *
 neighbor_best(void)
 {
-  int found;
-  /*  int lowest, best;*/
-  struct neighbor *n, *best;
-  uint16_t rtmetric;
+  struct neighbor *n;
 
-  rtmetric = RTMETRIC_MAX;
-  best = NULL;
-  found = 0;
+  /* The best neighbor may have aged out since it was found. */
+  if(best_valid && best != NULL) {
+    addrtable_expire(&neighbors, best);
+  }
 
-  /*  PRINTF("%d: ", node_id);*/
-  
-  /* Find the lowest rtmetric. */
-  for(n = list_head(neighbors_list); n != NULL; n = n->next) {
-    if(!rimeaddr_cmp(&n->addr, &rimeaddr_null) &&
-       rtmetric > n->rtmetric + neighbor_etx(n)) {
-      rtmetric = n->rtmetric + neighbor_etx(n);
-      best = n;
+  if(!best_valid) {
+    /* Find the lowest rtmetric. */
+    best = NULL;
+    best_rtmetric = RTMETRIC_MAX;
+    for(n = addrtable_next(&neighbors, NULL); n != NULL;
+	n = addrtable_next(&neighbors, n)) {
+      if(best_rtmetric > path_rtmetric(n)) {
+	best_rtmetric = path_rtmetric(n);
+	best = n;
+      }
     }
+    best_valid = 1;
   }
 
   return best;
@@ -304,13 +291,14 @@ void
 neighbor_set_lifetime(int seconds)
 {
   max_time = seconds;
+  addrtable_set_maxage(&neighbors, seconds);
 }
 /*---------------------------------------------------------------------------*/
 int
 neighbor_num(void)
 {
-  PRINTF("neighbor_num %d\n", list_length(neighbors_list));
-  return list_length(neighbors_list);
+  PRINTF("neighbor_num %d\n", addrtable_num(&neighbors));
+  return addrtable_num(&neighbors);
 }
 /*---------------------------------------------------------------------------*/
 struct neighbor *
@@ -322,7 +310,8 @@ neighbor_get(int num)
   PRINTF("neighbor_get %d\n", num);
   
   i = 0;
-  for(n = list_head(neighbors_list); n != NULL; n = n->next) {
+  for(n = addrtable_next(&neighbors, NULL); n != NULL;
+      n = addrtable_next(&neighbors, n)) {
     if(i == num) {
       PRINTF("neighbor_get found %d.%d\n", n->addr.u8[0], n->addr.u8[1]);
       return n;
@@ -57,10 +57,9 @@
 #define NEIGHBOR_NUM_ETXS 8
 
 struct neighbor {
-  struct neighbor *next;
-  uint16_t time;
   rimeaddr_t addr;
   uint16_t rtmetric;
+  uint8_t congested;
   uint8_t etxptr;
   uint8_t etxs[NEIGHBOR_NUM_ETXS];
 };
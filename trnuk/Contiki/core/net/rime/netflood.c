@@ -44,6 +44,7 @@
  */
 
 #include "net/rime/netflood.h"
+#include "net/rime/dupcache.h"
 
 #include <string.h>
 
@@ -82,37 +83,39 @@ recv_from_ipolite(struct ipolite_conn *ipolite, rimeaddr_t *from)
 
   hops = hdr->hops;
 
+  /* Every flood is passed up, and forwarded, once only. */
+  if(dupcache_check(c->c.c.c.channel.channelno, &hdr->originator,
+		    hdr->originator_seqno)) {
+    PRINTF("%d.%d: netflood duplicate %d.%d/%d\n",
+	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	   hdr->originator.u8[0], hdr->originator.u8[1],
+	   hdr->originator_seqno);
+    return;
+  }
+
   /* Remember packet if we need to forward it. */
   queuebuf = queuebuf_new_from_packetbuf();
 
   packetbuf_hdrreduce(sizeof(struct netflood_hdr));
   if(c->u->recv != NULL) {
-    if(!(rimeaddr_cmp(&hdr->originator, &c->last_originator) &&
-	 hdr->originator_seqno <= c->last_originator_seqno)) {
+    if(c->u->recv(c, from, &hdr->originator, hdr->originator_seqno,
+		  hops)) {
+
+      if(queuebuf != NULL) {
+	queuebuf_to_packetbuf(queuebuf);
+	queuebuf_free(queuebuf);
+	queuebuf = NULL;
+	hdr = packetbuf_dataptr();
 
-      if(c->u->recv(c, from, &hdr->originator, hdr->originator_seqno,
-		    hops)) {
-	
-	if(queuebuf != NULL) {
-	  queuebuf_to_packetbuf(queuebuf);
-	  queuebuf_free(queuebuf);
-	  queuebuf = NULL;
-	  hdr = packetbuf_dataptr();
-	  
-	  /* Rebroadcast received packet. */
-	  if(hops < HOPS_MAX) {
-	    PRINTF("%d.%d: netflood rebroadcasting %d.%d/%d (%d.%d/%d) hops %d\n",
-		   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-		   hdr->originator.u8[0], hdr->originator.u8[1],
-		   hdr->originator_seqno,
-		   c->last_originator.u8[0], c->last_originator.u8[1],
-		   c->last_originator_seqno,
-		  hops);
-	    hdr->hops++;
-	    send(c);
-	    rimeaddr_copy(&c->last_originator, &hdr->originator);
-	    c->last_originator_seqno = hdr->originator_seqno;
-	  }
+	/* Rebroadcast received packet. */
+	if(hops < HOPS_MAX) {
+	  PRINTF("%d.%d: netflood rebroadcasting %d.%d/%d hops %d\n",
+		 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+		 hdr->originator.u8[0], hdr->originator.u8[1],
+		 hdr->originator_seqno,
+		 hops);
+	  hdr->hops++;
+	  send(c);
 	}
       }
     }
@@ -163,9 +166,10 @@ netflood_send(struct netflood_conn *c, uint8_t seqno)
   if(packetbuf_hdralloc(sizeof(struct netflood_hdr))) {
     struct netflood_hdr *hdr = packetbuf_hdrptr();
     rimeaddr_copy(&hdr->originator, &rimeaddr_node_addr);
-    rimeaddr_copy(&c->last_originator, &hdr->originator);
-    c->last_originator_seqno = hdr->originator_seqno = seqno;
+    hdr->originator_seqno = seqno;
     hdr->hops = 0;
+    /* Do not forward our own flood when it comes back to us. */
+    dupcache_check(c->c.c.c.channel.channelno, &hdr->originator, seqno);
     PRINTF("%d.%d: netflood sending '%s'\n",
 	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	   (char *)packetbuf_dataptr());
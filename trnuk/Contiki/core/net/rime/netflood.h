@@ -15,12 +15,12 @@
  * primitive does not perform retransmissions of flooded packets and
  * packets are not tagged with version numbers.  Instead, the netflood
  * primitive sets the end-to-end sender and end-to-end packet ID
- * attributes on the packets it sends.  A forwarding node saves the
- * end-to-end sender and packet ID of the last packet it forwards and
- * does not forward a packet if it has the same end-to-end sender and
- * packet ID as the last packet.  This reduces the risk of routing
- * loops, but does not eliminate them entirely as the netflood
- * primitive saves the attributes of the latest packet seen only.
+ * attributes on the packets it sends.  A node remembers the
+ * end-to-end sender and packet ID of the packets it has recently
+ * seen in the duplicate cache, and passes up and forwards a packet
+ * only the first time it sees it.  This reduces the risk of routing
+ * loops, but does not eliminate them entirely as the cache only
+ * holds a limited number of packets for a limited time.
  * Therefore, the netflood primitive also uses the time to live
  * attribute, which is decreased by one before forwarding a packet.
  * If the time to live reaches zero, the primitive does not forward
@@ -98,8 +98,6 @@ struct netflood_conn {
   struct ipolite_conn c;
   const struct netflood_callbacks *u;
   clock_time_t queue_time;
-  rimeaddr_t last_originator;
-  uint8_t last_originator_seqno;
 };
 
 void netflood_open(struct netflood_conn *c, clock_time_t queue_time,
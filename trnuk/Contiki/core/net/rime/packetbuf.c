@@ -77,6 +77,8 @@ const char *packetbuf_attr_strings[] =
 
     "PACKETBUF_ATTR_RELIABLE",
     "PACKETBUF_ATTR_ERELIABLE",
+    "PACKETBUF_ATTR_MAC_ACK",
+    "PACKETBUF_ATTR_MAC_ACK_EXPECTED",
 
     "PACKETBUF_ADDR_SENDER",
     "PACKETBUF_ADDR_RECEIVER",
@@ -87,14 +89,34 @@ const char *packetbuf_attr_strings[] =
   };
 
 static uint16_t buflen, bufptr;
-static uint8_t hdrptr;
+static uint8_t hdrptr, hdrend;
 
-/* The declarations below ensure that the packet buffer is aligned on
-   an even 16-bit boundary. On some platforms (most notably the
-   msp430), having apotentially misaligned packet buffer may lead to
-   problems when accessing 16-bit values. */
-static uint16_t packetbuf_aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE) / 2 + 1];
-static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
+/* The number of packet buffers. The packetbuf uses one of them, and
+   each packet queued with queuebuf holds a reference to one. */
+#ifdef PACKETBUF_CONF_NUM
+#define PACKETBUF_NUM PACKETBUF_CONF_NUM
+#else
+#define PACKETBUF_NUM (QUEUEBUF_NUM + 1)
+#endif
+
+/* The buffer is first in the structure to ensure that the packet
+   buffer is aligned on an even 16-bit boundary. On some platforms
+   (most notably the msp430), having apotentially misaligned packet
+   buffer may lead to problems when accessing 16-bit values. */
+struct packetbuf_buf {
+  uint16_t data[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE) / 2 + 1];
+  /* The number of references to the buffer; 0 if the buffer is free. */
+  uint8_t refs;
+  /* The lowest header pointer of the references to the buffer. The
+     bytes below it are not used by anyone, so the header can be
+     extended in place even when the buffer is shared. */
+  uint8_t hdrlow;
+};
+
+static struct packetbuf_buf bufs[PACKETBUF_NUM] = {{{0}, 1}};
+static struct packetbuf_buf *buf = &bufs[0];
+static uint8_t nfree = PACKETBUF_NUM - 1;
+static uint8_t *packetbuf = (uint8_t *)bufs[0].data;
 
 static uint8_t *packetbufptr;
 
@@ -106,12 +128,59 @@ static uint8_t *packetbufptr;
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+buf_release(struct packetbuf_buf *b)
+{
+  if(--b->refs == 0) {
+    ++nfree;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_buf(struct packetbuf_buf *b)
+{
+  buf = b;
+  packetbuf = (uint8_t *)b->data;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Give the packetbuf a buffer of its own if it shares its buffer with
+ * queued packets, copying the packet into it if copy is non-zero. A
+ * free buffer is always available, as packetbuf_share() does not let
+ * the queued packets take the last one.
+ */
+static void
+unshare(int copy)
+{
+  struct packetbuf_buf *b;
+  int reference;
+
+  if(buf->refs == 1) {
+    return;
+  }
+  for(b = bufs; b->refs != 0; ++b);
+  b->refs = 1;
+  --nfree;
+
+  reference = packetbuf_is_reference();
+  if(copy) {
+    memcpy((uint8_t *)b->data + hdrptr, packetbuf + hdrptr,
+	   hdrend - hdrptr + (reference ? 0 : bufptr + buflen));
+  }
+  buf_release(buf);
+  set_buf(b);
+  if(!reference) {
+    packetbufptr = &packetbuf[hdrend];
+  }
+}
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_clear(void)
 {
+  unshare(0);
   buflen = bufptr = 0;
-  hdrptr = PACKETBUF_HDR_SIZE;
+  hdrptr = hdrend = PACKETBUF_HDR_SIZE;
 
   packetbufptr = &packetbuf[PACKETBUF_HDR_SIZE];
   packetbuf_attr_clear();
@@ -135,11 +204,12 @@ packetbuf_compact(void)
   int i, len;
 
   if(packetbuf_is_reference()) {
-    memcpy(&packetbuf[PACKETBUF_HDR_SIZE], packetbuf_reference_ptr(),
+    memcpy(&packetbuf[hdrend], packetbuf_reference_ptr(),
 	   packetbuf_datalen());
   } else if (bufptr > 0) {
-    len = packetbuf_datalen() + PACKETBUF_HDR_SIZE;
-    for (i = PACKETBUF_HDR_SIZE; i < len; i++) {
+    unshare(1);
+    len = packetbuf_datalen() + hdrend;
+    for (i = hdrend; i < len; i++) {
       packetbuf[i] = packetbuf[bufptr + i];
     }
 
@@ -154,14 +224,14 @@ packetbuf_copyto_hdr(uint8_t *to)
   {
     int i;
     PRINTF("packetbuf_write_hdr: header:\n");
-    for(i = hdrptr; i < PACKETBUF_HDR_SIZE; ++i) {
+    for(i = hdrptr; i < hdrend; ++i) {
       PRINTF("0x%02x, ", packetbuf[i]);
     }
     PRINTF("\n");
   }
 #endif /* DEBUG_LEVEL */
-  memcpy(to, packetbuf + hdrptr, PACKETBUF_HDR_SIZE - hdrptr);
-  return PACKETBUF_HDR_SIZE - hdrptr;
+  memcpy(to, packetbuf + hdrptr, hdrend - hdrptr);
+  return hdrend - hdrptr;
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -174,7 +244,7 @@ packetbuf_copyto(void *to)
     char *bufferptr = buffer;
     
     bufferptr[0] = 0;
-    for(i = hdrptr; i < PACKETBUF_HDR_SIZE; ++i) {
+    for(i = hdrptr; i < hdrend; ++i) {
       bufferptr += sprintf(bufferptr, "0x%02x, ", packetbuf[i]);
     }
     PRINTF("packetbuf_write: header: %s\n", buffer);
@@ -186,20 +256,39 @@ packetbuf_copyto(void *to)
     PRINTF("packetbuf_write: data: %s\n", buffer);
   }
 #endif /* DEBUG_LEVEL */
-  memcpy(to, packetbuf + hdrptr, PACKETBUF_HDR_SIZE - hdrptr);
-  memcpy((uint8_t *)to + PACKETBUF_HDR_SIZE - hdrptr, packetbufptr + bufptr,
+  memcpy(to, packetbuf + hdrptr, hdrend - hdrptr);
+  memcpy((uint8_t *)to + hdrend - hdrptr, packetbufptr + bufptr,
 	 buflen);
-  return PACKETBUF_HDR_SIZE - hdrptr + buflen;
+  return hdrend - hdrptr + buflen;
 }
 /*---------------------------------------------------------------------------*/
 int
 packetbuf_hdralloc(int size)
 {
+  int move;
+
+  if(buf->refs > 1 && hdrptr != buf->hdrlow) {
+    unshare(1);
+  }
+  if(hdrptr <= size && hdrend < PACKETBUF_HDR_SIZE &&
+     !packetbuf_is_reference()) {
+    /* The packet was restored from a queued packet and starts before
+       the header portion ends: move it up to make room. */
+    unshare(1);
+    move = PACKETBUF_HDR_SIZE - hdrend;
+    memmove(&packetbuf[hdrptr + move], &packetbuf[hdrptr],
+	    hdrend - hdrptr + bufptr + buflen);
+    hdrptr += move;
+    hdrend += move;
+    packetbufptr = &packetbuf[hdrend];
+  }
   if(hdrptr > size) {
     hdrptr -= size;
+    buf->hdrlow = hdrptr;
     return 1;
   }
   hdrptr = 0;
+  buf->hdrlow = hdrptr;
   return 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -225,7 +314,8 @@ packetbuf_set_datalen(uint16_t len)
 void *
 packetbuf_dataptr(void)
 {
-  return (void *)(&packetbuf[bufptr + PACKETBUF_HDR_SIZE]);
+  unshare(1);
+  return (void *)(&packetbuf[bufptr + hdrend]);
 }
 /*---------------------------------------------------------------------------*/
 void *
@@ -245,7 +335,7 @@ packetbuf_reference(void *ptr, uint16_t len)
 int
 packetbuf_is_reference(void)
 {
-  return packetbufptr != &packetbuf[PACKETBUF_HDR_SIZE];
+  return packetbufptr != &packetbuf[hdrend];
 }
 /*---------------------------------------------------------------------------*/
 void *
@@ -263,7 +353,7 @@ packetbuf_datalen(void)
 uint8_t
 packetbuf_hdrlen(void)
 {
-  return PACKETBUF_HDR_SIZE - hdrptr;
+  return hdrend - hdrptr;
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
@@ -272,6 +362,84 @@ packetbuf_totlen(void)
   return packetbuf_hdrlen() + packetbuf_datalen();
 }
 /*---------------------------------------------------------------------------*/
+int
+packetbuf_share(struct packetbuf_handle *h)
+{
+  if(packetbuf_is_reference()) {
+    return 0;
+  }
+  packetbuf_compact();
+  /* Keep a free buffer for the packetbuf to move to when it is
+     written to. */
+  if(buf->refs == 1 && nfree == 0) {
+    return 0;
+  }
+  if(buf->refs == 1 || hdrptr < buf->hdrlow) {
+    buf->hdrlow = hdrptr;
+  }
+  ++buf->refs;
+  h->buf = buf;
+  h->hdrptr = hdrptr;
+  h->len = packetbuf_totlen();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_restore(const struct packetbuf_handle *h)
+{
+  struct packetbuf_buf *b = h->buf;
+
+  ++b->refs;
+  buf_release(buf);
+  set_buf(b);
+  /* The header of the queued packet becomes part of the data, as if
+     the packet had been copied into the packetbuf. */
+  hdrptr = hdrend = h->hdrptr;
+  bufptr = 0;
+  buflen = h->len > PACKETBUF_SIZE? PACKETBUF_SIZE: h->len;
+  packetbufptr = &packetbuf[hdrend];
+  packetbuf_attr_clear();
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_handle_alloc(struct packetbuf_handle *h, uint16_t len)
+{
+  struct packetbuf_buf *b;
+
+  /* As in packetbuf_share(), a free buffer is kept for the packetbuf
+     if it is shared. */
+  if(nfree <= (buf->refs > 1 ? 1 : 0)) {
+    return 0;
+  }
+  for(b = bufs; b->refs != 0; ++b);
+  b->refs = 1;
+  --nfree;
+
+  h->buf = b;
+  h->len = len;
+  /* Place the packet where a packet copied into the packetbuf would
+     be, or lower if it does not fit. */
+  if(len > PACKETBUF_SIZE) {
+    h->hdrptr = PACKETBUF_HDR_SIZE + PACKETBUF_SIZE - len;
+  } else {
+    h->hdrptr = PACKETBUF_HDR_SIZE;
+  }
+  b->hdrlow = h->hdrptr;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_release(struct packetbuf_handle *h)
+{
+  buf_release(h->buf);
+}
+/*---------------------------------------------------------------------------*/
+void *
+packetbuf_handle_ptr(const struct packetbuf_handle *h)
+{
+  return (uint8_t *)((struct packetbuf_buf *)h->buf)->data + h->hdrptr;
+}
+/*---------------------------------------------------------------------------*/
 
 
 
@@ -102,6 +102,10 @@ void packetbuf_clear(void);
  *             packetbuf. Thus this function is used to get a pointer to
  *             the header for incoming packets.
  *
+ *             If the packetbuf shares its buffer with queued packets
+ *             (see packetbuf_share()), the packet is first copied to
+ *             a buffer of its own, as the data may be written to.
+ *
  */
 void *packetbuf_dataptr(void);
 
@@ -114,6 +118,11 @@ void *packetbuf_dataptr(void);
  *             pointer to the header in the packetbuf. The header is
  *             stored in the packetbuf.
  *
+ *             Only the part of the header that was allocated with
+ *             packetbuf_hdralloc() since the packetbuf was last
+ *             cleared or restored from a queued packet may be written
+ *             to: the rest may be shared with queued packets.
+ *
  */
 void *packetbuf_hdrptr(void);
 
@@ -299,6 +308,77 @@ int packetbuf_hdralloc(int size);
  */
 int packetbuf_hdrreduce(int size);
 
+/**
+ * \brief      A reference to a packet that shares the packetbuf buffer
+ *
+ *             The packetbuf is one of a pool of reference counted
+ *             buffers. A packet is queued by taking a reference to
+ *             the packetbuf buffer instead of copying it. The
+ *             packetbuf moves to a buffer of its own the next time
+ *             the packet is written to, or when it is cleared.
+ */
+struct packetbuf_handle {
+  void *buf;
+  uint16_t len;
+  uint8_t hdrptr;
+};
+
+/**
+ * \brief      Take a reference to the packet in the packetbuf
+ * \param h    A pointer to the handle that is to hold the reference
+ * \retval     Non-zero if the reference was taken, zero if no buffer
+ *             was available or the packetbuf references external data
+ *
+ *             This function is used by the queuebuf module to queue
+ *             the packet in the packetbuf without copying it. The
+ *             packetbuf is compacted first, so that the header and the
+ *             data of the queued packet are consecutive in memory.
+ *
+ */
+int packetbuf_share(struct packetbuf_handle *h);
+
+/**
+ * \brief      Make a referenced packet the packet in the packetbuf
+ * \param h    A pointer to the handle of the packet
+ *
+ *             This function points the packetbuf to the buffer of a
+ *             packet referenced with packetbuf_share(). As when a
+ *             packet is copied into the packetbuf, the whole packet
+ *             is in the data portion and the header is empty. The
+ *             packet attributes are cleared.
+ *
+ */
+void packetbuf_restore(const struct packetbuf_handle *h);
+
+/**
+ * \brief      Allocate a buffer for a packet that is not in the packetbuf
+ * \param h    A pointer to the handle that is to hold the reference
+ * \param len  The length of the packet, including its header
+ * \retval     Non-zero if a buffer was allocated, zero otherwise
+ *
+ *             This function is used to bring a packet back from
+ *             outside the packetbuf pool. The caller writes the
+ *             packet to the pointer returned by
+ *             packetbuf_handle_ptr(). The packet can then be used
+ *             like a packet referenced with packetbuf_share().
+ *
+ */
+int packetbuf_handle_alloc(struct packetbuf_handle *h, uint16_t len);
+
+/**
+ * \brief      Drop a reference taken with packetbuf_share()
+ * \param h    A pointer to the handle of the packet
+ */
+void packetbuf_release(struct packetbuf_handle *h);
+
+/**
+ * \brief      Get a pointer to a referenced packet
+ * \param h    A pointer to the handle of the packet
+ * \return     A pointer to the header of the packet, which is
+ *             followed by the data
+ */
+void *packetbuf_handle_ptr(const struct packetbuf_handle *h);
+
 /* Packet attributes stuff below: */
 
 typedef uint16_t packetbuf_attr_t;
@@ -340,6 +420,8 @@ enum {
   
   PACKETBUF_ATTR_RELIABLE,
   PACKETBUF_ATTR_ERELIABLE,
+  PACKETBUF_ATTR_MAC_ACK,
+  PACKETBUF_ATTR_MAC_ACK_EXPECTED,
 
   PACKETBUF_ADDR_SENDER,
   PACKETBUF_ADDR_RECEIVER,
@@ -45,24 +45,226 @@
 #include "net/rime/ctimer.h"
 #include "net/rime/packetqueue.h"
 
+#if PACKETQUEUE_XMEM
+#include <string.h>
+
+#include "dev/xmem.h"
+#include "net/rime/rimestats.h"
+
+#ifdef PACKETQUEUE_CONF_XMEM_OFFSET
+#define XMEM_OFFSET PACKETQUEUE_CONF_XMEM_OFFSET
+#else
+#define XMEM_OFFSET 0
+#endif
+
+#ifdef XMEM_ERASE_UNIT_SIZE
+#define SECTOR_SIZE XMEM_ERASE_UNIT_SIZE
+#else
+#define SECTOR_SIZE 65536UL
+#endif
+
+#ifdef PACKETQUEUE_CONF_XMEM_SIZE
+#define XMEM_SIZE PACKETQUEUE_CONF_XMEM_SIZE
+#else
+#define XMEM_SIZE (2 * SECTOR_SIZE)
+#endif
+
+#define NUM_SECTORS (XMEM_SIZE / SECTOR_SIZE)
+#define NEXT_SECTOR(s) ((s) + 1 == NUM_SECTORS ? 0 : (s) + 1)
+
+#if XMEM_SIZE % SECTOR_SIZE != 0
+#error PACKETQUEUE_CONF_XMEM_SIZE must be a multiple of XMEM_ERASE_UNIT_SIZE
+#elif NUM_SECTORS < 2
+#error PACKETQUEUE_CONF_XMEM_SIZE must be at least two erase units
+#endif
+
+/* Writes are collected in RAM and programmed a flash page at a
+   time. */
+#define PAGE_SIZE 256
+
+/*
+ * The packets are written back to back to a circular log. A packet
+ * never crosses a sector boundary: if it does not fit in the
+ * remainder of the current sector, the log continues at the start of
+ * the next sector. The number of packets in each sector that are
+ * still queued is counted, and a sector is not erased as long as it
+ * holds queued packets.
+ *
+ * Erasing a sector takes about a second, so it is kept off the packet
+ * path: the sector after the current one is erased from a ctimer as
+ * soon as the writer has entered the current sector and the next one
+ * holds no queued packets. A packet that needs a sector that has not
+ * been erased yet is dropped.
+ */
+struct xmem_record {
+  uint16_t len;
+  struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
+  struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+};
+
+static uint16_t live[NUM_SECTORS];
+static uint8_t sector = NUM_SECTORS - 1;
+static uint8_t erased = NUM_SECTORS;      /* NUM_SECTORS if none. */
+static struct ctimer erase_timer;
+static unsigned long writeptr = XMEM_SIZE, pageptr = XMEM_SIZE;
+static uint8_t page[PAGE_SIZE];
+
+/*---------------------------------------------------------------------------*/
+static void
+flush_page(void)
+{
+  if(writeptr > pageptr) {
+    xmem_pwrite(page, writeptr - pageptr, XMEM_OFFSET + pageptr);
+  }
+  pageptr = writeptr;
+}
+/*---------------------------------------------------------------------------*/
+static void
+log_write(const void *from, uint16_t len)
+{
+  const uint8_t *p = from;
+  uint16_t n;
+
+  while(len > 0) {
+    n = PAGE_SIZE - (uint16_t)(writeptr - pageptr);
+    if(n > len) {
+      n = len;
+    }
+    memcpy(&page[writeptr - pageptr], p, n);
+    writeptr += n;
+    p += n;
+    len -= n;
+    if(writeptr - pageptr == PAGE_SIZE) {
+      flush_page();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+log_read(void *to, uint16_t len, unsigned long ptr)
+{
+  uint16_t n;
+
+  /* The bytes that have not yet been written to flash are read from
+     the page buffer. */
+  n = len;
+  if(ptr < writeptr && ptr + len > pageptr) {
+    n = ptr < pageptr ? pageptr - ptr : 0;
+    memcpy((uint8_t *)to + n, &page[ptr + n - pageptr], len - n);
+  }
+  if(n > 0) {
+    xmem_pread(to, n, XMEM_OFFSET + ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+erase_next(void *ptr)
+{
+  uint8_t next;
+
+  next = NEXT_SECTOR(sector);
+  if(erased != next && live[next] == 0) {
+    xmem_erase(SECTOR_SIZE, XMEM_OFFSET + (unsigned long)next * SECTOR_SIZE);
+    erased = next;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+spill_packetbuf(struct packetqueue_item *i)
+{
+  struct xmem_record r;
+
+  r.len = packetbuf_totlen();
+  if(writeptr + sizeof(r) + r.len >
+     (unsigned long)(sector + 1) * SECTOR_SIZE) {
+    if(erased != NEXT_SECTOR(sector)) {
+      RIMESTATS_ADD(xmemdrop);
+      return 0;
+    }
+    flush_page();
+    sector = erased;
+    erased = NUM_SECTORS;
+    writeptr = pageptr = (unsigned long)sector * SECTOR_SIZE;
+    ctimer_set(&erase_timer, 0, erase_next, NULL);
+  }
+
+  i->buf = NULL;
+  i->xmemptr = writeptr;
+  ++live[sector];
+
+  packetbuf_attr_copyto(r.attrs, r.addrs);
+  log_write(&r, sizeof(r));
+  log_write(packetbuf_hdrptr(), packetbuf_hdrlen());
+  if(packetbuf_is_reference()) {
+    log_write(packetbuf_reference_ptr(), packetbuf_datalen());
+  } else {
+    log_write(packetbuf_dataptr(), packetbuf_datalen());
+  }
+  RIMESTATS_ADD(xmemspill);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_xmem(struct packetqueue_item *i)
+{
+  uint8_t s;
+
+  s = i->xmemptr / SECTOR_SIZE;
+  if(--live[s] == 0 && s == NEXT_SECTOR(sector)) {
+    ctimer_set(&erase_timer, 0, erase_next, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+refill(struct packetqueue_item *i)
+{
+  struct xmem_record r;
+  struct queuebuf *b;
+
+  log_read(&r, sizeof(r), i->xmemptr);
+  b = queuebuf_new(r.len, r.attrs, r.addrs);
+  if(b != NULL) {
+    log_read(queuebuf_dataptr(b), r.len, i->xmemptr + sizeof(r));
+    free_xmem(i);
+    i->buf = b;
+    RIMESTATS_ADD(xmemrefill);
+  }
+}
+#endif /* PACKETQUEUE_XMEM */
 /*---------------------------------------------------------------------------*/
 void
 packetqueue_init(struct packetqueue *q)
 {
   list_init(*q->list);
   memb_init(q->memb);
+#if PACKETQUEUE_XMEM
+  /* The log starts in the first sector. */
+  if(erased != 0 && writeptr == XMEM_SIZE) {
+    ctimer_set(&erase_timer, 0, erase_next, NULL);
+  }
+#endif /* PACKETQUEUE_XMEM */
 }
 /*---------------------------------------------------------------------------*/
 static void
-remove_queued_packet(void *item)
+free_item(struct packetqueue_item *i)
 {
-  struct packetqueue_item *i = item;
   struct packetqueue *q = i->queue;
 
   list_remove(*q->list, i);
+#if PACKETQUEUE_XMEM
+  if(i->buf == NULL) {
+    free_xmem(i);
+  }
+#endif /* PACKETQUEUE_XMEM */
   queuebuf_free(i->buf);
   ctimer_stop(&i->lifetimer);
   memb_free(q->memb, i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_queued_packet(void *item)
+{
+  free_item(item);
   /*  printf("removing queued packet due to timeout\n");*/
 }
 /*---------------------------------------------------------------------------*/
@@ -71,6 +273,9 @@ packetqueue_enqueue_packetbuf(struct packetqueue *q, clock_time_t lifetime,
 			      void *ptr)
 {
   struct packetqueue_item *i;
+#if PACKETQUEUE_XMEM
+  struct packetqueue_item *tail;
+#endif /* PACKETQUEUE_XMEM */
 
   /* Allocate a memory block to hold the packet queue item. */
   i = memb_alloc(q->memb);
@@ -79,6 +284,20 @@ packetqueue_enqueue_packetbuf(struct packetqueue *q, clock_time_t lifetime,
     return 0;
   }
 
+#if PACKETQUEUE_XMEM
+  /* Once packets have been spilled to flash, the following packets
+     go there too, so that the queue is served in order. */
+  tail = list_tail(*q->list);
+  if(tail == NULL || tail->buf != NULL) {
+    i->buf = queuebuf_new_from_packetbuf();
+  } else {
+    i->buf = NULL;
+  }
+  if(i->buf == NULL && !spill_packetbuf(i)) {
+    memb_free(q->memb, i);
+    return 0;
+  }
+#else /* PACKETQUEUE_XMEM */
   /* Allocate a queuebuf and copy the contents of the packetbuf into it. */
   i->buf = queuebuf_new_from_packetbuf();
 
@@ -86,6 +305,7 @@ packetqueue_enqueue_packetbuf(struct packetqueue *q, clock_time_t lifetime,
     memb_free(q->memb, i);
     return 0;
   }
+#endif /* PACKETQUEUE_XMEM */
 
   i->queue = q;
   i->ptr = ptr;
@@ -116,10 +336,17 @@ packetqueue_dequeue(struct packetqueue *q)
   
   i = list_head(*q->list);
   if(i != NULL) {
-    list_remove(*q->list, i);
-    queuebuf_free(i->buf);
-    ctimer_stop(&i->lifetimer);
-    memb_free(q->memb, i);
+    free_item(i);
+#if PACKETQUEUE_XMEM
+    /* Read the next packet from flash into the queuebuf that was just
+       freed. */
+    for(i = list_head(*q->list); i != NULL; i = i->next) {
+      if(i->buf == NULL) {
+	refill(i);
+	break;
+      }
+    }
+#endif /* PACKETQUEUE_XMEM */
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -127,6 +354,11 @@ struct queuebuf *
 packetqueue_queuebuf(struct packetqueue_item *i)
 {
   if(i != NULL) {
+#if PACKETQUEUE_XMEM
+    if(i->buf == NULL) {
+      refill(i);
+    }
+#endif /* PACKETQUEUE_XMEM */
     return i->buf;
   } else {
     return NULL;
@@ -60,6 +60,22 @@
 #include "net/rime/packetbuf.h"
 #include "net/rime/queuebuf.h"
 
+/**
+ * \brief      Spill packets to external flash when the queuebufs run out
+ *
+ *             If PACKETQUEUE_CONF_XMEM is set, a packet that cannot
+ *             be held in a queuebuf is written to a log in external
+ *             flash instead of being dropped, and is read back when
+ *             it reaches the head of its queue. The log occupies
+ *             PACKETQUEUE_CONF_XMEM_SIZE bytes, a multiple of the
+ *             flash erase unit, from PACKETQUEUE_CONF_XMEM_OFFSET.
+ */
+#ifdef PACKETQUEUE_CONF_XMEM
+#define PACKETQUEUE_XMEM PACKETQUEUE_CONF_XMEM
+#else
+#define PACKETQUEUE_XMEM 0
+#endif
+
 /**
  * \brief      Representation of a packet queue.
  *
@@ -88,6 +104,10 @@ struct packetqueue_item {
   struct packetqueue *queue;
   struct ctimer lifetimer;
   void *ptr;
+#if PACKETQUEUE_XMEM
+  /* The position of the packet in the flash log, if buf is NULL. */
+  unsigned long xmemptr;
+#endif /* PACKETQUEUE_XMEM */
 };
 
 
@@ -189,7 +209,9 @@ void packetqueue_dequeue(struct packetqueue *q);
 /**
  * \brief      Access the queuebuf in a packet queue item.
  * \param i    A packet queue item, obtained with packetqueue_first().
- * \return     A pointer to the queuebuf in the packet queue item.
+ * \return     A pointer to the queuebuf in the packet queue item, or
+ *             NULL if the packet is in external flash and no
+ *             queuebuf is available to read it back into.
  */
 struct queuebuf *packetqueue_queuebuf(struct packetqueue_item *i);
 /**
@@ -47,12 +47,6 @@
 
 #include <string.h> /* for memcpy() */
 
-#ifdef QUEUEBUF_CONF_NUM
-#define QUEUEBUF_NUM QUEUEBUF_CONF_NUM
-#else
-#define QUEUEBUF_NUM 4
-#endif
-
 #ifdef QUEUEBUF_CONF_REF_NUM
 #define QUEUEBUF_REF_NUM QUEUEBUF_CONF_REF_NUM
 #else
@@ -60,8 +54,7 @@
 #endif
 
 struct queuebuf {
-  uint16_t len;
-  uint8_t data[PACKETBUF_SIZE + PACKETBUF_HDR_SIZE];
+  struct packetbuf_handle handle;
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
 };
@@ -140,7 +133,14 @@ queuebuf_new_from_packetbuf(void)
 	       queuebuf_ref_len);*/
 #endif /* CONTIKI_TARGET_NETSIM */
 #endif /* QUEUEBUF_STATS */
-      buf->len = packetbuf_copyto(buf->data);
+      if(!packetbuf_share(&buf->handle)) {
+	PRINTF("queuebuf_new_from_packetbuf: could not allocate a packetbuf\n");
+	memb_free(&bufmem, buf);
+#if QUEUEBUF_STATS
+	--queuebuf_len;
+#endif /* QUEUEBUF_STATS */
+	return NULL;
+      }
       packetbuf_attr_copyto(buf->attrs, buf->addrs);
     } else {
       PRINTF("queuebuf_new_from_packetbuf: could not allocate a queuebuf\n");
@@ -149,10 +149,43 @@ queuebuf_new_from_packetbuf(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+struct queuebuf *
+queuebuf_new(uint16_t len, const struct packetbuf_attr *attrs,
+	     const struct packetbuf_addr *addrs)
+{
+  struct queuebuf *buf;
+
+  buf = memb_alloc(&bufmem);
+  if(buf != NULL) {
+#if QUEUEBUF_STATS
+    ++queuebuf_len;
+    if(queuebuf_len == queuebuf_max_len + 1) {
+      memb_free(&bufmem, buf);
+      queuebuf_len--;
+      return NULL;
+    }
+#endif /* QUEUEBUF_STATS */
+    if(!packetbuf_handle_alloc(&buf->handle, len)) {
+      PRINTF("queuebuf_new: could not allocate a packetbuf\n");
+      memb_free(&bufmem, buf);
+#if QUEUEBUF_STATS
+      --queuebuf_len;
+#endif /* QUEUEBUF_STATS */
+      return NULL;
+    }
+    memcpy(buf->attrs, attrs, sizeof(buf->attrs));
+    memcpy(buf->addrs, addrs, sizeof(buf->addrs));
+  } else {
+    PRINTF("queuebuf_new: could not allocate a queuebuf\n");
+  }
+  return buf;
+}
+/*---------------------------------------------------------------------------*/
 void
 queuebuf_free(struct queuebuf *buf)
 {
   if(memb_inmemb(&bufmem, buf)) {
+    packetbuf_release(&buf->handle);
     memb_free(&bufmem, buf);
 #if QUEUEBUF_STATS
     --queuebuf_len;
@@ -181,7 +214,7 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   struct queuebuf_ref *r;
   
   if(memb_inmemb(&bufmem, b)) {
-    packetbuf_copyfrom(b->data, b->len);
+    packetbuf_restore(&b->handle);
     packetbuf_attr_copyfrom(b->attrs, b->addrs);
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
@@ -198,7 +231,7 @@ queuebuf_dataptr(struct queuebuf *b)
   struct queuebuf_ref *r;
   
   if(memb_inmemb(&bufmem, b)) {
-    return b->data;
+    return packetbuf_handle_ptr(&b->handle);
   } else if(memb_inmemb(&refbufmem, b)) {
     r = (struct queuebuf_ref *)b;
     return r->ref;
@@ -209,7 +242,20 @@ queuebuf_dataptr(struct queuebuf *b)
 int
 queuebuf_datalen(struct queuebuf *b)
 {
-  return b->len;
+  if(memb_inmemb(&bufmem, b)) {
+    return b->handle.len;
+  }
+  return ((struct queuebuf_ref *)b)->len;
+}
+/*---------------------------------------------------------------------------*/
+const rimeaddr_t *
+queuebuf_addr(struct queuebuf *b, uint8_t type)
+{
+  if(memb_inmemb(&bufmem, b)) {
+    return &b->addrs[type - PACKETBUF_ADDR_FIRST].addr;
+  }
+  /* Reference queuebufs do not keep the packet attributes. */
+  return NULL;
 }
 /*---------------------------------------------------------------------------*/
 /** @} */
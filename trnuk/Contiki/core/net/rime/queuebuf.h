@@ -56,16 +56,26 @@
 
 #include "net/rime/packetbuf.h"
 
+#ifdef QUEUEBUF_CONF_NUM
+#define QUEUEBUF_NUM QUEUEBUF_CONF_NUM
+#else
+#define QUEUEBUF_NUM 4
+#endif
+
 struct queuebuf;
 
 void queuebuf_init(void);
 
 struct queuebuf *queuebuf_new_from_packetbuf(void);
+struct queuebuf *queuebuf_new(uint16_t len,
+			     const struct packetbuf_attr *attrs,
+			     const struct packetbuf_addr *addrs);
 void queuebuf_free(struct queuebuf *b);
 void queuebuf_to_packetbuf(struct queuebuf *b);
 
 void *queuebuf_dataptr(struct queuebuf *b);
 int queuebuf_datalen(struct queuebuf *b);
+const rimeaddr_t *queuebuf_addr(struct queuebuf *b, uint8_t type);
 
 
 #endif /* __QUEUEBUF_H__ */
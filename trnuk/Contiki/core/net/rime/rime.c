@@ -113,6 +113,7 @@ rime_init(const struct mac_driver *m)
   route_init();
   packetbuf_clear();
   neighbor_init();
+  rimestats_init();
   announcement_init();
   rime_mac = m;
   rime_mac->set_receive_function(input);
@@ -33,14 +33,353 @@
 
 /**
  * \file
- *         A brief description of what this file is.
+ *         Rime statistics
  * \author
  *         Adam Dunkels <adam@sics.se>
  */
 
+#include <string.h>
+
+#include "contiki.h"
+#include "lib/crc16.h"
 #include "net/rime/rimestats.h"
+#include "net/rime/addrtable.h"
+#include "net/rime/packetbuf.h"
 /*---------------------------------------------------------------------------*/
 
 struct rimestats rimestats;
 
+#define NUM_GLOBALS (sizeof(struct rimestats) / sizeof(unsigned long))
+#define NUM_COUNTERS (sizeof(struct rimestats_link) / sizeof(uint16_t))
+#define NEIGHBOR_COUNTERS ((sizeof(struct rimestats_neighbor) -           \
+			   offsetof(struct rimestats_neighbor, link)) /     \
+			  sizeof(uint16_t))
+
+#define FORMAT_VERSION 1
+
+#if RIMESTATS_LINKS
+static struct rimestats_neighbor neighbors_mem[RIMESTATS_NEIGHBORS];
+ADDRTABLE(neighbors, struct rimestats_neighbor, neighbors_mem, addr);
+
+static struct rimestats_channel channels[RIMESTATS_CHANNELS];
+static uint8_t num_channels;
+#endif /* RIMESTATS_LINKS */
+
+/*---------------------------------------------------------------------------*/
+void
+rimestats_init(void)
+{
+#if RIMESTATS_LINKS
+  addrtable_init(&neighbors, 0, NULL);
+  num_channels = 0;
+#endif /* RIMESTATS_LINKS */
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_reset(void)
+{
+#if RIMESTATS_LINKS
+  struct rimestats_neighbor *n;
+
+  while((n = addrtable_next(&neighbors, NULL)) != NULL) {
+    addrtable_remove(&neighbors, n);
+  }
+  num_channels = 0;
+#endif /* RIMESTATS_LINKS */
+  memset(&rimestats, 0, sizeof(rimestats));
+}
+/*---------------------------------------------------------------------------*/
+struct rimestats_neighbor *
+rimestats_neighbor(const rimeaddr_t *addr)
+{
+#if RIMESTATS_LINKS
+  return addrtable_find(&neighbors, addr);
+#else /* RIMESTATS_LINKS */
+  return NULL;
+#endif /* RIMESTATS_LINKS */
+}
+/*---------------------------------------------------------------------------*/
+struct rimestats_neighbor *
+rimestats_neighbor_next(struct rimestats_neighbor *prev)
+{
+#if RIMESTATS_LINKS
+  return addrtable_next(&neighbors, prev);
+#else /* RIMESTATS_LINKS */
+  return NULL;
+#endif /* RIMESTATS_LINKS */
+}
+/*---------------------------------------------------------------------------*/
+struct rimestats_channel *
+rimestats_channel(uint16_t channelno)
+{
+#if RIMESTATS_LINKS
+  uint8_t i;
+
+  for(i = 0; i < num_channels; ++i) {
+    if(channels[i].channelno == channelno) {
+      return &channels[i];
+    }
+  }
+#endif /* RIMESTATS_LINKS */
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+struct rimestats_channel *
+rimestats_channel_next(struct rimestats_channel *prev)
+{
+#if RIMESTATS_LINKS
+  if(prev == NULL) {
+    prev = channels;
+  } else {
+    prev++;
+  }
+  if(prev < &channels[num_channels]) {
+    return prev;
+  }
+#endif /* RIMESTATS_LINKS */
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+#if RIMESTATS_LINKS
+static struct rimestats_neighbor *
+neighbor(const rimeaddr_t *addr)
+{
+  struct rimestats_neighbor *n;
+
+  if(addr == NULL ||
+     rimeaddr_cmp(addr, &rimeaddr_null) ||
+     rimeaddr_cmp(addr, &rimeaddr_node_addr)) {
+    return NULL;
+  }
+  n = addrtable_find(&neighbors, addr);
+  if(n == NULL) {
+    /* The least recently active neighbor makes room for the new
+       one. */
+    n = addrtable_add(&neighbors, addr);
+    memset(&n->link, 0, sizeof(*n) - offsetof(struct rimestats_neighbor, link));
+  } else {
+    addrtable_refresh(&neighbors, n);
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static struct rimestats_channel *
+channel(uint16_t channelno)
+{
+  struct rimestats_channel *c;
+
+  c = rimestats_channel(channelno);
+  if(c == NULL && num_channels < RIMESTATS_CHANNELS) {
+    c = &channels[num_channels++];
+    memset(c, 0, sizeof(*c));
+    c->channelno = channelno;
+  }
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+bin(int value, int min, int step)
+{
+  if(value < min) {
+    return 0;
+  }
+  value = (value - min) / step;
+  return value < RIMESTATS_BINS ? value : RIMESTATS_BINS - 1;
+}
+#endif /* RIMESTATS_LINKS */
+/*---------------------------------------------------------------------------*/
+void
+rimestats_link_add(const rimeaddr_t *addr, uint16_t channelno,
+		   uint8_t counter)
+{
+#if RIMESTATS_LINKS
+  struct rimestats_neighbor *n;
+  struct rimestats_channel *c;
+
+  n = neighbor(addr);
+  if(n != NULL) {
+    ((uint16_t *)&n->link)[counter]++;
+  }
+  c = channel(channelno);
+  if(c != NULL) {
+    ((uint16_t *)&c->link)[counter]++;
+  }
+#endif /* RIMESTATS_LINKS */
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_input(void)
+{
+#if RIMESTATS_LINKS
+  struct rimestats_neighbor *n;
+  struct rimestats_channel *c;
+  uint16_t lqi;
+
+  n = neighbor(packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  if(n != NULL) {
+    n->link.rx++;
+    /* A link quality of zero means that the radio does not report
+       the signal strength or the link quality. */
+    lqi = packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY);
+    if(lqi != 0) {
+      n->rssi[bin((int16_t)packetbuf_attr(PACKETBUF_ATTR_RSSI),
+		  RIMESTATS_RSSI_MIN, RIMESTATS_RSSI_STEP)]++;
+      n->lqi[bin(lqi, RIMESTATS_LQI_MIN, RIMESTATS_LQI_STEP)]++;
+    }
+  }
+  c = channel(packetbuf_attr(PACKETBUF_ATTR_CHANNEL));
+  if(c != NULL) {
+    c->link.rx++;
+  }
+#endif /* RIMESTATS_LINKS */
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_output(void)
+{
+  RIMESTATS_LINK_ADD(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+		     packetbuf_attr(PACKETBUF_ATTR_CHANNEL), tx);
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_rexmits(const rimeaddr_t *addr, uint8_t rexmits)
+{
+#if RIMESTATS_LINKS
+  struct rimestats_neighbor *n;
+
+  n = neighbor(addr);
+  if(n != NULL) {
+    n->rexmits[rexmits < RIMESTATS_BINS ? rexmits : RIMESTATS_BINS - 1]++;
+  }
+#endif /* RIMESTATS_LINKS */
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_delta(struct rimestats *d, const struct rimestats *now,
+		const struct rimestats *then)
+{
+  uint8_t i;
+
+  for(i = 0; i < NUM_GLOBALS; ++i) {
+    ((unsigned long *)d)[i] = ((unsigned long *)now)[i] -
+      ((unsigned long *)then)[i];
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+delta16(uint16_t *d, const uint16_t *now, const uint16_t *then, uint8_t n)
+{
+  uint8_t i;
+
+  for(i = 0; i < n; ++i) {
+    d[i] = now[i] - then[i];
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_neighbor_delta(struct rimestats_neighbor *d,
+			 const struct rimestats_neighbor *now,
+			 const struct rimestats_neighbor *then)
+{
+  rimeaddr_copy(&d->addr, &now->addr);
+  delta16((uint16_t *)&d->link, (uint16_t *)&now->link,
+	  (uint16_t *)&then->link, NEIGHBOR_COUNTERS);
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_channel_delta(struct rimestats_channel *d,
+			const struct rimestats_channel *now,
+			const struct rimestats_channel *then)
+{
+  d->channelno = now->channelno;
+  delta16((uint16_t *)&d->link, (uint16_t *)&now->link,
+	  (uint16_t *)&then->link, NUM_COUNTERS);
+}
+/*---------------------------------------------------------------------------*/
+static void (* export_writeb)(unsigned char c);
+static unsigned short export_crc;
+
+static void
+put(uint32_t value, uint8_t len)
+{
+  while(len-- > 0) {
+    export_crc = crc16_add(value & 0xff, export_crc);
+    export_writeb(value & 0xff);
+    value >>= 8;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+put_addr(const rimeaddr_t *addr)
+{
+  uint8_t i;
+
+  for(i = 0; i < sizeof(rimeaddr_t); ++i) {
+    put(addr->u8[i], 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+put16(const uint16_t *values, uint8_t n)
+{
+  while(n-- > 0) {
+    put(*values++, 2);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_export(void (* writeb)(unsigned char c))
+{
+  uint8_t i, num_neighbors;
+#if RIMESTATS_LINKS
+  struct rimestats_neighbor *n;
+  struct rimestats_channel *c;
+
+  num_neighbors = addrtable_num(&neighbors);
+#else /* RIMESTATS_LINKS */
+  num_neighbors = 0;
+#endif /* RIMESTATS_LINKS */
+
+  export_writeb = writeb;
+  writeb('R');
+  writeb('S');
+  writeb(FORMAT_VERSION);
+  export_crc = 0;
+
+  put(NUM_GLOBALS, 1);
+  put(NUM_COUNTERS, 1);
+  put(RIMESTATS_BINS, 1);
+  put(num_neighbors, 1);
+#if RIMESTATS_LINKS
+  put(num_channels, 1);
+#else /* RIMESTATS_LINKS */
+  put(0, 1);
+#endif /* RIMESTATS_LINKS */
+  put(sizeof(rimeaddr_t), 1);
+  put((uint8_t)RIMESTATS_RSSI_MIN, 1);
+  put(RIMESTATS_RSSI_STEP, 1);
+  put((uint8_t)RIMESTATS_LQI_MIN, 1);
+  put(RIMESTATS_LQI_STEP, 1);
+  put_addr(&rimeaddr_node_addr);
+  put(clock_seconds(), 4);
+
+  for(i = 0; i < NUM_GLOBALS; ++i) {
+    put(((unsigned long *)&rimestats)[i], 4);
+  }
+
+#if RIMESTATS_LINKS
+  for(n = addrtable_next(&neighbors, NULL); n != NULL;
+      n = addrtable_next(&neighbors, n)) {
+    put_addr(&n->addr);
+    put16((uint16_t *)&n->link, NEIGHBOR_COUNTERS);
+  }
+  for(c = channels; c < &channels[num_channels]; ++c) {
+    put(c->channelno, 2);
+    put16((uint16_t *)&c->link, NUM_COUNTERS);
+  }
+#endif /* RIMESTATS_LINKS */
+
+  writeb(export_crc & 0xff);
+  writeb(export_crc >> 8);
+}
 /*---------------------------------------------------------------------------*/
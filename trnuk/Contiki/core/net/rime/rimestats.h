@@ -41,6 +41,10 @@
 #ifndef __RIMESTATS_H__
 #define __RIMESTATS_H__
 
+#include <stddef.h>
+
+#include "net/rime/rimeaddr.h"
+
 struct rimestats {
   unsigned long tx, rx;
 
@@ -54,10 +58,203 @@ struct rimestats {
     sendingdrop; /* Packet dropped when we were sending a packet */
 
   unsigned long lltx, llrx;
+
+  /* Queued packets moved to and from external flash: */
+  unsigned long xmemspill, xmemrefill,
+    xmemdrop; /* Packet dropped because the flash log was full */
+
+  /* Lookups in the flood duplicate cache: */
+  unsigned long dupcachehit, dupcachemiss;
+
+  unsigned long llrxoverflow; /* Frames lost to a radio RXFIFO overflow */
 };
 
 extern struct rimestats rimestats;
 
 #define RIMESTATS_ADD(x) rimestats.x++
 
+/*
+ * Besides the global counters, a few counters are kept for each of
+ * the neighbors and each of the channels that we have most recently
+ * sent to or received from. The tables are bounded: when a table is
+ * full, the least recently active neighbor is replaced, and a new
+ * channel is not counted.
+ *
+ * The per-link counters are 16 bits and wrap around, so the
+ * difference between two snapshots is correct as long as less than
+ * 65536 events happened in between.
+ */
+
+#ifdef RIMESTATS_CONF_LINKS
+#define RIMESTATS_LINKS RIMESTATS_CONF_LINKS
+#else /* RIMESTATS_CONF_LINKS */
+#define RIMESTATS_LINKS 1
+#endif /* RIMESTATS_CONF_LINKS */
+
+#ifdef RIMESTATS_CONF_NEIGHBORS
+#define RIMESTATS_NEIGHBORS RIMESTATS_CONF_NEIGHBORS
+#else /* RIMESTATS_CONF_NEIGHBORS */
+#define RIMESTATS_NEIGHBORS 4
+#endif /* RIMESTATS_CONF_NEIGHBORS */
+
+#ifdef RIMESTATS_CONF_CHANNELS
+#define RIMESTATS_CHANNELS RIMESTATS_CONF_CHANNELS
+#else /* RIMESTATS_CONF_CHANNELS */
+#define RIMESTATS_CHANNELS 4
+#endif /* RIMESTATS_CONF_CHANNELS */
+
+/* The number of bins in the RSSI, link quality, and retransmission
+   histograms. */
+#define RIMESTATS_BINS 8
+
+/* The default bins cover the RSSI and correlation values that the
+   CC2420 reports for packets it can receive. */
+#ifdef RIMESTATS_CONF_RSSI_MIN
+#define RIMESTATS_RSSI_MIN RIMESTATS_CONF_RSSI_MIN
+#define RIMESTATS_RSSI_STEP RIMESTATS_CONF_RSSI_STEP
+#else /* RIMESTATS_CONF_RSSI_MIN */
+#define RIMESTATS_RSSI_MIN -50
+#define RIMESTATS_RSSI_STEP 12
+#endif /* RIMESTATS_CONF_RSSI_MIN */
+
+#ifdef RIMESTATS_CONF_LQI_MIN
+#define RIMESTATS_LQI_MIN RIMESTATS_CONF_LQI_MIN
+#define RIMESTATS_LQI_STEP RIMESTATS_CONF_LQI_STEP
+#else /* RIMESTATS_CONF_LQI_MIN */
+#define RIMESTATS_LQI_MIN 48
+#define RIMESTATS_LQI_STEP 8
+#endif /* RIMESTATS_CONF_LQI_MIN */
+
+struct rimestats_link {
+  uint16_t tx, rx, reliabletx, reliablerx, rexmit, timedout, ackrx;
+};
+
+struct rimestats_neighbor {
+  rimeaddr_t addr;
+  struct rimestats_link link;
+  /* Received packets by signal strength and by link quality, in bins
+     of RIMESTATS_RSSI_STEP and RIMESTATS_LQI_STEP from
+     RIMESTATS_RSSI_MIN and RIMESTATS_LQI_MIN. The first and the last
+     bin also hold the values below and above. */
+  uint16_t rssi[RIMESTATS_BINS];
+  uint16_t lqi[RIMESTATS_BINS];
+  /* Acknowledged reliable packets by the number of retransmissions
+     they needed. The last bin holds RIMESTATS_BINS - 1 or more. */
+  uint16_t rexmits[RIMESTATS_BINS];
+};
+
+struct rimestats_channel {
+  uint16_t channelno;
+  struct rimestats_link link;
+};
+
+#if RIMESTATS_LINKS
+
+#define RIMESTATS_LINK_ADD(addr, channel, x)                            \
+  rimestats_link_add(addr, channel,                                     \
+                     offsetof(struct rimestats_link, x) / sizeof(uint16_t))
+#define RIMESTATS_INPUT() rimestats_input()
+#define RIMESTATS_OUTPUT() rimestats_output()
+#define RIMESTATS_REXMITS(addr, n) rimestats_rexmits(addr, n)
+
+#else /* RIMESTATS_LINKS */
+
+#define RIMESTATS_LINK_ADD(addr, channel, x)
+#define RIMESTATS_INPUT()
+#define RIMESTATS_OUTPUT()
+#define RIMESTATS_REXMITS(addr, n)
+
+#endif /* RIMESTATS_LINKS */
+
+void rimestats_init(void);
+
+/**
+ * \brief      Clear all counters and tables
+ */
+void rimestats_reset(void);
+
+void rimestats_link_add(const rimeaddr_t *addr, uint16_t channel,
+			uint8_t counter);
+
+/**
+ * \brief      Count the packet in the packetbuf as received
+ *
+ *             Called by chameleon when a packet has been parsed. The
+ *             sender, channel, RSSI, and link quality are taken from
+ *             the packet attributes.
+ */
+void rimestats_input(void);
+
+/**
+ * \brief      Count the packet in the packetbuf as sent
+ */
+void rimestats_output(void);
+
+/**
+ * \brief      Count a reliable packet as acknowledged after n retransmissions
+ */
+void rimestats_rexmits(const rimeaddr_t *addr, uint8_t n);
+
+/**
+ * \brief      Find the counters of a neighbor or a channel
+ * \return     The counters, or NULL if they are not in the table
+ */
+struct rimestats_neighbor *rimestats_neighbor(const rimeaddr_t *addr);
+struct rimestats_channel *rimestats_channel(uint16_t channelno);
+
+/**
+ * \brief      Iterate over the neighbor or channel table
+ * \param prev The previous entry, or NULL to get the first one
+ * \return     The next entry, or NULL if there are no more
+ */
+struct rimestats_neighbor *rimestats_neighbor_next(struct rimestats_neighbor *prev);
+struct rimestats_channel *rimestats_channel_next(struct rimestats_channel *prev);
+
+/**
+ * \brief      Compute the difference between two snapshots
+ * \param d    The difference, now - then. May be the same as now.
+ *
+ *             A snapshot is a copy of the counters: the rimestats
+ *             structure or an entry of the neighbor or the channel
+ *             table. Structure assignment is enough to take one.
+ */
+void rimestats_delta(struct rimestats *d, const struct rimestats *now,
+		     const struct rimestats *then);
+void rimestats_neighbor_delta(struct rimestats_neighbor *d,
+			      const struct rimestats_neighbor *now,
+			      const struct rimestats_neighbor *then);
+void rimestats_channel_delta(struct rimestats_channel *d,
+			     const struct rimestats_channel *now,
+			     const struct rimestats_channel *then);
+
+/**
+ * \brief      Write all counters in binary form
+ * \param writeb A function that writes one byte, such as a serial
+ *             port output function
+ *
+ *             The counters are written as one frame, with all
+ *             multi-byte values in little endian byte order:
+ *
+ *             - The two bytes 'R' 'S' and the format version, 1.
+ *             - The number of global counters, link counters,
+ *               histogram bins, neighbors, and channels, one byte
+ *               each, and the size of a Rime address.
+ *             - RIMESTATS_RSSI_MIN, RIMESTATS_RSSI_STEP,
+ *               RIMESTATS_LQI_MIN, and RIMESTATS_LQI_STEP, one
+ *               signed byte each.
+ *             - Our address and clock_seconds(), four bytes.
+ *             - The global counters, four bytes each, in the order of
+ *               struct rimestats.
+ *             - For each neighbor, its address, its link counters,
+ *               and its RSSI, link quality, and retransmission
+ *               histograms, two bytes each.
+ *             - For each channel, its number and its link counters,
+ *               two bytes each.
+ *             - A CRC-16 of everything after the version byte.
+ *
+ *             The tools/rimestats-print program decodes the frames in
+ *             a serial port log.
+ */
+void rimestats_export(void (* writeb)(unsigned char c));
+
 #endif /* __RIMESTATS_H__ */
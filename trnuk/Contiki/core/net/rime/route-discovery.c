@@ -209,53 +209,44 @@ rreq_packet_received(struct netflood_conn *nf, rimeaddr_t *from,
   struct route_discovery_conn *c = (struct route_discovery_conn *)
     ((char *)nf - offsetof(struct route_discovery_conn, rreqconn));
 
-  PRINTF("%d.%d: rreq_packet_received from %d.%d hops %d rreq_id %d last %d.%d/%d\n",
+  PRINTF("%d.%d: rreq_packet_received from %d.%d hops %d rreq_id %d\n",
 	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	 from->u8[0], from->u8[1],
-	 hops, msg->rreq_id,
-     c->last_rreq_originator.u8[0],
-     c->last_rreq_originator.u8[1],
-	 c->last_rreq_id);
+	 hops, msg->rreq_id);
 
-  if(!(rimeaddr_cmp(&c->last_rreq_originator, originator) &&
-       c->last_rreq_id == msg->rreq_id)) {
-
-    PRINTF("%d.%d: rreq_packet_received: request for %d.%d originator %d.%d / %d\n",
-	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-	   msg->dest.u8[0], msg->dest.u8[1],
-	   originator->u8[0], originator->u8[1],
-	   msg->rreq_id);
-
-    rimeaddr_copy(&c->last_rreq_originator, originator);
-    c->last_rreq_id = msg->rreq_id;
+  /* The rreq_id is the netflood sequence number, so netflood's
+     duplicate cache passes up each route request once only. */
+  PRINTF("%d.%d: rreq_packet_received: request for %d.%d originator %d.%d / %d\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	 msg->dest.u8[0], msg->dest.u8[1],
+	 originator->u8[0], originator->u8[1],
+	 msg->rreq_id);
 
-    if(rimeaddr_cmp(&msg->dest, &rimeaddr_node_addr)) {
-      PRINTF("%d.%d: route_packet_received: route request for our address\n",
-	     rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1]);
-      PRINTF("from %d.%d hops %d rssi %d lqi %d\n",
-	     from->u8[0], from->u8[1],
-	     hops,
-	     packetbuf_attr(PACKETBUF_ATTR_RSSI),
-	     packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY));
+  if(rimeaddr_cmp(&msg->dest, &rimeaddr_node_addr)) {
+    PRINTF("%d.%d: route_packet_received: route request for our address\n",
+	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1]);
+    PRINTF("from %d.%d hops %d rssi %d lqi %d\n",
+	   from->u8[0], from->u8[1],
+	   hops,
+	   packetbuf_attr(PACKETBUF_ATTR_RSSI),
+	   packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY));
 
-      insert_route(originator, from, hops);
-      
-      /* Send route reply back to source. */
-      send_rrep(c, originator);
-      return 0; /* Don't continue to flood the rreq packet. */
-    } else {
-      /*      PRINTF("route request for %d\n", msg->dest_id);*/
-      PRINTF("from %d.%d hops %d rssi %d lqi %d\n",
-	     from->u8[0], from->u8[1],
-	     hops,
-	     packetbuf_attr(PACKETBUF_ATTR_RSSI),
-	     packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY));
-      insert_route(originator, from, hops);
-    }
+    insert_route(originator, from, hops);
     
-    return 1;
+    /* Send route reply back to source. */
+    send_rrep(c, originator);
+    return 0; /* Don't continue to flood the rreq packet. */
+  } else {
+    /*      PRINTF("route request for %d\n", msg->dest_id);*/
+    PRINTF("from %d.%d hops %d rssi %d lqi %d\n",
+	   from->u8[0], from->u8[1],
+	   hops,
+	   packetbuf_attr(PACKETBUF_ATTR_RSSI),
+	   packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY));
+    insert_route(originator, from, hops);
   }
-  return 0; /* Don't forward packet. */
+  
+  return 1;
 }
 /*---------------------------------------------------------------------------*/
 static const struct unicast_callbacks rrep_callbacks = {rrep_packet_received};
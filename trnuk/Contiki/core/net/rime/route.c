@@ -45,9 +45,7 @@
 
 #include <stdio.h>
 
-#include "lib/list.h"
-#include "lib/memb.h"
-#include "net/rime/ctimer.h"
+#include "net/rime/addrtable.h"
 #include "net/rime/route.h"
 #include "contiki-conf.h"
 
@@ -70,12 +68,10 @@
 #endif /* ROUTE_CONF_DEFAULT_LIFETIME */
 
 /*
- * List of route entries.
+ * Table of route entries, indexed by destination.
  */
-LIST(route_table);
-MEMB(route_mem, struct route_entry, NUM_RT_ENTRIES);
-
-static struct ctimer t;
+static struct route_entry route_mem[NUM_RT_ENTRIES];
+ADDRTABLE(route_table, struct route_entry, route_mem, dest);
 
 static int max_time = DEFAULT_LIFETIME;
 
@@ -90,32 +86,22 @@ static int max_time = DEFAULT_LIFETIME;
 
 /*---------------------------------------------------------------------------*/
 static void
-periodic(void *ptr)
+removed(void *ptr)
 {
-  struct route_entry *e;
-
-  for(e = list_head(route_table); e != NULL; e = e->next) {
-    e->time++;
-    if(e->time >= max_time) {
-      PRINTF("route periodic: removing entry to %d.%d with nexthop %d.%d and cost %d\n",
-	     e->dest.u8[0], e->dest.u8[1],
-	     e->nexthop.u8[0], e->nexthop.u8[1],
-	     e->cost);
-      list_remove(route_table, e);
-      memb_free(&route_mem, e);
-    }
-  }
+#if DEBUG
+  struct route_entry *e = ptr;
 
-  ctimer_set(&t, CLOCK_SECOND, periodic, NULL);
+  PRINTF("route: removing entry to %d.%d with nexthop %d.%d and cost %d\n",
+	 e->dest.u8[0], e->dest.u8[1],
+	 e->nexthop.u8[0], e->nexthop.u8[1],
+	 e->cost);
+#endif /* DEBUG */
 }
 /*---------------------------------------------------------------------------*/
 void
 route_init(void)
 {
-  list_init(route_table);
-  memb_init(&route_mem);
-
-  ctimer_set(&t, CLOCK_SECOND, periodic, NULL);
+  addrtable_init(&route_table, max_time, removed);
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -124,32 +110,18 @@ route_add(const rimeaddr_t *dest, const rimeaddr_t *nexthop,
 {
   struct route_entry *e;
 
-  /* Avoid inserting duplicate entries. */
+  /* Avoid inserting duplicate entries. If the table is full, the
+     entry that has gone longest without being refreshed is
+     replaced. */
   e = route_lookup(dest);
-  if(e != NULL && rimeaddr_cmp(&e->nexthop, nexthop)) {
-    list_remove(route_table, e);
-  } else {
-    /* Allocate a new entry or reuse the oldest entry with highest cost. */
-    e = memb_alloc(&route_mem);
-    if(e == NULL) {
-      /* Remove oldest entry.  XXX */
-      e = list_chop(route_table);
-      PRINTF("route_add: removing entry to %d.%d with nexthop %d.%d and cost %d\n",
-	     e->dest.u8[0], e->dest.u8[1],
-	     e->nexthop.u8[0], e->nexthop.u8[1],
-	     e->cost);
-    }
+  if(e == NULL || !rimeaddr_cmp(&e->nexthop, nexthop)) {
+    e = addrtable_add(&route_table, dest);
   }
 
-  rimeaddr_copy(&e->dest, dest);
   rimeaddr_copy(&e->nexthop, nexthop);
   e->cost = cost;
   e->seqno = seqno;
-  e->time = 0;
-  e->decay = 0;
-
-  /* New entry goes first. */
-  list_push(route_table, e);
+  route_refresh(e);
 
   PRINTF("route_add: new entry to %d.%d with nexthop %d.%d and cost %d\n",
 	 e->dest.u8[0], e->dest.u8[1],
@@ -170,15 +142,11 @@ route_lookup(const rimeaddr_t *dest)
   best_entry = NULL;
   
   /* Find the route with the lowest cost. */
-  for(e = list_head(route_table); e != NULL; e = e->next) {
-    /*    printf("route_lookup: comparing %d.%d.%d.%d with %d.%d.%d.%d\n",
-	   uip_ipaddr_to_quad(dest), uip_ipaddr_to_quad(&e->dest));*/
-
-    if(rimeaddr_cmp(dest, &e->dest)) {
-      if(e->cost < lowest_cost) {
-	best_entry = e;
-	lowest_cost = e->cost;
-      }
+  for(e = addrtable_find(&route_table, dest); e != NULL;
+      e = addrtable_find_next(&route_table, e)) {
+    if(e->cost < lowest_cost) {
+      best_entry = e;
+      lowest_cost = e->cost;
     }
   }
   return best_entry;
@@ -190,26 +158,30 @@ route_refresh(struct route_entry *e)
   if(e != NULL) {
     /* Refresh age of route so that used routes do not get thrown
        out. */
-    e->time = 0;
+    addrtable_refresh(&route_table, e);
     e->decay = 0;
+    e->time_last_decay = addrtable_seconds();
   }
 }
 /*---------------------------------------------------------------------------*/
 void
 route_decay(struct route_entry *e)
 {
+  uint16_t now;
+
   /* If routes are not refreshed, they decay over time. This function
      is called to decay a route. The route can only be decayed once
      per second. */
-  PRINTF("route_decay: time %d last %d decay %d for entry to %d.%d with nexthop %d.%d and cost %d\n",
-	 e->time, e->time_last_decay, e->decay,
+  now = addrtable_seconds();
+  PRINTF("route_decay: time %u last %u decay %d for entry to %d.%d with nexthop %d.%d and cost %d\n",
+	 now, e->time_last_decay, e->decay,
 	 e->dest.u8[0], e->dest.u8[1],
 	 e->nexthop.u8[0], e->nexthop.u8[1],
 	 e->cost);
   
-  if(e->time != e->time_last_decay) {
+  if(now != e->time_last_decay) {
     /* Do not decay a route too often - not more than once per second. */
-    e->time_last_decay = e->time;
+    e->time_last_decay = now;
     e->decay++;
 
     if(e->decay >= DECAY_THRESHOLD) {
@@ -225,8 +197,7 @@ route_decay(struct route_entry *e)
 void
 route_remove(struct route_entry *e)
 {
-  list_remove(route_table, e);
-  memb_free(&route_mem, e);
+  addrtable_remove(&route_table, e);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -235,9 +206,9 @@ route_flush_all(void)
   struct route_entry *e;
 
   while(1) {
-    e = list_pop(route_table);
+    e = addrtable_next(&route_table, NULL);
     if(e != NULL) {
-      memb_free(&route_mem, e);
+      addrtable_remove(&route_table, e);
     } else {
       break;
     }
@@ -248,18 +219,13 @@ void
 route_set_lifetime(int seconds)
 {
   max_time = seconds;
+  addrtable_set_maxage(&route_table, seconds);
 }
 /*---------------------------------------------------------------------------*/
 int
 route_num(void)
 {
-  struct route_entry *e;
-  int i = 0;
-
-  for(e = list_head(route_table); e != NULL; e = e->next) {
-    i++;
-  }
-  return i;
+  return addrtable_num(&route_table);
 }
 /*---------------------------------------------------------------------------*/
 struct route_entry *
@@ -268,7 +234,8 @@ route_get(int num)
   struct route_entry *e;
   int i = 0;
 
-  for(e = list_head(route_table); e != NULL; e = e->next) {
+  for(e = addrtable_next(&route_table, NULL); e != NULL;
+      e = addrtable_next(&route_table, e)) {
     if(i == num) {
       return e;
     }
@@ -55,15 +55,13 @@
 #include "net/rime/rimeaddr.h"
 
 struct route_entry {
-  struct route_entry *next;
   rimeaddr_t dest;
   rimeaddr_t nexthop;
   uint8_t seqno;
   uint8_t cost;
-  uint8_t time;
 
   uint8_t decay;
-  uint8_t time_last_decay;
+  uint16_t time_last_decay;
 };
 
 void route_init(void);
@@ -71,6 +69,7 @@ int route_add(const rimeaddr_t *dest, const rimeaddr_t *nexthop,
 	      uint8_t cost, uint8_t seqno);
 struct route_entry *route_lookup(const rimeaddr_t *dest);
 void route_refresh(struct route_entry *e);
+void route_decay(struct route_entry *e);
 void route_remove(struct route_entry *e);
 void route_flush_all(void);
 void route_set_lifetime(int seconds);
@@ -51,6 +51,7 @@
 
 #include <stdio.h>
 #include <stddef.h> /* for offsetof */
+#include <string.h>
 
 #include "net/rime.h"
 #include "net/rime/polite.h"
@@ -92,6 +93,425 @@ enum {
 
 #define LT(a, b) ((signed short)((a) - (b)) < 0)
 
+#if RUDOLPH2_WINDOWED
+/* The chunks of a page are sent BURST_INTERVAL apart. */
+#ifdef RUDOLPH2_CONF_BURST_INTERVAL
+#define BURST_INTERVAL RUDOLPH2_CONF_BURST_INTERVAL
+#else
+#define BURST_INTERVAL (CLOCK_SECOND / 16)
+#endif
+
+/* A receiver that has not heard any chunk of the page it is waiting
+   for in NACK_DELAY asks for the chunks it misses. Repeated NACKs
+   back off exponentially, up to NACK_DELAY << NACK_BACKOFF_MAX. */
+#define NACK_DELAY (BURST_INTERVAL * 4)
+#define NACK_BACKOFF_MAX 6
+
+#define FLAG_SENDING       0x08
+#define FLAG_ADVERTISE     0x10
+
+#define NONE      0xffff
+#define LAST_NONE 0xff
+
+#define PAGE_MASK ((uint16_t)(0xffff >> (16 - RUDOLPH2_PAGE_CHUNKS)))
+#define CHUNK_BIT(i) ((uint16_t)1 << (i))
+
+struct rudolph2_nack {
+  struct rudolph2_hdr hdr;
+  uint16_t bits;
+};
+
+static void timed_send(void *ptr);
+
+/*---------------------------------------------------------------------------*/
+static void
+schedule(struct rudolph2_conn *c, clock_time_t interval)
+{
+  ctimer_set(&c->t, interval, timed_send, c);
+}
+/*---------------------------------------------------------------------------*/
+/* The number of pages that we have all of. */
+static uint16_t
+pages_complete(struct rudolph2_conn *c)
+{
+  if(c->flags & FLAG_LAST_RECEIVED) {
+    return (c->rcv_nxt + RUDOLPH2_PAGE_CHUNKS - 1) / RUDOLPH2_PAGE_CHUNKS;
+  }
+  return c->rcv_nxt / RUDOLPH2_PAGE_CHUNKS;
+}
+/*---------------------------------------------------------------------------*/
+/* The chunks that a page we have all of consists of. */
+static uint16_t
+page_mask(struct rudolph2_conn *c, uint16_t page)
+{
+  uint16_t n;
+
+  n = c->rcv_nxt - page * RUDOLPH2_PAGE_CHUNKS;
+  if((c->flags & FLAG_LAST_RECEIVED) && n < RUDOLPH2_PAGE_CHUNKS) {
+    return CHUNK_BIT(n) - 1;
+  }
+  return PAGE_MASK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+send_chunk(struct rudolph2_conn *c, uint16_t chunk)
+{
+  struct rudolph2_hdr *hdr;
+  uint16_t page, offset;
+  int len;
+
+  page = chunk / RUDOLPH2_PAGE_CHUNKS;
+  if(c->buf_page != page) {
+    /* Read the whole page from flash at once. */
+    len = 0;
+    if(c->cb->read_chunk) {
+      len = c->cb->read_chunk(c, page * RUDOLPH2_PAGESIZE,
+			      c->snd_buf, RUDOLPH2_PAGESIZE);
+    }
+    c->buf_len = len > 0 ? len : 0;
+    c->buf_page = page;
+  }
+
+  offset = (chunk % RUDOLPH2_PAGE_CHUNKS) * RUDOLPH2_DATASIZE;
+  len = c->buf_len > offset ? c->buf_len - offset : 0;
+  if(len > RUDOLPH2_DATASIZE) {
+    len = RUDOLPH2_DATASIZE;
+  }
+
+  packetbuf_clear();
+  hdr = packetbuf_dataptr();
+  hdr->type = TYPE_DATA;
+  hdr->hops_from_base = c->hops_from_base;
+  hdr->version = c->version;
+  hdr->chunk = chunk;
+  memcpy((uint8_t *)hdr + sizeof(struct rudolph2_hdr), &c->snd_buf[offset], len);
+  packetbuf_set_datalen(sizeof(struct rudolph2_hdr) + len);
+
+  PRINTF("%d.%d: send chunk %d\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1], chunk);
+
+  /* Only an identical chunk from a node at the same distance from
+     the base suppresses ours. */
+  if(polite_send(&c->c, BURST_INTERVAL, sizeof(struct rudolph2_hdr))) {
+    c->flags |= FLAG_SENDING;
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Put the chunk that is waiting to be sent back in the burst, if a
+   NACK is to replace it. */
+static void
+requeue_pending(struct rudolph2_conn *c)
+{
+  uint16_t page;
+
+  if(c->snd_nxt == NONE) {
+    return;
+  }
+  page = c->snd_nxt / RUDOLPH2_PAGE_CHUNKS;
+  if(c->snd_bits == 0) {
+    c->snd_page = page;
+  }
+  if(page == c->snd_page) {
+    c->snd_bits |= CHUNK_BIT(c->snd_nxt % RUDOLPH2_PAGE_CHUNKS);
+  }
+  c->snd_nxt = NONE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_nack(struct rudolph2_conn *c)
+{
+  struct rudolph2_nack *nack;
+  uint16_t want;
+
+  if(c->rcv_last == LAST_NONE) {
+    want = PAGE_MASK;
+  } else {
+    want = (uint16_t)((2UL << c->rcv_last) - 1);
+  }
+
+  requeue_pending(c);
+  packetbuf_clear();
+  nack = packetbuf_dataptr();
+  nack->hdr.type = TYPE_NACK;
+  nack->hdr.hops_from_base = c->hops_from_base;
+  nack->hdr.version = c->version;
+  nack->hdr.chunk = c->rcv_nxt / RUDOLPH2_PAGE_CHUNKS;
+  nack->bits = want & ~c->rcv_bits;
+  packetbuf_set_datalen(sizeof(struct rudolph2_nack));
+
+  PRINTF("%d.%d: Sending nack for page %d bits 0x%04x\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	 nack->hdr.chunk, nack->bits);
+  if(polite_send(&c->c, NACK_TIMEOUT, sizeof(struct rudolph2_nack))) {
+    c->flags |= FLAG_SENDING;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+nack_timeout(void *ptr)
+{
+  struct rudolph2_conn *c = ptr;
+
+  if((c->flags & (FLAG_IS_STOPPED | FLAG_LAST_RECEIVED)) == 0) {
+    send_nack(c);
+    if(c->nacks < NACK_BACKOFF_MAX) {
+      c->nacks++;
+    }
+    ctimer_set(&c->nack_timer, NACK_DELAY << c->nacks, nack_timeout, c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+progress(struct rudolph2_conn *c)
+{
+  c->nacks = 0;
+  ctimer_set(&c->nack_timer, NACK_DELAY, nack_timeout, c);
+}
+/*---------------------------------------------------------------------------*/
+static void
+page_received(struct rudolph2_conn *c)
+{
+  uint16_t page, len;
+  int flag;
+
+  page = c->rcv_nxt / RUDOLPH2_PAGE_CHUNKS;
+  if(c->rcv_last != LAST_NONE) {
+    len = c->rcv_last * RUDOLPH2_DATASIZE + c->rcv_lastlen;
+    flag = RUDOLPH2_FLAG_LASTCHUNK;
+  } else {
+    len = RUDOLPH2_PAGESIZE;
+    flag = RUDOLPH2_FLAG_NONE;
+  }
+
+  PRINTF("%d.%d: received page %d len %d\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1], page, len);
+
+  /* xxx Don't write any data if the application has been stopped. */
+  if((c->flags & FLAG_IS_STOPPED) == 0) {
+    if(page == 0) {
+      c->cb->write_chunk(c, 0, RUDOLPH2_FLAG_NEWFILE, c->rcv_buf, 0);
+    }
+    /* Write the whole page to flash at once. */
+    c->cb->write_chunk(c, page * RUDOLPH2_PAGESIZE, flag, c->rcv_buf, len);
+  }
+
+  /* Keep the page for forwarding, unless the send buffer holds the
+     page that is being sent. */
+  if(c->snd_bits == 0 || c->snd_page != c->buf_page) {
+    memcpy(c->snd_buf, c->rcv_buf, len);
+    c->buf_page = page;
+    c->buf_len = len;
+  }
+
+  c->rcv_bits = 0;
+  if(flag == RUDOLPH2_FLAG_LASTCHUNK) {
+    c->rcv_nxt = page * RUDOLPH2_PAGE_CHUNKS + c->rcv_last + 1;
+    c->flags |= FLAG_LAST_RECEIVED;
+    ctimer_stop(&c->nack_timer);
+  } else {
+    c->rcv_nxt += RUDOLPH2_PAGE_CHUNKS;
+    progress(c);
+  }
+
+  /* Forward the page while receiving the next one. */
+  schedule(c, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+timed_send(void *ptr)
+{
+  struct rudolph2_conn *c = (struct rudolph2_conn *)ptr;
+  uint16_t chunk;
+  uint8_t i;
+
+  if(c->flags & (FLAG_IS_STOPPED | FLAG_SENDING)) {
+    return;
+  }
+
+  if(c->snd_bits == 0) {
+    /* Repair a page that was asked for before pushing a new one. */
+    if(c->nack_bits != 0) {
+      c->snd_page = c->nack_page;
+      c->snd_bits = c->nack_bits;
+      c->nack_bits = 0;
+    } else if(c->push_page < pages_complete(c)) {
+      c->snd_page = c->push_page++;
+      c->snd_bits = page_mask(c, c->snd_page);
+    }
+  }
+
+  if(c->snd_bits != 0) {
+    for(i = 0; (c->snd_bits & CHUNK_BIT(i)) == 0; ++i);
+    c->snd_bits &= ~CHUNK_BIT(i);
+    chunk = c->snd_page * RUDOLPH2_PAGE_CHUNKS + i;
+    c->flags &= ~FLAG_ADVERTISE;
+    if(send_chunk(c, chunk)) {
+      c->snd_nxt = chunk;
+    } else {
+      c->snd_bits |= CHUNK_BIT(i);
+      schedule(c, BURST_INTERVAL);
+    }
+  } else if(c->flags & FLAG_LAST_RECEIVED) {
+    /* Nothing is left to send. Every STEADY_INTERVAL, we send the
+       last chunk to let nodes that have missed the file know about
+       it. */
+    if(c->flags & FLAG_ADVERTISE) {
+      c->flags &= ~FLAG_ADVERTISE;
+      send_chunk(c, c->rcv_nxt - 1);
+    } else {
+      c->flags |= FLAG_ADVERTISE;
+      schedule(c, STEADY_INTERVAL);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+sent(struct polite_conn *polite)
+{
+  struct rudolph2_conn *c = (struct rudolph2_conn *)polite;
+
+  c->flags &= ~FLAG_SENDING;
+  c->snd_nxt = NONE;
+  schedule(c, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+dropped(struct polite_conn *polite)
+{
+  struct rudolph2_conn *c = (struct rudolph2_conn *)polite;
+
+  /* A neighbor sent the same packet. We may not send from here, as
+     the packet is still to be passed to recv(). */
+  c->flags &= ~FLAG_SENDING;
+  c->snd_nxt = NONE;
+  schedule(c, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_nack(struct rudolph2_conn *c)
+{
+  struct rudolph2_nack *nack = packetbuf_dataptr();
+  uint16_t page, bits;
+
+  if(packetbuf_datalen() < sizeof(struct rudolph2_nack)) {
+    return;
+  }
+
+  PRINTF("%d.%d: Got NACK for %d:%d bits 0x%04x (%d:%d)\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	 nack->hdr.version, nack->hdr.chunk, nack->bits,
+	 c->version, c->rcv_nxt);
+  if(nack->hdr.version == c->version) {
+    page = nack->hdr.chunk;
+    bits = nack->bits;
+  } else if(LT(nack->hdr.version, c->version)) {
+    page = 0;
+    bits = PAGE_MASK;
+  } else {
+    return;
+  }
+
+  /* NACKs for pages that we do not have yet are ignored; we push
+     those pages when we get them. */
+  if(page >= pages_complete(c)) {
+    return;
+  }
+  bits &= page_mask(c, page);
+  if(c->snd_bits != 0 && c->snd_page == page) {
+    c->snd_bits |= bits;
+  } else if(c->nack_bits == 0 || page < c->nack_page) {
+    c->nack_page = page;
+    c->nack_bits = bits;
+  } else if(page == c->nack_page) {
+    c->nack_bits |= bits;
+  }
+  schedule(c, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_data(struct rudolph2_conn *c)
+{
+  struct rudolph2_hdr *hdr = packetbuf_dataptr();
+  uint16_t page;
+  uint8_t i;
+  int len;
+
+  if(LT(c->version, hdr->version)) {
+    PRINTF("%d.%d: rudolph2 new version %d, chunk %d\n",
+	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	   hdr->version, hdr->chunk);
+    polite_cancel(&c->c);
+    c->version = hdr->version;
+    c->rcv_nxt = 0;
+    c->rcv_bits = 0;
+    c->rcv_last = LAST_NONE;
+    c->flags &= ~(FLAG_LAST_RECEIVED | FLAG_SENDING | FLAG_ADVERTISE);
+    c->snd_nxt = NONE;
+    c->snd_bits = c->nack_bits = 0;
+    c->push_page = 0;
+    c->buf_page = NONE;
+    ctimer_stop(&c->t);
+    progress(c);
+  }
+
+  if(hdr->version != c->version || (c->flags & FLAG_LAST_RECEIVED)) {
+    return;
+  }
+
+  page = hdr->chunk / RUDOLPH2_PAGE_CHUNKS;
+  if(page == c->rcv_nxt / RUDOLPH2_PAGE_CHUNKS) {
+    i = hdr->chunk % RUDOLPH2_PAGE_CHUNKS;
+    len = packetbuf_datalen() - sizeof(struct rudolph2_hdr);
+    if(len > RUDOLPH2_DATASIZE) {
+      len = RUDOLPH2_DATASIZE;
+    }
+    if((c->rcv_bits & CHUNK_BIT(i)) == 0) {
+      memcpy(&c->rcv_buf[i * RUDOLPH2_DATASIZE],
+	     (uint8_t *)hdr + sizeof(struct rudolph2_hdr), len);
+      c->rcv_bits |= CHUNK_BIT(i);
+      if(len < RUDOLPH2_DATASIZE) {
+	c->rcv_last = i;
+	c->rcv_lastlen = len;
+      }
+    }
+    if(c->rcv_last != LAST_NONE ?
+       (c->rcv_bits & ((2UL << c->rcv_last) - 1)) == (2UL << c->rcv_last) - 1 :
+       c->rcv_bits == PAGE_MASK) {
+      page_received(c);
+    } else {
+      progress(c);
+    }
+  } else if(page > c->rcv_nxt / RUDOLPH2_PAGE_CHUNKS &&
+	    (c->flags & FLAG_SENDING) == 0) {
+    /* The sender has moved on to a later page, so we have missed
+       chunks of ours. */
+    send_nack(c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv(struct polite_conn *polite)
+{
+  struct rudolph2_conn *c = (struct rudolph2_conn *)polite;
+  struct rudolph2_hdr *hdr = packetbuf_dataptr();
+
+  if(packetbuf_datalen() < sizeof(struct rudolph2_hdr)) {
+    return;
+  }
+
+  /* Only accept NACKs from nodes that are farther away from the base
+     than us, and data from nodes that are closer. */
+  if(hdr->type == TYPE_NACK && hdr->hops_from_base > c->hops_from_base) {
+    recv_nack(c);
+  } else if(hdr->type == TYPE_DATA &&
+	    hdr->hops_from_base < c->hops_from_base) {
+    c->hops_from_base = hdr->hops_from_base + 1;
+    recv_data(c);
+  }
+}
+#else /* RUDOLPH2_WINDOWED */
 /*---------------------------------------------------------------------------*/
 static int
 read_data(struct rudolph2_conn *c, uint8_t *dataptr, int chunk)
@@ -360,6 +780,7 @@ recv(struct polite_conn *polite)
     }
   }
 }
+#endif /* RUDOLPH2_WINDOWED */
 /*---------------------------------------------------------------------------*/
 static const struct polite_callbacks polite = { recv, sent, dropped };
 /*---------------------------------------------------------------------------*/
@@ -371,12 +792,26 @@ rudolph2_open(struct rudolph2_conn *c, uint16_t channel,
   c->cb = cb;
   c->version = 0;
   c->hops_from_base = HOPS_MAX;
+#if RUDOLPH2_WINDOWED
+  c->flags = 0;
+  c->rcv_nxt = 0;
+  c->rcv_bits = 0;
+  c->rcv_last = LAST_NONE;
+  c->snd_nxt = NONE;
+  c->snd_bits = c->nack_bits = 0;
+  c->push_page = 0;
+  c->buf_page = NONE;
+#endif /* RUDOLPH2_WINDOWED */
 }
 /*---------------------------------------------------------------------------*/
 void
 rudolph2_close(struct rudolph2_conn *c)
 {
   polite_close(&c->c);
+#if RUDOLPH2_WINDOWED
+  ctimer_stop(&c->t);
+  ctimer_stop(&c->nack_timer);
+#endif /* RUDOLPH2_WINDOWED */
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -384,6 +819,37 @@ rudolph2_send(struct rudolph2_conn *c, clock_time_t send_interval)
 {
   int len;
 
+#if RUDOLPH2_WINDOWED
+  c->hops_from_base = 0;
+  c->version++;
+  polite_cancel(&c->c);
+  ctimer_stop(&c->nack_timer);
+
+  /* Find the number of chunks, reading a page at a time. The last
+     page is left in the send buffer. */
+  c->rcv_nxt = 0;
+  do {
+    len = 0;
+    if(c->cb->read_chunk) {
+      len = c->cb->read_chunk(c, c->rcv_nxt / RUDOLPH2_PAGE_CHUNKS *
+			      RUDOLPH2_PAGESIZE,
+			      c->snd_buf, RUDOLPH2_PAGESIZE);
+    }
+    if(len < 0) {
+      len = 0;
+    }
+    c->buf_page = c->rcv_nxt / RUDOLPH2_PAGE_CHUNKS;
+    c->buf_len = len;
+    c->rcv_nxt += RUDOLPH2_PAGE_CHUNKS;
+  } while(len == RUDOLPH2_PAGESIZE);
+  c->rcv_nxt += len / RUDOLPH2_DATASIZE + 1 - RUDOLPH2_PAGE_CHUNKS;
+
+  c->flags = FLAG_LAST_RECEIVED;
+  c->snd_nxt = NONE;
+  c->snd_bits = c->nack_bits = 0;
+  c->push_page = 0;
+  schedule(c, 0);
+#else /* RUDOLPH2_WINDOWED */
   c->hops_from_base = 0;
   c->version++;
   c->snd_nxt = 0;
@@ -396,6 +862,7 @@ rudolph2_send(struct rudolph2_conn *c, clock_time_t send_interval)
   /*  printf("Highest chunk %d\n", c->rcv_nxt);*/
   send_data(c, SEND_INTERVAL);
   ctimer_set(&c->t, SEND_INTERVAL, timed_send, c);
+#endif /* RUDOLPH2_WINDOWED */
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -403,6 +870,9 @@ rudolph2_stop(struct rudolph2_conn *c)
 {
   polite_cancel(&c->c);
   c->flags |= FLAG_IS_STOPPED;
+#if RUDOLPH2_WINDOWED
+  ctimer_stop(&c->nack_timer);
+#endif /* RUDOLPH2_WINDOWED */
 }
 /*---------------------------------------------------------------------------*/
 /** @} */
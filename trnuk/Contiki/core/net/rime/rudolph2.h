@@ -79,6 +79,36 @@ struct rudolph2_callbacks {
 
 #define RUDOLPH2_DATASIZE 64
 
+/**
+ * \brief      Transfer the data in pages of chunks
+ *
+ *             If RUDOLPH2_CONF_WINDOWED is set, the data is sent in
+ *             pages of RUDOLPH2_PAGE_CHUNKS chunks. A page is sent as
+ *             a burst of chunks, a receiver asks for all chunks it
+ *             misses in a page with one NACK, and a node forwards a
+ *             page as soon as it has received it instead of waiting
+ *             for the whole file. The write_chunk and read_chunk
+ *             callbacks are called with a page at a time, of up to
+ *             RUDOLPH2_PAGESIZE bytes. All nodes must use the same
+ *             setting.
+ */
+#ifdef RUDOLPH2_CONF_WINDOWED
+#define RUDOLPH2_WINDOWED RUDOLPH2_CONF_WINDOWED
+#else
+#define RUDOLPH2_WINDOWED 0
+#endif
+
+#if RUDOLPH2_WINDOWED
+/* The number of chunks in a page, at most 16. */
+#ifdef RUDOLPH2_CONF_PAGE_CHUNKS
+#define RUDOLPH2_PAGE_CHUNKS RUDOLPH2_CONF_PAGE_CHUNKS
+#else
+#define RUDOLPH2_PAGE_CHUNKS 8
+#endif
+
+#define RUDOLPH2_PAGESIZE (RUDOLPH2_PAGE_CHUNKS * RUDOLPH2_DATASIZE)
+#endif /* RUDOLPH2_WINDOWED */
+
 struct rudolph2_conn {
   struct polite_conn c;
   const struct rudolph2_callbacks *cb;
@@ -88,6 +118,17 @@ struct rudolph2_conn {
   uint8_t hops_from_base;
   uint8_t nacks;
   uint8_t flags;
+#if RUDOLPH2_WINDOWED
+  struct ctimer nack_timer;
+  uint16_t rcv_bits;
+  uint8_t rcv_last, rcv_lastlen;
+  uint16_t snd_page, snd_bits;
+  uint16_t nack_page, nack_bits;
+  uint16_t push_page;
+  uint16_t buf_page, buf_len;
+  uint8_t rcv_buf[RUDOLPH2_PAGESIZE];
+  uint8_t snd_buf[RUDOLPH2_PAGESIZE];
+#endif /* RUDOLPH2_WINDOWED */
 };
 
 void rudolph2_open(struct rudolph2_conn *c, uint16_t channel,
@@ -53,12 +53,25 @@
 
 #define REXMIT_TIME CLOCK_SECOND
 
+/* With RUNICAST_CONF_MAC_ACK, the MAC layer waits for a link-layer
+   ACK of each packet and reports it in PACKETBUF_ATTR_MAC_ACK, as
+   the CC2420 does with CC2420_CONF_AUTOACK. The packets then tell
+   the receiver that it need not send a runicast ACK if it has sent a
+   link-layer ACK. */
+#ifdef RUNICAST_CONF_MAC_ACK
+#define MAC_ACK RUNICAST_CONF_MAC_ACK
+#else /* RUNICAST_CONF_MAC_ACK */
+#define MAC_ACK 0
+#endif /* RUNICAST_CONF_MAC_ACK */
+
 static const struct packetbuf_attrlist attributes[] =
   {
     RUNICAST_ATTRIBUTES
     PACKETBUF_ATTR_LAST
   };
 
+#define CHANNEL(c) ((c)->c.c.c.c.channel.channelno)
+
 #define DEBUG 0
 #if DEBUG
 #include <stdio.h>
@@ -67,6 +80,25 @@ static const struct packetbuf_attrlist attributes[] =
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+acked(struct runicast_conn *c)
+{
+  rimeaddr_t *receiver = stunicast_receiver(&c->c);
+
+  RIMESTATS_ADD(ackrx);
+  RIMESTATS_LINK_ADD(receiver, CHANNEL(c), ackrx);
+  RIMESTATS_REXMITS(receiver, c->rxmit > 0 ? c->rxmit - 1 : 0);
+  PRINTF("%d.%d: runicast: ACKed %d\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	 c->sndnxt);
+  c->sndnxt = (c->sndnxt + 1) % (1 << RUNICAST_PACKET_ID_BITS);
+  c->is_tx = 0;
+  stunicast_cancel(&c->c);
+  if(c->u->sent != NULL) {
+    c->u->sent(c, receiver, c->rxmit);
+  }
+}
 /*---------------------------------------------------------------------------*/
 static void
 sent_by_stunicast(struct stunicast_conn *stunicast)
@@ -75,14 +107,20 @@ sent_by_stunicast(struct stunicast_conn *stunicast)
 
   if(c->rxmit != 0) {
     RIMESTATS_ADD(rexmit);
+    RIMESTATS_LINK_ADD(stunicast_receiver(&c->c), CHANNEL(c), rexmit);
     PRINTF("%d.%d: runicast: packet %u resent %u\n",
 	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	   packetbuf_attr(PACKETBUF_ATTR_PACKET_ID), c->rxmit);
   }
 
   c->rxmit++;
-  if(c->rxmit >= c->max_rxmit) {
+  if(packetbuf_attr(PACKETBUF_ATTR_MAC_ACK)) {
+    /* The radio got a link-layer ACK for the packet. A runicast ACK
+       may follow, which is then ignored as a bad ACK. */
+    acked(c);
+  } else if(c->rxmit >= c->max_rxmit) {
     RIMESTATS_ADD(timedout);
+    RIMESTATS_LINK_ADD(stunicast_receiver(&c->c), CHANNEL(c), timedout);
     c->is_tx = 0;
     stunicast_cancel(&c->c);
     if(c->u->timedout) {
@@ -119,16 +157,7 @@ recv_from_stunicast(struct stunicast_conn *stunicast, rimeaddr_t *from)
 	     packetbuf_attr(PACKETBUF_ATTR_PACKET_ID),
 	     c->sndnxt);
     if(packetbuf_attr(PACKETBUF_ATTR_PACKET_ID) == c->sndnxt) {
-      RIMESTATS_ADD(ackrx);
-      PRINTF("%d.%d: runicast: ACKed %d\n",
-	     rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-	     packetbuf_attr(PACKETBUF_ATTR_PACKET_ID));
-      c->sndnxt = (c->sndnxt + 1) % (1 << RUNICAST_PACKET_ID_BITS);
-      c->is_tx = 0;
-      stunicast_cancel(&c->c);
-      if(c->u->sent != NULL) {
-	c->u->sent(c, stunicast_receiver(&c->c), c->rxmit);
-      }
+      acked(c);
     } else {
       PRINTF("%d.%d: runicast: received bad ACK %d for %d\n",
 	     rimeaddr_node_addr.u8[0],rimeaddr_node_addr.u8[1],
@@ -143,6 +172,7 @@ recv_from_stunicast(struct stunicast_conn *stunicast, rimeaddr_t *from)
     struct queuebuf *q;
 
     RIMESTATS_ADD(reliablerx);
+    RIMESTATS_LINK_ADD(from, CHANNEL(c), reliablerx);
 
     PRINTF("%d.%d: runicast: got packet %d\n",
 	   rimeaddr_node_addr.u8[0],rimeaddr_node_addr.u8[1],
@@ -152,8 +182,14 @@ recv_from_stunicast(struct stunicast_conn *stunicast, rimeaddr_t *from)
 
     /*    packetbuf_hdrreduce(sizeof(struct runicast_hdr));*/
 
-    q = queuebuf_new_from_packetbuf();
-    if(q != NULL) {
+    if(packetbuf_attr(PACKETBUF_ATTR_MAC_ACK) &&
+       packetbuf_attr(PACKETBUF_ATTR_MAC_ACK_EXPECTED)) {
+      /* The radio has already acknowledged the packet, and the sender
+	 waits for that ACK. */
+      PRINTF("%d.%d: runicast: packet %d ACKed by the radio\n",
+	     rimeaddr_node_addr.u8[0],rimeaddr_node_addr.u8[1],
+	     packet_seqno);
+    } else if((q = queuebuf_new_from_packetbuf()) != NULL) {
       PRINTF("%d.%d: runicast: Sending ACK to %d.%d for %d\n",
 	     rimeaddr_node_addr.u8[0],rimeaddr_node_addr.u8[1],
 	     from->u8[0], from->u8[1],
@@ -217,12 +253,15 @@ runicast_send(struct runicast_conn *c, rimeaddr_t *receiver, uint8_t max_retrans
     return 0;
   }
   packetbuf_set_attr(PACKETBUF_ATTR_RELIABLE, 1);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 0);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK_EXPECTED, MAC_ACK);
   packetbuf_set_attr(PACKETBUF_ATTR_PACKET_TYPE, PACKETBUF_ATTR_PACKET_TYPE_DATA);
   packetbuf_set_attr(PACKETBUF_ATTR_PACKET_ID, c->sndnxt);
   c->max_rxmit = max_retransmissions;
   c->rxmit = 0;
   c->is_tx = 1;
   RIMESTATS_ADD(reliabletx);
+  RIMESTATS_LINK_ADD(receiver, CHANNEL(c), reliabletx);
   PRINTF("%d.%d: runicast: sending packet %d\n",
 	 rimeaddr_node_addr.u8[0],rimeaddr_node_addr.u8[1],
 	 c->sndnxt);
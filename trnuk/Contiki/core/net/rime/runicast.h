@@ -85,6 +85,7 @@ struct runicast_conn;
 
 #define RUNICAST_ATTRIBUTES  { PACKETBUF_ATTR_PACKET_TYPE, PACKETBUF_ATTR_BIT }, \
                         { PACKETBUF_ATTR_PACKET_ID, PACKETBUF_ATTR_BIT * 2 }, \
+                        { PACKETBUF_ATTR_MAC_ACK_EXPECTED, PACKETBUF_ATTR_BIT }, \
                         STUNICAST_ATTRIBUTES
 struct runicast_callbacks {
   void (* recv)(struct runicast_conn *c, rimeaddr_t *from, uint8_t seqno);
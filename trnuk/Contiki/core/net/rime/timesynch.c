@@ -50,9 +50,99 @@
 #include "dev/cc2420.h"
 
 #if TIMESYNCH_CONF_ENABLED
+
+/* The number of (local, global) time pairs that the clock rate and
+   offset are estimated from. */
+#ifdef TIMESYNCH_CONF_WINDOW
+#define WINDOW TIMESYNCH_CONF_WINDOW
+#else
+#define WINDOW 8
+#endif /* TIMESYNCH_CONF_WINDOW */
+
+/* A node that has not heard its reference for this many seconds
+   raises its authority level by one, so that it can synchronize to
+   other nodes if its reference has gone away. */
+#ifdef TIMESYNCH_CONF_AUTHORITY_AGE
+#define AUTHORITY_AGE TIMESYNCH_CONF_AUTHORITY_AGE
+#else
+#define AUTHORITY_AGE 300
+#endif /* TIMESYNCH_CONF_AUTHORITY_AGE */
+
+/* The periodic timer keeps the 32-bit local time running; it must
+   fire at least once per half rtimer wrap-around. */
+#define PERIOD 4
+
+/* The skew is the rate of change of the offset, as a fraction of
+   2^SKEW_SHIFT. It is limited to +-MAX_SKEW, about 200 ppm. The time
+   since the estimate is scaled down by 2^DT_SHIFT before it is
+   multiplied by the skew, and limited to MAX_EXTRAPOLATION ticks,
+   about two hours, so that the product fits in 32 bits. */
+#define SKEW_SHIFT 24
+#define MAX_SKEW 3355L
+#define DT_SHIFT 6
+#define MAX_EXTRAPOLATION 0x1ffffffL
+
+/* The time differences in the regression are scaled down so that the
+   largest one is below 2^X_BITS, to keep the sums in 32 bits. */
+#define X_BITS 12
+
+/* A sample that is this far off the estimate is an outlier, unless
+   REJECT_MAX samples in a row are. */
+#define MAX_RESIDUAL (RTIMER_ARCH_SECOND / 64)
+#define REJECT_MAX 3
+
+#define LEVEL_NONE 0xff
+
 static int authority_level;
-static rtimer_clock_t offset;
+static uint8_t reference_level = LEVEL_NONE;
+
+static uint32_t local_now;
+static uint32_t sample_local[WINDOW];
+static rtimer_clock_t sample_offset[WINDOW];
+static uint8_t samples, newest, rejected;
+
+/* The estimate: the offset at the local time ref_local, and its rate
+   of change. */
+static uint32_t ref_local;
+static rtimer_clock_t ref_offset;
+static int32_t skew;
+static rtimer_clock_t residual;
+
+static uint16_t seconds_since_sample;
+static struct ctimer periodic_timer;
+
+/*---------------------------------------------------------------------------*/
+/* Extend an rtimer time that is within half a wrap-around of the
+   last periodic update to 32 bits. */
+static uint32_t
+extend(rtimer_clock_t t)
+{
+  return local_now + (int16_t)(t - (rtimer_clock_t)local_now);
+}
+/*---------------------------------------------------------------------------*/
+static rtimer_clock_t
+extended_offset_at(uint32_t local)
+{
+  int32_t dt;
 
+  dt = local - ref_local;
+  if(dt > MAX_EXTRAPOLATION) {
+    dt = MAX_EXTRAPOLATION;
+  } else if(dt < -MAX_EXTRAPOLATION) {
+    dt = -MAX_EXTRAPOLATION;
+  }
+  /* Round to the nearest tick, or the error adds up over the hops. */
+  return ref_offset +
+    (rtimer_clock_t)(((dt >> DT_SHIFT) * skew +
+		      (1L << (SKEW_SHIFT - DT_SHIFT - 1))) >>
+		     (SKEW_SHIFT - DT_SHIFT));
+}
+/*---------------------------------------------------------------------------*/
+static rtimer_clock_t
+offset_at(rtimer_clock_t local)
+{
+  return extended_offset_at(extend(local));
+}
 /*---------------------------------------------------------------------------*/
 int
 timesynch_authority_level(void)
@@ -69,31 +159,155 @@ timesynch_set_authority_level(int level)
 rtimer_clock_t
 timesynch_time(void)
 {
-  return rtimer_arch_now() + offset;
+  rtimer_clock_t now = rtimer_arch_now();
+  return now + offset_at(now);
 }
 /*---------------------------------------------------------------------------*/
 rtimer_clock_t
 timesynch_time_to_rtimer(rtimer_clock_t synched_time)
 {
-  return synched_time - offset;
+  /* The offset changes slowly enough that the offset at the
+     synchronized time is close enough to the offset at the local
+     time. */
+  return synched_time - offset_at(synched_time - ref_offset);
 }
 /*---------------------------------------------------------------------------*/
 rtimer_clock_t
 timesynch_rtimer_to_time(rtimer_clock_t rtimer_time)
 {
-  return rtimer_time + offset;
+  return rtimer_time + offset_at(rtimer_time);
 }
 /*---------------------------------------------------------------------------*/
 rtimer_clock_t
 timesynch_offset(void)
 {
-  return offset;
+  return offset_at(rtimer_arch_now());
+}
+/*---------------------------------------------------------------------------*/
+rtimer_clock_t
+timesynch_error(void)
+{
+  uint32_t error;
+
+  if(authority_level == 0) {
+    return 0;
+  }
+  if(samples == 0) {
+    return TIMESYNCH_ERROR_UNKNOWN;
+  }
+  /* The error of the fit, plus the error that an uncertainty in the
+     skew of about 4 ppm adds since the last sample. Each hop from the
+     node with authority level 0 adds about as much. */
+  error = (residual + 1 +
+	   (extend(rtimer_arch_now()) - sample_local[newest]) / 0x40000UL) *
+    (reference_level + 1);
+  if(error >= TIMESYNCH_ERROR_UNKNOWN) {
+    return TIMESYNCH_ERROR_UNKNOWN - 1;
+  }
+  return error;
 }
 /*---------------------------------------------------------------------------*/
+/* Divide a by b and scale the result up by 2^shift, without
+   overflowing 32 bits. */
+static int32_t
+scaled_div(int32_t a, int32_t b, uint8_t shift)
+{
+  int32_t abs_a;
+
+  abs_a = a < 0 ? -a : a;
+  while(shift > 0 && abs_a < 0x40000000L) {
+    abs_a <<= 1;
+    a <<= 1;
+    shift--;
+  }
+  b >>= shift;
+  if(b == 0) {
+    return 0;
+  }
+  return a / b;
+}
+/*---------------------------------------------------------------------------*/
+/* Fit a line to the offsets in the window with least squares. */
 static void
-adjust_offset(rtimer_clock_t authoritative_time, rtimer_clock_t local_time)
+estimate(void)
 {
-  offset = offset + authoritative_time - local_time;
+  int32_t x, y, sum_x, sum_y, sum_xx, sum_xy, mean_x, mean_y, r;
+  uint32_t span;
+  rtimer_clock_t max_r;
+  uint8_t i, oldest, x_shift;
+
+  sum_x = sum_y = 0;
+  for(i = 0; i < samples; ++i) {
+    sum_x += (int32_t)(sample_local[i] - sample_local[newest]);
+    sum_y += (int16_t)(sample_offset[i] - sample_offset[newest]);
+  }
+  mean_x = sum_x / samples;
+  mean_y = (sum_y + (sum_y < 0 ? -samples : samples) / 2) / samples;
+  ref_local = sample_local[newest] + mean_x;
+  ref_offset = sample_offset[newest] + mean_y;
+
+  oldest = samples < WINDOW ? 0 : (newest + 1) % WINDOW;
+  span = sample_local[newest] - sample_local[oldest];
+
+  /* Keep the previous skew until the samples span about a second. */
+  if(span >= RTIMER_ARCH_SECOND) {
+    for(x_shift = 0; (span >> x_shift) >= (1L << X_BITS); ++x_shift);
+    sum_xx = sum_xy = 0;
+    for(i = 0; i < samples; ++i) {
+      x = (int32_t)(sample_local[i] - ref_local) >> x_shift;
+      y = (int16_t)(sample_offset[i] - sample_offset[newest]) - mean_y;
+      sum_xx += x * x;
+      sum_xy += x * y;
+    }
+    skew = scaled_div(sum_xy, sum_xx, SKEW_SHIFT - x_shift);
+    if(skew > MAX_SKEW) {
+      skew = MAX_SKEW;
+    } else if(skew < -MAX_SKEW) {
+      skew = -MAX_SKEW;
+    }
+  }
+
+  max_r = 0;
+  for(i = 0; i < samples; ++i) {
+    r = (rtimer_clock_t)(sample_offset[i] -
+			 extended_offset_at(sample_local[i]));
+    r = (int16_t)r < 0 ? -(int16_t)r : (int16_t)r;
+    if(r > max_r) {
+      max_r = r;
+    }
+  }
+  residual = max_r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_sample(rtimer_clock_t authoritative_time, rtimer_clock_t local_time)
+{
+  rtimer_clock_t offset, error;
+
+  /* The local time is the rtimer time at which the packet arrived. */
+  local_time = timesynch_time_to_rtimer(local_time);
+  offset = authoritative_time - local_time;
+
+  if(samples > 0) {
+    error = offset - offset_at(local_time);
+    if((int16_t)error > MAX_RESIDUAL || (int16_t)error < -MAX_RESIDUAL) {
+      if(++rejected < REJECT_MAX) {
+	return;
+      }
+      /* The reference time has jumped; start over. */
+      samples = 0;
+    }
+  }
+  rejected = 0;
+
+  newest = (samples == 0) ? 0 : (newest + 1) % WINDOW;
+  if(samples < WINDOW) {
+    samples++;
+  }
+  sample_local[newest] = extend(local_time);
+  sample_offset[newest] = offset;
+  seconds_since_sample = 0;
+  estimate();
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -103,10 +317,19 @@ incoming_packet(void)
     /* We check the authority level of the sender of the incoming
        packet. If the sending node has a lower authority level than we
        have, we synchronize to the time of the sending node and set our
-       own authority level to be one more than the sending node. */
+       own authority level to be one more than the sending node.
+
+       The sender of a packet is not known at this point, so the
+       samples are taken from all nodes with the authority level of
+       the best node we have heard. They all keep the same time. */
     if(cc2420_authority_level_of_sender < authority_level) {
-      adjust_offset(cc2420_time_of_departure,
-		    cc2420_time_of_arrival);
+      if(cc2420_authority_level_of_sender != reference_level) {
+	reference_level = cc2420_authority_level_of_sender;
+	samples = 0;
+      }
+      local_now = extend(rtimer_arch_now());
+      add_sample(cc2420_time_of_departure,
+		 cc2420_time_of_arrival);
       if(cc2420_authority_level_of_sender + 1 != authority_level) {
 	authority_level = cc2420_authority_level_of_sender + 1;
       }
@@ -114,21 +337,32 @@ incoming_packet(void)
   }
 }
 /*---------------------------------------------------------------------------*/
-#if 0
 static void
-periodic_authority_increase(void *ptr)
+periodic(void *ptr)
 {
-  /* XXX the authority level should be increased over time except
-     for the sink node (which has authority 0). */
+  local_now = extend(rtimer_arch_now());
+
+  /* The authority level is increased over time except for the sink
+     node, which has authority 0. */
+  if(authority_level != 0 && samples > 0) {
+    seconds_since_sample += PERIOD;
+    if(seconds_since_sample >= AUTHORITY_AGE) {
+      seconds_since_sample = 0;
+      authority_level++;
+
+    }
+  }
+  ctimer_set(&periodic_timer, PERIOD * CLOCK_SECOND, periodic, NULL);
 }
-#endif
 /*---------------------------------------------------------------------------*/
 RIME_SNIFFER(sniffer, incoming_packet, NULL);
 /*---------------------------------------------------------------------------*/
 void
 timesynch_init(void)
 {
+  local_now = rtimer_arch_now();
   rime_sniffer_add(&sniffer);
+  ctimer_set(&periodic_timer, PERIOD * CLOCK_SECOND, periodic, NULL);
 }
 /*---------------------------------------------------------------------------*/
 #endif /* TIMESYNCH_CONF_ENABLED */
@@ -20,6 +20,13 @@
  * authority (lower authority number), the node adjusts its clock
  * towards the clock of the sending node.
  *
+ * A node estimates both the offset and the rate of its clock
+ * relative to the clock of the nodes it synchronizes to, from the
+ * last few packets it has received from them, and extrapolates its
+ * time between packets. A node that has not heard from them for a
+ * while lowers its authority, so that it can synchronize to other
+ * nodes.
+ *
  * The timesynch module is implemented as a meta-MAC protocol, so that
  * the module is invoked for every incoming packet.
  *
@@ -124,6 +131,25 @@ rtimer_clock_t timesynch_rtimer_to_time(rtimer_clock_t rtimer_time);
  */
 rtimer_clock_t timesynch_offset(void);
 
+/**
+ * \brief      Get an estimate of the error of the time-synchronized time
+ * \return     The estimated error, in rtimer ticks, or
+ *             TIMESYNCH_ERROR_UNKNOWN if the node is not synchronized
+ *
+ *             This function returns how far the time-synchronized
+ *             time may be from the time of the node with authority
+ *             level 0. It is based on the largest error of the
+ *             current clock estimate and the number of hops to the
+ *             node with authority level 0, and grows slowly with the
+ *             time since the last synchronization. A MAC protocol
+ *             that wakes up at synchronized times can use it as its
+ *             guard time.
+ *
+ */
+rtimer_clock_t timesynch_error(void);
+
+#define TIMESYNCH_ERROR_UNKNOWN 0xffff
+
 /**
  * \brief      Get the current authority level of the time-synchronized time
  * \return     The current authority level of the time-synchronized time
@@ -0,0 +1,426 @@
+/**
+ * \addtogroup trickletable
+ * @{
+ */
+
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Multi-item Trickle dissemination for Rime
+ */
+
+#include "net/rime/trickle-table.h"
+#include "lib/random.h"
+
+#include <string.h>
+
+#define INTERVAL_MAX 4
+
+#define DUPLICATE_THRESHOLD 1
+
+#define TYPE_SUMMARY 0
+#define TYPE_DATA    1
+
+/* The item is to be sent in the next data packet. */
+#define FLAG_SEND 0x01
+
+/* The most bytes of items in a data packet. */
+#define DATA_MAX 96
+
+#define VERSION_LT(a, b) ((signed char)((a) - (b)) < 0)
+
+#define BUCKET(key) ((key) % TRICKLE_TABLE_BUCKETS)
+
+struct summary_msg {
+  uint8_t type;
+  uint8_t pad;
+  uint16_t hash[TRICKLE_TABLE_BUCKETS];
+};
+
+/* A data packet holds a type byte followed by items, each of which is
+   a header and len bytes of value. The items are not aligned. */
+struct item_hdr {
+  uint16_t key;
+  uint8_t version;
+  uint8_t len;
+};
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+static int run_trickle(struct trickle_table_conn *c);
+/*---------------------------------------------------------------------------*/
+static uint16_t
+item_hash(uint16_t key, uint8_t version)
+{
+  uint16_t h;
+
+  h = (key ^ ((uint16_t)version << 8 | version)) * 40503U;
+  return h ^ (h >> 7);
+}
+/*---------------------------------------------------------------------------*/
+/* The bucket hashes are the XOR of the hashes of their items, so that
+   they do not depend on the order of the items and can be updated
+   when one item changes. */
+static void
+set_version(struct trickle_table_conn *c, struct trickle_table_item *item,
+	    uint8_t version)
+{
+  c->hash[BUCKET(item->key)] ^= item_hash(item->key, item->version) ^
+    item_hash(item->key, version);
+  item->version = version;
+}
+/*---------------------------------------------------------------------------*/
+static struct trickle_table_item *
+find(struct trickle_table_conn *c, uint16_t key)
+{
+  uint8_t i;
+
+  for(i = 0; i < c->num; ++i) {
+    if(c->items[i].key == key) {
+      return &c->items[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct trickle_table_item *
+add(struct trickle_table_conn *c, uint16_t key, uint8_t version)
+{
+  struct trickle_table_item *item;
+
+  if(c->num == TRICKLE_TABLE_ITEMS) {
+    return NULL;
+  }
+  item = &c->items[c->num++];
+  item->key = key;
+  item->version = version;
+  item->flags = 0;
+  item->len = 0;
+  c->hash[BUCKET(key)] ^= item_hash(key, version);
+  return item;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_summary(struct trickle_table_conn *c)
+{
+  struct summary_msg *msg;
+
+  packetbuf_clear();
+  msg = packetbuf_dataptr();
+  msg->type = TYPE_SUMMARY;
+  msg->pad = 0;
+  memcpy(msg->hash, c->hash, sizeof(c->hash));
+  packetbuf_set_datalen(sizeof(struct summary_msg));
+  broadcast_send(&c->c);
+}
+/*---------------------------------------------------------------------------*/
+/* Send as many of the items that are marked for sending as fit in one
+   packet. The rest are sent in the next interval. */
+static void
+send_data(struct trickle_table_conn *c)
+{
+  struct trickle_table_item *item;
+  struct item_hdr hdr;
+  uint8_t *ptr;
+  uint8_t i, len;
+
+  packetbuf_clear();
+  ptr = packetbuf_dataptr();
+  *ptr++ = TYPE_DATA;
+  len = 1;
+  for(i = 0; i < c->num; ++i) {
+    item = &c->items[i];
+    if((item->flags & FLAG_SEND) &&
+       len + sizeof(struct item_hdr) + item->len <= DATA_MAX) {
+      hdr.key = item->key;
+      hdr.version = item->version;
+      hdr.len = item->len;
+      memcpy(ptr, &hdr, sizeof(struct item_hdr));
+      memcpy(ptr + sizeof(struct item_hdr), item->value, item->len);
+      ptr += sizeof(struct item_hdr) + item->len;
+      len += sizeof(struct item_hdr) + item->len;
+      item->flags &= ~FLAG_SEND;
+    }
+  }
+  packetbuf_set_datalen(len);
+  PRINTF("%d.%d: trickle-table sending %d bytes of items\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1], len);
+  broadcast_send(&c->c);
+}
+/*---------------------------------------------------------------------------*/
+static int
+pending(struct trickle_table_conn *c)
+{
+  uint8_t i;
+
+  for(i = 0; i < c->num; ++i) {
+    if(c->items[i].flags & FLAG_SEND) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+mark_bucket(struct trickle_table_conn *c, uint8_t bucket)
+{
+  uint8_t i;
+
+  for(i = 0; i < c->num; ++i) {
+    if(BUCKET(c->items[i].key) == bucket) {
+      c->items[i].flags |= FLAG_SEND;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+timer_callback(void *ptr)
+{
+  struct trickle_table_conn *c = ptr;
+  run_trickle(c);
+}
+/*---------------------------------------------------------------------------*/
+static void
+reset_interval(struct trickle_table_conn *c)
+{
+  PT_INIT(&c->pt);
+  run_trickle(c);
+}
+/*---------------------------------------------------------------------------*/
+/* Start over with the shortest interval, unless we already use it:
+   resetting it again would only postpone the next transmission. */
+static void
+inconsistent(struct trickle_table_conn *c)
+{
+  if(c->interval_scaling != 0) {
+    c->interval_scaling = 0;
+    reset_interval(c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_timer(struct trickle_table_conn *c, struct ctimer *t, clock_time_t i)
+{
+  ctimer_set(t, i, timer_callback, c);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_trickle(struct trickle_table_conn *c)
+{
+  clock_time_t interval;
+  PT_BEGIN(&c->pt);
+
+  while(1) {
+    interval = c->interval << c->interval_scaling;
+    set_timer(c, &c->interval_timer, interval);
+    set_timer(c, &c->t, interval / 2 + (random_rand() % (interval / 2)));
+
+    c->duplicates = 0;
+    PT_YIELD(&c->pt); /* Wait until listen timeout */
+    if(pending(c)) {
+      send_data(c);
+    } else if(c->duplicates < DUPLICATE_THRESHOLD) {
+      send_summary(c);
+    }
+    PT_YIELD(&c->pt); /* Wait until interval timer expired. */
+    if(pending(c)) {
+      c->interval_scaling = 0;
+    } else if(c->interval_scaling < INTERVAL_MAX) {
+      c->interval_scaling++;
+    }
+  }
+
+  PT_END(&c->pt);
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_summary(struct trickle_table_conn *c)
+{
+  struct summary_msg *msg = packetbuf_dataptr();
+  uint8_t b, differ;
+
+  if(packetbuf_datalen() < sizeof(struct summary_msg)) {
+    return;
+  }
+
+  differ = 0;
+  for(b = 0; b < TRICKLE_TABLE_BUCKETS; ++b) {
+    if(msg->hash[b] != c->hash[b]) {
+      mark_bucket(c, b);
+      differ = 1;
+    }
+  }
+
+  if(differ) {
+    inconsistent(c);
+  } else {
+    ++c->duplicates;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_data(struct trickle_table_conn *c)
+{
+  struct trickle_table_item *item;
+  struct item_hdr hdr;
+  uint8_t *ptr, *end;
+  uint8_t changed;
+
+  ptr = (uint8_t *)packetbuf_dataptr() + 1;
+  end = (uint8_t *)packetbuf_dataptr() + packetbuf_datalen();
+  changed = 0;
+
+  while(ptr + sizeof(struct item_hdr) <= end) {
+    memcpy(&hdr, ptr, sizeof(struct item_hdr));
+    ptr += sizeof(struct item_hdr);
+    if(ptr + hdr.len > end || hdr.len > TRICKLE_TABLE_VALUESIZE) {
+      break;
+    }
+
+    item = find(c, hdr.key);
+    if(item == NULL) {
+      item = add(c, hdr.key, hdr.version - 1);
+    }
+    if(item == NULL) {
+      PRINTF("%d.%d: trickle-table full, dropping key %d\n",
+	     rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1], hdr.key);
+    } else if(VERSION_LT(item->version, hdr.version)) {
+      /* A newer version, which we pass on. */
+      set_version(c, item, hdr.version);
+      memcpy(item->value, ptr, hdr.len);
+      item->len = hdr.len;
+      item->flags |= FLAG_SEND;
+      changed = 1;
+      if(c->cb->recv != NULL) {
+	c->cb->recv(c, item);
+      }
+    } else if(item->version == hdr.version) {
+      /* A neighbor has sent the version we were about to send. */
+      item->flags &= ~FLAG_SEND;
+    } else {
+      /* The sender has an older version. */
+      item->flags |= FLAG_SEND;
+      changed = 1;
+    }
+    ptr += hdr.len;
+  }
+
+  if(changed) {
+    inconsistent(c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv(struct broadcast_conn *bc, rimeaddr_t *from)
+{
+  struct trickle_table_conn *c = (struct trickle_table_conn *)bc;
+  uint8_t *type = packetbuf_dataptr();
+
+  PRINTF("%d.%d: trickle-table recv type %d from %d.%d len %d\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	 *type, from->u8[0], from->u8[1], packetbuf_datalen());
+
+  if(packetbuf_datalen() == 0) {
+    return;
+  }
+  if(*type == TYPE_SUMMARY) {
+    recv_summary(c);
+  } else if(*type == TYPE_DATA) {
+    recv_data(c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static CC_CONST_FUNCTION struct broadcast_callbacks bc = { recv };
+/*---------------------------------------------------------------------------*/
+void
+trickle_table_open(struct trickle_table_conn *c, clock_time_t interval,
+		   uint16_t channel, const struct trickle_table_callbacks *cb)
+{
+  broadcast_open(&c->c, channel, &bc);
+  c->cb = cb;
+  c->interval = interval;
+  c->num = 0;
+  memset(c->hash, 0, sizeof(c->hash));
+  c->interval_scaling = 0;
+  reset_interval(c);
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_table_close(struct trickle_table_conn *c)
+{
+  broadcast_close(&c->c);
+  ctimer_stop(&c->t);
+  ctimer_stop(&c->interval_timer);
+}
+/*---------------------------------------------------------------------------*/
+int
+trickle_table_set(struct trickle_table_conn *c, uint16_t key,
+		  const void *value, uint8_t len)
+{
+  struct trickle_table_item *item;
+
+  if(len > TRICKLE_TABLE_VALUESIZE) {
+    return 0;
+  }
+  item = find(c, key);
+  if(item == NULL) {
+    item = add(c, key, 0);
+    if(item == NULL) {
+      return 0;
+    }
+  }
+  set_version(c, item, item->version + 1);
+  memcpy(item->value, value, len);
+  item->len = len;
+  item->flags |= FLAG_SEND;
+  PRINTF("%d.%d: trickle-table set key %d version %d\n",
+	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	 key, item->version);
+  inconsistent(c);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+struct trickle_table_item *
+trickle_table_get(struct trickle_table_conn *c, uint16_t key)
+{
+  return find(c, key);
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,151 @@
+/**
+ * \addtogroup rime
+ * @{
+ */
+
+/**
+ * \defgroup trickletable Multi-item Trickle dissemination
+ * @{
+ *
+ * The trickle-table module keeps a table of small items, each
+ * identified by a key and tagged with a version number, consistent
+ * across the network. A node that updates an item bumps its version,
+ * and the newest version of every item spreads to all nodes.
+ *
+ * All items share one Trickle timer. While the network is
+ * consistent, nodes only exchange a summary of their tables: a hash
+ * of the keys and versions of the items in each of
+ * TRICKLE_TABLE_BUCKETS buckets. A node that hears a summary that
+ * differs from its own resets the timer and sends the items of the
+ * buckets that differ. A node that hears an older version of an
+ * item sends its own version of the item, and a node that hears the
+ * version it is about to send does not send it.
+ *
+ * \section channels Channels
+ *
+ * The trickle-table module uses 1 channel.
+ *
+ */
+
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Header file for multi-item Trickle dissemination
+ */
+
+#ifndef __TRICKLE_TABLE_H__
+#define __TRICKLE_TABLE_H__
+
+#include "sys/pt.h"
+#include "net/rime/broadcast.h"
+#include "net/rime/ctimer.h"
+
+/* The number of items in a table. */
+#ifdef TRICKLE_TABLE_CONF_ITEMS
+#define TRICKLE_TABLE_ITEMS TRICKLE_TABLE_CONF_ITEMS
+#else
+#define TRICKLE_TABLE_ITEMS 16
+#endif /* TRICKLE_TABLE_CONF_ITEMS */
+
+/* The largest value of an item, in bytes. */
+#ifdef TRICKLE_TABLE_CONF_VALUESIZE
+#define TRICKLE_TABLE_VALUESIZE TRICKLE_TABLE_CONF_VALUESIZE
+#else
+#define TRICKLE_TABLE_VALUESIZE 8
+#endif /* TRICKLE_TABLE_CONF_VALUESIZE */
+
+/* The number of buckets in a summary, at most 16. Each bucket adds
+   two bytes to the summary. */
+#ifdef TRICKLE_TABLE_CONF_BUCKETS
+#define TRICKLE_TABLE_BUCKETS TRICKLE_TABLE_CONF_BUCKETS
+#else
+#define TRICKLE_TABLE_BUCKETS 8
+#endif /* TRICKLE_TABLE_CONF_BUCKETS */
+
+struct trickle_table_conn;
+
+struct trickle_table_item {
+  uint16_t key;
+  uint8_t version;
+  uint8_t flags;
+  uint8_t len;
+  uint8_t value[TRICKLE_TABLE_VALUESIZE];
+};
+
+struct trickle_table_callbacks {
+  /* Called when a new version of an item has been received. */
+  void (* recv)(struct trickle_table_conn *c,
+		struct trickle_table_item *item);
+};
+
+struct trickle_table_conn {
+  struct broadcast_conn c;
+  const struct trickle_table_callbacks *cb;
+  struct ctimer t, interval_timer;
+  struct pt pt;
+  clock_time_t interval;
+  uint8_t interval_scaling;
+  uint8_t duplicates;
+  uint8_t num;
+  uint16_t hash[TRICKLE_TABLE_BUCKETS];
+  struct trickle_table_item items[TRICKLE_TABLE_ITEMS];
+};
+
+void trickle_table_open(struct trickle_table_conn *c, clock_time_t interval,
+			uint16_t channel,
+			const struct trickle_table_callbacks *cb);
+void trickle_table_close(struct trickle_table_conn *c);
+
+/**
+ * \brief      Set the value of an item and spread it to the network
+ * \param c    The connection
+ * \param key  The key of the item
+ * \param value The new value
+ * \param len  The length of the value, at most TRICKLE_TABLE_VALUESIZE
+ * \return     Non-zero if the item was set, zero if the value was too
+ *             long or the table was full
+ */
+int trickle_table_set(struct trickle_table_conn *c, uint16_t key,
+		      const void *value, uint8_t len);
+
+/**
+ * \brief      Get an item
+ * \return     The item, or NULL if the table does not have the key
+ */
+struct trickle_table_item *trickle_table_get(struct trickle_table_conn *c,
+					     uint16_t key);
+
+#endif /* __TRICKLE_TABLE_H__ */
+/** @} */
+/** @} */
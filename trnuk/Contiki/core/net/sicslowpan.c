@@ -173,17 +173,47 @@ static u8_t uncomp_hdr_len;
  *  @{
  */
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * A 6lowpan reassembly buffer.
+ * The buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
+ * A buffer is identified by the sender, tag and size of the fragments
+ * being merged, and is free when size is 0.
+ * Fragment offsets are in units of 8 bytes, and every fragment but the
+ * last one holds a whole number of units, so the buffer records which
+ * units it has received.
  */
-static u8_t sicslowpan_buf[UIP_BUFSIZE];
+struct sicslowpan_reass {
+  u8_t buf[UIP_BUFSIZE];
+  /** One bit for each 8-byte unit of the IPv6 packet received so far. */
+  u8_t units[(UIP_BUFSIZE + 63) / 64];
+  /** The source address of the fragments being merged */
+  rimeaddr_t sender;
+  /** The tag in the fragments being merged. */
+  u16_t tag;
+  /** The total length of the IPv6 packet. */
+  u16_t size;
+  /** Number of 8-byte units received so far. */
+  u16_t received;
+  /** Reassembly %timer. */
+  struct timer timer;
+};
+
+/**
+ * The reassembly buffers. They have a fix size as we do not use
+ * dynamic memory allocation.
+ */
+static struct sicslowpan_reass reass_bufs[SICSLOWPAN_CONF_REASS_BUFS];
+
+/**
+ * The buffer the received packet is uncompressed into: a reassembly
+ * buffer for fragments, uip_buf otherwise.
+ */
+static u8_t *sicslowpan_buf;
 
 /** The total length of the IPv6 packet in the sicslowpan_buf. */
 static u16_t sicslowpan_len;
 
 /**
- * length of the ip packet already sent / received.
+ * length of the ip packet already sent.
  * It includes IP and transport headers.
  */
 static u16_t processed_ip_len;
@@ -191,14 +221,9 @@ static u16_t processed_ip_len;
 /** Datagram tag to be put in the fragments I send. */
 static u16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static u16_t reass_tag;
-
-/** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
-
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+#if UIP_STATISTICS == 1
+struct sicslowpan_reass_stats sicslowpan_reass_stat;
+#endif /* UIP_STATISTICS == 1 */
 
 
 /** @} */
@@ -226,6 +251,27 @@ static u8_t *hc01_ptr;
 
 /** Index for loops. */
 static u8_t i;
+
+/** The fast path only handles UDP. */
+#if SICSLOWPAN_CONF_HC01_FAST && UIP_CONF_UDP
+#define HC01_FAST 1
+#else
+#define HC01_FAST 0
+#endif
+
+#if HC01_FAST
+/**
+ * The IPHC encoding of the shape handled by the fast path: version,
+ * traffic class and flow label elided, next header compressed, both
+ * IIDs inferred from the L2 addresses.
+ */
+#define HC01_FAST_ENC0 (SICSLOWPAN_IPHC_TC_C | SICSLOWPAN_IPHC_VF_C | \
+                        SICSLOWPAN_IPHC_NH_C)
+#define HC01_FAST_ENC1 (SICSLOWPAN_IPHC_SAM_0 | SICSLOWPAN_IPHC_DAM_0)
+
+/** Hop limits, indexed by the compressed hop limit encoding. */
+static const u8_t hc01_ttl[4] = {0, 1, 64, 255};
+#endif /* HC01_FAST */
 /** @} */
 
 
@@ -256,6 +302,144 @@ addr_context_lookup_by_number(u8_t number) {
   }
   return NULL;
 }
+#if HC01_FAST
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress the IP/UDP header of the common packet shape
+ * \param rime_destaddr L2 destination address
+ * \return 1 if the header was compressed, 0 if the generic
+ * compression must be used
+ *
+ * Most of the traffic is UDP between two nodes sharing a prefix, with
+ * the IIDs derived from the L2 addresses, no traffic class and no flow
+ * label: link-local UDP, or global UDP through one context. This
+ * checks for that shape and writes the header in one pass. The result
+ * is the same as compress_hdr_hc01() would produce.
+ */
+static u8_t
+compress_hdr_hc01_fast(rimeaddr_t *rime_destaddr)
+{
+  u8_t *ptr;
+  u8_t ttl;
+  u16_t srcport, destport;
+
+  if(UIP_IP_BUF->vtc != 0x60 || UIP_IP_BUF->tcflow != 0 ||
+     UIP_IP_BUF->flow != 0 || UIP_IP_BUF->proto != UIP_PROTO_UDP) {
+    return 0;
+  }
+  switch(UIP_IP_BUF->ttl) {
+    case 1:
+      ttl = SICSLOWPAN_IPHC_TTL_1;
+      break;
+    case 64:
+      ttl = SICSLOWPAN_IPHC_TTL_64;
+      break;
+    case 255:
+      ttl = SICSLOWPAN_IPHC_TTL_255;
+      break;
+    default:
+      return 0;
+  }
+  if(UIP_IP_BUF->destipaddr.u8[0] == 0xff ||
+     memcmp(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr, 8) != 0 ||
+     !uip_is_addr_mac_addr_based(&UIP_IP_BUF->srcipaddr, &uip_lladdr) ||
+     !uip_is_addr_mac_addr_based(&UIP_IP_BUF->destipaddr,
+                                 (uip_lladdr_t *)rime_destaddr)) {
+    return 0;
+  }
+  /* source and destination share the prefix, hence the context */
+  context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr);
+  if(context == NULL) {
+    return 0;
+  }
+
+  ptr = rime_ptr;
+  ptr[0] = SICSLOWPAN_DISPATCH_IPHC;
+  ptr[1] = HC01_FAST_ENC0 | ttl;
+  ptr[2] = HC01_FAST_ENC1 | (context->number << 4) | context->number;
+
+  srcport = HTONS(UIP_UDP_BUF->srcport);
+  destport = HTONS(UIP_UDP_BUF->destport);
+  if(srcport >= SICSLOWPAN_UDP_PORT_MIN &&
+     srcport < SICSLOWPAN_UDP_PORT_MAX &&
+     destport >= SICSLOWPAN_UDP_PORT_MIN &&
+     destport < SICSLOWPAN_UDP_PORT_MAX) {
+    ptr[3] = SICSLOWPAN_NHC_UDP_C;
+    ptr[4] = (u8_t)((srcport - SICSLOWPAN_UDP_PORT_MIN) << 4) +
+      (u8_t)(destport - SICSLOWPAN_UDP_PORT_MIN);
+    memcpy(ptr + 5, &UIP_UDP_BUF->udpchksum, 2);
+    rime_hdr_len = 7;
+  } else {
+    ptr[3] = SICSLOWPAN_NHC_UDP_I;
+    memcpy(ptr + 4, &UIP_UDP_BUF->srcport, 4);
+    memcpy(ptr + 8, &UIP_UDP_BUF->udpchksum, 2);
+    rime_hdr_len = 10;
+  }
+  uncomp_hdr_len = UIP_IPH_LEN + UIP_UDPH_LEN;
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Uncompress the IP/UDP header of the common packet shape
+ * \return 1 if the header was uncompressed, 0 if the generic
+ * decompression must be used
+ *
+ * The counterpart of compress_hdr_hc01_fast(): recognizes the shape
+ * from the IPHC encoding and the NHC byte, and fills in the header
+ * without parsing it field by field. rime_hdr_len, uncomp_hdr_len
+ * and hc01_ptr are set as uncompress_hdr_hc01() would set them; the
+ * length fields are left to the caller.
+ */
+static u8_t
+uncompress_hdr_hc01_fast(void)
+{
+  u8_t *ptr;
+  u8_t enc0, enc1;
+
+  ptr = rime_ptr + rime_hdr_len;
+  enc0 = ptr[1];
+  enc1 = ptr[2];
+  if((enc0 & 0xE0) != HC01_FAST_ENC0 ||
+     (enc0 & 0x18) == SICSLOWPAN_IPHC_TTL_I ||
+     (enc1 & 0xCC) != HC01_FAST_ENC1 ||
+     ((enc1 >> 4) & 0x03) != (enc1 & 0x03) ||
+     (ptr[3] != SICSLOWPAN_NHC_UDP_C && ptr[3] != SICSLOWPAN_NHC_UDP_I)) {
+    return 0;
+  }
+  context = addr_context_lookup_by_number(enc1 & 0x03);
+  if(context == NULL) {
+    return 0;
+  }
+
+  SICSLOWPAN_IP_BUF->vtc = 0x60;
+  SICSLOWPAN_IP_BUF->tcflow = 0;
+  SICSLOWPAN_IP_BUF->flow = 0;
+  SICSLOWPAN_IP_BUF->proto = UIP_PROTO_UDP;
+  SICSLOWPAN_IP_BUF->ttl = hc01_ttl[(enc0 & 0x18) >> 3];
+  memcpy(&SICSLOWPAN_IP_BUF->srcipaddr, context->prefix, 8);
+  uip_netif_addr_autoconf_set(&SICSLOWPAN_IP_BUF->srcipaddr,
+                              (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  memcpy(&SICSLOWPAN_IP_BUF->destipaddr, context->prefix, 8);
+  uip_netif_addr_autoconf_set(&SICSLOWPAN_IP_BUF->destipaddr,
+                              (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+
+  if(ptr[3] == SICSLOWPAN_NHC_UDP_C) {
+    SICSLOWPAN_UDP_BUF->srcport = HTONS(SICSLOWPAN_UDP_PORT_MIN +
+                                        (ptr[4] >> 4));
+    SICSLOWPAN_UDP_BUF->destport = HTONS(SICSLOWPAN_UDP_PORT_MIN +
+                                         (ptr[4] & 0x0F));
+    memcpy(&SICSLOWPAN_UDP_BUF->udpchksum, ptr + 5, 2);
+    hc01_ptr = ptr + 7;
+  } else {
+    memcpy(&SICSLOWPAN_UDP_BUF->srcport, ptr + 4, 4);
+    memcpy(&SICSLOWPAN_UDP_BUF->udpchksum, ptr + 8, 2);
+    hc01_ptr = ptr + 10;
+  }
+  uncomp_hdr_len += UIP_IPH_LEN + UIP_UDPH_LEN;
+  rime_hdr_len = hc01_ptr - rime_ptr;
+  return 1;
+}
+#endif /* HC01_FAST */
 /*--------------------------------------------------------------------*/
 /**
  * \brief Compress IP/UDP header
@@ -312,6 +496,11 @@ addr_context_lookup_by_number(u8_t number) {
 static void
 compress_hdr_hc01(rimeaddr_t *rime_destaddr)
 {
+#if HC01_FAST
+  if(compress_hdr_hc01_fast(rime_destaddr)) {
+    return;
+  }
+#endif /* HC01_FAST */
   hc01_ptr = rime_ptr + 3;
   /*
    * As we copy some bit-length fields, in the IPHC encoding bytes,
@@ -561,6 +750,11 @@ compress_hdr_hc01(rimeaddr_t *rime_destaddr)
 
 static void
 uncompress_hdr_hc01(u16_t ip_len) {
+#if HC01_FAST
+  if(uncompress_hdr_hc01_fast()) {
+    goto iplength;
+  }
+#endif /* HC01_FAST */
   hc01_ptr = rime_ptr + rime_hdr_len + 3;
   
   /* Version and flow label */
@@ -765,6 +959,9 @@ uncompress_hdr_hc01(u16_t ip_len) {
 
   rime_hdr_len = hc01_ptr - rime_ptr;
   
+#if HC01_FAST
+ iplength:
+#endif /* HC01_FAST */
   /* IP length field. */
   if(ip_len == 0) {
     /* This is not a fragmented packet */
@@ -1249,6 +1446,94 @@ output(uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/** \brief Find the reassembly buffer of a received fragment
+ *  \param size The size of the IP packet, from the fragment header
+ *  \param tag The datagram tag, from the fragment header
+ *  \return The buffer, or NULL if the packet cannot be reassembled
+ *
+ *  Buffers that have timed out are freed first. If no buffer holds the
+ *  packet, a free buffer is set up for it; if all buffers are in use,
+ *  the one that has been waiting the longest is discarded.
+ */
+static struct sicslowpan_reass *
+reass_lookup(u16_t size, u16_t tag)
+{
+  struct sicslowpan_reass *r, *oldest;
+  const rimeaddr_t *sender;
+  clock_time_t now;
+
+  if(size > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("sicslowpan input: packet too large to reassemble (%d)\n", size);
+    UIP_STAT(++sicslowpan_reass_stat.drop);
+    return NULL;
+  }
+
+  sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  now = clock_time();
+  oldest = NULL;
+  for(r = reass_bufs; r < &reass_bufs[SICSLOWPAN_CONF_REASS_BUFS]; ++r) {
+    if(r->size != 0 && timer_expired(&r->timer)) {
+      PRINTF("sicslowpan input: reassembly timed out (tag %d)\n", r->tag);
+      UIP_STAT(++sicslowpan_reass_stat.timeout);
+      r->size = 0;
+    }
+    if(r->size == 0) {
+      oldest = r;
+    } else if(r->size == size && r->tag == tag &&
+              rimeaddr_cmp(&r->sender, sender)) {
+      return r;
+    } else if(oldest == NULL ||
+              (oldest->size != 0 &&
+               (clock_time_t)(now - r->timer.start) >
+               (clock_time_t)(now - oldest->timer.start))) {
+      oldest = r;
+    }
+  }
+
+  r = oldest;
+  if(r->size != 0) {
+    PRINTF("sicslowpan input: no free reassembly buffer, dropping tag %d\n",
+           r->tag);
+    UIP_STAT(++sicslowpan_reass_stat.evicted);
+  }
+  UIP_STAT(++sicslowpan_reass_stat.started);
+  r->size = size;
+  r->tag = tag;
+  r->received = 0;
+  memset(r->units, 0, sizeof(r->units));
+  rimeaddr_copy(&r->sender, sender);
+  timer_set(&r->timer, SICSLOWPAN_REASS_MAXAGE*CLOCK_SECOND);
+  PRINTF("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+         size, tag);
+  return r;
+}
+/*--------------------------------------------------------------------*/
+/** \brief Record the 8-byte units that a fragment holds
+ *  \param r The reassembly buffer
+ *  \param first The first unit of the fragment
+ *  \param end The unit after the last unit of the fragment
+ *  \return 1 if the units are new, 0 if any of them has already been
+ *  received
+ */
+static int
+reass_mark(struct sicslowpan_reass *r, u16_t first, u16_t end)
+{
+  u16_t i;
+
+  for(i = first; i < end; ++i) {
+    if(r->units[i >> 3] & (0x80 >> (i & 7))) {
+      return 0;
+    }
+  }
+  for(i = first; i < end; ++i) {
+    r->units[i >> 3] |= 0x80 >> (i & 7);
+  }
+  r->received += end - first;
+  return 1;
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1256,11 +1541,12 @@ output(uip_lladdr_t *localdest)
  *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
  *  a non-fragmented packet we first uncompress the IP header. The
  *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
- *  to uip_buf and the IP layer is called.
- *
- * \note We do not check for overlapping sicslowpan fragments
- * (it is a SHALL in the RFC 4944 and should never happen)
+ *  copied in siclowpan_buf. Fragments go to the reassembly buffer of
+ *  their (sender, tag, size), so fragments of several packets may be
+ *  interleaved and may arrive in any order. A fragment whose data has
+ *  already been received, such as a link-layer retransmission, is
+ *  ignored. If the IP packet is complete it is copied to uip_buf and
+ *  the IP layer is called.
  */
 static void
 input(const struct mac_driver *r)
@@ -1272,6 +1558,10 @@ input(const struct mac_driver *r)
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   u16_t frag_tag = 0;
+  /* reassembly buffer of the fragment */
+  struct sicslowpan_reass *reass = NULL;
+  /* end of the fragment in the IP packet */
+  u16_t frag_end;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
 #ifdef SICSLOWPAN_CONF_CONVENTIONAL_MAC
@@ -1297,11 +1587,6 @@ input(const struct mac_driver *r)
   rime_ptr = packetbuf_dataptr();
 
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)){
-    sicslowpan_len = 0;
-    processed_ip_len = 0;
-  }
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1340,33 +1625,18 @@ input(const struct mac_driver *r)
       break;
   }
 
-  if(processed_ip_len > 0) {
-    /* reassembly is ongoing */
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTF("sicslowpan input: Dropping 6lowpan packet\n");
+  if(frag_size > 0) {
+    /* A fragment goes to the reassembly buffer of its packet. */
+    UIP_STAT(++sicslowpan_reass_stat.frags);
+    reass = reass_lookup(frag_size, frag_tag);
+    if(reass == NULL) {
       return;
     }
+    sicslowpan_buf = reass->buf;
+    sicslowpan_len = frag_size;
   } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if(frag_size > 0){
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE*CLOCK_SECOND);
-      PRINTF("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      rimeaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
-    }
+    /* A packet that is not fragmented is uncompressed in place. */
+    sicslowpan_buf = uip_buf;
   }
 
   if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1421,38 +1691,54 @@ input(const struct mac_driver *r)
    * If this is a subsequent fragment, this is the contrary.
    */
   rime_payload_len = packetbuf_datalen() - rime_hdr_len;
+#if SICSLOWPAN_CONF_FRAG
+  if(reass != NULL) {
+    frag_end = uncomp_hdr_len + (u16_t)(frag_offset << 3) + rime_payload_len;
+    if(frag_end > reass->size ||
+       (frag_end < reass->size && (frag_end & 7) != 0)) {
+      /* the fragment does not fit in the packet, or is not the last
+         one and does not end on a unit, drop the packet */
+      PRINTF("sicslowpan input: malformed fragment, dropping\n");
+      UIP_STAT(++sicslowpan_reass_stat.drop);
+      reass->size = 0;
+      return;
+    }
+    if(!reass_mark(reass, frag_offset, (frag_end + 7) >> 3)) {
+      PRINTF("sicslowpan input: duplicate fragment, ignoring\n");
+      UIP_STAT(++sicslowpan_reass_stat.dup);
+      return;
+    }
+  }
+#endif /* SICSLOWPAN_CONF_FRAG */
   memcpy((void *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (u16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
   
-  /* update processed_ip_len if fragment, sicslowpan_len otherwise */
+  /* update the reassembly buffer if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0){
-    if(processed_ip_len == 0) {
-      processed_ip_len += uncomp_hdr_len;
+  if(reass != NULL){
+    /* The first fragment may arrive after the others. */
+    if(reass->received < (reass->size + 7) >> 3) {
+      return;
     }
-    processed_ip_len += rime_payload_len;
-  } else {
-#endif /* SICSLOWPAN_CONF_FRAG */
-    sicslowpan_len = rime_payload_len + uncomp_hdr_len;
-#if SICSLOWPAN_CONF_FRAG
-  }
 
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  if(processed_ip_len == 0 || (processed_ip_len == sicslowpan_len)){
+    /*
+     * We have a full IP packet in the reassembly buffer, deliver it
+     * to the IP stack
+     */
     PRINTF("sicslowpan input: IP packet ready (length %d)\n",
            sicslowpan_len);
+    UIP_STAT(++sicslowpan_reass_stat.done);
     memcpy((void *)UIP_IP_BUF, (void *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_len = 0;
+    reass->size = 0;
+  }
 #endif /* SICSLOWPAN_CONF_FRAG */
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  if(frag_size == 0) {
+    sicslowpan_len = rime_payload_len + uncomp_hdr_len;
   }
+#if SICSLOWPAN_CONF_FRAG
+  uip_len = sicslowpan_len;
 #endif /* SICSLOWPAN_CONF_FRAG */
+  tcpip_input();
   return;
 }
 /** @} */
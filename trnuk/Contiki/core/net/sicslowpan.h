@@ -51,6 +51,27 @@
 #include "net/uip.h"
 #include "net/mac/mac.h"
 
+#if SICSLOWPAN_CONF_FRAG && UIP_STATISTICS == 1
+/**
+ * 6lowpan reassembly statistics.
+ */
+struct sicslowpan_reass_stats {
+  uip_stats_t frags;    /**< Number of received fragments. */
+  uip_stats_t started;  /**< Number of packets whose reassembly was
+                           started. */
+  uip_stats_t done;     /**< Number of reassembled packets. */
+  uip_stats_t timeout;  /**< Number of packets that timed out. */
+  uip_stats_t evicted;  /**< Number of packets dropped to free a
+                           reassembly buffer. */
+  uip_stats_t drop;     /**< Number of packets dropped because they
+                           were too large or had malformed
+                           fragments. */
+  uip_stats_t dup;      /**< Number of fragments ignored because
+                           their data had already been received. */
+};
+extern struct sicslowpan_reass_stats sicslowpan_reass_stat;
+#endif /* SICSLOWPAN_CONF_FRAG && UIP_STATISTICS == 1 */
+
 /**
  * \name General sicslowpan defines
  * @{
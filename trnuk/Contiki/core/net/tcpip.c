@@ -151,10 +151,47 @@ unsigned char tcpip_is_forwarding; /* Forwarding right now? */
 
 PROCESS(tcpip_process, "TCP/IP stack");
 
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP_SNDBUF_SEGS > 0
+#define TCPBUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+/* Returns the connection that the segment in uip_buf was sent on, if
+   uip_input() has just processed a TCP segment for it. uip_conn is
+   left over from earlier TCP work after UDP and ICMP packets, so the
+   outgoing segment must match it. This must be checked before the
+   segment is passed to the output function, which may change
+   uip_buf. */
+static struct uip_conn *
+sndbuf_conn(void)
+{
+  if(uip_conn != NULL &&
+     TCPBUF->proto == UIP_PROTO_TCP &&
+     TCPBUF->srcport == uip_conn->lport &&
+     TCPBUF->destport == uip_conn->rport &&
+     uip_ipaddr_cmp(&TCPBUF->destipaddr, &uip_conn->ripaddr)) {
+    return uip_conn;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sndbuf_poll(struct uip_conn *conn)
+{
+  /* A connection that uses the send buffer and has just sent a
+     segment may have room to send another one right away. */
+  if(conn != NULL && uip_sndbuf_more(conn)) {
+    tcpip_poll_tcp(conn);
+  }
+}
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
 /*---------------------------------------------------------------------------*/
 static void
 packet_input(void)
 {
+#if UIP_TCP_SNDBUF_SEGS > 0
+  struct uip_conn *conn;
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+
 #if UIP_CONF_IP_FORWARD
   if(uip_len > 0) {
     tcpip_is_forwarding = 1;
@@ -162,6 +199,9 @@ packet_input(void)
       tcpip_is_forwarding = 0;
       uip_input();
       if(uip_len > 0) {
+#if UIP_TCP_SNDBUF_SEGS > 0
+        conn = sndbuf_conn();
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
 #if UIP_CONF_TCP_SPLIT
         uip_split_output();
 #else /* UIP_CONF_TCP_SPLIT */
@@ -172,6 +212,9 @@ packet_input(void)
         tcpip_output();
 #endif
 #endif /* UIP_CONF_TCP_SPLIT */
+#if UIP_TCP_SNDBUF_SEGS > 0
+        sndbuf_poll(conn);
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
       }
     }
     tcpip_is_forwarding = 0;
@@ -180,6 +223,9 @@ packet_input(void)
   if(uip_len > 0) {
     uip_input();
     if(uip_len > 0) {
+#if UIP_TCP_SNDBUF_SEGS > 0
+      conn = sndbuf_conn();
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
 #if UIP_CONF_TCP_SPLIT
       uip_split_output();
 #else /* UIP_CONF_TCP_SPLIT */
@@ -190,6 +236,9 @@ packet_input(void)
       tcpip_output();
 #endif
 #endif /* UIP_CONF_TCP_SPLIT */
+#if UIP_TCP_SNDBUF_SEGS > 0
+      sndbuf_poll(conn);
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
     }
   }
 #endif /* UIP_CONF_IP_FORWARD */
@@ -479,6 +528,9 @@ eventhandler(process_event_t ev, process_data_t data)
         if(uip_len > 0) {
 	  PRINTF("tcpip_output from tcp poll len %d\n", uip_len);
           tcpip_output();
+#if UIP_TCP_SNDBUF_SEGS > 0
+          sndbuf_poll(data);
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
         }
 #endif /* UIP_CONF_IPV6 */
         /* Start the periodic polling, if it isn't already active. */
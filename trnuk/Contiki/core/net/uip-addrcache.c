@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Address resolution cache shared by the ARP, neighbor and
+ *         IPv6 neighbor discovery code.
+ */
+
+#include "net/uip-addrcache.h"
+
+#include <string.h>
+
+#define ENTRY(c, i) ((u8_t *)(c)->entries + (u16_t)(i) * (c)->entrysize)
+#define KEY(c, i)   ((uip_ipaddr_t *)(ENTRY(c, i) + (c)->keyoff))
+#define INDEX(c, e) ((u8_t)(((u8_t *)(e) - (u8_t *)(c)->entries) / (c)->entrysize))
+
+/* The list sentinel. */
+#define HEAD(c) ((c)->size)
+
+/*---------------------------------------------------------------------------*/
+static u16_t
+hash(struct uip_addrcache *c, uip_ipaddr_t *ipaddr)
+{
+  u16_t h;
+  u8_t i;
+
+  h = 0;
+  for(i = 0; i < sizeof(uip_ipaddr_t) / 2; ++i) {
+    h ^= ipaddr->u16[i];
+  }
+  h ^= h >> 8;
+  return h & (c->hashsize - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+unlink_entry(struct uip_addrcache *c, u8_t i)
+{
+  c->next[c->prev[i]] = c->next[i];
+  c->prev[c->next[i]] = c->prev[i];
+}
+/*---------------------------------------------------------------------------*/
+static void
+link_after(struct uip_addrcache *c, u8_t pos, u8_t i)
+{
+  c->prev[i] = pos;
+  c->next[i] = c->next[pos];
+  c->prev[c->next[pos]] = i;
+  c->next[pos] = i;
+}
+/*---------------------------------------------------------------------------*/
+static u16_t
+find_slot(struct uip_addrcache *c, uip_ipaddr_t *ipaddr)
+{
+  u16_t h;
+
+  for(h = hash(c, ipaddr); c->hash[h] != 0; h = (h + 1) & (c->hashsize - 1)) {
+    if(uip_ipaddr_cmp(KEY(c, c->hash[h] - 1), ipaddr)) {
+      return h;
+    }
+  }
+  return c->hashsize;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_remove(struct uip_addrcache *c, u16_t h)
+{
+  u16_t j, home;
+
+  /* Shift later entries of the probe sequence back into the hole so
+     that lookups do not need tombstones. */
+  c->hash[h] = 0;
+  for(j = (h + 1) & (c->hashsize - 1); c->hash[j] != 0;
+      j = (j + 1) & (c->hashsize - 1)) {
+    home = hash(c, KEY(c, c->hash[j] - 1));
+    if(((j - home) & (c->hashsize - 1)) >= ((j - h) & (c->hashsize - 1))) {
+      c->hash[h] = c->hash[j];
+      c->hash[j] = 0;
+      h = j;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_index(struct uip_addrcache *c, u8_t i, u16_t h)
+{
+  hash_remove(c, h);
+
+  /* Free entries are kept at the head of the list. */
+  unlink_entry(c, i);
+  link_after(c, HEAD(c), i);
+  c->nfree++;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Initialize an address cache, removing all entries.
+ */
+void
+uip_addrcache_init(struct uip_addrcache *c)
+{
+  u8_t i;
+
+  memset(c->hash, 0, c->hashsize);
+  c->prev[HEAD(c)] = c->next[HEAD(c)] = HEAD(c);
+  for(i = 0; i < c->size; ++i) {
+    link_after(c, c->prev[HEAD(c)], i);
+  }
+  c->nfree = c->size;
+  c->hand = 0;
+  c->now = 0;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Look up the entry for an IP address.
+ *
+ * \return A pointer to the entry, or NULL if the address is not in
+ * the cache or its entry has aged out.
+ */
+void *
+uip_addrcache_lookup(struct uip_addrcache *c, uip_ipaddr_t *ipaddr)
+{
+  u16_t h;
+  u8_t i;
+
+  h = find_slot(c, ipaddr);
+  if(h == c->hashsize) {
+    return NULL;
+  }
+  i = c->hash[h] - 1;
+  if(c->maxage != 0 && (u16_t)(c->now - c->time[i]) >= c->maxage) {
+    remove_index(c, i, h);
+    return NULL;
+  }
+  return ENTRY(c, i);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Add an IP address to the cache.
+ *
+ * If the address already has an entry, the entry is refreshed and
+ * returned. Otherwise a free entry, or the least recently added or
+ * refreshed one, is given to the address. Only the address field of
+ * the returned entry is set; the caller fills in the rest.
+ *
+ * \return A pointer to the entry.
+ */
+void *
+uip_addrcache_add(struct uip_addrcache *c, uip_ipaddr_t *ipaddr)
+{
+  u16_t h;
+  u8_t i;
+
+  h = find_slot(c, ipaddr);
+  if(h != c->hashsize) {
+    i = c->hash[h] - 1;
+  } else {
+    i = c->next[HEAD(c)];
+    if(c->nfree > 0) {
+      c->nfree--;
+    } else {
+      hash_remove(c, find_slot(c, KEY(c, i)));
+    }
+    uip_ipaddr_copy(KEY(c, i), ipaddr);
+    for(h = hash(c, ipaddr); c->hash[h] != 0;
+        h = (h + 1) & (c->hashsize - 1));
+    c->hash[h] = i + 1;
+  }
+  c->time[i] = c->now;
+  unlink_entry(c, i);
+  link_after(c, c->prev[HEAD(c)], i);
+  return ENTRY(c, i);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Refresh an entry, restarting its age and making it the most
+ * recently used one.
+ */
+void
+uip_addrcache_refresh(struct uip_addrcache *c, void *entry)
+{
+  u16_t h;
+  u8_t i;
+
+  i = INDEX(c, entry);
+  h = find_slot(c, KEY(c, i));
+  if(h != c->hashsize && c->hash[h] == i + 1) {
+    c->time[i] = c->now;
+    unlink_entry(c, i);
+    link_after(c, c->prev[HEAD(c)], i);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Remove an entry from the cache.
+ */
+void
+uip_addrcache_remove(struct uip_addrcache *c, void *entry)
+{
+  u16_t h;
+  u8_t i;
+
+  i = INDEX(c, entry);
+  h = find_slot(c, KEY(c, i));
+  if(h != c->hashsize && c->hash[h] == i + 1) {
+    remove_index(c, i, h);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Advance the cache's clock by one tick.
+ *
+ * Each call also checks one entry, in round-robin order, and removes
+ * it if it has aged out. This bounds the work per call while making
+ * sure that entries that are never looked up are dropped before the
+ * 16-bit timestamps wrap around.
+ */
+void
+uip_addrcache_periodic(struct uip_addrcache *c)
+{
+  u16_t h;
+  u8_t i;
+
+  c->now++;
+  if(c->maxage == 0 || c->size == 0) {
+    return;
+  }
+  i = c->hand;
+  c->hand = (i + 1 == c->size) ? 0 : i + 1;
+  if((u16_t)(c->now - c->time[i]) >= c->maxage) {
+    h = find_slot(c, KEY(c, i));
+    if(h != c->hashsize && c->hash[h] == i + 1) {
+      remove_index(c, i, h);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Header file for the address resolution cache shared by the
+ *         ARP, neighbor and IPv6 neighbor discovery code.
+ */
+
+#ifndef __UIP_ADDRCACHE_H__
+#define __UIP_ADDRCACHE_H__
+
+#include <stddef.h>
+
+#include "net/uip.h"
+
+/*
+ * An address cache maps IP addresses to entries of a caller-provided
+ * array of structures. The structures are never moved, so pointers
+ * to them stay valid until the entry is removed or reused.
+ *
+ * Lookups go through an open-addressed hash table indexed by the IP
+ * address. Entries are kept in a list ordered by when they were last
+ * added or refreshed; a new address takes a free entry if there is
+ * one and otherwise evicts the least recently added or refreshed
+ * one. Entries age lazily: each entry is stamped with the cache's
+ * tick counter when added or refreshed, and an entry older than the
+ * maximum age is dropped when it is next looked up or when the
+ * periodic function's sweep hand reaches it.
+ *
+ * A cache holds at most 255 entries.
+ */
+
+/**
+ * The size of the hash table for a cache of n entries: a power of
+ * two that is at least twice as large as the cache.
+ *
+ * \hideinitializer
+ */
+#define UIP_ADDRCACHE_HASHSIZE(n) ((n) <= 2 ? 4 : (n) <= 4 ? 8 :         \
+                                   (n) <= 8 ? 16 : (n) <= 16 ? 32 :      \
+                                   (n) <= 32 ? 64 : (n) <= 64 ? 128 :    \
+                                   (n) <= 128 ? 256 : 512)
+
+struct uip_addrcache {
+  void *entries;
+  u16_t entrysize;
+  u16_t keyoff;
+  u8_t size;
+  u8_t nfree;
+  u8_t hand;
+  u16_t hashsize;
+  u16_t maxage;
+  u16_t now;
+  u8_t *hash;
+  u8_t *prev, *next;
+  u16_t *time;
+};
+
+/**
+ * Declare an address cache.
+ *
+ * \param name The name of the cache.
+ *
+ * \param structure The type of the entries.
+ *
+ * \param entries An array of structures that holds the cache's
+ * entries. The array must be declared before the cache.
+ *
+ * \param field The name of the uip_ipaddr_t field of the structure
+ * that holds the IP address of an entry.
+ *
+ * \param maxage The maximum age of an entry, in calls to
+ * uip_addrcache_periodic(). Zero means entries never age.
+ *
+ * \hideinitializer
+ */
+#define UIP_ADDRCACHE(name, structure, entries, field, maxage)           \
+  static u8_t name##_hash[UIP_ADDRCACHE_HASHSIZE(sizeof(entries) /       \
+                                                 sizeof(entries[0]))];   \
+  static u8_t name##_prev[sizeof(entries) / sizeof(entries[0]) + 1];     \
+  static u8_t name##_next[sizeof(entries) / sizeof(entries[0]) + 1];     \
+  static u16_t name##_time[sizeof(entries) / sizeof(entries[0])];        \
+  static struct uip_addrcache name = {                                   \
+    entries, sizeof(entries[0]), offsetof(structure, field),             \
+    sizeof(entries) / sizeof(entries[0]), 0, 0,                          \
+    UIP_ADDRCACHE_HASHSIZE(sizeof(entries) / sizeof(entries[0])),        \
+    maxage, 0, name##_hash, name##_prev, name##_next, name##_time }
+
+void uip_addrcache_init(struct uip_addrcache *c);
+void *uip_addrcache_lookup(struct uip_addrcache *c, uip_ipaddr_t *ipaddr);
+void *uip_addrcache_add(struct uip_addrcache *c, uip_ipaddr_t *ipaddr);
+void uip_addrcache_refresh(struct uip_addrcache *c, void *entry);
+void uip_addrcache_remove(struct uip_addrcache *c, void *entry);
+void uip_addrcache_periodic(struct uip_addrcache *c);
+
+#endif /* __UIP_ADDRCACHE_H__ */
@@ -74,6 +74,51 @@ static struct uip_fw_netif *netifs = NULL;
  */
 static struct uip_fw_netif *defaultnetif = NULL;
 
+/*
+ * The maximum number of registered network interfaces that the
+ * longest-prefix-match trie can hold. If more interfaces are
+ * registered, find_netif() falls back to a linear walk of the list.
+ */
+#ifdef UIP_CONF_FW_NETIFS
+#define FW_NETIFS UIP_CONF_FW_NETIFS
+#else
+#define FW_NETIFS 4
+#endif
+
+/*
+ * A path-compressed binary trie over the prefixes of the registered
+ * network interfaces. Each node holds a prefix of len bits (kept in
+ * host byte order), an optional interface for which the prefix is
+ * the network address, and two children (node index + 1, or 0)
+ * selected by the bit following the prefix. A trie with n prefixes
+ * never needs more than 2n - 1 nodes.
+ */
+struct fwtrie_node {
+  u32_t prefix;
+  struct uip_fw_netif *netif;
+  u8_t len;
+  u8_t child[2];
+};
+
+#define FWTRIE_NODES (2 * FW_NETIFS - 1)
+
+#if FW_NETIFS < 1 || FWTRIE_NODES > 255
+#error "UIP_CONF_FW_NETIFS must be between 1 and 128"
+#endif
+
+static struct fwtrie_node fwtrie[FWTRIE_NODES];
+static u8_t fwtrie_root, fwtrie_used;
+
+/*
+ * FWTRIE_STALE: the trie has to be rebuilt from the netifs list.
+ * FWTRIE_OK: the trie holds all interfaces. FWTRIE_FULL: the
+ * interfaces did not fit in the trie.
+ */
+#define FWTRIE_STALE 0
+#define FWTRIE_OK    1
+#define FWTRIE_FULL  2
+static u8_t fwtrie_state;
+
 struct tcpip_hdr {
   /* IP header. */
   u8_t vhl,
@@ -164,12 +209,33 @@ struct fwcache_entry {
 #define FWCACHE_SIZE 2
 #endif
 
+/*
+ * The cache is set associative: a packet is hashed to a bucket of
+ * FWCACHE_WAYS entries and only that bucket is searched or
+ * replaced. FWCACHE_SIZE must be a multiple of FWCACHE_WAYS, and
+ * the number of buckets should preferably be a power of two.
+ */
+#ifdef UIP_CONF_FWCACHE_WAYS
+#define FWCACHE_WAYS UIP_CONF_FWCACHE_WAYS
+#elif FWCACHE_SIZE < 2
+#define FWCACHE_WAYS 1
+#else
+#define FWCACHE_WAYS 2
+#endif
+
+#if FWCACHE_WAYS < 1 || FWCACHE_WAYS > FWCACHE_SIZE
+#error "UIP_CONF_FWCACHE_WAYS must be between 1 and UIP_CONF_FWCACHE_SIZE"
+#elif FWCACHE_SIZE % FWCACHE_WAYS != 0
+#error "UIP_CONF_FWCACHE_SIZE must be a multiple of UIP_CONF_FWCACHE_WAYS"
+#endif
+
+#define FWCACHE_BUCKETS (FWCACHE_SIZE / FWCACHE_WAYS)
 
 /*
  * A cache of packet header fields which are used for
  * identifying duplicate packets.
  */
-static struct fwcache_entry fwcache[FWCACHE_SIZE];
+static struct fwcache_entry fwcache[FWCACHE_BUCKETS * FWCACHE_WAYS];
 
 /**
  * \internal
@@ -192,6 +258,7 @@ uip_fw_init(void)
     netifs = netifs->next;
     t->next = NULL;
   }
+  fwtrie_state = FWTRIE_STALE;
 }
 /*------------------------------------------------------------------------------*/
 /**
@@ -215,6 +282,170 @@ ipaddr_maskcmp(uip_ipaddr_t *ipaddr,
     (ipaddr->u16[1] & netmask->u16[1]) == (netipaddr->u16[1] & netmask->u16[1]);
 }
 /*------------------------------------------------------------------------------*/
+/**
+ * \internal
+ * Convert an IP address into a 32-bit trie key in host byte order.
+ */
+/*------------------------------------------------------------------------------*/
+static u32_t
+ipaddr_key(const uip_ipaddr_t *ipaddr)
+{
+  return ((u32_t)ipaddr->u8[0] << 24) | ((u32_t)ipaddr->u8[1] << 16) |
+    ((u32_t)ipaddr->u8[2] << 8) | ipaddr->u8[3];
+}
+/*------------------------------------------------------------------------------*/
+#define FWTRIE_MASK(len) ((len) == 0 ? 0 : 0xffffffffUL << (32 - (len)))
+#define FWTRIE_BIT(key, pos) ((u8_t)(((key) >> (31 - (pos))) & 1))
+/*------------------------------------------------------------------------------*/
+/**
+ * \internal
+ * Allocate a trie node.
+ *
+ * \return The index + 1 of the new node.
+ */
+/*------------------------------------------------------------------------------*/
+static u8_t
+fwtrie_alloc(u32_t prefix, u8_t len, struct uip_fw_netif *netif)
+{
+  struct fwtrie_node *n;
+
+  n = &fwtrie[fwtrie_used];
+  n->prefix = prefix;
+  n->len = len;
+  n->netif = netif;
+  n->child[0] = n->child[1] = 0;
+  return ++fwtrie_used;
+}
+/*------------------------------------------------------------------------------*/
+/**
+ * \internal
+ * Insert a network interface prefix into the trie.
+ *
+ * If another interface already owns the same prefix, that interface
+ * is kept, so the order of the netifs list decides between equal
+ * prefixes just as the linear search did.
+ *
+ * \return Zero if the trie is out of nodes, non-zero otherwise.
+ */
+/*------------------------------------------------------------------------------*/
+static u8_t
+fwtrie_insert(struct uip_fw_netif *netif)
+{
+  u32_t prefix, mask, diff;
+  u8_t len, common, *p, leaf, glue;
+  struct fwtrie_node *n;
+
+  /* A non-contiguous netmask is treated as its leading run of ones. */
+  mask = ipaddr_key(&netif->netmask);
+  for(len = 0; len < 32 && (mask & 0x80000000UL); ++len) {
+    mask <<= 1;
+  }
+  prefix = ipaddr_key(&netif->ipaddr) & FWTRIE_MASK(len);
+
+  if(fwtrie_used + 2 > FWTRIE_NODES) {
+    return 0;
+  }
+
+  p = &fwtrie_root;
+  while(*p != 0) {
+    n = &fwtrie[*p - 1];
+
+    /* Find the length of the prefix that the node and the new prefix
+       have in common. */
+    diff = prefix ^ n->prefix;
+    for(common = 0; common < len && common < n->len &&
+	  !(diff & 0x80000000UL); ++common) {
+      diff <<= 1;
+    }
+
+    if(common == n->len) {
+      if(len == n->len) {
+	/* Same prefix: an existing node may be a glue node without an
+	   interface. */
+	if(n->netif == NULL) {
+	  n->netif = netif;
+	}
+	return 1;
+      }
+      /* The node is a prefix of the new one; descend. */
+      p = &n->child[FWTRIE_BIT(prefix, n->len)];
+      continue;
+    }
+
+    if(common == len) {
+      /* The new prefix is a prefix of the node: insert above it. */
+      leaf = fwtrie_alloc(prefix, len, netif);
+      fwtrie[leaf - 1].child[FWTRIE_BIT(n->prefix, len)] = *p;
+      *p = leaf;
+      return 1;
+    }
+
+    /* The prefixes diverge: split with a glue node. */
+    glue = fwtrie_alloc(prefix & FWTRIE_MASK(common), common, NULL);
+    leaf = fwtrie_alloc(prefix, len, netif);
+    fwtrie[glue - 1].child[FWTRIE_BIT(prefix, common)] = leaf;
+    fwtrie[glue - 1].child[FWTRIE_BIT(n->prefix, common)] = *p;
+    *p = glue;
+    return 1;
+  }
+
+  *p = fwtrie_alloc(prefix, len, netif);
+  return 1;
+}
+/*------------------------------------------------------------------------------*/
+/**
+ * \internal
+ * Rebuild the trie from the list of registered network interfaces.
+ */
+/*------------------------------------------------------------------------------*/
+static void
+fwtrie_build(void)
+{
+  struct uip_fw_netif *netif;
+
+  fwtrie_root = fwtrie_used = 0;
+  fwtrie_state = FWTRIE_OK;
+  for(netif = netifs; netif != NULL; netif = netif->next) {
+    if(!fwtrie_insert(netif)) {
+      fwtrie_state = FWTRIE_FULL;
+      return;
+    }
+  }
+}
+/*------------------------------------------------------------------------------*/
+/**
+ * \internal
+ * Find the network interface with the longest prefix that matches
+ * an IP address.
+ *
+ * \return The interface, or NULL if no prefix matched.
+ */
+/*------------------------------------------------------------------------------*/
+static struct uip_fw_netif *
+fwtrie_lookup(const uip_ipaddr_t *ipaddr)
+{
+  struct uip_fw_netif *best;
+  struct fwtrie_node *n;
+  u32_t key;
+  u8_t i;
+
+  key = ipaddr_key(ipaddr);
+  best = NULL;
+  for(i = fwtrie_root; i != 0; i = n->child[FWTRIE_BIT(key, n->len)]) {
+    n = &fwtrie[i - 1];
+    if(((key ^ n->prefix) & FWTRIE_MASK(n->len)) != 0) {
+      break;
+    }
+    if(n->netif != NULL) {
+      best = n->netif;
+    }
+    if(n->len == 32) {
+      break;
+    }
+  }
+  return best;
+}
+/*------------------------------------------------------------------------------*/
 /**
  * \internal
  * Send out an ICMP TIME-EXCEEDED message.
@@ -269,6 +500,23 @@ time_exceeded(void)
   ICMPBUF->ipchksum = ~(uip_ipchksum());
 
 
+}
+/*------------------------------------------------------------------------------*/
+/**
+ * \internal
+ * Find the bucket of the forwarding cache that the packet in
+ * uip_buf hashes to.
+ */
+/*------------------------------------------------------------------------------*/
+static struct fwcache_entry *
+fwcache_bucket(void)
+{
+  u16_t h;
+
+  h = BUF->ipid ^ BUF->srcipaddr.u16[0] ^ BUF->srcipaddr.u16[1] ^
+    BUF->destipaddr.u16[0] ^ BUF->destipaddr.u16[1] ^ BUF->proto;
+  h ^= h >> 8;
+  return &fwcache[(h % FWCACHE_BUCKETS) * FWCACHE_WAYS];
 }
 /*------------------------------------------------------------------------------*/
 /**
@@ -280,22 +528,18 @@ time_exceeded(void)
 static void
 fwcache_register(void)
 {
-  struct fwcache_entry *fw;
-  int i, oldest;
+  struct fwcache_entry *fw, *bucket;
+  int i;
 
-  oldest = FW_TIME;
-  fw = NULL;
-  
-  /* Find the oldest entry in the cache. */
-  for(i = 0; i < FWCACHE_SIZE; ++i) {
-    if(fwcache[i].timer == 0) {
-      fw = &fwcache[i];
-      break;
-    } else if(fwcache[i].timer <= oldest) {
-      fw = &fwcache[i];
-      oldest = fwcache[i].timer;
-    }
-  }
+  bucket = fwcache_bucket();
+
+  /* The entries of a bucket are kept newest first. The timers cannot
+     tell the entries apart, as they only tick in uip_fw_periodic(),
+     so the new entry goes first and the first expired entry, or else
+     the oldest one, makes room for it. */
+  for(i = 0; i < FWCACHE_WAYS - 1 && bucket[i].timer != 0; ++i);
+  memmove(&bucket[1], &bucket[0], i * sizeof(struct fwcache_entry));
+  fw = &bucket[0];
 
   fw->timer = FW_TIME;
   fw->ipid = BUF->ipid;
@@ -321,14 +565,26 @@ static struct uip_fw_netif *
 find_netif(void)
 {
   struct uip_fw_netif *netif;
-  
-  /* Walk through every network interface to check for a match. */
-  for(netif = netifs; netif != NULL; netif = netif->next) {
-    if(ipaddr_maskcmp(&BUF->destipaddr, &netif->ipaddr,
-		      &netif->netmask)) {
-      /* If there was a match, we break the loop. */
+
+  if(fwtrie_state == FWTRIE_STALE) {
+    fwtrie_build();
+  }
+
+  if(fwtrie_state == FWTRIE_OK) {
+    /* Pick the interface with the longest matching prefix. */
+    netif = fwtrie_lookup(&BUF->destipaddr);
+    if(netif != NULL) {
       return netif;
     }
+  } else {
+    /* Walk through every network interface to check for a match. */
+    for(netif = netifs; netif != NULL; netif = netif->next) {
+      if(ipaddr_maskcmp(&BUF->destipaddr, &netif->ipaddr,
+			&netif->netmask)) {
+	/* If there was a match, we break the loop. */
+	return netif;
+      }
+    }
   }
   
   /* If no matching netif was found, we use default netif. */
@@ -336,23 +592,40 @@ find_netif(void)
 }
 /*------------------------------------------------------------------------------*/
 /**
- * Output an IP packet on the correct network interface.
- *
- * The IP packet should be present in the uip_buf buffer and its
- * length in the global uip_len variable.
- *
- * \retval UIP_FW_ZEROLEN Indicates that a zero-length packet
- * transmission was attempted and that no packet was sent.
- *
- * \retval UIP_FW_NOROUTE No suitable network interface could be found
- * for the outbound packet, and the packet was not sent.
+ * \internal
+ * Send the packet in uip_buf on a network interface and update the
+ * interface's statistics.
+ */
+/*------------------------------------------------------------------------------*/
+static u8_t
+netif_output(struct uip_fw_netif *netif, u8_t forwarded)
+{
+  u8_t ret;
+
+  ret = netif->output();
+#if UIP_FW_STATISTICS
+  if(ret == UIP_FW_TOOLARGE || ret == UIP_FW_NOROUTE ||
+     ret == UIP_FW_DROPPED) {
+    ++netif->stats.dropped;
+  } else {
+    ++netif->stats.sent;
+    if(forwarded) {
+      ++netif->stats.forwarded;
+    }
+  }
+#endif /* UIP_FW_STATISTICS */
+  return ret;
+}
+/*------------------------------------------------------------------------------*/
+/**
+ * \internal
+ * Output the IP packet in uip_buf on the correct network interface.
  *
- * \return The return value from the actual network interface output
- * function is passed unmodified as a return value.
+ * \param forwarded Non-zero if the packet is being forwarded.
  */
 /*------------------------------------------------------------------------------*/
-u8_t
-uip_fw_output(void)
+static u8_t
+fw_output(u8_t forwarded)
 {
   struct uip_fw_netif *netif;
 #if UIP_BROADCAST
@@ -369,10 +642,10 @@ uip_fw_output(void)
   /* Link local broadcasts go out on all interfaces. */
   if(uip_ipaddr_cmp(&udp->destipaddr, &uip_broadcast_addr)) {
     if(defaultnetif != NULL) {
-      defaultnetif->output();
+      netif_output(defaultnetif, forwarded);
     }
     for(netif = netifs; netif != NULL; netif = netif->next) {
-      netif->output();
+      netif_output(netif, forwarded);
     }
     return UIP_FW_OK;
   }
@@ -388,7 +661,29 @@ uip_fw_output(void)
   }
   /* If we now have found a suitable network interface, we call its
      output function to send out the packet. */
-  return netif->output();
+  return netif_output(netif, forwarded);
+}
+/*------------------------------------------------------------------------------*/
+/**
+ * Output an IP packet on the correct network interface.
+ *
+ * The IP packet should be present in the uip_buf buffer and its
+ * length in the global uip_len variable.
+ *
+ * \retval UIP_FW_ZEROLEN Indicates that a zero-length packet
+ * transmission was attempted and that no packet was sent.
+ *
+ * \retval UIP_FW_NOROUTE No suitable network interface could be found
+ * for the outbound packet, and the packet was not sent.
+ *
+ * \return The return value from the actual network interface output
+ * function is passed unmodified as a return value.
+ */
+/*------------------------------------------------------------------------------*/
+u8_t
+uip_fw_output(void)
+{
+  return fw_output(0);
 }
 /*------------------------------------------------------------------------------*/
 /**
@@ -403,7 +698,7 @@ uip_fw_output(void)
 u8_t
 uip_fw_forward(void)
 {
-  struct fwcache_entry *fw;
+  struct fwcache_entry *fw, *bucket;
 
   /* First check if the packet is destined for ourselves and return 0
      to indicate that the packet should be processed locally. */
@@ -429,9 +724,10 @@ uip_fw_forward(void)
 #endif /* UIP_PINGADDRCONF */
 
   /* Check if the packet is in the forwarding cache already, and if so
-     we drop it. */
-
-  for(fw = fwcache; fw < &fwcache[FWCACHE_SIZE]; ++fw) {
+     we drop it. Only the bucket that the packet hashes to can hold
+     it. */
+  bucket = fwcache_bucket();
+  for(fw = bucket; fw < &bucket[FWCACHE_WAYS]; ++fw) {
     if(fw->timer != 0 &&
 #if UIP_REASSEMBLY > 0
        fw->len == BUF->len &&
@@ -474,7 +770,7 @@ uip_fw_forward(void)
 
   if(uip_len > 0) {
     uip_appdata = &uip_buf[UIP_LLH_LEN + UIP_TCPIP_HLEN];
-    uip_fw_output();
+    fw_output(1);
   }
 
 #if UIP_BROADCAST
@@ -500,6 +796,7 @@ uip_fw_register(struct uip_fw_netif *netif)
 {
   netif->next = netifs;
   netifs = netif;
+  fwtrie_state = FWTRIE_STALE;
 }
 /*------------------------------------------------------------------------------*/
 /**
@@ -518,6 +815,21 @@ uip_fw_default(struct uip_fw_netif *netif)
   defaultnetif = netif;
 }
 /*------------------------------------------------------------------------------*/
+/**
+ * Tell the forwarding module that the address or netmask of a
+ * registered network interface has changed.
+ *
+ * uip_fw_setipaddr() and uip_fw_setnetmask() call this function;
+ * code that writes the ipaddr or netmask fields of a registered
+ * interface directly must call it afterwards.
+ */
+/*------------------------------------------------------------------------------*/
+void
+uip_fw_update(void)
+{
+  fwtrie_state = FWTRIE_STALE;
+}
+/*------------------------------------------------------------------------------*/
 /**
  * Perform periodic processing.
  */
@@ -526,7 +838,7 @@ void
 uip_fw_periodic(void)
 {
   struct fwcache_entry *fw;
-  for(fw = fwcache; fw < &fwcache[FWCACHE_SIZE]; ++fw) {
+  for(fw = fwcache; fw < &fwcache[FWCACHE_BUCKETS * FWCACHE_WAYS]; ++fw) {
     if(fw->timer > 0) {
       --fw->timer;
     }
@@ -48,6 +48,22 @@
 
 #include "net/uip.h"
 
+/**
+ * Determines if per-interface forwarding statistics should be
+ * collected.
+ *
+ * When enabled, every network interface counts the packets that were
+ * sent on it, how many of those were forwarded packets, and how many
+ * were refused by the interface's output function.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_FW_STATISTICS
+#define UIP_FW_STATISTICS UIP_CONF_FW_STATISTICS
+#else
+#define UIP_FW_STATISTICS 0
+#endif
+
 /**
  * Representation of a uIP network interface.
  */
@@ -59,6 +75,16 @@ struct uip_fw_netif {
   u8_t (* output)(void);
                               /**< A pointer to the function that
 				 sends a packet. */
+#if UIP_FW_STATISTICS
+  struct {
+    uip_stats_t sent;      /**< Number of packets sent on the
+			      interface. */
+    uip_stats_t forwarded; /**< Number of sent packets that were
+			      forwarded. */
+    uip_stats_t dropped;   /**< Number of packets the output function
+			      refused. */
+  } stats;                 /**< Forwarding statistics. */
+#endif /* UIP_FW_STATISTICS */
 };
 
 /**
@@ -93,8 +119,8 @@ struct uip_fw_netif {
  * \hideinitializer
  */
 #define uip_fw_setipaddr(netif, addr) \
-        do { (netif)->ipaddr[0] = ((u16_t *)(addr))[0]; \
-             (netif)->ipaddr[1] = ((u16_t *)(addr))[1]; } while(0)
+        do { uip_ipaddr_copy(&(netif)->ipaddr, (addr)); \
+             uip_fw_update(); } while(0)
 /**
  * Set the netmask of a network interface.
  *
@@ -105,14 +131,15 @@ struct uip_fw_netif {
  * \hideinitializer
  */
 #define uip_fw_setnetmask(netif, addr) \
-        do { (netif)->netmask[0] = ((u16_t *)(addr))[0]; \
-             (netif)->netmask[1] = ((u16_t *)(addr))[1]; } while(0)
+        do { uip_ipaddr_copy(&(netif)->netmask, (addr)); \
+             uip_fw_update(); } while(0)
 
 void uip_fw_init(void);
 u8_t uip_fw_forward(void);
 u8_t uip_fw_output(void);
 void uip_fw_register(struct uip_fw_netif *netif);
 void uip_fw_default(struct uip_fw_netif *netif);
+void uip_fw_update(void);
 void uip_fw_periodic(void);
 
 
@@ -70,6 +70,7 @@
 
 #include "net/uip-nd6.h"
 #include "net/uip-netif.h"
+#include "net/uip-addrcache.h"
 #include "lib/random.h"
 
 #include <string.h>
@@ -99,6 +100,7 @@ void uip_log(char *msg);
     PRINTF("Removing neighbor with ip addr");  \
     PRINT6ADDR(&neighbor->ipaddr);             \
     PRINTF("\n");                              \
+    uip_addrcache_remove(&nbrcache, neighbor); \
     neighbor->used = 0;                        \
   } while(0)
 
@@ -110,6 +112,10 @@ void uip_log(char *msg);
 struct etimer uip_nd6_timer_periodic;
 /** \brief Neighor cache */
 static struct uip_nd6_neighbor uip_nd6_nbrcache_list[UIP_CONF_ND6_MAX_NEIGHBORS];
+/** \brief Address index of the neighbor cache. Entries do not age;
+    neighbor unreachability detection removes them. */
+UIP_ADDRCACHE(nbrcache, struct uip_nd6_neighbor, uip_nd6_nbrcache_list,
+              ipaddr, 0);
 /** \brief Default router list */
 static struct uip_nd6_defrouter uip_nd6_defrouter_list[UIP_CONF_ND6_MAX_DEFROUTERS];
 /** \brief Prefix list */
@@ -128,6 +134,7 @@ void
 uip_nd6_init(void)
 {
   /* INITIALIZE NEIGHBOR DISCOVERY*/
+  uip_addrcache_init(&nbrcache);
   for(i = 0; i < UIP_CONF_ND6_MAX_NEIGHBORS; i ++) {
     uip_nd6_nbrcache_list[i].used = 0;
   }
@@ -151,17 +158,7 @@ uip_nd6_init(void)
 struct uip_nd6_neighbor *
 uip_nd6_nbrcache_lookup(uip_ipaddr_t *ipaddr)
 {
-  neighbor = NULL;
-   
-  for(i = 0; i < UIP_CONF_ND6_MAX_NEIGHBORS; i ++) {
-    if(uip_nd6_nbrcache_list[i].used == 0) {
-      continue;
-    }
-    if(uip_ipaddr_cmp(&uip_nd6_nbrcache_list[i].ipaddr, ipaddr)) {
-      neighbor = &uip_nd6_nbrcache_list[i];
-      break;
-    }
-  }
+  neighbor = uip_addrcache_lookup(&nbrcache, ipaddr);
   return neighbor;
 }
 
@@ -169,20 +166,12 @@ struct uip_nd6_neighbor *
 uip_nd6_nbrcache_add(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
 		     u8_t isrouter, uip_neighbor_state state)
 {
-  neighbor = NULL;
-
-  for(i = 0; i < UIP_CONF_ND6_MAX_NEIGHBORS; ++i) {
-    if(uip_nd6_nbrcache_list[i].used == 0) {
-      break;
-    }
-  }
-  if(i == UIP_CONF_ND6_MAX_NEIGHBORS){
-    i = (u8_t)(random_rand()%UIP_CONF_ND6_MAX_NEIGHBORS);
+  if(nbrcache.nfree == 0 && uip_addrcache_lookup(&nbrcache, ipaddr) == NULL) {
+    /* The least recently added neighbor is replaced. */
     UIP_LOG("CACHE FULL");
   }
   
-  neighbor = &(uip_nd6_nbrcache_list[i]);
-  uip_ipaddr_copy(&(neighbor->ipaddr), ipaddr);
+  neighbor = uip_addrcache_add(&nbrcache, ipaddr);
   if(lladdr != NULL){
     memcpy(&(neighbor->lladdr), lladdr, UIP_LLADDR_LEN);
   } else {
@@ -398,7 +387,7 @@ uip_nd6_periodic(void)
       switch (neighbor->state) {
         case INCOMPLETE:
           if(neighbor->count_send >= UIP_ND6_MAX_MULTICAST_SOLICIT) {
-            uip_nd6_nbrcache_list[i].used = 0;
+            uip_nd6_nbrcache_rm(neighbor);
           }
           else if(stimer_expired(&(neighbor->last_send))) {
             PRINTF("INCOMPLETE: NS %u\n",neighbor->count_send+1);
@@ -40,6 +40,7 @@
  */
 
 #include "net/uip-neighbor.h"
+#include "net/uip-addrcache.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -55,79 +56,42 @@
 struct neighbor_entry {
   uip_ipaddr_t ipaddr;
   struct uip_neighbor_addr addr;
-  u8_t time;
 };
 static struct neighbor_entry entries[ENTRIES];
+UIP_ADDRCACHE(cache, struct neighbor_entry, entries, ipaddr, MAX_TIME);
 
 /*---------------------------------------------------------------------------*/
 void
 uip_neighbor_init(void)
 {
-  int i;
-
-  for(i = 0; i < ENTRIES; ++i) {
-    entries[i].time = MAX_TIME;
-  }
+  uip_addrcache_init(&cache);
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_neighbor_periodic(void)
 {
-  int i;
-
-  for(i = 0; i < ENTRIES; ++i) {
-    if(entries[i].time < MAX_TIME) {
-      entries[i].time++;
-    }
-  }
+  uip_addrcache_periodic(&cache);
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_neighbor_add(uip_ipaddr_t *ipaddr, struct uip_neighbor_addr *addr)
 {
-  int i, oldest;
-  u8_t oldest_time;
+  struct neighbor_entry *e;
 
   /*  printf("Adding neighbor with link address %02x:%02x:%02x:%02x:%02x:%02x\n",
 	 addr->addr.addr[0], addr->addr.addr[1], addr->addr.addr[2], addr->addr.addr[3],
 	 addr->addr.addr[4], addr->addr.addr[5]);*/
   
-  /* Find the first unused entry or the oldest used entry. */
-  oldest_time = 0;
-  oldest = 0;
-  for(i = 0; i < ENTRIES; ++i) {
-    if(entries[i].time == MAX_TIME) {
-      oldest = i;
-      break;
-    }
-    if(uip_ipaddr_cmp(&entries[i].ipaddr, ipaddr)) {
-      oldest = i;
-      break;
-    }
-    if(entries[i].time > oldest_time) {
-      oldest = i;
-      oldest_time = entries[i].time;
-    }
-  }
-
-  /* Use the oldest or first free entry (either pointed to by the
-     "oldest" variable). */
-  entries[oldest].time = 0;
-  uip_ipaddr_copy(&entries[oldest].ipaddr, ipaddr);
-  memcpy(&entries[oldest].addr, addr, sizeof(struct uip_neighbor_addr));
+  /* Use the existing entry, a free entry or the least recently
+     updated one. */
+  e = uip_addrcache_add(&cache, ipaddr);
+  memcpy(&e->addr, addr, sizeof(struct uip_neighbor_addr));
 }
 /*---------------------------------------------------------------------------*/
 static struct neighbor_entry *
 find_entry(uip_ipaddr_t *ipaddr)
 {
-  int i;
-  
-  for(i = 0; i < ENTRIES; ++i) {
-    if(uip_ipaddr_cmp(&entries[i].ipaddr, ipaddr)) {
-      return &entries[i];
-    }
-  }
-  return NULL;
+  return uip_addrcache_lookup(&cache, ipaddr);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -137,7 +101,7 @@ uip_neighbor_update(uip_ipaddr_t *ipaddr)
 
   e = find_entry(ipaddr);
   if(e != NULL) {
-    e->time = 0;
+    uip_addrcache_refresh(&cache, e);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -218,7 +218,7 @@ static u16_t tmp16;
 
 /* Macros. */
 #define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
-#define FBUF ((struct uip_tcpip_hdr *)&uip_reassbuf[0])
+#define FBUF ((struct uip_tcpip_hdr *)&uip_reass_ctx->buf[0])
 #define ICMPBUF ((struct uip_icmpip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define UDPBUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
 
@@ -369,6 +369,313 @@ uip_udpchksum(void)
 #endif /* UIP_UDP_CHECKSUMS */
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
+#if UIP_TCP_CONN_HASH
+/* The connection index maps the (lport, rport, ripaddr) tuple of
+   each connection to its position in uip_conns[]. Each slot holds
+   the connection number plus one, with zero marking an empty slot,
+   and collisions are resolved by linear probing. A connection stays
+   in the index until its slot in uip_conns[] is reused, so lookups
+   must skip entries that have since moved to the CLOSED state. */
+#define CONN_HASH_NEXT(i) (((i) + 1) & (UIP_TCP_CONN_HASH_SIZE - 1))
+static u8_t conn_hash[UIP_TCP_CONN_HASH_SIZE];
+
+/* Incoming SYNs are first checked against a bitmap with one bit per
+   port hash so that SYNs to ports nobody listens on can be rejected
+   without scanning uip_listenports[]. */
+#define LISTEN_HASH_BITS 64
+#define LISTEN_HASH(port) (((port) ^ ((port) >> 6)) & (LISTEN_HASH_BITS - 1))
+static u8_t listen_hash[LISTEN_HASH_BITS / 8];
+/*---------------------------------------------------------------------------*/
+static u8_t
+conn_hash_slot(u16_t lport, u16_t rport, const uip_ipaddr_t *ripaddr)
+{
+  u16_t h;
+
+  h = lport ^ rport ^ ripaddr->u16[0] ^ ripaddr->u16[1];
+  h ^= h >> 8;
+  return h & (UIP_TCP_CONN_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_hash_add(struct uip_conn *conn)
+{
+  u8_t i;
+
+  i = conn_hash_slot(conn->lport, conn->rport, &conn->ripaddr);
+  while(conn_hash[i] != 0) {
+    i = CONN_HASH_NEXT(i);
+  }
+  conn_hash[i] = (u8_t)(conn - uip_conns) + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_hash_remove(struct uip_conn *conn)
+{
+  u8_t i, j, k, n;
+
+  n = (u8_t)(conn - uip_conns) + 1;
+  i = conn_hash_slot(conn->lport, conn->rport, &conn->ripaddr);
+  while(conn_hash[i] != n) {
+    if(conn_hash[i] == 0) {
+      /* The connection has never been indexed. */
+      return;
+    }
+    i = CONN_HASH_NEXT(i);
+  }
+
+  /* Shift later entries of the probe sequence back into the hole so
+     that no tombstones are needed. An entry at j may only move to i
+     if its home slot k does not lie cyclically within (i, j]. */
+  j = i;
+  for(;;) {
+    j = CONN_HASH_NEXT(j);
+    if(conn_hash[j] == 0) {
+      break;
+    }
+    conn = &uip_conns[conn_hash[j] - 1];
+    k = conn_hash_slot(conn->lport, conn->rport, &conn->ripaddr);
+    if(i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+      continue;
+    }
+    conn_hash[i] = conn_hash[j];
+    i = j;
+  }
+  conn_hash[i] = 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct uip_conn *
+conn_hash_lookup(u16_t lport, u16_t rport, const uip_ipaddr_t *ripaddr)
+{
+  register struct uip_conn *conn;
+  u8_t i;
+
+  i = conn_hash_slot(lport, rport, ripaddr);
+  while(conn_hash[i] != 0) {
+    conn = &uip_conns[conn_hash[i] - 1];
+    if(conn->tcpstateflags != UIP_CLOSED &&
+       lport == conn->lport &&
+       rport == conn->rport &&
+       uip_ipaddr_cmp(ripaddr, &conn->ripaddr)) {
+      return conn;
+    }
+    i = CONN_HASH_NEXT(i);
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+listen_hash_add(u16_t port)
+{
+  u8_t h;
+
+  h = LISTEN_HASH(port);
+  listen_hash[h >> 3] |= 1 << (h & 7);
+}
+#endif /* UIP_TCP_CONN_HASH */
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP_SNDBUF_SEGS > 0
+/* The send buffer pool. A segment belongs to the connection pointed
+   to by its conn field, or is free if that field is NULL. Segments
+   of connections that have been closed are reclaimed lazily, either
+   when the connection slot is reused or when the pool runs dry. */
+struct uip_tcp_seg {
+  struct uip_tcp_seg *next;
+  struct uip_conn *conn;
+  u16_t len;
+  u8_t data[UIP_TCP_MSS];
+};
+static struct uip_tcp_seg sndbuf_segs[UIP_TCP_SNDBUF_SEGS];
+
+/* The offset from snd_nxt of the segment that is about to be sent
+   from the send buffer. */
+static u16_t sndbuf_off;
+
+/* The number of duplicate ACKs that trigger a fast retransmit. */
+#define SNDBUF_DUPACKS 3
+/*---------------------------------------------------------------------------*/
+static void
+sndbuf_free(struct uip_conn *conn)
+{
+  struct uip_tcp_seg *seg;
+
+  for(seg = conn->sndq; seg != NULL; seg = seg->next) {
+    seg->conn = NULL;
+  }
+  conn->sndq = NULL;
+  conn->queued = 0;
+  conn->sndflags = 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct uip_tcp_seg *
+sndbuf_find_free(void)
+{
+  register struct uip_tcp_seg *seg;
+
+  for(seg = &sndbuf_segs[0]; seg < &sndbuf_segs[UIP_TCP_SNDBUF_SEGS]; ++seg) {
+    if(seg->conn == NULL) {
+      return seg;
+    }
+  }
+
+  /* Reclaim the segments of connections that have been closed. */
+  for(seg = &sndbuf_segs[0]; seg < &sndbuf_segs[UIP_TCP_SNDBUF_SEGS]; ++seg) {
+    if(seg->conn->tcpstateflags == UIP_CLOSED) {
+      sndbuf_free(seg->conn);
+      return seg;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Update uip_mss() to the amount of new data that the connection may
+   send right now. */
+static void
+sndbuf_mss(struct uip_conn *conn)
+{
+  u16_t wnd;
+
+  if(!(conn->sndflags & UIP_SNDBUF_ON)) {
+    return;
+  }
+
+  wnd = conn->cwnd < conn->sndwnd? conn->cwnd: conn->sndwnd;
+  if(conn->sndwnd == 0 && conn->len == 0) {
+    /* Send one segment into a zero window to probe it. It will be
+       retransmitted until the window opens. */
+    wnd = conn->initialmss;
+  }
+
+  if((conn->sndflags & UIP_SNDBUF_CLOSE) ||
+     conn->queued > conn->len ||
+     wnd <= conn->len ||
+     sndbuf_find_free() == NULL) {
+    conn->mss = 0;
+  } else {
+    wnd -= conn->len;
+    conn->mss = wnd > conn->initialmss? conn->initialmss: wnd;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Process the ACK in an incoming segment for a connection that has
+   data in the send buffer. Returns non-zero if new data was
+   acknowledged. */
+static u8_t
+sndbuf_ack(struct uip_conn *conn)
+{
+  struct uip_tcp_seg *seg;
+  u32_t acked;
+
+  acked = ((((u32_t)BUF->ackno[0] << 24) | ((u32_t)BUF->ackno[1] << 16) |
+	    ((u32_t)BUF->ackno[2] << 8) | BUF->ackno[3]) -
+	   (((u32_t)conn->snd_nxt[0] << 24) | ((u32_t)conn->snd_nxt[1] << 16) |
+	    ((u32_t)conn->snd_nxt[2] << 8) | conn->snd_nxt[3]));
+
+  if(acked == 0) {
+    /* A segment without data that does not acknowledge anything new
+       is a duplicate ACK. */
+    if(uip_len == 0 && conn->len > 0 &&
+       (BUF->flags & (TCP_SYN | TCP_FIN)) == 0) {
+      ++conn->dupacks;
+      if(conn->dupacks == SNDBUF_DUPACKS) {
+	conn->ssthresh = conn->len / 2 > 2 * conn->initialmss?
+	  conn->len / 2: 2 * conn->initialmss;
+	conn->cwnd = conn->ssthresh + SNDBUF_DUPACKS * conn->initialmss;
+	conn->sndflags |= UIP_SNDBUF_FASTRT;
+      } else if(conn->dupacks > SNDBUF_DUPACKS &&
+		conn->cwnd < UIP_TCP_SNDBUF_SEGS * conn->initialmss) {
+	/* Each further duplicate ACK means that a segment has left
+	   the network. */
+	conn->cwnd += conn->initialmss;
+      }
+    }
+    return 0;
+  }
+
+  if(acked > conn->queued) {
+    /* The ACK is for data we have not sent. */
+    return 0;
+  }
+
+  uip_add32(conn->snd_nxt, (u16_t)acked);
+  conn->snd_nxt[0] = uip_acc32[0];
+  conn->snd_nxt[1] = uip_acc32[1];
+  conn->snd_nxt[2] = uip_acc32[2];
+  conn->snd_nxt[3] = uip_acc32[3];
+
+  conn->queued -= acked;
+  conn->len = acked < conn->len? conn->len - acked: 0;
+
+  /* Release the segments that have been acknowledged and trim the
+     oldest remaining one if it was only partly acknowledged. */
+  while(acked > 0) {
+    seg = conn->sndq;
+    if(seg->len <= acked) {
+      acked -= seg->len;
+      conn->sndq = seg->next;
+      seg->conn = NULL;
+    } else {
+      seg->len -= acked;
+      memmove(seg->data, &seg->data[acked], seg->len);
+      acked = 0;
+    }
+  }
+
+  /* Grow the congestion window: exponentially during slow start,
+     by about one segment per round-trip time after that. Leaving
+     fast recovery deflates the window to the slow start
+     threshold. */
+  if(conn->dupacks >= SNDBUF_DUPACKS) {
+    conn->cwnd = conn->ssthresh;
+  } else if(conn->cwnd < conn->ssthresh) {
+    conn->cwnd += conn->initialmss;
+  } else {
+    acked = (u32_t)conn->initialmss * conn->initialmss / conn->cwnd;
+    conn->cwnd += acked > 0? (u16_t)acked: 1;
+  }
+  if(conn->cwnd > UIP_TCP_SNDBUF_SEGS * conn->initialmss) {
+    conn->cwnd = UIP_TCP_SNDBUF_SEGS * conn->initialmss;
+  }
+  conn->dupacks = 0;
+  conn->sndflags &= ~UIP_SNDBUF_FASTRT;
+
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_sndbuf_enable(void)
+{
+  uip_conn->sndflags = UIP_SNDBUF_ON;
+  uip_conn->cwnd = 2 * uip_conn->initialmss;
+  uip_conn->ssthresh = 0xffff;
+  uip_conn->sndwnd = uip_conn->mss;
+  uip_conn->dupacks = 0;
+  sndbuf_mss(uip_conn);
+}
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+/*---------------------------------------------------------------------------*/
+#if UIP_REASSEMBLY && !UIP_CONF_IPV6
+#define UIP_REASS_BUFSIZE (UIP_BUFSIZE - UIP_LLH_LEN)
+/*
+ * A reassembly context holds the fragments of one IP packet, keyed on
+ * the source and destination addresses and the IP identification
+ * that are kept in the IP header at the start of the buffer. The
+ * timer is zero when the context is unused. The timer only has the
+ * resolution of a periodic round, so contexts that were started in
+ * the same round are ordered by their sequence number.
+ */
+struct uip_reass_ctx {
+  u8_t buf[UIP_REASS_BUFSIZE];
+  u8_t bitmap[UIP_REASS_BUFSIZE / (8 * 8) + 1];
+  u16_t len;
+  u16_t seq;
+  u8_t flags;
+  u8_t tmr;
+};
+static struct uip_reass_ctx uip_reass_ctxs[UIP_REASS_CONTEXTS];
+static u16_t uip_reass_seq;
+static struct uip_reass_ctx *uip_reass_ctx;
+#endif /* UIP_REASSEMBLY */
+/*---------------------------------------------------------------------------*/
 void
 uip_init(void)
 {
@@ -377,10 +684,28 @@ uip_init(void)
   }
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = UIP_CLOSED;
+#if UIP_TCP_SNDBUF_SEGS > 0
+    uip_conns[c].sndq = NULL;
+    uip_conns[c].sndflags = 0;
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+  }
+#if UIP_TCP_SNDBUF_SEGS > 0
+  for(c = 0; c < UIP_TCP_SNDBUF_SEGS; ++c) {
+    sndbuf_segs[c].conn = NULL;
   }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+#if UIP_TCP_CONN_HASH
+  memset(conn_hash, 0, sizeof(conn_hash));
+  memset(listen_hash, 0, sizeof(listen_hash));
+#endif /* UIP_TCP_CONN_HASH */
 #if UIP_ACTIVE_OPEN
   lastport = 1024;
 #endif /* UIP_ACTIVE_OPEN */
+#if UIP_REASSEMBLY && !UIP_CONF_IPV6
+  for(c = 0; c < UIP_REASS_CONTEXTS; ++c) {
+    uip_reass_ctxs[c].tmr = 0;
+  }
+#endif /* UIP_REASSEMBLY */
 
 #if UIP_UDP
   for(c = 0; c < UIP_UDP_CONNS; ++c) {
@@ -454,9 +779,18 @@ uip_connect(uip_ipaddr_t *ripaddr, u16_t rport)
   conn->rto = UIP_RTO;
   conn->sa = 0;
   conn->sv = 16;   /* Initial value of the RTT variance. */
+#if UIP_TCP_SNDBUF_SEGS > 0
+  sndbuf_free(conn);
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+#if UIP_TCP_CONN_HASH
+  conn_hash_remove(conn);
+#endif /* UIP_TCP_CONN_HASH */
   conn->lport = htons(lastport);
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
+#if UIP_TCP_CONN_HASH
+  conn_hash_add(conn);
+#endif /* UIP_TCP_CONN_HASH */
   
   return conn;
 }
@@ -514,6 +848,16 @@ uip_unlisten(u16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == port) {
       uip_listenports[c] = 0;
+#if UIP_TCP_CONN_HASH
+      /* Other listening ports may share the bit, so the bitmap is
+	 rebuilt from scratch. */
+      memset(listen_hash, 0, sizeof(listen_hash));
+      for(c = 0; c < UIP_LISTENPORTS; ++c) {
+	if(uip_listenports[c] != 0) {
+	  listen_hash_add(uip_listenports[c]);
+	}
+      }
+#endif /* UIP_TCP_CONN_HASH */
       return;
     }
   }
@@ -525,6 +869,9 @@ uip_listen(u16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == 0) {
       uip_listenports[c] = port;
+#if UIP_TCP_CONN_HASH
+      listen_hash_add(port);
+#endif /* UIP_TCP_CONN_HASH */
       return;
     }
   }
@@ -533,133 +880,169 @@ uip_listen(u16_t port)
 /* XXX: IP fragment reassembly: not well-tested. */
 
 #if UIP_REASSEMBLY && !UIP_CONF_IPV6
-#define UIP_REASS_BUFSIZE (UIP_BUFSIZE - UIP_LLH_LEN)
-static u8_t uip_reassbuf[UIP_REASS_BUFSIZE];
-static u8_t uip_reassbitmap[UIP_REASS_BUFSIZE / (8 * 8)];
 static const u8_t bitmap_bits[8] = {0xff, 0x7f, 0x3f, 0x1f,
 				    0x0f, 0x07, 0x03, 0x01};
-static u16_t uip_reasslen;
-static u8_t uip_reassflags;
 #define UIP_REASS_FLAG_LASTFRAG 0x01
-static u8_t uip_reasstmr;
 
 #define IP_MF   0x20
 
-static u8_t
+/*---------------------------------------------------------------------------*/
+/* Find the reassembly context of the fragment in uip_buf, or set up a
+   new one. If all contexts are in use, the one that has been waiting
+   the longest is reused. */
+static struct uip_reass_ctx *
+uip_reass_lookup(void)
+{
+  struct uip_reass_ctx *r, *oldest;
+
+  oldest = NULL;
+  for(r = uip_reass_ctxs; r < &uip_reass_ctxs[UIP_REASS_CONTEXTS]; ++r) {
+    if(r->tmr == 0) {
+      oldest = r;
+    } else if(uip_ipaddr_cmp(&BUF->srcipaddr,
+			     &((struct uip_tcpip_hdr *)r->buf)->srcipaddr) &&
+	      uip_ipaddr_cmp(&BUF->destipaddr,
+			     &((struct uip_tcpip_hdr *)r->buf)->destipaddr) &&
+	      BUF->ipid[0] == ((struct uip_tcpip_hdr *)r->buf)->ipid[0] &&
+	      BUF->ipid[1] == ((struct uip_tcpip_hdr *)r->buf)->ipid[1]) {
+      return r;
+    } else if(oldest == NULL ||
+	      (oldest->tmr != 0 &&
+	       (r->tmr < oldest->tmr ||
+		(r->tmr == oldest->tmr &&
+		 (u16_t)(oldest->seq - r->seq) < 0x8000)))) {
+      oldest = r;
+    }
+  }
+
+  r = oldest;
+  if(r->tmr != 0) {
+    UIP_STAT(++uip_stat.reass.evicted);
+  }
+  UIP_STAT(++uip_stat.reass.started);
+
+  /* Write the IP header of the fragment into the reassembly buffer.
+     The timer is set to the maximum age. */
+  memcpy(r->buf, &BUF->vhl, UIP_IPH_LEN);
+  r->tmr = UIP_REASS_MAXAGE;
+  r->seq = uip_reass_seq++;
+  r->flags = 0;
+  /* Clear the bitmap. */
+  memset(r->bitmap, 0, sizeof(r->bitmap));
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+static u16_t
 uip_reass(void)
 {
   u16_t offset, len;
   u16_t i;
 
-  /* If ip_reasstmr is zero, no packet is present in the buffer, so we
-     write the IP header of the fragment into the reassembly
-     buffer. The timer is updated with the maximum age. */
-  if(uip_reasstmr == 0) {
-    memcpy(uip_reassbuf, &BUF->vhl, UIP_IPH_LEN);
-    uip_reasstmr = UIP_REASS_MAXAGE;
-    uip_reassflags = 0;
-    /* Clear the bitmap. */
-    memset(uip_reassbitmap, 0, sizeof(uip_reassbitmap));
-  }
-
-  /* Check if the incoming fragment matches the one currently present
-     in the reasembly buffer. If so, we proceed with copying the
-     fragment into the buffer. */
-  if(BUF->srcipaddr[0] == FBUF->srcipaddr[0] &&
-     BUF->srcipaddr[1] == FBUF->srcipaddr[1] &&
-     BUF->destipaddr[0] == FBUF->destipaddr[0] &&
-     BUF->destipaddr[1] == FBUF->destipaddr[1] &&
-     BUF->ipid[0] == FBUF->ipid[0] &&
-     BUF->ipid[1] == FBUF->ipid[1]) {
-
-    len = (BUF->len[0] << 8) + BUF->len[1] - (BUF->vhl & 0x0f) * 4;
-    offset = (((BUF->ipoffset[0] & 0x3f) << 8) + BUF->ipoffset[1]) * 8;
-
-    /* If the offset or the offset + fragment length overflows the
-       reassembly buffer, we discard the entire packet. */
-    if(offset > UIP_REASS_BUFSIZE ||
-       offset + len > UIP_REASS_BUFSIZE) {
-      uip_reasstmr = 0;
-      goto nullreturn;
-    }
+  UIP_STAT(++uip_stat.reass.frags);
+  uip_reass_ctx = uip_reass_lookup();
+
+  len = (BUF->len[0] << 8) + BUF->len[1] - (BUF->vhl & 0x0f) * 4;
+  offset = (((BUF->ipoffset[0] & 0x3f) << 8) + BUF->ipoffset[1]) * 8;
 
-    /* Copy the fragment into the reassembly buffer, at the right
-       offset. */
-    memcpy(&uip_reassbuf[UIP_IPH_LEN + offset],
-	   (char *)BUF + (int)((BUF->vhl & 0x0f) * 4),
-	   len);
+  /* If the offset or the offset + fragment length overflows the
+     reassembly buffer, we discard the entire packet. */
+  if(offset > UIP_REASS_BUFSIZE - UIP_IPH_LEN ||
+     offset + len > UIP_REASS_BUFSIZE - UIP_IPH_LEN) {
+    UIP_STAT(++uip_stat.reass.drop);
+    uip_reass_ctx->tmr = 0;
+    goto nullreturn;
+  }
+
+  /* Copy the fragment into the reassembly buffer, at the right
+     offset. */
+  memcpy(&uip_reass_ctx->buf[UIP_IPH_LEN + offset],
+	 (char *)BUF + (int)((BUF->vhl & 0x0f) * 4),
+	 len);
       
-    /* Update the bitmap. */
-    if(offset / (8 * 8) == (offset + len) / (8 * 8)) {
-      /* If the two endpoints are in the same byte, we only update
-	 that byte. */
+  /* Update the bitmap. */
+  if(offset / (8 * 8) == (offset + len) / (8 * 8)) {
+    /* If the two endpoints are in the same byte, we only update
+       that byte. */
 	     
-      uip_reassbitmap[offset / (8 * 8)] |=
-	     bitmap_bits[(offset / 8 ) & 7] &
-	     ~bitmap_bits[((offset + len) / 8 ) & 7];
-    } else {
-      /* If the two endpoints are in different bytes, we update the
-	 bytes in the endpoints and fill the stuff inbetween with
-	 0xff. */
-      uip_reassbitmap[offset / (8 * 8)] |=
-	bitmap_bits[(offset / 8 ) & 7];
-      for(i = 1 + offset / (8 * 8); i < (offset + len) / (8 * 8); ++i) {
-	uip_reassbitmap[i] = 0xff;
-      }
-      uip_reassbitmap[(offset + len) / (8 * 8)] |=
-	~bitmap_bits[((offset + len) / 8 ) & 7];
+    uip_reass_ctx->bitmap[offset / (8 * 8)] |=
+	   bitmap_bits[(offset / 8 ) & 7] &
+	   ~bitmap_bits[((offset + len) / 8 ) & 7];
+  } else {
+    /* If the two endpoints are in different bytes, we update the
+       bytes in the endpoints and fill the stuff inbetween with
+       0xff. */
+    uip_reass_ctx->bitmap[offset / (8 * 8)] |=
+      bitmap_bits[(offset / 8 ) & 7];
+    for(i = 1 + offset / (8 * 8); i < (offset + len) / (8 * 8); ++i) {
+      uip_reass_ctx->bitmap[i] = 0xff;
     }
+    uip_reass_ctx->bitmap[(offset + len) / (8 * 8)] |=
+      ~bitmap_bits[((offset + len) / 8 ) & 7];
+  }
     
-    /* If this fragment has the More Fragments flag set to zero, we
-       know that this is the last fragment, so we can calculate the
-       size of the entire packet. We also set the
-       IP_REASS_FLAG_LASTFRAG flag to indicate that we have received
-       the final fragment. */
-
-    if((BUF->ipoffset[0] & IP_MF) == 0) {
-      uip_reassflags |= UIP_REASS_FLAG_LASTFRAG;
-      uip_reasslen = offset + len;
-    }
+  /* If this fragment has the More Fragments flag set to zero, we
+     know that this is the last fragment, so we can calculate the
+     size of the entire packet. We also set the
+     IP_REASS_FLAG_LASTFRAG flag to indicate that we have received
+     the final fragment. */
+
+  if((BUF->ipoffset[0] & IP_MF) == 0) {
+    uip_reass_ctx->flags |= UIP_REASS_FLAG_LASTFRAG;
+    uip_reass_ctx->len = offset + len;
+  }
     
-    /* Finally, we check if we have a full packet in the buffer. We do
-       this by checking if we have the last fragment and if all bits
-       in the bitmap are set. */
-    if(uip_reassflags & UIP_REASS_FLAG_LASTFRAG) {
-      /* Check all bytes up to and including all but the last byte in
-	 the bitmap. */
-      for(i = 0; i < uip_reasslen / (8 * 8) - 1; ++i) {
-	if(uip_reassbitmap[i] != 0xff) {
-	  goto nullreturn;
-	}
-      }
-      /* Check the last byte in the bitmap. It should contain just the
-	 right amount of bits. */
-      if(uip_reassbitmap[uip_reasslen / (8 * 8)] !=
-	 (u8_t)~bitmap_bits[uip_reasslen / 8 & 7]) {
+  /* Finally, we check if we have a full packet in the buffer. We do
+     this by checking if we have the last fragment and if all bits
+     in the bitmap are set. */
+  if(uip_reass_ctx->flags & UIP_REASS_FLAG_LASTFRAG) {
+    /* Check all bytes up to but not including the last byte in the
+       bitmap. */
+    for(i = 0; i < uip_reass_ctx->len / (8 * 8); ++i) {
+      if(uip_reass_ctx->bitmap[i] != 0xff) {
 	goto nullreturn;
       }
-
-      /* If we have come this far, we have a full packet in the
-	 buffer, so we allocate a pbuf and copy the packet into it. We
-	 also reset the timer. */
-      uip_reasstmr = 0;
-      memcpy(BUF, FBUF, uip_reasslen);
-
-      /* Pretend to be a "normal" (i.e., not fragmented) IP packet
-	 from now on. */
-      BUF->ipoffset[0] = BUF->ipoffset[1] = 0;
-      BUF->len[0] = uip_reasslen >> 8;
-      BUF->len[1] = uip_reasslen & 0xff;
-      BUF->ipchksum = 0;
-      BUF->ipchksum = ~(uip_ipchksum());
-
-      return uip_reasslen;
     }
+    /* Check the last byte in the bitmap. It should contain just the
+       right amount of bits. */
+    if(uip_reass_ctx->bitmap[uip_reass_ctx->len / (8 * 8)] !=
+       (u8_t)~bitmap_bits[uip_reass_ctx->len / 8 & 7]) {
+      goto nullreturn;
+    }
+
+    /* If we have come this far, we have a full packet in the
+       buffer, so we copy it to uip_buf and release the context. */
+    UIP_STAT(++uip_stat.reass.done);
+    uip_reass_ctx->tmr = 0;
+    len = uip_reass_ctx->len + UIP_IPH_LEN;
+    memcpy(BUF, FBUF, len);
+
+    /* Pretend to be a "normal" (i.e., not fragmented) IP packet
+       from now on. */
+    BUF->ipoffset[0] = BUF->ipoffset[1] = 0;
+    BUF->len[0] = len >> 8;
+    BUF->len[1] = len & 0xff;
+    BUF->ipchksum = 0;
+    BUF->ipchksum = ~(uip_ipchksum());
+
+    return len;
   }
 
  nullreturn:
   return 0;
 }
+/*---------------------------------------------------------------------------*/
+/* Age the reassembly contexts; called once per periodic round. */
+static void
+uip_reass_periodic(void)
+{
+  struct uip_reass_ctx *r;
+
+  for(r = uip_reass_ctxs; r < &uip_reass_ctxs[UIP_REASS_CONTEXTS]; ++r) {
+    if(r->tmr != 0 && --r->tmr == 0) {
+      UIP_STAT(++uip_stat.reass.timeout);
+    }
+  }
+}
 #endif /* UIP_REASSEMBLY */
 /*---------------------------------------------------------------------------*/
 static void
@@ -676,6 +1059,9 @@ void
 uip_process(u8_t flag)
 {
   register struct uip_conn *uip_connr = uip_conn;
+#if UIP_TCP_SNDBUF_SEGS > 0
+  struct uip_tcp_seg *seg;
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
 
 #if UIP_UDP
   if(flag == UIP_UDP_SEND_CONN) {
@@ -688,6 +1074,17 @@ uip_process(u8_t flag)
   /* Check if we were invoked because of a poll request for a
      particular connection. */
   if(flag == UIP_POLL_REQUEST) {
+#if UIP_TCP_SNDBUF_SEGS > 0
+    /* Connections that use the send buffer may be polled for more
+       data while they have data in flight. */
+    if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+       (uip_connr->sndflags & UIP_SNDBUF_ON)) {
+      sndbuf_mss(uip_connr);
+      uip_flags = UIP_POLL;
+      UIP_APPCALL();
+      goto appsend;
+    }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
     if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
        !uip_outstanding(uip_connr)) {
 	uip_flags = UIP_POLL;
@@ -699,8 +1096,10 @@ uip_process(u8_t flag)
     /* Check if we were invoked because of the perodic timer fireing. */
   } else if(flag == UIP_TIMER) {
 #if UIP_REASSEMBLY
-    if(uip_reasstmr != 0) {
-      --uip_reasstmr;
+    /* The periodic timer is run once for every connection, but the
+       reassembly contexts are only aged once per round. */
+    if(uip_conn == &uip_conns[0]) {
+      uip_reass_periodic();
     }
 #endif /* UIP_REASSEMBLY */
     /* Increase the initial sequence number. */
@@ -776,6 +1175,21 @@ uip_process(u8_t flag)
 #endif /* UIP_ACTIVE_OPEN */
 	    
 	  case UIP_ESTABLISHED:
+#if UIP_TCP_SNDBUF_SEGS > 0
+	    if(uip_connr->sndq != NULL) {
+	      /* The send buffer has a copy of the data, so we do not
+		 need the application. We collapse the congestion
+		 window and go back to resend everything from the
+		 oldest unacknowledged segment. */
+	      uip_connr->ssthresh =
+		uip_connr->len / 2 > 2 * uip_connr->initialmss?
+		uip_connr->len / 2: 2 * uip_connr->initialmss;
+	      uip_connr->cwnd = uip_connr->initialmss;
+	      uip_connr->dupacks = 0;
+	      uip_connr->len = 0;
+	      goto sndbuf_rexmit;
+	    }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
 	    /* In the ESTABLISHED state, we call upon the application
                to do the actual retransmit after which we jump into
                the code for sending out the packet (the apprexmit
@@ -795,6 +1209,9 @@ uip_process(u8_t flag)
       } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
 	/* If there was no need for a retransmission, we poll the
            application for new data. */
+#if UIP_TCP_SNDBUF_SEGS > 0
+	sndbuf_mss(uip_connr);
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
 	uip_flags = UIP_POLL;
 	UIP_APPCALL();
 	goto appsend;
@@ -1211,6 +1628,12 @@ uip_process(u8_t flag)
   
   /* Demultiplex this segment. */
   /* First check any active connections. */
+#if UIP_TCP_CONN_HASH
+  uip_connr = conn_hash_lookup(BUF->destport, BUF->srcport, &BUF->srcipaddr);
+  if(uip_connr != NULL) {
+    goto found;
+  }
+#else /* UIP_TCP_CONN_HASH */
   for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
       ++uip_connr) {
     if(uip_connr->tcpstateflags != UIP_CLOSED &&
@@ -1220,6 +1643,7 @@ uip_process(u8_t flag)
       goto found;
     }
   }
+#endif /* UIP_TCP_CONN_HASH */
 
   /* If we didn't find and active connection that expected the packet,
      either this packet is an old duplicate, or this is a SYN packet
@@ -1231,6 +1655,13 @@ uip_process(u8_t flag)
   
   tmp16 = BUF->destport;
   /* Next, check listening connections. */
+#if UIP_TCP_CONN_HASH
+  c = LISTEN_HASH(tmp16);
+  if((listen_hash[c >> 3] & (1 << (c & 7))) == 0) {
+    UIP_STAT(++uip_stat.tcp.synrst);
+    goto reset;
+  }
+#endif /* UIP_TCP_CONN_HASH */
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(tmp16 == uip_listenports[c]) {
       goto found_listen;
@@ -1331,9 +1762,18 @@ uip_process(u8_t flag)
   uip_connr->sa = 0;
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
+#if UIP_TCP_SNDBUF_SEGS > 0
+  sndbuf_free(uip_connr);
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+#if UIP_TCP_CONN_HASH
+  conn_hash_remove(uip_connr);
+#endif /* UIP_TCP_CONN_HASH */
   uip_connr->lport = BUF->destport;
   uip_connr->rport = BUF->srcport;
   uip_ipaddr_copy(&uip_connr->ripaddr, &BUF->srcipaddr);
+#if UIP_TCP_CONN_HASH
+  conn_hash_add(uip_connr);
+#endif /* UIP_TCP_CONN_HASH */
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
 
   uip_connr->snd_nxt[0] = iss[0];
@@ -1446,18 +1886,33 @@ uip_process(u8_t flag)
      the outstanding data, calculate RTT estimations, and reset the
      retransmission timer. */
   if((BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
-    uip_add32(uip_connr->snd_nxt, uip_connr->len);
-
-    if(BUF->ackno[0] == uip_acc32[0] &&
-       BUF->ackno[1] == uip_acc32[1] &&
-       BUF->ackno[2] == uip_acc32[2] &&
-       BUF->ackno[3] == uip_acc32[3]) {
-      /* Update sequence number. */
-      uip_connr->snd_nxt[0] = uip_acc32[0];
-      uip_connr->snd_nxt[1] = uip_acc32[1];
-      uip_connr->snd_nxt[2] = uip_acc32[2];
-      uip_connr->snd_nxt[3] = uip_acc32[3];
-	
+#if UIP_TCP_SNDBUF_SEGS > 0
+    /* With data in the send buffer, the ACK is cumulative and may
+       cover only some of the segments in flight. */
+    if(uip_connr->sndq != NULL) {
+      c = sndbuf_ack(uip_connr);
+    } else
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+    {
+      uip_add32(uip_connr->snd_nxt, uip_connr->len);
+
+      c = BUF->ackno[0] == uip_acc32[0] &&
+	BUF->ackno[1] == uip_acc32[1] &&
+	BUF->ackno[2] == uip_acc32[2] &&
+	BUF->ackno[3] == uip_acc32[3];
+      if(c) {
+	/* Update sequence number. */
+	uip_connr->snd_nxt[0] = uip_acc32[0];
+	uip_connr->snd_nxt[1] = uip_acc32[1];
+	uip_connr->snd_nxt[2] = uip_acc32[2];
+	uip_connr->snd_nxt[3] = uip_acc32[3];
+
+	/* Reset length of outstanding data. */
+	uip_connr->len = 0;
+      }
+    }
+
+    if(c) {
       /* Do RTT estimation, unless we have done retransmissions. */
       if(uip_connr->nrtx == 0) {
 	signed char m;
@@ -1477,9 +1932,11 @@ uip_process(u8_t flag)
       uip_flags = UIP_ACKDATA;
       /* Reset the retransmission timer. */
       uip_connr->timer = uip_connr->rto;
-
-      /* Reset length of outstanding data. */
-      uip_connr->len = 0;
+#if UIP_TCP_SNDBUF_SEGS > 0
+      if(uip_connr->sndflags & UIP_SNDBUF_ON) {
+	uip_connr->nrtx = 0;
+      }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
     }
     
   }
@@ -1650,6 +2107,24 @@ uip_process(u8_t flag)
     }
     uip_connr->mss = tmp16;
 
+#if UIP_TCP_SNDBUF_SEGS > 0
+    if(uip_connr->sndflags & UIP_SNDBUF_ON) {
+      uip_connr->sndwnd = ((u16_t)BUF->wnd[0] << 8) + (u16_t)BUF->wnd[1];
+      if(uip_connr->sndflags & UIP_SNDBUF_FASTRT) {
+	/* The third duplicate ACK in a row: resend the oldest segment
+	   without waiting for the retransmission timer. */
+	uip_connr->sndflags &= ~UIP_SNDBUF_FASTRT;
+	goto sndbuf_rexmit;
+      }
+      sndbuf_mss(uip_connr);
+      if(uip_connr->dupacks > SNDBUF_DUPACKS && uip_connr->mss > 0) {
+	/* During fast recovery, each duplicate ACK may open the window
+	   for new data. */
+	uip_flags = UIP_POLL;
+      }
+    }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+
     /* If this packet constitutes an ACK for outstanding data (flagged
        by the UIP_ACKDATA flag, we should call the application since it
        might want to send more data. If the incoming packet had data
@@ -1666,7 +2141,7 @@ uip_process(u8_t flag)
        put into the uip_appdata and the length of the data should be
        put into uip_len. If the application don't have any data to
        send, uip_len must be set to 0. */
-    if(uip_flags & (UIP_NEWDATA | UIP_ACKDATA)) {
+    if(uip_flags & (UIP_NEWDATA | UIP_ACKDATA | UIP_POLL)) {
       uip_slen = 0;
       UIP_APPCALL();
 
@@ -1680,6 +2155,17 @@ uip_process(u8_t flag)
       }
 
       if(uip_flags & UIP_CLOSE) {
+#if UIP_TCP_SNDBUF_SEGS > 0
+	if((uip_connr->sndflags & UIP_SNDBUF_ON) &&
+	   (uip_connr->sndq != NULL || uip_slen > 0)) {
+	  /* Hold back the FIN until all buffered data, including any
+	     data sent along with the close, has been acknowledged. */
+	  uip_connr->sndflags |= UIP_SNDBUF_CLOSE;
+	  uip_flags &= ~UIP_CLOSE;
+	  goto sndbuf_send;
+	}
+      sndbuf_close:
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
 	uip_slen = 0;
 	uip_connr->len = 1;
 	uip_connr->tcpstateflags = UIP_FIN_WAIT_1;
@@ -1688,6 +2174,12 @@ uip_process(u8_t flag)
 	goto tcp_send_nodata;
       }
 
+#if UIP_TCP_SNDBUF_SEGS > 0
+      if(uip_connr->sndflags & UIP_SNDBUF_ON) {
+	goto sndbuf_send;
+      }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+
       /* If uip_slen > 0, the application has data to be sent. */
       if(uip_slen > 0) {
 
@@ -1743,6 +2235,90 @@ uip_process(u8_t flag)
       }
     }
     goto drop;
+
+#if UIP_TCP_SNDBUF_SEGS > 0
+    /* Connections that use the send buffer come here instead of
+       going through the apprexmit code above. */
+  sndbuf_send:
+    uip_connr->sndflags &= ~UIP_SNDBUF_MORE;
+    if((uip_connr->sndflags & UIP_SNDBUF_CLOSE) &&
+       uip_connr->sndq == NULL && uip_slen == 0) {
+      goto sndbuf_close;
+    }
+
+    seg = NULL;
+    if(uip_connr->queued > uip_connr->len) {
+      /* Data left unsent after a retransmission timeout goes out
+	 before any new data, as soon as the window allows. */
+      tmp16 = 0;
+      for(seg = uip_connr->sndq; tmp16 < uip_connr->len; seg = seg->next) {
+	tmp16 += seg->len;
+      }
+      if(uip_connr->len > 0 &&
+	 (uip_connr->len + seg->len > uip_connr->cwnd ||
+	  uip_connr->len + seg->len > uip_connr->sndwnd)) {
+	seg = NULL;
+      } else {
+	memcpy(&uip_buf[UIP_IPTCPH_LEN + UIP_LLH_LEN], seg->data, seg->len);
+      }
+    } else if(uip_slen > 0 && uip_connr->mss > 0) {
+      seg = sndbuf_find_free();
+      if(seg != NULL) {
+	if(uip_slen > uip_connr->mss) {
+	  uip_slen = uip_connr->mss;
+	}
+	seg->conn = uip_connr;
+	seg->next = NULL;
+	seg->len = uip_slen;
+	memcpy(seg->data, uip_sappdata, uip_slen);
+	if(uip_connr->sndq == NULL) {
+	  uip_connr->sndq = seg;
+	} else {
+	  struct uip_tcp_seg *last;
+	  for(last = uip_connr->sndq; last->next != NULL; last = last->next);
+	  last->next = seg;
+	}
+	uip_connr->queued += uip_slen;
+	tmp16 = uip_connr->len;
+      }
+    }
+
+    if(seg != NULL) {
+      if(uip_connr->len == 0) {
+	uip_connr->timer = uip_connr->rto;
+      }
+      sndbuf_off = tmp16;
+      uip_connr->len += seg->len;
+      uip_len = seg->len + UIP_TCPIP_HLEN;
+      BUF->flags = TCP_ACK | TCP_PSH;
+
+      /* Ask to be polled again at once if the window has room for
+	 more. */
+      sndbuf_mss(uip_connr);
+      if(uip_connr->mss > 0 || uip_connr->queued > uip_connr->len) {
+	uip_connr->sndflags |= UIP_SNDBUF_MORE;
+      }
+      goto tcp_send_noopts;
+    }
+
+    if(uip_flags & UIP_NEWDATA) {
+      uip_len = UIP_TCPIP_HLEN;
+      BUF->flags = TCP_ACK;
+      goto tcp_send_noopts;
+    }
+    goto drop;
+
+  sndbuf_rexmit:
+    /* Resend the oldest segment in the send buffer. */
+    seg = uip_connr->sndq;
+    if(uip_connr->len < seg->len) {
+      uip_connr->len = seg->len;
+    }
+    memcpy(&uip_buf[UIP_IPTCPH_LEN + UIP_LLH_LEN], seg->data, seg->len);
+    uip_len = seg->len + UIP_TCPIP_HLEN;
+    BUF->flags = TCP_ACK | TCP_PSH;
+    goto tcp_send_noopts;
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
   case UIP_LAST_ACK:
     /* We can close this connection if the peer has acknowledged our
        FIN. This is indicated by the UIP_ACKDATA flag. */
@@ -1836,6 +2412,18 @@ uip_process(u8_t flag)
   BUF->seqno[2] = uip_connr->snd_nxt[2];
   BUF->seqno[3] = uip_connr->snd_nxt[3];
 
+#if UIP_TCP_SNDBUF_SEGS > 0
+  if(sndbuf_off != 0) {
+    /* Segments from the send buffer may start past snd_nxt. */
+    uip_add32(BUF->seqno, sndbuf_off);
+    BUF->seqno[0] = uip_acc32[0];
+    BUF->seqno[1] = uip_acc32[1];
+    BUF->seqno[2] = uip_acc32[2];
+    BUF->seqno[3] = uip_acc32[3];
+    sndbuf_off = 0;
+  }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+
   BUF->proto = UIP_PROTO_TCP;
   
   BUF->srcport  = uip_connr->lport;
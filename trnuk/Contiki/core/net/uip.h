@@ -595,6 +595,44 @@ struct uip_conn *uip_connect(uip_ipaddr_t *ripaddr, u16_t port);
  */
 CCIF void uip_send(const void *data, int len);
 
+/**
+ * Let uIP buffer and retransmit the data sent on the current
+ * connection.
+ *
+ * After this function has been called, every segment sent with
+ * uip_send() is copied into a buffer from a shared pool and kept
+ * until it has been acknowledged. Several segments may then be in
+ * flight at the same time, limited by the congestion window and the
+ * window advertised by the peer, and uIP retransmits lost segments
+ * itself: the application is never invoked with the uip_rexmit()
+ * event.
+ *
+ * Data passed to uip_send() is accepted as soon as the call returns,
+ * up to uip_mss() bytes, so the application may advance its own
+ * buffer pointer right away. When uip_mss() is zero no data can be
+ * accepted until a later uip_acked() or uip_poll() event.
+ *
+ * This function should be called from the uip_connected() event,
+ * before any data has been sent on the connection.
+ *
+ * \note This function is available only if UIP_TCP_SNDBUF_SEGS has
+ * been configured to a non-zero value in uipopt.h.
+ */
+void uip_sndbuf_enable(void);
+
+/**
+ * \internal
+ *
+ * Check if a connection that uses the send buffer has room for more
+ * data right after a segment has been sent, so that it should be
+ * polled again at once.
+ *
+ * \param conn A pointer to the uip_conn structure for the connection.
+ *
+ * \hideinitializer
+ */
+#define uip_sndbuf_more(conn) ((conn)->sndflags & UIP_SNDBUF_MORE)
+
 /**
  * The length of any incoming data that is currently available (if available)
  * in the uip_appdata buffer.
@@ -1281,6 +1319,8 @@ extern u16_t uip_urglen, uip_surglen;
  * file pointers) for the connection. The type of this field is
  * configured in the "uipopt.h" header file.
  */
+struct uip_tcp_seg;
+
 struct uip_conn {
   uip_ipaddr_t ripaddr;   /**< The IP address of the remote host. */
   
@@ -1306,6 +1346,16 @@ struct uip_conn {
   u8_t timer;         /**< The retransmission timer. */
   u8_t nrtx;          /**< The number of retransmissions for the last
 			 segment sent. */
+#if UIP_TCP_SNDBUF_SEGS > 0
+  struct uip_tcp_seg *sndq; /**< Segments that have not been
+			       acknowledged, oldest first. */
+  u16_t queued;       /**< Number of bytes in the sndq segments. */
+  u16_t cwnd;         /**< Congestion window. */
+  u16_t ssthresh;     /**< Slow start threshold. */
+  u16_t sndwnd;       /**< Window last advertised by the peer. */
+  u8_t dupacks;       /**< Number of duplicate ACKs in a row. */
+  u8_t sndflags;      /**< Send buffer flags. */
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
 
   /** The application state. */
   uip_tcp_appstate_t appstate;
@@ -1452,6 +1502,22 @@ struct uip_stats {
 			     checksum. */
   } udp;                  /**< UDP statistics. */
 #endif /* UIP_UDP */
+#if UIP_REASSEMBLY || UIP_CONF_IPV6_REASSEMBLY
+  struct {
+    uip_stats_t frags;    /**< Number of received fragments. */
+    uip_stats_t started;  /**< Number of packets whose reassembly
+			     was started. */
+    uip_stats_t done;     /**< Number of packets that were
+			     completely reassembled. */
+    uip_stats_t timeout;  /**< Number of packets discarded because
+			     they were not complete in time. */
+    uip_stats_t evicted;  /**< Number of packets discarded to make
+			     room for a new packet. */
+    uip_stats_t drop;     /**< Number of fragments dropped because
+			     they did not fit the reassembly
+			     buffer. */
+  } reass;                /**< IP reassembly statistics. */
+#endif /* UIP_REASSEMBLY || UIP_CONF_IPV6_REASSEMBLY */
 #if UIP_CONF_IPV6
   struct {
     uip_stats_t drop;     /**< Number of dropped ND6 packets. */
@@ -1566,6 +1632,18 @@ void uip_process(u8_t flag);
   
 #define UIP_STOPPED      16
 
+/* The send buffer flags used in the uip_conn->sndflags. */
+#define UIP_SNDBUF_ON     1     /* The connection uses the send
+				   buffer. */
+#define UIP_SNDBUF_CLOSE  2     /* The application has closed the
+				   connection, the FIN is sent when all
+				   buffered data has been
+				   acknowledged. */
+#define UIP_SNDBUF_MORE   4     /* More data can be sent right
+				   away. */
+#define UIP_SNDBUF_FASTRT 8     /* The oldest segment should be
+				   retransmitted now. */
+
 /* The TCP and IP headers. */
 struct uip_tcpip_hdr {
 #if UIP_CONF_IPV6
@@ -147,7 +147,7 @@ u8_t uip_ext_opt_offset = 0;
 /** \name Buffer defines
  *  @{
  */
-#define FBUF                             ((struct uip_tcpip_hdr *)&uip_reassbuf[0])
+#define FBUF                             ((struct uip_tcpip_hdr *)&uip_reass_ctx->buf[0])
 #define UIP_IP_BUF                          ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define UIP_ICMP_BUF                      ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
 #define UIP_UDP_BUF                        ((struct uip_udp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
@@ -401,6 +401,112 @@ uip_udpchksum(void)
 #endif /* UIP_UDP && UIP_UDP_CHECKSUMS */
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_TCP_CONN_HASH
+/* The connection index maps the (lport, rport, ripaddr) tuple of
+   each connection to its position in uip_conns[]. Each slot holds
+   the connection number plus one, with zero marking an empty slot,
+   and collisions are resolved by linear probing. A connection stays
+   in the index until its slot in uip_conns[] is reused, so lookups
+   must skip entries that have since moved to the CLOSED state. */
+#define CONN_HASH_NEXT(i) (((i) + 1) & (UIP_TCP_CONN_HASH_SIZE - 1))
+static u8_t conn_hash[UIP_TCP_CONN_HASH_SIZE];
+
+/* Incoming SYNs are first checked against a bitmap with one bit per
+   port hash so that SYNs to ports nobody listens on can be rejected
+   without scanning uip_listenports[]. */
+#define LISTEN_HASH_BITS 64
+#define LISTEN_HASH(port) (((port) ^ ((port) >> 6)) & (LISTEN_HASH_BITS - 1))
+static u8_t listen_hash[LISTEN_HASH_BITS / 8];
+/*---------------------------------------------------------------------------*/
+static u8_t
+conn_hash_slot(u16_t lport, u16_t rport, const uip_ipaddr_t *ripaddr)
+{
+  u16_t h;
+
+  /* Only the low half of the interface identifier is hashed; it is
+     what differs between peers on the same prefix. */
+  h = lport ^ rport ^ ripaddr->u16[6] ^ ripaddr->u16[7];
+  h ^= h >> 8;
+  return h & (UIP_TCP_CONN_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_hash_add(struct uip_conn *conn)
+{
+  u8_t i;
+
+  i = conn_hash_slot(conn->lport, conn->rport, &conn->ripaddr);
+  while(conn_hash[i] != 0) {
+    i = CONN_HASH_NEXT(i);
+  }
+  conn_hash[i] = (u8_t)(conn - uip_conns) + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_hash_remove(struct uip_conn *conn)
+{
+  u8_t i, j, k, n;
+
+  n = (u8_t)(conn - uip_conns) + 1;
+  i = conn_hash_slot(conn->lport, conn->rport, &conn->ripaddr);
+  while(conn_hash[i] != n) {
+    if(conn_hash[i] == 0) {
+      /* The connection has never been indexed. */
+      return;
+    }
+    i = CONN_HASH_NEXT(i);
+  }
+
+  /* Shift later entries of the probe sequence back into the hole so
+     that no tombstones are needed. An entry at j may only move to i
+     if its home slot k does not lie cyclically within (i, j]. */
+  j = i;
+  for(;;) {
+    j = CONN_HASH_NEXT(j);
+    if(conn_hash[j] == 0) {
+      break;
+    }
+    conn = &uip_conns[conn_hash[j] - 1];
+    k = conn_hash_slot(conn->lport, conn->rport, &conn->ripaddr);
+    if(i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+      continue;
+    }
+    conn_hash[i] = conn_hash[j];
+    i = j;
+  }
+  conn_hash[i] = 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct uip_conn *
+conn_hash_lookup(u16_t lport, u16_t rport, const uip_ipaddr_t *ripaddr)
+{
+  register struct uip_conn *conn;
+  u8_t i;
+
+  i = conn_hash_slot(lport, rport, ripaddr);
+  while(conn_hash[i] != 0) {
+    conn = &uip_conns[conn_hash[i] - 1];
+    if(conn->tcpstateflags != UIP_CLOSED &&
+       lport == conn->lport &&
+       rport == conn->rport &&
+       uip_ipaddr_cmp(ripaddr, &conn->ripaddr)) {
+      return conn;
+    }
+    i = CONN_HASH_NEXT(i);
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+listen_hash_add(u16_t port)
+{
+  u8_t h;
+
+  h = LISTEN_HASH(port);
+  listen_hash[h >> 3] |= 1 << (h & 7);
+}
+#endif /* UIP_TCP && UIP_TCP_CONN_HASH */
+/*---------------------------------------------------------------------------*/
 void
 uip_init(void)
 {
@@ -415,6 +521,10 @@ uip_init(void)
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = UIP_CLOSED;
   }
+#if UIP_TCP_CONN_HASH
+  memset(conn_hash, 0, sizeof(conn_hash));
+  memset(listen_hash, 0, sizeof(listen_hash));
+#endif /* UIP_TCP_CONN_HASH */
 #endif /* UIP_TCP */
 
 #if UIP_ACTIVE_OPEN
@@ -500,9 +610,15 @@ uip_connect(uip_ipaddr_t *ripaddr, u16_t rport)
   conn->rto = UIP_RTO;
   conn->sa = 0;
   conn->sv = 16;   /* Initial value of the RTT variance. */
+#if UIP_TCP_CONN_HASH
+  conn_hash_remove(conn);
+#endif /* UIP_TCP_CONN_HASH */
   conn->lport = htons(lastport);
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
+#if UIP_TCP_CONN_HASH
+  conn_hash_add(conn);
+#endif /* UIP_TCP_CONN_HASH */
   
   return conn;
 }
@@ -565,6 +681,16 @@ uip_unlisten(u16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == port) {
       uip_listenports[c] = 0;
+#if UIP_TCP_CONN_HASH
+      /* Other listening ports may share the bit, so the bitmap is
+         rebuilt from scratch. */
+      memset(listen_hash, 0, sizeof(listen_hash));
+      for(c = 0; c < UIP_LISTENPORTS; ++c) {
+        if(uip_listenports[c] != 0) {
+          listen_hash_add(uip_listenports[c]);
+        }
+      }
+#endif /* UIP_TCP_CONN_HASH */
       return;
     }
   }
@@ -578,6 +704,9 @@ uip_listen(u16_t port)
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == 0) {
       uip_listenports[c] = port;
+#if UIP_TCP_CONN_HASH
+      listen_hash_add(port);
+#endif /* UIP_TCP_CONN_HASH */
       return;
     }
   }
@@ -589,19 +718,36 @@ uip_listen(u16_t port)
 #if UIP_CONF_IPV6_REASSEMBLY
 #define UIP_REASS_BUFSIZE (UIP_BUFSIZE - UIP_LLH_LEN)
 
-static u8_t uip_reassbuf[UIP_REASS_BUFSIZE];
+#define UIP_REASS_FLAG_LASTFRAG 0x01
+#define UIP_REASS_FLAG_FIRSTFRAG 0x02
+#define UIP_REASS_FLAG_ERROR_MSG 0x04
+
+/*
+ * A reassembly context holds the fragments of one packet, keyed on the
+ * source and destination addresses kept in the IP header at the start
+ * of the buffer and on the Identification of the Fragment header.
+ * Contexts that were started in the same clock tick are ordered by
+ * their sequence number.
+ */
+struct uip_reass_ctx {
+  u8_t buf[UIP_REASS_BUFSIZE];
+  /*the first byte of an IP fragment is aligned on an 8-byte boundary */
+  u8_t bitmap[UIP_REASS_BUFSIZE / (8 * 8) + 1];
+  u32_t id; /* the Identification value that the source node put in all
+               the fragments of the packet */
+  clock_time_t start; /* when the first fragment was received */
+  u16_t seq;
+  u16_t len;
+  u8_t flags;
+  u8_t used;
+};
 
-static u8_t uip_reassbitmap[UIP_REASS_BUFSIZE / (8 * 8)];
-/*the first byte of an IP fragment is aligned on an 8-byte boundary */
+static struct uip_reass_ctx uip_reass_ctxs[UIP_REASS_CONTEXTS];
+static struct uip_reass_ctx *uip_reass_ctx;
+static u16_t uip_reass_seq;
 
 static const u8_t bitmap_bits[8] = {0xff, 0x7f, 0x3f, 0x1f,
                                     0x0f, 0x07, 0x03, 0x01};
-static u16_t uip_reasslen;
-static u8_t uip_reassflags;
-
-#define UIP_REASS_FLAG_LASTFRAG 0x01
-#define UIP_REASS_FLAG_FIRSTFRAG 0x02
-#define UIP_REASS_FLAG_ERROR_MSG 0x04
 
 
 /*
@@ -614,169 +760,255 @@ static u8_t uip_reassflags;
  */
 
 
-struct etimer uip_reass_timer; /* timer for reassembly */
-u8_t uip_reass_on; /* equal to 1 if we are currently reassembling a packet */
+struct etimer uip_reass_timer; /* expires when the oldest context does */
+u8_t uip_reass_on; /* number of packets currently being reassembled */
 
-static u32_t uip_id; /* For every packet that is to be fragmented, the source
-                        node generates an Identification value that is present
-                        in all the fragments */
 #define IP_MF   0x0001
 
+#define UIP_REASS_TIMEOUT (UIP_REASS_MAXAGE * CLOCK_SECOND)
+
+/*---------------------------------------------------------------------------*/
+/* Release a reassembly context. */
+static void
+uip_reass_free(struct uip_reass_ctx *r)
+{
+  r->used = 0;
+  uip_reass_on--;
+}
+/*---------------------------------------------------------------------------*/
+/* Point the reassembly timer at the context that times out first. */
+static void
+uip_reass_set_timer(void)
+{
+  struct uip_reass_ctx *r, *oldest;
+  clock_time_t now, age;
+
+  now = clock_time();
+  oldest = NULL;
+  age = 0;
+  for(r = uip_reass_ctxs; r < &uip_reass_ctxs[UIP_REASS_CONTEXTS]; ++r) {
+    if(r->used && (oldest == NULL || now - r->start > age)) {
+      oldest = r;
+      age = now - r->start;
+    }
+  }
+  if(oldest == NULL) {
+    etimer_stop(&uip_reass_timer);
+    return;
+  }
+  etimer_set(&uip_reass_timer,
+             age < UIP_REASS_TIMEOUT ? UIP_REASS_TIMEOUT - age : 0);
+}
+/*---------------------------------------------------------------------------*/
+/* Find the reassembly context of the fragment in uip_buf, or set up a
+   new one. If all contexts are in use, the one that has been waiting
+   the longest is reused. */
+static struct uip_reass_ctx *
+uip_reass_lookup(void)
+{
+  struct uip_reass_ctx *r, *oldest;
+  clock_time_t now;
+
+  now = clock_time();
+  oldest = NULL;
+  for(r = uip_reass_ctxs; r < &uip_reass_ctxs[UIP_REASS_CONTEXTS]; ++r) {
+    if(!r->used) {
+      oldest = r;
+    } else if(uip_ipaddr_cmp(&((struct uip_tcpip_hdr *)r->buf)->srcipaddr,
+                             &UIP_IP_BUF->srcipaddr) &&
+              uip_ipaddr_cmp(&((struct uip_tcpip_hdr *)r->buf)->destipaddr,
+                             &UIP_IP_BUF->destipaddr) &&
+              r->id == UIP_FRAG_BUF->id) {
+      return r;
+    } else if(oldest == NULL ||
+              (oldest->used &&
+               ((clock_time_t)(now - r->start) >
+                (clock_time_t)(now - oldest->start) ||
+                (r->start == oldest->start &&
+                 (u16_t)(oldest->seq - r->seq) < 0x8000)))) {
+      oldest = r;
+    }
+  }
+
+  r = oldest;
+  if(r->used) {
+    PRINTF("Reassembly contexts full, dropping oldest packet\n");
+    UIP_STAT(++uip_stat.reass.evicted);
+    uip_reass_free(r);
+  }
+  UIP_STAT(++uip_stat.reass.started);
+
+  PRINTF("Starting reassembly\n");
+  /* We first write the unfragmentable part of IP header into the
+     reassembly buffer. The reset the other reassembly variables. */
+  memcpy(r->buf, UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
+  /* temporary in case we do not receive the fragment with offset 0 first */
+  r->start = now;
+  r->seq = uip_reass_seq++;
+  r->used = 1;
+  r->flags = 0;
+  r->id = UIP_FRAG_BUF->id;
+  /* Clear the bitmap. */
+  memset(r->bitmap, 0, sizeof(r->bitmap));
+  uip_reass_on++;
+  uip_reass_set_timer();
+  return r;
+}
+/*---------------------------------------------------------------------------*/
 static u16_t
 uip_reass(void)
 {
   u16_t offset=0;
   u16_t len;
   u16_t i;
-  
-  /* If ip_reasstmr is zero, no packet is present in the buffer */
-  /* We first write the unfragmentable part of IP header into the reassembly
-     buffer. The reset the other reassembly variables. */
-  if(uip_reass_on == 0) {
-    PRINTF("Starting reassembly\n");
+
+  UIP_STAT(++uip_stat.reass.frags);
+  uip_reass_ctx = uip_reass_lookup();
+
+  len = uip_len - uip_ext_len - UIP_IPH_LEN - UIP_FRAGH_LEN;
+  offset = (ntohs(UIP_FRAG_BUF->offsetresmore) & 0xfff8);
+  /* in byte, originaly in multiple of 8 bytes*/
+  PRINTF("len %d\n", len);
+  PRINTF("offset %d\n", offset);
+  if(offset == 0){
+    uip_reass_ctx->flags |= UIP_REASS_FLAG_FIRSTFRAG;
+    /*
+     * The Next Header field of the last header of the Unfragmentable
+     * Part is obtained from the Next Header field of the first
+     * fragment's Fragment header.
+     */
+    *uip_next_hdr = UIP_FRAG_BUF->next;
     memcpy(FBUF, UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
-    /* temporary in case we do not receive the fragment with offset 0 first */
-    etimer_set(&uip_reass_timer, UIP_REASS_MAXAGE*CLOCK_SECOND);
-    uip_reass_on = 1;
-    uip_reassflags = 0;
-    uip_id = UIP_FRAG_BUF->id;
-    /* Clear the bitmap. */
-    memset(uip_reassbitmap, 0, sizeof(uip_reassbitmap));
-  }
-  /*
-   * Check if the incoming fragment matches the one currently present
-   * in the reasembly buffer. If so, we proceed with copying the fragment
-   * into the buffer.
-   */
-  if(uip_ipaddr_cmp(&FBUF->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
-     uip_ipaddr_cmp(&FBUF->destipaddr, &UIP_IP_BUF->destipaddr) &&
-     UIP_FRAG_BUF->id == uip_id) {
-    len = uip_len - uip_ext_len - UIP_IPH_LEN - UIP_FRAGH_LEN;
-    offset = (ntohs(UIP_FRAG_BUF->offsetresmore) & 0xfff8);
-    /* in byte, originaly in multiple of 8 bytes*/
-    PRINTF("len %d\n", len);
-    PRINTF("offset %d\n", offset);
-    if(offset == 0){
-      uip_reassflags |= UIP_REASS_FLAG_FIRSTFRAG;
-      /*
-       * The Next Header field of the last header of the Unfragmentable
-       * Part is obtained from the Next Header field of the first
-       * fragment's Fragment header.
-       */
-      *uip_next_hdr = UIP_FRAG_BUF->next;
-      memcpy(FBUF, UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
-      PRINTF("src ");
-      PRINT6ADDR(&FBUF->srcipaddr);
-      PRINTF("dest ");
-      PRINT6ADDR(&FBUF->destipaddr);
-      PRINTF("next %d\n", UIP_IP_BUF->proto);
+    PRINTF("src ");
+    PRINT6ADDR(&FBUF->srcipaddr);
+    PRINTF("dest ");
+    PRINT6ADDR(&FBUF->destipaddr);
+    PRINTF("next %d\n", UIP_IP_BUF->proto);
       
-    }
+  }
     
-    /* If the offset or the offset + fragment length overflows the
-       reassembly buffer, we discard the entire packet. */
-    if(offset > UIP_REASS_BUFSIZE ||
-       offset + len > UIP_REASS_BUFSIZE) {
-      uip_reass_on = 0;
-      etimer_stop(&uip_reass_timer);
-      return 0;
-    }
+  /* If the offset or the offset + fragment length overflows the
+     reassembly buffer, we discard the entire packet. */
+  if(offset > UIP_REASS_BUFSIZE - UIP_IPH_LEN - uip_ext_len ||
+     offset + len > UIP_REASS_BUFSIZE - UIP_IPH_LEN - uip_ext_len) {
+    UIP_STAT(++uip_stat.reass.drop);
+    uip_reass_free(uip_reass_ctx);
+    uip_reass_set_timer();
+    return 0;
+  }
 
-    /* If this fragment has the More Fragments flag set to zero, it is the
-       last fragment*/
-    if((ntohs(UIP_FRAG_BUF->offsetresmore) & IP_MF) == 0) {
-      uip_reassflags |= UIP_REASS_FLAG_LASTFRAG;
-      /*calculate the size of the entire packet*/
-      uip_reasslen = offset + len;
-      PRINTF("LAST FRAGMENT reasslen %d\n", uip_reasslen);
-    } else {
-      /* If len is not a multiple of 8 octets and the M flag of that fragment
-         is 1, then that fragment must be discarded and an ICMP Parameter
-         Problem, Code 0, message should be sent to the source of the fragment,
-         pointing to the Payload Length field of the fragment packet. */
-      if(len % 8 != 0){
-        uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, 4);
-        uip_reassflags |= UIP_REASS_FLAG_ERROR_MSG;
-        /* not clear if we should interrupt reassembly, but it seems so from
-           the conformance tests */
-        uip_reass_on = 0;
-        etimer_stop(&uip_reass_timer);
-        return uip_len;
-      }
+  /* If this fragment has the More Fragments flag set to zero, it is the
+     last fragment*/
+  if((ntohs(UIP_FRAG_BUF->offsetresmore) & IP_MF) == 0) {
+    uip_reass_ctx->flags |= UIP_REASS_FLAG_LASTFRAG;
+    /*calculate the size of the entire packet*/
+    uip_reass_ctx->len = offset + len;
+    PRINTF("LAST FRAGMENT reasslen %d\n", uip_reass_ctx->len);
+  } else {
+    /* If len is not a multiple of 8 octets and the M flag of that fragment
+       is 1, then that fragment must be discarded and an ICMP Parameter
+       Problem, Code 0, message should be sent to the source of the fragment,
+       pointing to the Payload Length field of the fragment packet. */
+    if(len % 8 != 0){
+      uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, 4);
+      uip_reass_ctx->flags |= UIP_REASS_FLAG_ERROR_MSG;
+      /* not clear if we should interrupt reassembly, but it seems so from
+         the conformance tests */
+      uip_reass_free(uip_reass_ctx);
+      uip_reass_set_timer();
+      return uip_len;
     }
+  }
     
-    /* Copy the fragment into the reassembly buffer, at the right
-       offset. */
-    memcpy((void *)FBUF + UIP_IPH_LEN + uip_ext_len + offset,
-           (void *)UIP_FRAG_BUF + UIP_FRAGH_LEN, len);
+  /* Copy the fragment into the reassembly buffer, at the right
+     offset. */
+  memcpy((void *)FBUF + UIP_IPH_LEN + uip_ext_len + offset,
+         (void *)UIP_FRAG_BUF + UIP_FRAGH_LEN, len);
     
-    /* Update the bitmap. */
-    if(offset >> 6 == (offset + len) >> 6) {
-      uip_reassbitmap[offset >> 6] |=
-        bitmap_bits[(offset >> 3) & 7] &
-        ~bitmap_bits[((offset + len) >> 3)  & 7];
-    } else {
-      /* If the two endpoints are in different bytes, we update the
-         bytes in the endpoints and fill the stuff inbetween with
-         0xff. */
-      uip_reassbitmap[offset >> 6] |= bitmap_bits[(offset >> 3) & 7];
+  /* Update the bitmap. */
+  if(offset >> 6 == (offset + len) >> 6) {
+    uip_reass_ctx->bitmap[offset >> 6] |=
+      bitmap_bits[(offset >> 3) & 7] &
+      ~bitmap_bits[((offset + len) >> 3)  & 7];
+  } else {
+    /* If the two endpoints are in different bytes, we update the
+       bytes in the endpoints and fill the stuff inbetween with
+       0xff. */
+    uip_reass_ctx->bitmap[offset >> 6] |= bitmap_bits[(offset >> 3) & 7];
  
-      for(i = (1 + (offset >> 6)); i < ((offset + len) >> 6); ++i) {
-        uip_reassbitmap[i] = 0xff;
-      }
-      uip_reassbitmap[(offset + len) >> 6] |=
-        ~bitmap_bits[((offset + len) >> 3) & 7];
+    for(i = (1 + (offset >> 6)); i < ((offset + len) >> 6); ++i) {
+      uip_reass_ctx->bitmap[i] = 0xff;
     }
+    uip_reass_ctx->bitmap[(offset + len) >> 6] |=
+      ~bitmap_bits[((offset + len) >> 3) & 7];
+  }
   
-    /* Finally, we check if we have a full packet in the buffer. We do
-       this by checking if we have the last fragment and if all bits
-       in the bitmap are set. */
+  /* Finally, we check if we have a full packet in the buffer. We do
+     this by checking if we have the last fragment and if all bits
+     in the bitmap are set. */
     
-    if(uip_reassflags & UIP_REASS_FLAG_LASTFRAG) {
-      /* Check all bytes up to and including all but the last byte in
-         the bitmap. */
-      for(i = 0; i < (uip_reasslen >> 6); ++i) {
-        if(uip_reassbitmap[i] != 0xff) {
-          return 0;
-        }
-      }
-      /* Check the last byte in the bitmap. It should contain just the
-         right amount of bits. */
-      if(uip_reassbitmap[uip_reasslen >> 6] !=
-         (u8_t)~bitmap_bits[(uip_reasslen >> 3) & 7]) {
+  if(uip_reass_ctx->flags & UIP_REASS_FLAG_LASTFRAG) {
+    /* Check all bytes up to and including all but the last byte in
+       the bitmap. */
+    for(i = 0; i < (uip_reass_ctx->len >> 6); ++i) {
+      if(uip_reass_ctx->bitmap[i] != 0xff) {
         return 0;
       }
+    }
+    /* Check the last byte in the bitmap. It should contain just the
+       right amount of bits. */
+    if(uip_reass_ctx->bitmap[uip_reass_ctx->len >> 6] !=
+       (u8_t)~bitmap_bits[(uip_reass_ctx->len >> 3) & 7]) {
+      return 0;
+    }
 
-     /* If we have come this far, we have a full packet in the
-         buffer, so we copy it to uip_buf. We also reset the timer. */
-      uip_reass_on = 0;
-      etimer_stop(&uip_reass_timer);
-
-      uip_reasslen += UIP_IPH_LEN + uip_ext_len;
-      memcpy(UIP_IP_BUF, FBUF, uip_reasslen);
-      UIP_IP_BUF->len[0] = ((uip_reasslen - UIP_IPH_LEN) >> 8);
-      UIP_IP_BUF->len[1] = ((uip_reasslen - UIP_IPH_LEN) & 0xff);
-      PRINTF("REASSEMBLED PAQUET %d (%d)\n", uip_reasslen,
-             (UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]);
+    /* If we have come this far, we have a full packet in the
+       buffer, so we copy it to uip_buf. We also release the
+       context. */
+    UIP_STAT(++uip_stat.reass.done);
+    uip_reass_free(uip_reass_ctx);
+    uip_reass_set_timer();
+
+    len = uip_reass_ctx->len + UIP_IPH_LEN + uip_ext_len;
+    memcpy(UIP_IP_BUF, FBUF, len);
+    UIP_IP_BUF->len[0] = ((len - UIP_IPH_LEN) >> 8);
+    UIP_IP_BUF->len[1] = ((len - UIP_IPH_LEN) & 0xff);
+    PRINTF("REASSEMBLED PAQUET %d (%d)\n", len,
+           (UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]);
    
-      return uip_reasslen;
+    return len;
       
-    }
-  } else {
-    PRINTF("Already reassembling another paquet\n");
   }
   return 0;
 }
-
+/*---------------------------------------------------------------------------*/
 void
 uip_reass_over(void)
 {
-   /* to late, we abandon the reassembly of the packet */
+  struct uip_reass_ctx *r;
+
+  uip_len = 0;
+
+  /* Time out the first expired context. Only one ICMP error can be
+     sent per call, so the timer is set to fire again right away if
+     more contexts have expired. */
+  for(r = uip_reass_ctxs; r < &uip_reass_ctxs[UIP_REASS_CONTEXTS]; ++r) {
+    if(r->used && clock_time() - r->start >= UIP_REASS_TIMEOUT) {
+      break;
+    }
+  }
+  if(r == &uip_reass_ctxs[UIP_REASS_CONTEXTS]) {
+    uip_reass_set_timer();
+    return;
+  }
 
-  uip_reass_on = 0;
-  etimer_stop(&uip_reass_timer);
+  /* to late, we abandon the reassembly of the packet */
+  UIP_STAT(++uip_stat.reass.timeout);
+  uip_reass_ctx = r;
+  uip_reass_free(r);
+  uip_reass_set_timer();
 
-  if(uip_reassflags & UIP_REASS_FLAG_FIRSTFRAG){
+  if(r->flags & UIP_REASS_FLAG_FIRSTFRAG){
     PRINTF("FRAG INTERRUPTED TOO LATE\n");
     /* If the first fragment has been received, an ICMP Time Exceeded
        -- Fragment Reassembly Time Exceeded message should be sent to the
@@ -787,7 +1019,6 @@ uip_reass_over(void)
      * any RFC, we decided not to include it as it reduces the size of
      * the packet.
      */
-    uip_len = 0;
     uip_ext_len = 0;
     memcpy(UIP_IP_BUF, FBUF, UIP_IPH_LEN); /* copy the header for src
                                               and dest address*/
@@ -1225,7 +1456,7 @@ uip_process(u8_t flag)
         if(uip_len == 0) {
           goto drop;
         }
-        if(uip_reassflags & UIP_REASS_FLAG_ERROR_MSG){
+        if(uip_reass_ctx->flags & UIP_REASS_FLAG_ERROR_MSG){
           /* we are not done with reassembly, this is an error message */
           goto send;
         }
@@ -1439,6 +1670,13 @@ uip_process(u8_t flag)
   
   /* Demultiplex this segment. */
   /* First check any active connections. */
+#if UIP_TCP_CONN_HASH
+  uip_connr = conn_hash_lookup(UIP_TCP_BUF->destport, UIP_TCP_BUF->srcport,
+                               &UIP_IP_BUF->srcipaddr);
+  if(uip_connr != NULL) {
+    goto found;
+  }
+#else /* UIP_TCP_CONN_HASH */
   for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
       ++uip_connr) {
     if(uip_connr->tcpstateflags != UIP_CLOSED &&
@@ -1448,6 +1686,7 @@ uip_process(u8_t flag)
       goto found;
     }
   }
+#endif /* UIP_TCP_CONN_HASH */
 
   /* If we didn't find and active connection that expected the packet,
      either this packet is an old duplicate, or this is a SYN packet
@@ -1459,6 +1698,13 @@ uip_process(u8_t flag)
   
   tmp16 = UIP_TCP_BUF->destport;
   /* Next, check listening connections. */
+#if UIP_TCP_CONN_HASH
+  c = LISTEN_HASH(tmp16);
+  if((listen_hash[c >> 3] & (1 << (c & 7))) == 0) {
+    UIP_STAT(++uip_stat.tcp.synrst);
+    goto reset;
+  }
+#endif /* UIP_TCP_CONN_HASH */
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(tmp16 == uip_listenports[c]) {
       goto found_listen;
@@ -1560,9 +1806,15 @@ uip_process(u8_t flag)
   uip_connr->sa = 0;
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
+#if UIP_TCP_CONN_HASH
+  conn_hash_remove(uip_connr);
+#endif /* UIP_TCP_CONN_HASH */
   uip_connr->lport = UIP_TCP_BUF->destport;
   uip_connr->rport = UIP_TCP_BUF->srcport;
   uip_ipaddr_copy(&uip_connr->ripaddr, &UIP_IP_BUF->srcipaddr);
+#if UIP_TCP_CONN_HASH
+  conn_hash_add(uip_connr);
+#endif /* UIP_TCP_CONN_HASH */
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
 
   uip_connr->snd_nxt[0] = iss[0];
@@ -60,6 +60,7 @@
 
 
 #include "net/uip_arp.h"
+#include "net/uip-addrcache.h"
 
 #include <string.h>
 
@@ -98,7 +99,6 @@ struct ethip_hdr {
 struct arp_entry {
   uip_ipaddr_t ipaddr;
   struct uip_eth_addr ethaddr;
-  u8_t time;
 };
 
 static const struct uip_eth_addr broadcast_ethaddr =
@@ -106,11 +106,8 @@ static const struct uip_eth_addr broadcast_ethaddr =
 static const u16_t broadcast_ipaddr[2] = {0xffff,0xffff};
 
 static struct arp_entry arp_table[UIP_ARPTAB_SIZE];
+UIP_ADDRCACHE(arp_cache, struct arp_entry, arp_table, ipaddr, UIP_ARP_MAXAGE);
 static uip_ipaddr_t ipaddr;
-static u8_t i, c;
-
-static u8_t arptime;
-static u8_t tmpage;
 
 #define BUF   ((struct arp_hdr *)&uip_buf[0])
 #define IPBUF ((struct ethip_hdr *)&uip_buf[0])
@@ -132,9 +129,7 @@ static u8_t tmpage;
 void
 uip_arp_init(void)
 {
-  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-    memset(&arp_table[i].ipaddr, 0, 4);
-  }
+  uip_addrcache_init(&arp_cache);
 }
 /*-----------------------------------------------------------------------------------*/
 /**
@@ -144,82 +139,26 @@ uip_arp_init(void)
  * and should be called at regular intervals. The recommended interval
  * is 10 seconds between the calls.
  *
+ * Entries are aged lazily, so the cost of a call does not depend on
+ * the size of the ARP table.
  */
 /*-----------------------------------------------------------------------------------*/
 void
 uip_arp_timer(void)
 {
-  struct arp_entry *tabptr;
-  
-  ++arptime;
-  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-    tabptr = &arp_table[i];
-    if(uip_ipaddr_cmp(&tabptr->ipaddr, &uip_all_zeroes_addr) &&
-       arptime - tabptr->time >= UIP_ARP_MAXAGE) {
-      memset(&tabptr->ipaddr, 0, 4);
-    }
-  }
-
+  uip_addrcache_periodic(&arp_cache);
 }
 /*-----------------------------------------------------------------------------------*/
 static void
 uip_arp_update(uip_ipaddr_t *ipaddr, struct uip_eth_addr *ethaddr)
 {
   register struct arp_entry *tabptr;
-  /* Walk through the ARP mapping table and try to find an entry to
-     update. If none is found, the IP -> MAC address mapping is
-     inserted in the ARP table. */
-  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-
-    tabptr = &arp_table[i];
-    /* Only check those entries that are actually in use. */
-    if(!uip_ipaddr_cmp(&tabptr->ipaddr, &uip_all_zeroes_addr)) {
-
-      /* Check if the source IP address of the incoming packet matches
-         the IP address in this ARP table entry. */
-      if(uip_ipaddr_cmp(ipaddr, &tabptr->ipaddr)) {
-	 
-	/* An old entry found, update this and return. */
-	memcpy(tabptr->ethaddr.addr, ethaddr->addr, 6);
-	tabptr->time = arptime;
-
-	return;
-      }
-    }
-  }
-
-  /* If we get here, no existing ARP table entry was found, so we
-     create one. */
-
-  /* First, we try to find an unused entry in the ARP table. */
-  for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-    tabptr = &arp_table[i];
-    if(uip_ipaddr_cmp(&tabptr->ipaddr, &uip_all_zeroes_addr)) {
-      break;
-    }
-  }
 
-  /* If no unused entry is found, we try to find the oldest entry and
-     throw it away. */
-  if(i == UIP_ARPTAB_SIZE) {
-    tmpage = 0;
-    c = 0;
-    for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-      tabptr = &arp_table[i];
-      if(arptime - tabptr->time > tmpage) {
-	tmpage = arptime - tabptr->time;
-	c = i;
-      }
-    }
-    i = c;
-    tabptr = &arp_table[i];
-  }
-
-  /* Now, i is the ARP table entry which we will fill with the new
-     information. */
-  uip_ipaddr_copy(&tabptr->ipaddr, ipaddr);
+  /* Find the entry for the IP address, or create one. If the ARP
+     table is full, the entry that was least recently updated is
+     thrown away. */
+  tabptr = uip_addrcache_add(&arp_cache, ipaddr);
   memcpy(tabptr->ethaddr.addr, ethaddr->addr, 6);
-  tabptr->time = arptime;
 }
 /*-----------------------------------------------------------------------------------*/
 /**
@@ -386,14 +325,9 @@ uip_arp_out(void)
       uip_ipaddr_copy(&ipaddr, &IPBUF->destipaddr);
     }
       
-    for(i = 0; i < UIP_ARPTAB_SIZE; ++i) {
-      tabptr = &arp_table[i];
-      if(uip_ipaddr_cmp(&ipaddr, &tabptr->ipaddr)) {
-	break;
-      }
-    }
+    tabptr = uip_addrcache_lookup(&arp_cache, &ipaddr);
 
-    if(i == UIP_ARPTAB_SIZE) {
+    if(tabptr == NULL) {
       /* The destination address was not in our ARP table, so we
 	 overwrite the IP packet with an ARP request. */
 
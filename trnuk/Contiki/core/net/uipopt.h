@@ -172,6 +172,25 @@
 #else /* UIP_CONF_REASSEMBLY */
 #define UIP_REASSEMBLY 0
 #endif /* UIP_CONF_REASSEMBLY */
+
+/**
+ * The number of IP packets that can be reassembled at the same time.
+ *
+ * Each reassembly context is keyed on the source and destination
+ * addresses and the identification of the fragmented packet, and
+ * has its own timer and reassembly buffer of the same size as the
+ * uip_buf buffer. When a fragment of a new packet arrives and all
+ * contexts are in use, the context that has been waiting the
+ * longest is discarded. This applies to both IPv4 reassembly
+ * (UIP_REASSEMBLY) and IPv6 reassembly (UIP_CONF_IPV6_REASSEMBLY).
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_REASS_CONTEXTS
+#define UIP_REASS_CONTEXTS UIP_CONF_REASS_CONTEXTS
+#else /* UIP_CONF_REASS_CONTEXTS */
+#define UIP_REASS_CONTEXTS 1
+#endif /* UIP_CONF_REASS_CONTEXTS */
 /** @} */
 
 /*------------------------------------------------------------------------------*/
@@ -342,6 +361,85 @@
 #define UIP_LISTENPORTS UIP_CONF_MAX_LISTENPORTS
 #endif /* UIP_CONF_MAX_LISTENPORTS */
 
+/**
+ * Determines if incoming TCP segments should be demultiplexed through
+ * a hash index instead of a linear scan of the connection table.
+ *
+ * The index is an open-addressed table of one byte per slot, keyed
+ * on the local port, remote port and remote IP address of each
+ * connection, together with a small bitmap that lets SYNs to ports
+ * nobody listens on be rejected without scanning the listen ports.
+ * It only pays off when UIP_CONNS is large, such as on border
+ * routers with dozens of connections.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_CONN_HASH
+#define UIP_TCP_CONN_HASH UIP_CONF_TCP_CONN_HASH
+#else /* UIP_CONF_TCP_CONN_HASH */
+#define UIP_TCP_CONN_HASH 0
+#endif /* UIP_CONF_TCP_CONN_HASH */
+
+/**
+ * The number of slots in the TCP connection hash index.
+ *
+ * Must be a power of two larger than UIP_CONNS. The default keeps
+ * the load factor at or below one half.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_CONN_HASH_SIZE
+#define UIP_TCP_CONN_HASH_SIZE UIP_CONF_TCP_CONN_HASH_SIZE
+#elif UIP_CONNS <= 4
+#define UIP_TCP_CONN_HASH_SIZE 8
+#elif UIP_CONNS <= 8
+#define UIP_TCP_CONN_HASH_SIZE 16
+#elif UIP_CONNS <= 16
+#define UIP_TCP_CONN_HASH_SIZE 32
+#elif UIP_CONNS <= 32
+#define UIP_TCP_CONN_HASH_SIZE 64
+#elif UIP_CONNS <= 64
+#define UIP_TCP_CONN_HASH_SIZE 128
+#else
+#define UIP_TCP_CONN_HASH_SIZE 256
+#endif /* UIP_CONF_TCP_CONN_HASH_SIZE */
+
+#if UIP_TCP_CONN_HASH
+/* The index stores connection numbers plus one in bytes, and probes
+   until it finds an empty slot. */
+#if UIP_CONNS > 255
+#error "UIP_CONF_TCP_CONN_HASH needs UIP_CONF_MAX_CONNECTIONS to be at most 255"
+#endif
+#if UIP_TCP_CONN_HASH_SIZE <= UIP_CONNS
+#error "UIP_CONF_TCP_CONN_HASH_SIZE must be larger than UIP_CONF_MAX_CONNECTIONS"
+#endif
+#if UIP_TCP_CONN_HASH_SIZE > 256 || \
+    (UIP_TCP_CONN_HASH_SIZE & (UIP_TCP_CONN_HASH_SIZE - 1)) != 0
+#error "UIP_CONF_TCP_CONN_HASH_SIZE must be a power of two of at most 256"
+#endif
+#endif /* UIP_TCP_CONN_HASH */
+
+/**
+ * The number of segments in the shared TCP send buffer pool.
+ *
+ * When non-zero, connections that call uip_sndbuf_enable() keep a
+ * copy of every segment they send in a buffer drawn from this pool,
+ * so that several segments can be in flight at once and
+ * retransmissions are done by uIP without involving the
+ * application. Each segment requires UIP_TCP_MSS bytes plus a few
+ * bytes of bookkeeping. Connections that do not opt in keep the
+ * usual one-segment-at-a-time behaviour.
+ *
+ * The send buffer is only implemented for IPv4.
+ *
+ * \hideinitializer
+ */
+#if defined(UIP_CONF_TCP_SNDBUF_SEGS) && !UIP_CONF_IPV6
+#define UIP_TCP_SNDBUF_SEGS UIP_CONF_TCP_SNDBUF_SEGS
+#else /* UIP_CONF_TCP_SNDBUF_SEGS */
+#define UIP_TCP_SNDBUF_SEGS 0
+#endif /* UIP_CONF_TCP_SNDBUF_SEGS */
+
 /**
  * Determines if support for TCP urgent data notification should be
  * compiled in.
@@ -486,6 +584,15 @@
 #define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS 1
 #endif
 
+/**
+ * If we use IPHC compression, do we handle UDP between nodes sharing
+ * a prefix, with IIDs derived from the L2 addresses, in a specialized
+ * fast path. Other packets use the generic compression.
+ */
+#ifndef SICSLOWPAN_CONF_HC01_FAST
+#define SICSLOWPAN_CONF_HC01_FAST 1
+#endif
+
 /**
  * Do we support 6lowpan fragmentation
  */
@@ -493,6 +600,15 @@
 #define SICSLOWPAN_CONF_FRAG  0
 #endif
 
+/**
+ * If we support 6lowpan fragmentation, how many packets can be
+ * reassembled at the same time. Each packet needs a buffer of
+ * UIP_BUFSIZE bytes.
+ */
+#ifndef SICSLOWPAN_CONF_REASS_BUFS
+#define SICSLOWPAN_CONF_REASS_BUFS 1
+#endif
+
 /** @} */
 
 /*------------------------------------------------------------------------------*/
@@ -47,7 +47,12 @@
 #define COFFEE_SECTOR_SIZE		65536UL
 #define COFFEE_PAGE_SIZE		256UL
 #define COFFEE_START			COFFEE_SECTOR_SIZE
+#if PACKETQUEUE_CONF_XMEM
+/* The packet queue log takes the end of the flash. */
+#define COFFEE_SIZE			(PACKETQUEUE_CONF_XMEM_OFFSET - COFFEE_START)
+#else
 #define COFFEE_SIZE			(1024UL * 1024UL - COFFEE_START)
+#endif
 #define COFFEE_NAME_LENGTH		16
 #define COFFEE_MAX_OPEN_FILES		6
 #define COFFEE_FD_SET_SIZE		8
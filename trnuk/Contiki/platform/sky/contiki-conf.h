@@ -32,6 +32,12 @@
 #define RIME_CONF_NO_POLITE_ANNOUCEMENTS 1
 #endif /* !WITH_UIP6 */
 
+/* runicast relies on the link-layer ACKs when the CC2420 waits for
+   them. */
+#ifdef CC2420_CONF_AUTOACK
+#define RUNICAST_CONF_MAC_ACK CC2420_CONF_AUTOACK
+#endif /* CC2420_CONF_AUTOACK */
+
 #define CFS_CONF_OFFSET_TYPE	long
 
 #define PROFILE_CONF_ON 0
@@ -158,6 +164,13 @@ typedef unsigned long off_t;
 #define CFS_XMEM_CONF_OFFSET    (2 * XMEM_ERASE_UNIT_SIZE)
 #define CFS_XMEM_CONF_SIZE      (1 * XMEM_ERASE_UNIT_SIZE)
 
+/* Use the last two 64k of external flash for packets that overflow
+   the packet queues, if PACKETQUEUE_CONF_XMEM is set. Coffee is made
+   smaller by as much, see cfs-coffee-arch.h. */
+#define PACKETQUEUE_CONF_XMEM_SIZE   (2 * XMEM_ERASE_UNIT_SIZE)
+#define PACKETQUEUE_CONF_XMEM_OFFSET (16 * XMEM_ERASE_UNIT_SIZE - \
+                                      PACKETQUEUE_CONF_XMEM_SIZE)
+
 #define CFS_RAM_CONF_SIZE 4096
 
 /*
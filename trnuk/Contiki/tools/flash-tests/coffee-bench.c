@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host test and benchmark of file lookup in Coffee
+ *
+ *         Formats a flash image and creates FILES files in it. Every
+ *         file is opened and read back, names that do not exist must
+ *         not open, and files that are removed and created again must
+ *         be found at their new pages. Then opens of a working set of
+ *         files, opens of names that do not exist, and opens of a file
+ *         that is already open are counted in flash reads, which are
+ *         what an open costs on a node, and timed. Build it with and
+ *         without the directory cache, see the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "cfs-coffee-arch.h"
+#include "xmem-file.h"
+
+#define ROUNDS  20000
+#define WORKSET 8
+#define REMOVED (FILES / 4)
+
+static int errors;
+/*---------------------------------------------------------------------------*/
+void
+watchdog_start(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+watchdog_stop(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+watchdog_periodic(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+name(char *buf, const char *prefix, int n)
+{
+  memset(buf, 0, COFFEE_NAME_LENGTH);
+  sprintf(buf, "%s%d", prefix, n);
+}
+/*---------------------------------------------------------------------------*/
+/* The data of a file is its name padded with non-zero bytes, as
+   Coffee finds the end of a file at its last non-zero byte. */
+static void
+data(char *buf, int n)
+{
+  memset(buf, '#', COFFEE_NAME_LENGTH);
+  buf[sprintf(buf, "%d", n)] = '#';
+}
+/*---------------------------------------------------------------------------*/
+static void
+create(int n)
+{
+  char buf[COFFEE_NAME_LENGTH], d[COFFEE_NAME_LENGTH];
+  int fd;
+
+  name(buf, "file", n);
+  data(d, n);
+  fd = cfs_open(buf, CFS_WRITE);
+  if(fd < 0 || cfs_write(fd, d, sizeof(d)) != sizeof(d)) {
+    printf("cannot create %s\n", buf);
+    exit(1);
+  }
+  cfs_close(fd);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(int n, int exists)
+{
+  char buf[COFFEE_NAME_LENGTH], d[COFFEE_NAME_LENGTH], r[COFFEE_NAME_LENGTH];
+  int fd;
+
+  name(buf, "file", n);
+  data(d, n);
+  fd = cfs_open(buf, CFS_READ);
+  if(!exists) {
+    if(fd >= 0) {
+      printf("%s was removed but opens\n", buf);
+      errors++;
+      cfs_close(fd);
+    }
+    return;
+  }
+  if(fd < 0) {
+    printf("%s does not open\n", buf);
+    errors++;
+    return;
+  }
+  if(cfs_read(fd, r, sizeof(r)) != sizeof(r) ||
+     memcmp(d, r, sizeof(r)) != 0) {
+    printf("%s has the wrong data\n", buf);
+    errors++;
+  }
+  cfs_close(fd);
+}
+/*---------------------------------------------------------------------------*/
+/* Opens and closes the file, and returns the flash reads it took. */
+static unsigned long
+open_close(const char *prefix, int n, int exists)
+{
+  char buf[COFFEE_NAME_LENGTH];
+  unsigned long reads;
+  int fd;
+
+  name(buf, prefix, n);
+  reads = xmem_file_stats.reads;
+  fd = cfs_open(buf, CFS_READ);
+  reads = xmem_file_stats.reads - reads;
+  if((fd >= 0) != exists) {
+    printf("%s: open returned %d\n", buf, fd);
+    errors++;
+  }
+  if(fd >= 0) {
+    cfs_close(fd);
+  }
+  return reads;
+}
+/*---------------------------------------------------------------------------*/
+static double
+ns_since(const struct timespec *start)
+{
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  static int workset[WORKSET];
+  struct timespec start;
+  unsigned long hit_reads, miss_reads, open_reads;
+  double hit_ns, miss_ns;
+  char buf[COFFEE_NAME_LENGTH];
+  int i, fd;
+
+  xmem_file_remove();
+  cfs_coffee_format();
+  for(i = 0; i < FILES; i++) {
+    create(i);
+  }
+
+  /* Lookups must find every file, and nothing else, also after files
+     have moved. */
+  for(i = 0; i < FILES; i++) {
+    check(i, 1);
+  }
+  for(i = 0; i < FILES; i++) {
+    open_close("none", i, 0);
+  }
+  for(i = 0; i < REMOVED; i++) {
+    name(buf, "file", i * 4);
+    cfs_remove(buf);
+  }
+  for(i = 0; i < FILES; i++) {
+    check(i, i % 4 != 0 || i / 4 >= REMOVED);
+  }
+  for(i = 0; i < REMOVED; i++) {
+    create(i * 4);
+  }
+  for(i = 0; i < FILES; i++) {
+    check(i, 1);
+  }
+
+  /* Most opens are of a few files that are opened again and again. */
+  for(i = 0; i < WORKSET; i++) {
+    workset[i] = rand() % FILES;
+  }
+  hit_reads = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < ROUNDS; i++) {
+    hit_reads += open_close("file", workset[rand() % WORKSET], 1);
+  }
+  hit_ns = ns_since(&start) / ROUNDS;
+
+  miss_reads = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < ROUNDS; i++) {
+    miss_reads += open_close("none", rand() % WORKSET, 0);
+  }
+  miss_ns = ns_since(&start) / ROUNDS;
+
+  /* A file that is open is found among the open files. */
+  name(buf, "file", FILES - 1);
+  fd = cfs_open(buf, CFS_READ);
+  open_reads = 0;
+  for(i = 0; i < ROUNDS; i++) {
+    open_reads += open_close("file", FILES - 1, 1);
+  }
+  cfs_close(fd);
+
+  printf("%3d files, %2d cache entries: %6.1f flash reads and %7.0f ns per "
+	 "open, %6.1f and %7.0f ns per miss, %3.1f per open of an open file, "
+	 "%d errors\n",
+	 FILES, COFFEE_DIR_CACHE_ENTRIES,
+	 (double)hit_reads / ROUNDS, hit_ns,
+	 (double)miss_reads / ROUNDS, miss_ns,
+	 (double)open_reads / ROUNDS, errors);
+  xmem_file_remove();
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
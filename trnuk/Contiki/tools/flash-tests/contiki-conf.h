@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Configuration of the external flash host tests
+ *
+ *         The tests are built with the compiler of the development
+ *         host, with xmem.c in this directory standing in for the
+ *         external flash of the Tmote Sky. The geometry is that of
+ *         the Sky.
+ */
+
+#ifndef __CONTIKI_CONF_H__
+#define __CONTIKI_CONF_H__
+
+#include <stdint.h>
+
+typedef uint8_t   u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef int8_t    s8_t;
+typedef int16_t  s16_t;
+typedef int32_t  s32_t;
+
+typedef unsigned short uip_stats_t;
+typedef unsigned long clock_time_t;
+
+#define CLOCK_CONF_SECOND 128
+
+#define CCIF
+#define CLIF
+
+#define CC_CONF_INLINE inline
+
+#define UIP_CONF_BYTE_ORDER      UIP_LITTLE_ENDIAN
+#define UIP_CONF_LLH_LEN         0
+#define UIP_CONF_LOGGING         0
+
+#define XMEM_FILE_SIZE            (1024L * 1024L)
+#define XMEM_ERASE_UNIT_SIZE (64 * 1024L)
+
+#ifndef XMEM_FILE
+#define XMEM_FILE "xmem.img"
+#endif /* XMEM_FILE */
+
+#endif /* __CONTIKI_CONF_H__ */
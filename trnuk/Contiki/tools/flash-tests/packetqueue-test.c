@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host test of the packet queue spill log in external flash
+ *
+ *         Two queues take bursts of packets that are much larger than
+ *         the queuebuf pool, and are drained at random in between.
+ *         Every packet that comes out is checked against a model of
+ *         the queues: the data, the header, and an attribute and an
+ *         address must be those of the packet that went in at the
+ *         same position. Packets that the queue refuses, because its
+ *         log sector is not erased yet, must be counted as xmemdrop.
+ *
+ *         The ctimers only run between bursts, so some bursts fill
+ *         the log faster than the sectors are erased. Build it with
+ *         several log sizes, see the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contiki.h"
+#include "net/rime.h"
+#include "net/rime/packetqueue.h"
+#include "dev/xmem.h"
+#include "xmem-file.h"
+
+#define QUEUE_LEN 250
+#define ROUNDS    4000
+#define MAX_BURST 60
+#define MAX_LEN   (PACKETBUF_SIZE - HDR_LEN)
+#define HDR_LEN   6
+
+struct model {
+  uint16_t id[QUEUE_LEN];
+  uint16_t len[QUEUE_LEN];
+  int head, count;
+};
+
+PACKETQUEUE(q0, QUEUE_LEN);
+PACKETQUEUE(q1, QUEUE_LEN);
+
+static struct packetqueue *queues[2] = { &q0, &q1 };
+static struct model models[2];
+static clock_time_t now;
+static int errors;
+
+struct rimestats rimestats;
+/*---------------------------------------------------------------------------*/
+clock_time_t
+clock_time(void)
+{
+  return now;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_timers(clock_time_t t)
+{
+  now += t;
+  etimer_request_poll();
+  while(process_run() > 0);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+byte(uint16_t id, int i)
+{
+  return (uint8_t)(id * 131 + i * 7 + (id >> 8));
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_packet(uint16_t id, uint16_t len)
+{
+  rimeaddr_t addr;
+  uint8_t *p;
+  int i;
+
+  packetbuf_clear();
+  p = packetbuf_dataptr();
+  for(i = 0; i < len; i++) {
+    p[i] = byte(id, i + HDR_LEN);
+  }
+  packetbuf_set_datalen(len);
+  packetbuf_hdralloc(HDR_LEN);
+  p = packetbuf_hdrptr();
+  for(i = 0; i < HDR_LEN; i++) {
+    p[i] = byte(id, i);
+  }
+  packetbuf_set_attr(PACKETBUF_ATTR_PACKET_ID, id);
+  addr.u8[0] = id >> 8;
+  addr.u8[1] = id & 0xff;
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &addr);
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_head(int n)
+{
+  struct model *m = &models[n];
+  struct queuebuf *b;
+  const rimeaddr_t *addr;
+  uint16_t id, len;
+  uint8_t *p;
+  int i;
+
+  id = m->id[m->head];
+  len = m->len[m->head];
+  b = packetqueue_queuebuf(packetqueue_first(queues[n]));
+  if(b == NULL) {
+    /* All queuebufs hold packets of the other queue. */
+    return 0;
+  }
+  p = queuebuf_dataptr(b);
+  if(queuebuf_datalen(b) != HDR_LEN + len) {
+    printf("packet %u: length %d, expected %u\n", id, queuebuf_datalen(b),
+	   HDR_LEN + len);
+    errors++;
+  } else {
+    for(i = 0; i < HDR_LEN + len; i++) {
+      if(p[i] != byte(id, i)) {
+	printf("packet %u: bad byte %d\n", id, i);
+	errors++;
+	break;
+      }
+    }
+  }
+  addr = queuebuf_addr(b, PACKETBUF_ADDR_RECEIVER);
+  queuebuf_to_packetbuf(b);
+  if(packetbuf_attr(PACKETBUF_ATTR_PACKET_ID) != id ||
+     addr == NULL || addr->u8[0] != (id >> 8) || addr->u8[1] != (id & 0xff)) {
+    printf("packet %u: bad attributes\n", id);
+    errors++;
+  }
+
+  packetqueue_dequeue(queues[n]);
+  m->head = (m->head + 1) % QUEUE_LEN;
+  m->count--;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  unsigned long packets, drops, spilled;
+  uint16_t id, len;
+  int round, burst, n, i, progress;
+
+  xmem_file_remove();
+  process_init();
+  process_start(&etimer_process, NULL);
+  ctimer_init();
+  queuebuf_init();
+  packetbuf_clear();
+  packetqueue_init(&q0);
+  packetqueue_init(&q1);
+  run_timers(0);
+
+  id = 0;
+  packets = drops = 0;
+  for(round = 0; round < ROUNDS; round++) {
+    /* A burst into one of the queues. */
+    n = rand() & 1;
+    burst = rand() % MAX_BURST;
+    for(i = 0; i < burst && models[n].count < QUEUE_LEN; i++) {
+      len = rand() % 4 == 0 ? MAX_LEN : rand() % MAX_LEN;
+      make_packet(++id, len);
+      packets++;
+      if(packetqueue_enqueue_packetbuf(queues[n], 0, NULL)) {
+	models[n].id[(models[n].head + models[n].count) % QUEUE_LEN] = id;
+	models[n].len[(models[n].head + models[n].count) % QUEUE_LEN] = len;
+	models[n].count++;
+      } else {
+	drops++;
+      }
+    }
+
+    /* Most of the time, the timers run before the queues drain. */
+    if(rand() % 4 != 0) {
+      run_timers(1);
+    }
+
+    /* Drain part of both queues. */
+    for(n = 0; n < 2; n++) {
+      burst = rand() % MAX_BURST;
+      for(i = 0; i < burst && models[n].count > 0; i++) {
+	if(!check_head(n)) {
+	  break;
+	}
+      }
+    }
+  }
+  do {
+    progress = 0;
+    for(n = 0; n < 2; n++) {
+      while(models[n].count > 0 && check_head(n)) {
+	progress = 1;
+      }
+    }
+  } while(progress);
+  for(n = 0; n < 2; n++) {
+    if(models[n].count > 0 || packetqueue_first(queues[n]) != NULL) {
+      printf("queue %d is not empty\n", n);
+      errors++;
+    }
+  }
+
+  if(drops != rimestats.xmemdrop) {
+    printf("%lu packets refused, but xmemdrop is %lu\n", drops,
+	   rimestats.xmemdrop);
+    errors++;
+  }
+  if(rimestats.xmemrefill != rimestats.xmemspill) {
+    printf("%lu packets spilled, but %lu refilled\n", rimestats.xmemspill,
+	   rimestats.xmemrefill);
+    errors++;
+  }
+  if(xmem_file_stats.page_crossings != 0 || xmem_file_stats.errors != 0) {
+    printf("%lu flash writes crossed a page, %lu bad accesses\n",
+	   xmem_file_stats.page_crossings, xmem_file_stats.errors);
+    errors++;
+  }
+
+  /* The writes are batched per page, so that a write is nearly a
+     full page unless it is the last one of a sector. */
+  spilled = rimestats.xmemspill;
+  printf("%d queuebufs, %ld sectors: %lu packets, %lu spilled, %lu dropped, "
+	 "%lu page writes of %.0f bytes, %lu erases, %d errors\n",
+	 QUEUEBUF_NUM, PACKETQUEUE_CONF_XMEM_SIZE / XMEM_ERASE_UNIT_SIZE,
+	 packets, spilled, drops, xmem_file_stats.writes,
+	 xmem_file_stats.writes ?
+	 (double)xmem_file_stats.write_bytes / xmem_file_stats.writes : 0.0,
+	 xmem_file_stats.erases, errors);
+  xmem_file_remove();
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         External flash in a file, for host builds
+ *
+ *         The flash image is kept in the file XMEM_FILE, which is
+ *         created erased when it does not exist, so that its contents
+ *         survive from one run to the next as on a node. The driver
+ *         behaves like the M25P80 driver of the Sky: erased flash
+ *         reads as zeros, a write can only set bits, and a write is
+ *         programmed one 256-byte page at a time. The accesses are
+ *         counted so that the tests can report them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contiki-conf.h"
+#include "dev/xmem.h"
+#include "xmem-file.h"
+
+#define PAGE_SIZE 256
+
+struct xmem_file_stats xmem_file_stats;
+
+static FILE *f;
+/*---------------------------------------------------------------------------*/
+void
+xmem_init(void)
+{
+  static unsigned char erased[XMEM_ERASE_UNIT_SIZE];
+  long i;
+
+  if(f != NULL) {
+    return;
+  }
+  f = fopen(XMEM_FILE, "r+b");
+  if(f == NULL) {
+    f = fopen(XMEM_FILE, "w+b");
+    if(f == NULL) {
+      perror(XMEM_FILE);
+      exit(1);
+    }
+    for(i = 0; i < XMEM_FILE_SIZE; i += sizeof(erased)) {
+      fwrite(erased, 1, sizeof(erased), f);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+xmem_file_remove(void)
+{
+  if(f != NULL) {
+    fclose(f);
+    f = NULL;
+  }
+  remove(XMEM_FILE);
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_pread(void *buf, int nbytes, unsigned long offset)
+{
+  xmem_init();
+  if(offset + nbytes > XMEM_FILE_SIZE) {
+    xmem_file_stats.errors++;
+    return -1;
+  }
+  fseek(f, offset, SEEK_SET);
+  if(fread(buf, 1, nbytes, f) != (size_t)nbytes) {
+    xmem_file_stats.errors++;
+    return -1;
+  }
+  xmem_file_stats.reads++;
+  xmem_file_stats.read_bytes += nbytes;
+  return nbytes;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_pwrite(const void *buf, int nbytes, unsigned long offset)
+{
+  const unsigned char *p = buf;
+  unsigned char old[PAGE_SIZE];
+  unsigned long next_page;
+  int n, i;
+
+  xmem_init();
+  if(offset + nbytes > XMEM_FILE_SIZE) {
+    xmem_file_stats.errors++;
+    return -1;
+  }
+  if(nbytes > 0 && offset / PAGE_SIZE != (offset + nbytes - 1) / PAGE_SIZE) {
+    xmem_file_stats.page_crossings++;
+  }
+
+  while(nbytes > 0) {
+    next_page = (offset | (PAGE_SIZE - 1)) + 1;
+    n = next_page - offset < (unsigned long)nbytes ? next_page - offset : nbytes;
+    fseek(f, offset, SEEK_SET);
+    if(fread(old, 1, n, f) != (size_t)n) {
+      xmem_file_stats.errors++;
+      return -1;
+    }
+    /* Programming cannot clear a bit. */
+    for(i = 0; i < n; i++) {
+      old[i] |= p[i];
+    }
+    fseek(f, offset, SEEK_SET);
+    fwrite(old, 1, n, f);
+    xmem_file_stats.writes++;
+    xmem_file_stats.write_bytes += n;
+    offset += n;
+    p += n;
+    nbytes -= n;
+  }
+  return p - (const unsigned char *)buf;
+}
+/*---------------------------------------------------------------------------*/
+int
+xmem_erase(long nbytes, unsigned long offset)
+{
+  static unsigned char erased[XMEM_ERASE_UNIT_SIZE];
+  long n;
+
+  xmem_init();
+  if(nbytes % XMEM_ERASE_UNIT_SIZE != 0 ||
+     offset % XMEM_ERASE_UNIT_SIZE != 0 ||
+     offset + nbytes > XMEM_FILE_SIZE) {
+    xmem_file_stats.errors++;
+    return -1;
+  }
+  fseek(f, offset, SEEK_SET);
+  for(n = 0; n < nbytes; n += XMEM_ERASE_UNIT_SIZE) {
+    fwrite(erased, 1, XMEM_ERASE_UNIT_SIZE, f);
+    xmem_file_stats.erases++;
+  }
+  return nbytes;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Host test of AES-128 and CCM* against published vectors
+ *
+ *         The AES_128 driver of the build must give the ciphertexts
+ *         of FIPS-197, Appendices B and C.1, and ccm-star.c on top of
+ *         it the packets of RFC 3610, whose CCM with a 13-byte nonce
+ *         and a 2-byte length field is the CCM* of 802.15.4 with a
+ *         MIC. Build it with the software AES and with the
+ *         stand-alone AES of the CC2420 model, see the Makefile.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lib/aes-128.h"
+#include "net/mac/ccm-star.h"
+
+struct aes_vector {
+  uint8_t key[16], plaintext[16], ciphertext[16];
+};
+
+static const struct aes_vector aes_vectors[] = {
+  /* FIPS-197, Appendix B */
+  {{0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c},
+   {0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d,
+    0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34},
+   {0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb,
+    0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32}},
+  /* FIPS-197, Appendix C.1 */
+  {{0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f},
+   {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+   {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a}},
+};
+
+/* The packets of RFC 3610 with the key C0 C1 ... CF. The input is
+   the bytes 00 01 02 ..., of which the first 8 are authenticated but
+   not encrypted, and the output is the encrypted packet followed by
+   its MIC. */
+struct ccm_vector {
+  int packet;
+  uint8_t nonce[13];
+  uint8_t len, mic_len;
+  uint8_t output[43];
+};
+
+static const struct ccm_vector ccm_vectors[] = {
+  {1, {0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00,
+       0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5}, 31, 8,
+   {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x58, 0x8c, 0x97, 0x9a, 0x61, 0xc6, 0x63, 0xd2,
+    0xf0, 0x66, 0xd0, 0xc2, 0xc0, 0xf9, 0x89, 0x80,
+    0x6d, 0x5f, 0x6b, 0x61, 0xda, 0xc3, 0x84, 0x17,
+    0xe8, 0xd1, 0x2c, 0xfd, 0xf9, 0x26, 0xe0}},
+  {2, {0x00, 0x00, 0x00, 0x04, 0x03, 0x02, 0x01,
+       0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5}, 32, 8,
+   {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x72, 0xc9, 0x1a, 0x36, 0xe1, 0x35, 0xf8, 0xcf,
+    0x29, 0x1c, 0xa8, 0x94, 0x08, 0x5c, 0x87, 0xe3,
+    0xcc, 0x15, 0xc4, 0x39, 0xc9, 0xe4, 0x3a, 0x3b,
+    0xa0, 0x91, 0xd5, 0x6e, 0x10, 0x40, 0x09, 0x16}},
+  {3, {0x00, 0x00, 0x00, 0x05, 0x04, 0x03, 0x02,
+       0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5}, 33, 8,
+   {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x51, 0xb1, 0xe5, 0xf4, 0x4a, 0x19, 0x7d, 0x1d,
+    0xa4, 0x6b, 0x0f, 0x8e, 0x2d, 0x28, 0x2a, 0xe8,
+    0x71, 0xe8, 0x38, 0xbb, 0x64, 0xda, 0x85, 0x96,
+    0x57, 0x4a, 0xda, 0xa7, 0x6f, 0xbd, 0x9f, 0xb0,
+    0xc5}},
+  {7, {0x00, 0x00, 0x00, 0x09, 0x08, 0x07, 0x06,
+       0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5}, 31, 10,
+   {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x01, 0x35, 0xd1, 0xb2, 0xc9, 0x5f, 0x41, 0xd5,
+    0xd1, 0xd4, 0xfe, 0xc1, 0x85, 0xd1, 0x66, 0xb8,
+    0x09, 0x4e, 0x99, 0x9d, 0xfe, 0xd9, 0x6c, 0x04,
+    0x8c, 0x56, 0x60, 0x2c, 0x97, 0xac, 0xbb, 0x74,
+    0x90}},
+};
+
+#define A_LEN 8
+
+#define STRINGIFY(x) #x
+#define NAME(x) STRINGIFY(x)
+
+static int errors;
+/*---------------------------------------------------------------------------*/
+static void
+check_aes(const struct aes_vector *v)
+{
+  uint8_t block[16];
+
+  memcpy(block, v->plaintext, sizeof(block));
+  AES_128.set_key(v->key);
+  AES_128.encrypt(block);
+  if(memcmp(block, v->ciphertext, sizeof(block)) != 0) {
+    printf("AES-128: wrong ciphertext\n");
+    errors++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_ccm(const struct ccm_vector *v)
+{
+  uint8_t key[16], p[43], mic[16];
+  int i;
+
+  for(i = 0; i < sizeof(key); i++) {
+    key[i] = 0xc0 + i;
+  }
+  for(i = 0; i < v->len; i++) {
+    p[i] = i;
+  }
+  ccm_star_set_key(key);
+
+  /* The MIC is of the packet before it is encrypted. */
+  ccm_star_mic(v->nonce, p, A_LEN, p + A_LEN, v->len - A_LEN, mic,
+               v->mic_len);
+  ccm_star_ctr(v->nonce, p + A_LEN, v->len - A_LEN);
+  if(memcmp(p, v->output, v->len) != 0 ||
+     memcmp(mic, v->output + v->len, v->mic_len) != 0) {
+    printf("RFC 3610 packet %d: wrong output\n", v->packet);
+    errors++;
+  }
+
+  /* Decrypting is encrypting again. */
+  ccm_star_ctr(v->nonce, p + A_LEN, v->len - A_LEN);
+  for(i = 0; i < v->len; i++) {
+    if(p[i] != i) {
+      printf("RFC 3610 packet %d: wrong decryption\n", v->packet);
+      errors++;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  int i;
+
+  for(i = 0; i < sizeof(aes_vectors) / sizeof(aes_vectors[0]); i++) {
+    check_aes(&aes_vectors[i]);
+  }
+  for(i = 0; i < sizeof(ccm_vectors) / sizeof(ccm_vectors[0]); i++) {
+    check_ccm(&ccm_vectors[i]);
+  }
+  printf("%s: %d AES-128 and %d CCM* vectors, %d errors\n", NAME(AES_128),
+         (int)(sizeof(aes_vectors) / sizeof(aes_vectors[0])),
+         (int)(sizeof(ccm_vectors) / sizeof(ccm_vectors[0])), errors);
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         A model of the CC2420, for host tests of its driver
+ *
+ *         See cc2420-sim.h. Only what the driver uses is modelled:
+ *         there is no address recognition, no automatic ACK and no
+ *         RXFIFO overflow.
+ */
+
+#include <string.h>
+
+/* The CCM of the chip is that of ccm-star.c, on a software AES of
+   its own, so that the chip does not share the key of the AES_128
+   driver of the test. */
+#undef AES_128_CONF
+#define AES_128_CONF     cc2420_sim_aes_128_driver
+#define aes_128_driver   cc2420_sim_aes_128_driver
+#define ccm_star_set_key cc2420_sim_ccm_set_key
+#define ccm_star_mic     cc2420_sim_ccm_mic
+#define ccm_star_ctr     cc2420_sim_ccm_ctr
+#include "lib/aes-128.c"
+#include "net/mac/ccm-star.c"
+
+#include "sys/rtimer.h"
+#include "dev/cc2420_const.h"
+#include "cc2420-sim.h"
+
+#define SPI_BYTE_TIME 1
+#define BYTE_TIME     32
+#define TURNAROUND    192
+
+struct cc2420_sim_stats cc2420_sim_stats;
+unsigned long cc2420_sim_now;
+
+volatile uint8_t SPI_TXBUF, SPI_RXBUF;
+
+static uint8_t ram[0x16c];
+static uint16_t regs[64];
+
+static enum { IDLE, RX, TX } state;
+static uint8_t rx_after_tx;
+static unsigned long tx_start, tx_end;
+static uint8_t sent[128];
+static int sent_len;
+
+/* The RXFIFO is a ring in the RAM. The lengths of the frames in it
+   tell when all of the first frame has been read. */
+static uint8_t rx_first, rx_count;
+static uint8_t frame_lens[16];
+static uint8_t frames, read_of_first;
+static uint8_t tx_len;
+
+/* The SPI transaction that is going on. */
+static enum { STROBE, REG_READ, REG_WRITE, TXFIFO, RXFIFO, RAM } mode;
+static int pos, reg, ram_read;
+static unsigned addr;
+/*---------------------------------------------------------------------------*/
+rtimer_clock_t
+rtimer_arch_now(void)
+{
+  cc2420_sim_now++;
+  return cc2420_sim_now * RTIMER_ARCH_SECOND / 1000000;
+}
+/*---------------------------------------------------------------------------*/
+void
+clock_delay(unsigned int i)
+{
+  cc2420_sim_now += i;
+}
+/*---------------------------------------------------------------------------*/
+void
+cc2420_arch_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+/* Moves a key or a block between the RAM of the chip, where the most
+   significant byte is at the highest address, and a buffer. */
+static void
+reverse(uint8_t *to, const uint8_t *from, int len)
+{
+  int i;
+
+  for(i = 0; i < len; i++) {
+    to[i] = from[len - 1 - i];
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+select_key(int key1)
+{
+  uint8_t key[16];
+
+  reverse(key, ram + (key1 ? CC2420RAM_KEY1 : CC2420RAM_KEY0), 16);
+  cc2420_sim_ccm_set_key(key);
+}
+/*---------------------------------------------------------------------------*/
+/* The nonce is in the first counter block, after its flags. */
+static void
+get_nonce(uint8_t *nonce, unsigned nonce_addr)
+{
+  uint8_t block[16];
+
+  reverse(block, ram + nonce_addr, 16);
+  memcpy(nonce, block + 1, CCM_STAR_NONCE_LENGTH);
+}
+/*---------------------------------------------------------------------------*/
+static int
+mic_len(void)
+{
+  int m;
+
+  m = (regs[CC2420_SECCTRL0] >> CC2420_SECCTRL0_SEC_M_IDX) & 7;
+  return m ? 2 * m + 2 : 0;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+ccm_blocks(int a_len, int m_len, int mic)
+{
+  return (a_len > 0 ? (a_len + 2 + 15) / 16 : 0) + 2 * ((m_len + 15) / 16) +
+    (mic > 0 ? 2 : 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rx_push(uint8_t b)
+{
+  ram[CC2420RAM_RXFIFO + ((rx_first + rx_count) & 0x7f)] = b;
+  rx_count++;
+}
+/*---------------------------------------------------------------------------*/
+/* The first frame in the RXFIFO, without its length byte, as a
+   buffer. */
+static void
+rx_frame(uint8_t *buf, int len, int to_fifo)
+{
+  int i;
+  uint8_t *b;
+
+  for(i = 0; i < len; i++) {
+    b = &ram[CC2420RAM_RXFIFO + ((rx_first + 1 + i) & 0x7f)];
+    if(to_fifo) {
+      *b = buf[i];
+    } else {
+      buf[i] = *b;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+stxenc(void)
+{
+  uint8_t nonce[CCM_STAR_NONCE_LENGTH];
+  uint8_t *f;
+  int len, a_len, mic, m_len;
+
+  if((regs[CC2420_SECCTRL0] & 3) != CC2420_SECCTRL0_CCM) {
+    return;
+  }
+  f = ram + CC2420RAM_TXFIFO + 1;
+  len = ram[CC2420RAM_TXFIFO] - 2;
+  a_len = (regs[CC2420_SECCTRL1] >> 8) & 0x7f;
+  mic = mic_len();
+  m_len = len - a_len - mic;
+  select_key(regs[CC2420_SECCTRL0] & CC2420_SECCTRL0_TXKEYSEL1);
+  get_nonce(nonce, CC2420RAM_TXNONCE);
+  cc2420_sim_ccm_mic(nonce, f, a_len, f + a_len, m_len, f + a_len + m_len,
+                     mic);
+  cc2420_sim_ccm_ctr(nonce, f + a_len, m_len);
+  cc2420_sim_stats.ccm_blocks += ccm_blocks(a_len, m_len, mic);
+}
+/*---------------------------------------------------------------------------*/
+/* Decrypts the first frame in the RXFIFO, and replaces the last byte
+   of its MIC with zero if the MIC is right. */
+static void
+srxdec(void)
+{
+  uint8_t nonce[CCM_STAR_NONCE_LENGTH];
+  uint8_t buf[128], mic[16];
+  int len, a_len, m, m_len;
+
+  if((regs[CC2420_SECCTRL0] & 3) != CC2420_SECCTRL0_CCM || frames == 0) {
+    return;
+  }
+  len = ram[CC2420RAM_RXFIFO + rx_first] - 2;
+  a_len = regs[CC2420_SECCTRL1] & 0x7f;
+  m = mic_len();
+  m_len = len - a_len - m;
+  rx_frame(buf, len, 0);
+  select_key(regs[CC2420_SECCTRL0] & CC2420_SECCTRL0_RXKEYSEL1);
+  get_nonce(nonce, CC2420RAM_RXNONCE);
+  cc2420_sim_ccm_ctr(nonce, buf + a_len, m_len);
+  cc2420_sim_ccm_mic(nonce, buf, a_len, buf + a_len, m_len, mic, m);
+  buf[len - 1] = memcmp(mic, buf + a_len + m_len, m) == 0 ? 0 : 0xff;
+  rx_frame(buf, len, 1);
+  cc2420_sim_stats.ccm_blocks += ccm_blocks(a_len, m_len, m);
+}
+/*---------------------------------------------------------------------------*/
+static void
+saes(void)
+{
+  uint8_t block[16];
+
+  select_key(regs[CC2420_SECCTRL0] & CC2420_SECCTRL0_SAKEYSEL1);
+  reverse(block, ram + CC2420RAM_SABUF, 16);
+  cc2420_sim_aes_128_driver.encrypt(block);
+  reverse(ram + CC2420RAM_SABUF, block, 16);
+  cc2420_sim_stats.saes_blocks++;
+}
+/*---------------------------------------------------------------------------*/
+/* Ends the transmission that is due. */
+static void
+tick(void)
+{
+  if(state == TX && cc2420_sim_now >= tx_end) {
+    sent_len = (ram[CC2420RAM_TXFIFO] & 0x7f) - 2;
+    memcpy(sent, ram + CC2420RAM_TXFIFO + 1, sent_len);
+    state = rx_after_tx ? RX : IDLE;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+strobe(int s)
+{
+  switch(s) {
+  case CC2420_SRXON:
+    state = RX;
+    break;
+  case CC2420_SRFOFF:
+    state = IDLE;
+    break;
+  case CC2420_SFLUSHTX:
+    tx_len = 0;
+    break;
+  case CC2420_SFLUSHRX:
+    rx_first = rx_count = frames = read_of_first = 0;
+    break;
+  case CC2420_STXENC:
+    stxenc();
+    break;
+  case CC2420_SRXDEC:
+    srxdec();
+    break;
+  case CC2420_SAES:
+    saes();
+    break;
+  case CC2420_STXON:
+    cc2420_sim_stats.tx_on_time = cc2420_sim_now;
+    cc2420_sim_stats.tx_on_spi_bytes = cc2420_sim_stats.spi_bytes;
+    rx_after_tx = state == RX;
+    state = TX;
+    tx_start = cc2420_sim_now + TURNAROUND;
+    tx_end = tx_start + (ram[CC2420RAM_TXFIFO] + 5) * BYTE_TIME;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+cc2420_sim_select(int on)
+{
+  pos = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+cc2420_sim_spi(void)
+{
+  uint8_t b;
+
+  b = SPI_TXBUF;
+  cc2420_sim_now += SPI_BYTE_TIME;
+  cc2420_sim_stats.spi_bytes++;
+  tick();
+
+  if(pos == 0) {
+    /* The status byte comes back while the address goes out. */
+    SPI_RXBUF = BV(CC2420_XOSC16M_STABLE) | BV(CC2420_LOCK) |
+      (state == TX ? BV(CC2420_TX_ACTIVE) : 0) |
+      (state == RX ? BV(CC2420_RSSI_VALID) : 0);
+    if(b & 0x80) {
+      mode = RAM;
+      addr = b & 0x7f;
+    } else if((b & 0x3f) <= CC2420_SAES) {
+      mode = STROBE;
+      strobe(b & 0x3f);
+    } else if((b & 0x3f) == CC2420_TXFIFO) {
+      mode = TXFIFO;
+    } else if((b & 0x3f) == CC2420_RXFIFO) {
+      mode = RXFIFO;
+    } else {
+      reg = b & 0x3f;
+      mode = (b & 0x40) ? REG_READ : REG_WRITE;
+    }
+  } else if(mode == RAM && pos == 1) {
+    addr |= (b & 0xc0) << 1;
+    ram_read = b & 0x20;
+  } else if(mode == RAM) {
+    if(ram_read) {
+      SPI_RXBUF = ram[addr];
+    } else {
+      ram[addr] = b;
+    }
+    addr++;
+  } else if(mode == REG_READ) {
+    SPI_RXBUF = pos == 1 ? regs[reg] >> 8 : regs[reg] & 0xff;
+  } else if(mode == REG_WRITE) {
+    if(pos == 1) {
+      regs[reg] = (regs[reg] & 0xff) | (b << 8);
+    } else {
+      regs[reg] = (regs[reg] & 0xff00) | b;
+    }
+  } else if(mode == TXFIFO) {
+    ram[CC2420RAM_TXFIFO + (tx_len++ & 0x7f)] = b;
+  } else if(mode == RXFIFO) {
+    SPI_RXBUF = 0;
+    if(rx_count > 0) {
+      SPI_RXBUF = ram[CC2420RAM_RXFIFO + rx_first];
+      rx_first = (rx_first + 1) & 0x7f;
+      rx_count--;
+      if(frames > 0 && ++read_of_first == frame_lens[0]) {
+        memmove(frame_lens, frame_lens + 1, --frames);
+        read_of_first = 0;
+      }
+    }
+  }
+  pos++;
+}
+/*---------------------------------------------------------------------------*/
+int
+cc2420_sim_fifo(void)
+{
+  cc2420_sim_now++;
+  tick();
+  return rx_count > 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+cc2420_sim_fifop(void)
+{
+  cc2420_sim_now++;
+  tick();
+  return frames > 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+cc2420_sim_sfd(void)
+{
+  cc2420_sim_now++;
+  tick();
+  return state == TX && cc2420_sim_now >= tx_start;
+}
+/*---------------------------------------------------------------------------*/
+void
+cc2420_sim_receive(const uint8_t *frame, int len)
+{
+  int i;
+
+  if(state != RX || rx_count + len + 3 > 128 || frames == sizeof(frame_lens)) {
+    return;
+  }
+  rx_push(len + 2);
+  for(i = 0; i < len; i++) {
+    rx_push(frame[i]);
+  }
+  rx_push(0xd0);                        /* RSSI */
+  rx_push(0x80 | 100);                  /* CRC OK and correlation */
+  frame_lens[frames++] = len + 3;
+}
+/*---------------------------------------------------------------------------*/
+int
+cc2420_sim_sent(uint8_t *frame)
+{
+  int len;
+
+  tick();
+  len = sent_len;
+  memcpy(frame, sent, len);
+  sent_len = 0;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
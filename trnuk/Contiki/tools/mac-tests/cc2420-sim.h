@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         A model of the CC2420, for host tests of its driver
+ *
+ *         The model sits behind the SPI macros of contiki-conf.h, so
+ *         that cc2420.c and cc2420-aes.c run unchanged on it. It has
+ *         the registers, the RAM and the FIFOs of the chip, the
+ *         stand-alone AES (SAES) and the in-line CCM (STXENC and
+ *         SRXDEC) of the data sheet, with keys and nonces stored most
+ *         significant byte at the highest address. Frames that are
+ *         sent end up in a buffer of the test, and the test puts the
+ *         frames that are received into the RXFIFO.
+ *
+ *         Time is counted in microseconds, with a microsecond for
+ *         each SPI byte and 32 for each byte on the air. The work of
+ *         the chip is counted in SPI bytes and AES blocks.
+ */
+
+#ifndef __CC2420_SIM_H__
+#define __CC2420_SIM_H__
+
+#include "contiki-conf.h"
+
+struct cc2420_sim_stats {
+  unsigned long spi_bytes;
+  unsigned long saes_blocks;    /* Blocks of the stand-alone AES. */
+  unsigned long ccm_blocks;     /* Blocks of the in-line CCM. */
+  unsigned long tx_on_time;     /* The time of the last STXON, */
+  unsigned long tx_on_spi_bytes; /* and the SPI bytes until then. */
+};
+
+extern struct cc2420_sim_stats cc2420_sim_stats;
+
+/* The time of the model, in microseconds. */
+extern unsigned long cc2420_sim_now;
+
+/**
+ * \brief      Receive a frame
+ * \param frame The frame, without its FCS
+ * \param len  The length of the frame
+ *
+ *             The frame goes into the RXFIFO with a good CRC if the
+ *             receiver is on. The test then calls cc2420_interrupt().
+ */
+void cc2420_sim_receive(const uint8_t *frame, int len);
+
+/**
+ * \brief      Get the last frame that was sent
+ * \param frame A buffer of 127 bytes for the frame, without its FCS
+ * \return     The length of the frame, or 0 if none has been sent
+ *             since the last call
+ */
+int cc2420_sim_sent(uint8_t *frame);
+
+/* The CCM of the model, for tests that secure frames as a peer
+   would. See ccm-star.h. */
+void cc2420_sim_ccm_set_key(const uint8_t *key);
+void cc2420_sim_ccm_mic(const uint8_t *nonce,
+                        const uint8_t *a, uint8_t a_len,
+                        const uint8_t *m, uint8_t m_len,
+                        uint8_t *result, uint8_t mic_len);
+void cc2420_sim_ccm_ctr(const uint8_t *nonce, uint8_t *m, uint8_t m_len);
+
+#endif /* __CC2420_SIM_H__ */
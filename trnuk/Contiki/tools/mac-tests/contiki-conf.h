@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Configuration of the MAC host tests
+ *
+ *         The tests are built with the compiler of the development
+ *         host. The SPI and the pins of the CC2420 go to the model in
+ *         cc2420-sim.c, so that the CC2420 driver runs as on the Sky.
+ */
+
+#ifndef __CONTIKI_CONF_H__
+#define __CONTIKI_CONF_H__
+
+#include <stdint.h>
+
+typedef uint8_t   u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef int8_t    s8_t;
+typedef int16_t  s16_t;
+typedef int32_t  s32_t;
+
+typedef unsigned short uip_stats_t;
+typedef unsigned long clock_time_t;
+
+#define CLOCK_CONF_SECOND 128
+
+#define CCIF
+#define CLIF
+
+#define CC_CONF_INLINE inline
+
+#define RIMEADDR_CONF_SIZE 8
+
+#define BV(x) (1 << (x))
+
+#define splhigh() 0
+#define splx(s) (void)(s)
+
+/* The CC2420 driver counts the time of a transmission in loops of
+   the MSP430 of the Sky. */
+#define TMOTE_SKY 1
+
+extern volatile uint8_t SPI_TXBUF, SPI_RXBUF;
+
+#define SPI_WAITFOREOTx() cc2420_sim_spi()
+#define SPI_WAITFOREORx() cc2420_sim_spi()
+#define SPI_ENABLE()      cc2420_sim_select(1)
+#define SPI_DISABLE()     cc2420_sim_select(0)
+
+#define FIFO_IS_1  cc2420_sim_fifo()
+#define FIFOP_IS_1 cc2420_sim_fifop()
+#define SFD_IS_1   cc2420_sim_sfd()
+
+#define SET_RESET_INACTIVE()
+#define SET_RESET_ACTIVE()
+#define SET_VREG_ACTIVE()
+#define SET_VREG_INACTIVE()
+#define FIFOP_INT_INIT()
+#define ENABLE_FIFOP_INT()
+#define DISABLE_FIFOP_INT()
+#define CLEAR_FIFOP_INT()
+
+void cc2420_sim_spi(void);
+void cc2420_sim_select(int on);
+int cc2420_sim_fifo(void);
+int cc2420_sim_fifop(void);
+int cc2420_sim_sfd(void);
+
+#endif /* __CONTIKI_CONF_H__ */
@@ -0,0 +1,5 @@
+/**
+ * \file
+ *         Stands in for the <io.h> of the MSP430 compiler, which the
+ *         CC2420 driver includes, in the MAC host tests
+ */
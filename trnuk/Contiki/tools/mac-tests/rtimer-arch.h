@@ -0,0 +1,16 @@
+/**
+ * \file
+ *         rtimer definitions for the MAC host tests, in which the
+ *         time is that of the CC2420 model
+ */
+
+#ifndef __RTIMER_ARCH_H__
+#define __RTIMER_ARCH_H__
+
+#include "sys/rtimer.h"
+
+#define RTIMER_ARCH_SECOND 4096
+
+rtimer_clock_t rtimer_arch_now(void);
+
+#endif /* __RTIMER_ARCH_H__ */
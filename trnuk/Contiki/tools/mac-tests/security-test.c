@@ -0,0 +1,581 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Host test and benchmark of the link-layer security of
+ *         sicslowmac
+ *
+ *         sicslowmac runs on the CC2420 driver and the CC2420 model
+ *         of cc2420-sim.c, with a peer that secures its frames with
+ *         the CCM of the model. The frames that the node sends must
+ *         be secured with the right key, and the frames of the peer
+ *         must be received, except those that are tampered with,
+ *         replayed, not secured, or secured with the wrong key. A
+ *         key that is changed must make the node forget the frame
+ *         counters received under the old one. The frame counter of
+ *         the node must never go back, also when it reboots, and no
+ *         frame may be sent with a counter that the counter file has
+ *         not reserved.
+ *
+ *         Then the cost of sending and receiving a frame is counted:
+ *         the SPI bytes, the AES blocks of the MCU and of the CC2420,
+ *         and the time of the model, which does not include the time
+ *         of the AES blocks of the MCU. Build it with the software
+ *         AES, the stand-alone AES of the CC2420, and the in-line
+ *         security of the CC2420, see the Makefile.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "dev/cc2420.h"
+#include "dev/cc2420-aes.h"
+#include "lib/aes-128.h"
+#include "net/mac/ccm-star.h"
+#include "net/mac/frame802154.h"
+#include "net/mac/sicslowmac.h"
+#include "net/rime/ctimer.h"
+#include "net/rime/packetbuf.h"
+#include "cc2420-sim.h"
+
+#define LEVEL   SICSLOWMAC_CONF_SECURITY_LEVEL
+#define MIC_LEN ((LEVEL & 3) == 0 ? 0 : 2 << (LEVEL & 3))
+#define ENCRYPT (LEVEL & 4)
+
+#define PAN_ID     0xabcd
+#define PAYLOAD    30
+#define ROUNDS     20000
+
+#define STRINGIFY(x) #x
+#define NAME(x) STRINGIFY(x)
+
+static const rimeaddr_t node = {{1, 2, 3, 4, 5, 6, 7, 8}};
+static const rimeaddr_t peer = {{1, 2, 3, 4, 5, 6, 7, 9}};
+
+static const uint8_t network_key[16] = "network key 0123";
+static const uint8_t network_key2[16] = "network key 4567";
+static const uint8_t pairwise_key[16] = "pairwise key 012";
+static const uint8_t pairwise_key2[16] = "pairwise key 345";
+static const uint8_t payload[80] =
+  "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+  "0123456789abcdefgh";
+
+static uint8_t received[128];
+static int received_len;
+static rimeaddr_t received_from;
+
+/* The AES_128 driver, counted. */
+static unsigned long aes_blocks;
+
+static int errors;
+
+#define ERROR(...) do { if(errors++ < 20) printf(__VA_ARGS__); } while(0)
+/*---------------------------------------------------------------------------*/
+static void
+counted_set_key(const uint8_t *key)
+{
+  TEST_AES_128.set_key(key);
+}
+/*---------------------------------------------------------------------------*/
+static void
+counted_encrypt(uint8_t *block)
+{
+  aes_blocks++;
+  TEST_AES_128.encrypt(block);
+}
+/*---------------------------------------------------------------------------*/
+const struct aes_128_driver test_aes_128_driver = {
+  counted_set_key,
+  counted_encrypt
+};
+/*---------------------------------------------------------------------------*/
+/* The counter file, in RAM. Writes fail while cfs_full is set. */
+static uint8_t cfs_file[4];
+static int cfs_len, cfs_full;
+static unsigned long cfs_writes;
+/*---------------------------------------------------------------------------*/
+int
+cfs_open(const char *name, int flags)
+{
+  if((flags & CFS_WRITE) && cfs_full) {
+    return -1;
+  }
+  if(flags & CFS_WRITE) {
+    cfs_len = 0;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+cfs_close(int fd)
+{
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_read(int fd, void *buf, unsigned int len)
+{
+  len = len < cfs_len ? len : cfs_len;
+  memcpy(buf, cfs_file, len);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_write(int fd, const void *buf, unsigned int len)
+{
+  len = len < sizeof(cfs_file) ? len : sizeof(cfs_file);
+  memcpy(cfs_file, buf, len);
+  cfs_len = len;
+  cfs_writes++;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+reserved_limit(void)
+{
+  return cfs_file[0] | ((uint32_t)cfs_file[1] << 8) |
+    ((uint32_t)cfs_file[2] << 16) | ((uint32_t)cfs_file[3] << 24);
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_set(struct ctimer *c, clock_time_t t, void (*f)(void *), void *ptr)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_stop(struct ctimer *c)
+{
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+clock_time(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+clock_seconds(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+unsigned short
+random_rand(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(const struct mac_driver *mac)
+{
+  int len;
+
+  len = mac->read();
+  if(len > 0) {
+    memcpy(received, packetbuf_dataptr(), len);
+    received_len = len;
+    rimeaddr_copy(&received_from, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_nonce(uint8_t *nonce, const rimeaddr_t *sender, uint32_t counter)
+{
+  memcpy(nonce, sender, 8);
+  nonce[8] = counter >> 24;
+  nonce[9] = counter >> 16;
+  nonce[10] = counter >> 8;
+  nonce[11] = counter;
+  nonce[12] = LEVEL;
+}
+/*---------------------------------------------------------------------------*/
+/* Builds a frame of the peer to the node, or a broadcast, secured as
+   the peer would secure it. */
+static int
+peer_frame(uint8_t *f, int unicast, const uint8_t *key, uint32_t counter,
+           int secured, int len)
+{
+  frame802154_t p;
+  uint8_t nonce[CCM_STAR_NONCE_LENGTH];
+  int hdr_len;
+
+  memset(&p, 0, sizeof(p));
+  p.fcf.frame_type = FRAME802154_DATAFRAME;
+  p.fcf.security_enabled = secured;
+  p.fcf.frame_version = secured ? FRAME802154_IEEE802154_2006 :
+    FRAME802154_IEEE802154_2003;
+  p.fcf.src_addr_mode = FRAME802154_LONGADDRMODE;
+  p.dest_pid = p.src_pid = PAN_ID;
+  p.seq = counter;
+  if(unicast) {
+    p.fcf.dest_addr_mode = FRAME802154_LONGADDRMODE;
+    rimeaddr_copy(&p.dest_addr, &node);
+  } else {
+    p.fcf.dest_addr_mode = FRAME802154_SHORTADDRMODE;
+    p.dest_addr.u8[0] = p.dest_addr.u8[1] = 0xff;
+  }
+  rimeaddr_copy(&p.src_addr, &peer);
+  p.aux_hdr.security_control.security_level = LEVEL;
+  p.aux_hdr.frame_counter = counter;
+  hdr_len = frame802154_create(&p, f, 127);
+  memcpy(f + hdr_len, payload, len);
+  if(!secured) {
+    return hdr_len + len;
+  }
+
+  set_nonce(nonce, &peer, counter);
+  cc2420_sim_ccm_set_key(key);
+  if(ENCRYPT) {
+    cc2420_sim_ccm_mic(nonce, f, hdr_len, f + hdr_len, len,
+                       f + hdr_len + len, MIC_LEN);
+    cc2420_sim_ccm_ctr(nonce, f + hdr_len, len);
+  } else {
+    cc2420_sim_ccm_mic(nonce, f, hdr_len + len, NULL, 0,
+                       f + hdr_len + len, MIC_LEN);
+  }
+  return hdr_len + len + MIC_LEN;
+}
+/*---------------------------------------------------------------------------*/
+/* Passes a frame to the node, and returns the length of what the
+   node received, or 0. */
+static int
+receive(const uint8_t *f, int len)
+{
+  received_len = 0;
+  cc2420_sim_receive(f, len);
+  cc2420_interrupt();
+  while(process_run() > 0);
+  return received_len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send(const rimeaddr_t *to, int len)
+{
+  packetbuf_copyfrom(payload, len);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, to);
+  sicslowmac_driver.send();
+}
+/*---------------------------------------------------------------------------*/
+/* Checks a frame that the node sent as the peer would, and returns
+   its frame counter. */
+static uint32_t
+check_secured(const char *what, uint8_t *f, int f_len, const uint8_t *key,
+              int len)
+{
+  frame802154_view_t v;
+  uint8_t nonce[CCM_STAR_NONCE_LENGTH], mic[16];
+  uint32_t counter;
+  int m_len;
+
+  if(f_len == 0 || frame802154_parse_view(f, f_len, &v) == 0 ||
+     v.aux_hdr == 0 || FRAME802154_VIEW_SECURITY_LEVEL(&v) != LEVEL) {
+    ERROR("%s: not sent secured\n", what);
+    return 0;
+  }
+  counter = FRAME802154_VIEW_FRAME_COUNTER(&v);
+  m_len = v.payload_len - MIC_LEN;
+  if(m_len != len) {
+    ERROR("%s: %d bytes of payload, expected %d\n", what, m_len, len);
+    return counter;
+  }
+  set_nonce(nonce, &node, counter);
+  cc2420_sim_ccm_set_key(key);
+  if(ENCRYPT) {
+    if(memcmp(f + v.hdr_len, payload, m_len) == 0) {
+      ERROR("%s: not encrypted\n", what);
+    }
+    cc2420_sim_ccm_ctr(nonce, f + v.hdr_len, m_len);
+    cc2420_sim_ccm_mic(nonce, f, v.hdr_len, f + v.hdr_len, m_len,
+                       mic, MIC_LEN);
+  } else {
+    cc2420_sim_ccm_mic(nonce, f, v.hdr_len + m_len, NULL, 0, mic, MIC_LEN);
+  }
+  if(memcmp(f + v.hdr_len, payload, m_len) != 0 ||
+     memcmp(mic, f + v.hdr_len + m_len, MIC_LEN) != 0) {
+    ERROR("%s: not secured with the right key\n", what);
+  }
+  return counter;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+check_sent(const char *what, const uint8_t *key, int len)
+{
+  uint8_t f[128];
+
+  return check_secured(what, f, cc2420_sim_sent(f), key, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+expect(const char *what, int len, int expected)
+{
+  if(len != expected) {
+    ERROR("%s: received %d bytes, expected %d\n", what, len, expected);
+  } else if(len > 0 && (memcmp(received, payload, len) != 0 ||
+                        !rimeaddr_cmp(&received_from, &peer))) {
+    ERROR("%s: received the wrong frame\n", what);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+boot(void)
+{
+  rimeaddr_set_node_addr((rimeaddr_t *)&node);
+  cc2420_init();
+  cc2420_set_pan_addr(PAN_ID, 0, node.u8);
+  sicslowmac_init(&cc2420_driver);
+  sicslowmac_driver.set_receive_function(input);
+  while(process_run() > 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_keys(void)
+{
+  uint8_t f[128];
+  int len, i;
+
+  send(&peer, PAYLOAD);
+  if(cc2420_sim_sent(f) != 0) {
+    ERROR("sent without a key\n");
+  }
+  sicslowmac_set_key(NULL, network_key);
+  sicslowmac_set_key(&peer, pairwise_key);
+
+  send(&peer, PAYLOAD);
+  check_sent("unicast", pairwise_key, PAYLOAD);
+  send(&rimeaddr_null, PAYLOAD);
+  check_sent("broadcast", network_key, PAYLOAD);
+  send(&peer, 1);
+  check_sent("one-byte unicast", pairwise_key, 1);
+
+  len = peer_frame(f, 1, pairwise_key, 5, 1, PAYLOAD);
+  expect("unicast", receive(f, len), PAYLOAD);
+  expect("replayed unicast", receive(f, len), 0);
+  len = peer_frame(f, 1, pairwise_key, 4, 1, PAYLOAD);
+  expect("older unicast", receive(f, len), 0);
+  len = peer_frame(f, 1, pairwise_key, 6, 0, PAYLOAD);
+  expect("unsecured unicast", receive(f, len), 0);
+
+  /* Without a MIC, a frame cannot be told from one that is tampered
+     with or secured with another key. */
+  if(MIC_LEN > 0) {
+    len = peer_frame(f, 1, pairwise_key, 6, 1, PAYLOAD);
+    for(i = 0; i < len; i++) {
+      f[i] ^= 0x10;
+      expect("tampered unicast", receive(f, len), 0);
+      f[i] ^= 0x10;
+    }
+    len = peer_frame(f, 1, network_key, 6, 1, PAYLOAD);
+    expect("unicast with the network key", receive(f, len), 0);
+    len = peer_frame(f, 0, pairwise_key, 6, 1, PAYLOAD);
+    expect("broadcast with the pairwise key", receive(f, len), 0);
+  }
+  len = peer_frame(f, 1, pairwise_key, 6, 1, PAYLOAD);
+  expect("unicast after the tampered ones", receive(f, len), PAYLOAD);
+  len = peer_frame(f, 1, pairwise_key, 7, 1, 1);
+  expect("one-byte unicast", receive(f, len), 1);
+
+  /* The counters under the network key are apart from those under
+     the pairwise key. */
+  len = peer_frame(f, 0, network_key, 3, 1, PAYLOAD);
+  expect("broadcast", receive(f, len), PAYLOAD);
+  expect("replayed broadcast", receive(f, len), 0);
+
+  /* Setting the same key again keeps the counters, and a new key
+     forgets them. */
+  sicslowmac_set_key(NULL, network_key);
+  expect("broadcast replayed after the same key", receive(f, len), 0);
+  sicslowmac_set_key(NULL, network_key2);
+  if(MIC_LEN > 0) {
+    len = peer_frame(f, 0, network_key, 10, 1, PAYLOAD);
+    expect("broadcast with the old network key", receive(f, len), 0);
+  }
+  len = peer_frame(f, 0, network_key2, 1, 1, PAYLOAD);
+  expect("broadcast with the new network key", receive(f, len), PAYLOAD);
+  len = peer_frame(f, 1, pairwise_key, 7, 1, PAYLOAD);
+  expect("unicast replayed after a new network key", receive(f, len), 0);
+  sicslowmac_set_key(&peer, pairwise_key2);
+  len = peer_frame(f, 1, pairwise_key2, 1, 1, PAYLOAD);
+  expect("unicast with the new pairwise key", receive(f, len), PAYLOAD);
+
+  /* Without a pairwise key, unicasts use the network key. */
+  sicslowmac_set_key(&peer, NULL);
+  send(&peer, PAYLOAD);
+  check_sent("unicast without a pairwise key", network_key2, PAYLOAD);
+  len = peer_frame(f, 1, network_key2, 2, 1, PAYLOAD);
+  expect("unicast with the network key", receive(f, len), PAYLOAD);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_counters(void)
+{
+  uint8_t f[128];
+  uint32_t counter, last;
+  int i, f_len, sent;
+
+  /* The counters go up, and never past what the counter file has
+     reserved. */
+  send(&rimeaddr_null, PAYLOAD);
+  last = check_sent("broadcast", network_key2, PAYLOAD);
+  for(i = 0; i < 3 * SICSLOWMAC_CONF_COUNTER_BLOCK; i++) {
+    send(&rimeaddr_null, PAYLOAD);
+    counter = check_sent("broadcast", network_key2, PAYLOAD);
+    if(counter != last + 1 || counter >= reserved_limit()) {
+      ERROR("frame counter %lu after %lu, with %lu reserved\n",
+            (unsigned long)counter, (unsigned long)last,
+            (unsigned long)reserved_limit());
+    }
+    last = counter;
+  }
+
+  /* After a reboot, the node goes on after the counters it has
+     reserved. */
+  boot();
+  sicslowmac_set_key(NULL, network_key2);
+  send(&rimeaddr_null, PAYLOAD);
+  counter = check_sent("broadcast after a reboot", network_key2, PAYLOAD);
+  if(counter <= last) {
+    ERROR("frame counter %lu after a reboot, after %lu\n",
+          (unsigned long)counter, (unsigned long)last);
+  }
+  last = counter;
+
+  /* When the counter file cannot be written, the node sends until
+     the counters it has reserved run out. */
+  cfs_full = 1;
+  sent = 0;
+  for(i = 0; i < 2 * SICSLOWMAC_CONF_COUNTER_BLOCK; i++) {
+    send(&rimeaddr_null, PAYLOAD);
+    f_len = cc2420_sim_sent(f);
+    if(f_len == 0) {
+      continue;
+    }
+    counter = check_secured("broadcast with the counter file full", f, f_len,
+                            network_key2, PAYLOAD);
+    if(counter <= last || counter >= reserved_limit()) {
+      ERROR("frame counter %lu with the counter file full, %lu reserved\n",
+            (unsigned long)counter, (unsigned long)reserved_limit());
+    }
+    last = counter;
+    sent++;
+  }
+  if(sent == 0 || sent >= SICSLOWMAC_CONF_COUNTER_BLOCK) {
+    ERROR("%d frames sent with the counter file full\n", sent);
+  }
+  cfs_full = 0;
+  send(&rimeaddr_null, PAYLOAD);
+  if(check_sent("broadcast after the counter file is written", network_key2,
+                PAYLOAD) != last + 1) {
+    ERROR("frames are not sent after the counter file is written\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(const char *what, const rimeaddr_t *to, int len)
+{
+  struct cc2420_sim_stats s;
+  unsigned long blocks, now;
+  uint8_t f[128];
+  int f_len;
+
+  /* Sending, until the transmission starts. */
+  s = cc2420_sim_stats;
+  blocks = aes_blocks;
+  now = cc2420_sim_now;
+  send(to, len);
+  printf("%-15s send    %4lu SPI bytes, %2lu MCU and %2lu CC2420 AES blocks, "
+         "%5lu us\n", what,
+         cc2420_sim_stats.tx_on_spi_bytes - s.spi_bytes,
+         aes_blocks - blocks - (cc2420_sim_stats.saes_blocks - s.saes_blocks),
+         cc2420_sim_stats.ccm_blocks - s.ccm_blocks +
+         cc2420_sim_stats.saes_blocks - s.saes_blocks,
+         cc2420_sim_stats.tx_on_time - now);
+  cc2420_sim_sent(f);
+
+  /* Receiving, from the arrival of the frame until it is
+     delivered. */
+  f_len = peer_frame(f, !rimeaddr_cmp(to, &rimeaddr_null),
+                     rimeaddr_cmp(to, &rimeaddr_null) ?
+                     network_key2 : pairwise_key2,
+                     0x10000 + cc2420_sim_now, 1, len);
+  s = cc2420_sim_stats;
+  blocks = aes_blocks;
+  now = cc2420_sim_now;
+  expect(what, receive(f, f_len), len);
+  printf("%-15s receive %4lu SPI bytes, %2lu MCU and %2lu CC2420 AES blocks, "
+         "%5lu us\n", what, cc2420_sim_stats.spi_bytes - s.spi_bytes,
+         aes_blocks - blocks - (cc2420_sim_stats.saes_blocks - s.saes_blocks),
+         cc2420_sim_stats.ccm_blocks - s.ccm_blocks +
+         cc2420_sim_stats.saes_blocks - s.saes_blocks,
+         cc2420_sim_now - now);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  struct timespec start, end;
+  uint8_t f[128];
+  long i;
+
+#if SICSLOWMAC_CONF_CC2420_SECURITY
+  printf("Security level %d, in-line CCM* of the CC2420\n", LEVEL);
+#else /* SICSLOWMAC_CONF_CC2420_SECURITY */
+  printf("Security level %d, CCM* on %s\n", LEVEL, NAME(TEST_AES_128));
+#endif /* SICSLOWMAC_CONF_CC2420_SECURITY */
+
+  process_init();
+  boot();
+  test_keys();
+  test_counters();
+
+  sicslowmac_set_key(&peer, pairwise_key2);
+  bench("unicast", &peer, PAYLOAD);
+  bench("broadcast", &rimeaddr_null, PAYLOAD);
+  bench("80-byte unicast", &peer, 80);
+
+  /* The time of the host, for the whole path through the driver and
+     the model. */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < ROUNDS; i++) {
+    send(&peer, PAYLOAD);
+    cc2420_sim_sent(f);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("%.0f ns of the host per unicast, %d errors\n",
+         ((end.tv_sec - start.tv_sec) * 1e9 +
+          (end.tv_nsec - start.tv_nsec)) / ROUNDS, errors);
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
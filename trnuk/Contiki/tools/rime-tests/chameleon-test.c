@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host test and benchmark of the chameleon-bitopt codecs
+ *
+ *         A channel is opened with the attribute list of each Rime
+ *         primitive, and must get a codec from channel_set_attributes()
+ *         unless the list is empty. PACKETS packets with random
+ *         attributes and addresses, also values that do not fit their
+ *         fields, are packed with the codec and with the generic code,
+ *         and the headers must be the same. Each header is unpacked
+ *         both ways, and the attributes and addresses must be the
+ *         same. Then packing and unpacking are timed both ways. See
+ *         the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "contiki.h"
+#include "net/rime.h"
+#include "net/rime/chameleon.h"
+
+#define PACKETS 200000
+#define ROUNDS  2000000
+#define DATA    "data"
+
+struct primitive {
+  const char *name;
+  const struct packetbuf_attrlist *attrlist;
+  uint16_t channelno;
+  struct channel channel;
+};
+
+static const struct packetbuf_attrlist abc_attrs[] =
+  { ABC_ATTRIBUTES PACKETBUF_ATTR_LAST };
+static const struct packetbuf_attrlist broadcast_attrs[] =
+  { BROADCAST_ATTRIBUTES PACKETBUF_ATTR_LAST };
+static const struct packetbuf_attrlist unicast_attrs[] =
+  { UNICAST_ATTRIBUTES PACKETBUF_ATTR_LAST };
+static const struct packetbuf_attrlist stunicast_attrs[] =
+  { STUNICAST_ATTRIBUTES PACKETBUF_ATTR_LAST };
+static const struct packetbuf_attrlist runicast_attrs[] =
+  { RUNICAST_ATTRIBUTES PACKETBUF_ATTR_LAST };
+static const struct packetbuf_attrlist trickle_attrs[] =
+  { TRICKLE_ATTRIBUTES PACKETBUF_ATTR_LAST };
+static const struct packetbuf_attrlist multihop_attrs[] =
+  { MULTIHOP_ATTRIBUTES PACKETBUF_ATTR_LAST };
+static const struct packetbuf_attrlist collect_attrs[] =
+  { COLLECT_ATTRIBUTES PACKETBUF_ATTR_LAST };
+
+/* A list without a codec. */
+static const struct packetbuf_attrlist other_attrs[] =
+  { { PACKETBUF_ATTR_PACKET_ID, PACKETBUF_ATTR_BIT * 16 },
+    BROADCAST_ATTRIBUTES PACKETBUF_ATTR_LAST };
+
+static struct primitive primitives[] = {
+  { "abc", abc_attrs, 128 },
+  { "broadcast", broadcast_attrs, 129 },
+  { "unicast", unicast_attrs, 130 },
+  { "stunicast", stunicast_attrs, 131 },
+  { "runicast", runicast_attrs, 132 },
+  { "trickle", trickle_attrs, 133 },
+  { "multihop", multihop_attrs, 134 },
+  { "collect", collect_attrs, 135 },
+  { "other", other_attrs, 136 },
+};
+#define PRIMITIVES (sizeof(primitives) / sizeof(primitives[0]))
+
+/* The attributes and addresses of a packet. */
+struct attrs {
+  packetbuf_attr_t attr[PACKETBUF_ADDR_FIRST];
+  rimeaddr_t addr[PACKETBUF_NUM_ADDRS];
+};
+
+static int errors;
+
+#define ERROR(...) do { if(errors++ < 10) printf(__VA_ARGS__); } while(0)
+/*---------------------------------------------------------------------------*/
+void
+abc_input(struct channel *channel)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+rime_output(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+rimestats_output(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_attrs(struct attrs *a)
+{
+  int i, j;
+
+  for(i = 0; i < PACKETBUF_ADDR_FIRST; i++) {
+    a->attr[i] = rand() % 4 == 0 ? rand() & 0xffff : rand() & 0x0f;
+  }
+  for(i = 0; i < PACKETBUF_NUM_ADDRS; i++) {
+    for(j = 0; j < sizeof(rimeaddr_t); j++) {
+      a->addr[i].u8[j] = rand();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_attrs(const struct attrs *a)
+{
+  int i;
+
+  for(i = PACKETBUF_ATTR_NONE + 1; i < PACKETBUF_ADDR_FIRST; i++) {
+    packetbuf_set_attr(i, a->attr[i]);
+  }
+  for(i = 0; i < PACKETBUF_NUM_ADDRS; i++) {
+    packetbuf_set_addr(PACKETBUF_ADDR_FIRST + i, &a->addr[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+get_attrs(struct attrs *a)
+{
+  int i;
+
+  memset(a, 0, sizeof(*a));
+  for(i = PACKETBUF_ATTR_NONE + 1; i < PACKETBUF_ADDR_FIRST; i++) {
+    a->attr[i] = packetbuf_attr(i);
+  }
+  for(i = 0; i < PACKETBUF_NUM_ADDRS; i++) {
+    rimeaddr_copy(&a->addr[i], packetbuf_addr(PACKETBUF_ADDR_FIRST + i));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Packs the attributes into a frame, and returns its length. */
+static int
+pack(struct channel *c, const struct attrs *a, uint8_t *frame)
+{
+  packetbuf_clear();
+  packetbuf_copyfrom(DATA, sizeof(DATA));
+  set_attrs(a);
+  chameleon_bitopt.output(c);
+  memcpy(frame, packetbuf_hdrptr(), packetbuf_totlen());
+  return packetbuf_totlen();
+}
+/*---------------------------------------------------------------------------*/
+static struct channel *
+unpack(const uint8_t *frame, int len, struct attrs *a)
+{
+  struct channel *c;
+
+  packetbuf_clear();
+  packetbuf_copyfrom(frame, len);
+  c = chameleon_bitopt.input();
+  get_attrs(a);
+  if(packetbuf_datalen() != sizeof(DATA) ||
+     memcmp(packetbuf_dataptr(), DATA, sizeof(DATA)) != 0) {
+    ERROR("channel %d: the data does not follow the header\n",
+	  c != NULL ? c->channelno : -1);
+  }
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(struct primitive *p, const struct attrs *a)
+{
+  const struct chameleon_codec *codec;
+  uint8_t frame[2][PACKETBUF_SIZE];
+  struct attrs got[2];
+  struct channel *c[2];
+  int len[2], i;
+
+  codec = p->channel.codec;
+  for(i = 0; i < 2; i++) {
+    p->channel.codec = i == 0 ? codec : NULL;
+    len[i] = pack(&p->channel, a, frame[i]);
+    c[i] = unpack(frame[i], len[i], &got[i]);
+  }
+  p->channel.codec = codec;
+
+  if(len[0] != len[1] || memcmp(frame[0], frame[1], len[0]) != 0) {
+    ERROR("%s: the codec packs a different header\n", p->name);
+  }
+  if(c[0] != &p->channel || c[1] != &p->channel) {
+    ERROR("%s: the header is not for the channel\n", p->name);
+  }
+  for(i = PACKETBUF_ATTR_NONE + 1; i < PACKETBUF_ADDR_FIRST; i++) {
+    if(got[0].attr[i] != got[1].attr[i]) {
+      ERROR("%s: the codec unpacks %s as %u, not %u\n", p->name,
+	    packetbuf_attr_strings[i], got[0].attr[i], got[1].attr[i]);
+    }
+  }
+  for(i = 0; i < PACKETBUF_NUM_ADDRS; i++) {
+    if(!rimeaddr_cmp(&got[0].addr[i], &got[1].addr[i])) {
+      ERROR("%s: the codec unpacks %s differently\n", p->name,
+	    packetbuf_attr_strings[PACKETBUF_ADDR_FIRST + i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static double
+ns_since(const struct timespec *start)
+{
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+/*---------------------------------------------------------------------------*/
+/* Times packing and unpacking, with the codec of the channel or
+   without one. */
+static void
+bench(struct primitive *p, const struct chameleon_codec *codec,
+      double *pack_ns, double *unpack_ns)
+{
+  struct timespec start;
+  struct attrs a;
+  uint8_t frame[PACKETBUF_SIZE];
+  long i;
+  int len;
+
+  random_attrs(&a);
+  p->channel.codec = codec;
+  len = pack(&p->channel, &a, frame);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < ROUNDS; i++) {
+    chameleon_bitopt.output(&p->channel);
+    packetbuf_hdrreduce(len - sizeof(DATA));
+  }
+  *pack_ns = ns_since(&start) / ROUNDS;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < ROUNDS; i++) {
+    packetbuf_copyfrom(frame, len);
+    chameleon_bitopt.input();
+  }
+  *unpack_ns = ns_since(&start) / ROUNDS;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  const struct chameleon_codec *codec;
+  struct primitive *p;
+  struct attrs a;
+  double pack_ns[2], unpack_ns[2];
+  int i;
+
+  chameleon_init(&chameleon_bitopt);
+  for(p = primitives; p < &primitives[PRIMITIVES]; p++) {
+    channel_open(&p->channel, p->channelno);
+    channel_set_attributes(p->channelno, p->attrlist);
+    if((p->channel.codec != NULL) !=
+       (p->attrlist != abc_attrs && p->attrlist != other_attrs)) {
+      ERROR("%s: %s codec\n", p->name,
+	    p->channel.codec != NULL ? "unexpected" : "no");
+    }
+  }
+
+  for(i = 0; i < PACKETS; i++) {
+    random_attrs(&a);
+    check(&primitives[rand() % PRIMITIVES], &a);
+  }
+
+  printf("%d-byte addresses: %d packets, %d errors\n",
+	 (int)sizeof(rimeaddr_t), PACKETS, errors);
+  for(p = primitives; p < &primitives[PRIMITIVES]; p++) {
+    codec = p->channel.codec;
+    if(codec == NULL) {
+      continue;
+    }
+    bench(p, codec, &pack_ns[0], &unpack_ns[0]);
+    bench(p, NULL, &pack_ns[1], &unpack_ns[1]);
+    p->channel.codec = codec;
+    printf("  %-10s %3d bits: pack %5.1f ns, %5.1f without the codec, "
+	   "unpack %5.1f ns, %5.1f without\n", p->name, p->channel.hdrsize,
+	   pack_ns[0], pack_ns[1], unpack_ns[0], unpack_ns[1]);
+  }
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
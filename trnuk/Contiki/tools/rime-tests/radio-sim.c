@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A simulated radio for host tests
+ *
+ *         Each frame on the socket starts with a header of its own:
+ *         the frame type, whether the frame requests an ACK, and a
+ *         sequence number that the ACK repeats. Frames that arrive
+ *         while the radio waits for an ACK are queued.
+ */
+
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "contiki.h"
+#include "net/rime/packetbuf.h"
+#include "radio-sim.h"
+
+#define TYPE_DATA   0
+#define TYPE_ACK    1
+
+#define HDR_TYPE    0
+#define HDR_REQUEST 1
+#define HDR_SEQNO   2
+#define HDR_LEN     3
+
+/* The time that the radio waits for an ACK, in milliseconds. */
+#define ACK_WAIT    20
+
+#define QUEUE_LEN   4
+
+struct frame {
+  uint8_t data[HDR_LEN + PACKETBUF_SIZE];
+  int len;
+};
+
+struct radio_sim_stats radio_sim_stats;
+
+static struct frame queue[QUEUE_LEN];
+static int queue_head, queue_count;
+
+static int sock = -1;
+static int autoack;
+static uint8_t seqno;
+static void (* receiver_callback)(const struct radio_driver *);
+/*---------------------------------------------------------------------------*/
+static int
+wait_frame(struct frame *f, int timeout)
+{
+  struct pollfd p;
+
+  p.fd = sock;
+  p.events = POLLIN;
+  if(poll(&p, 1, timeout) <= 0) {
+    return 0;
+  }
+  f->len = recv(sock, f->data, sizeof(f->data), 0);
+  return f->len <= 0 ? -1 : 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Acknowledges a frame if it requests an ACK, and queues it. */
+static void
+receive_frame(struct frame *f)
+{
+  uint8_t ack[HDR_LEN];
+
+  if(f->len < HDR_LEN) {
+    return;
+  }
+  if(f->data[HDR_TYPE] == TYPE_ACK) {
+    /* An ACK that nobody waits for. */
+    return;
+  }
+  radio_sim_stats.rx++;
+  if(autoack && f->data[HDR_REQUEST]) {
+    ack[HDR_TYPE] = TYPE_ACK;
+    ack[HDR_REQUEST] = 0;
+    ack[HDR_SEQNO] = f->data[HDR_SEQNO];
+    send(sock, ack, sizeof(ack), 0);
+    radio_sim_stats.acktx++;
+  }
+  if(queue_count == QUEUE_LEN) {
+    radio_sim_stats.dropped++;
+    return;
+  }
+  queue[(queue_head + queue_count) % QUEUE_LEN] = *f;
+  queue_count++;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_send(const void *payload, unsigned short payload_len)
+{
+  struct frame f;
+  struct timer t;
+  int request;
+
+  request = packetbuf_attr(PACKETBUF_ATTR_RELIABLE) != 0;
+  f.data[HDR_TYPE] = TYPE_DATA;
+  f.data[HDR_REQUEST] = request;
+  f.data[HDR_SEQNO] = ++seqno;
+  memcpy(f.data + HDR_LEN, payload, payload_len);
+  if(send(sock, f.data, HDR_LEN + payload_len, 0) < 0) {
+    return 0;
+  }
+  radio_sim_stats.tx++;
+
+  if(autoack && request) {
+    packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 0);
+    timer_set(&t, ACK_WAIT * CLOCK_SECOND / 1000);
+    while(!timer_expired(&t)) {
+      if(wait_frame(&f, ACK_WAIT) <= 0) {
+	break;
+      }
+      if(f.len >= HDR_LEN && f.data[HDR_TYPE] == TYPE_ACK &&
+	 f.data[HDR_SEQNO] == seqno) {
+	radio_sim_stats.ackrx++;
+	packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+	break;
+      }
+      receive_frame(&f);
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_read(void *buf, unsigned short buf_len)
+{
+  struct frame *f;
+  int len;
+
+  if(queue_count == 0) {
+    return 0;
+  }
+  f = &queue[queue_head];
+  queue_head = (queue_head + 1) % QUEUE_LEN;
+  queue_count--;
+  len = f->len - HDR_LEN;
+  if(len > buf_len) {
+    return 0;
+  }
+  memcpy(buf, f->data + HDR_LEN, len);
+  if(autoack) {
+    packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, f->data[HDR_REQUEST]);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_receive_function(void (* recv)(const struct radio_driver *))
+{
+  receiver_callback = recv;
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver radio_sim_driver = {
+  radio_send,
+  radio_read,
+  set_receive_function,
+  on,
+  off,
+};
+/*---------------------------------------------------------------------------*/
+void
+radio_sim_init(int fd, int a)
+{
+  sock = fd;
+  autoack = a;
+}
+/*---------------------------------------------------------------------------*/
+int
+radio_sim_poll(int timeout)
+{
+  struct frame f;
+  int n, r;
+
+  /* The frames are passed on one at a time, as they arrive. */
+  n = 0;
+  do {
+    while(queue_count > 0) {
+      if(receiver_callback != NULL) {
+	receiver_callback(&radio_sim_driver);
+      } else {
+	queue_count--;
+	queue_head = (queue_head + 1) % QUEUE_LEN;
+      }
+    }
+    r = wait_frame(&f, n == 0 ? timeout : 0);
+    if(r > 0) {
+      receive_frame(&f);
+      n++;
+    }
+  } while(r > 0);
+  return r < 0 ? -1 : n;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A simulated radio for host tests
+ *
+ *         The frames of a node go over a socket to the other nodes
+ *         of the test, which are processes of their own. With
+ *         auto-ACK, the radio acknowledges the frames that request an
+ *         ACK as it receives them, and waits for the ACK of the frames
+ *         that it sends, as the CC2420 with CC2420_CONF_AUTOACK. A
+ *         frame requests an ACK if PACKETBUF_ATTR_RELIABLE is set, as
+ *         with sicslowmac.
+ */
+
+#ifndef __RADIO_SIM_H__
+#define __RADIO_SIM_H__
+
+#include "dev/radio.h"
+
+struct radio_sim_stats {
+  unsigned long tx, rx;
+  unsigned long acktx, ackrx;   /* Link-layer ACKs. */
+  unsigned long dropped;        /* Frames that found the queue full. */
+};
+
+extern struct radio_sim_stats radio_sim_stats;
+extern const struct radio_driver radio_sim_driver;
+
+/**
+ * \brief      Set up the radio
+ * \param fd   A connected SOCK_SEQPACKET socket to the other nodes
+ * \param autoack Non-zero to acknowledge frames and wait for ACKs
+ */
+void radio_sim_init(int fd, int autoack);
+
+/**
+ * \brief      Receive the frames that have arrived
+ * \param timeout The time to wait for a frame, in milliseconds
+ * \return     The number of frames received, or -1 if the other
+ *             end has closed the socket
+ *
+ *             The receive function is called for each frame.
+ */
+int radio_sim_poll(int timeout);
+
+#endif /* __RADIO_SIM_H__ */
@@ -0,0 +1,16 @@
+/**
+ * \file
+ *         rtimer definitions for the Rime host tests, which do not use
+ *         real-time timers
+ */
+
+#ifndef __RTIMER_ARCH_H__
+#define __RTIMER_ARCH_H__
+
+#include "sys/rtimer.h"
+
+#define RTIMER_ARCH_SECOND 4096
+
+#define rtimer_arch_now() 0
+
+#endif /* __RTIMER_ARCH_H__ */
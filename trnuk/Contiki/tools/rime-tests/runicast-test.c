@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Host test of runicast with and without link-layer ACKs
+ *
+ *         A sender and a receiver, each a process of its own, are
+ *         connected by the simulated radio. The sender sends PACKETS
+ *         runicast packets, one at a time, and the receiver checks
+ *         that it gets them all in order. The channel loses no
+ *         frames, so every packet must be ACKed at its first
+ *         transmission, whether or not the sender was built with
+ *         RUNICAST_CONF_MAC_ACK and whether or not the radio of the
+ *         receiver has auto-ACK: the receiver must send a runicast ACK
+ *         unless the sender takes the link-layer ACK instead. The
+ *         radio of the sender has auto-ACK when the sender was built
+ *         with RUNICAST_CONF_MAC_ACK, and the auto-ACK of the receiver
+ *         is given on the command line. See the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "contiki.h"
+#include "net/rime.h"
+#include "net/rime/runicast.h"
+#include "net/mac/nullmac.h"
+#include "radio-sim.h"
+
+#ifndef RUNICAST_CONF_MAC_ACK
+#define RUNICAST_CONF_MAC_ACK 0
+#endif /* RUNICAST_CONF_MAC_ACK */
+
+#define PACKETS      200
+#define MAX_REXMITS  4
+#define CHANNEL      144
+
+static struct runicast_conn conn;
+static int received, sent, timedout, rexmits, errors;
+
+#define ERROR(...) do { if(errors++ < 10) printf(__VA_ARGS__); } while(0)
+/*---------------------------------------------------------------------------*/
+clock_time_t
+clock_time(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * CLOCK_SECOND + t.tv_nsec / (1000000000 / CLOCK_SECOND);
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+clock_seconds(void)
+{
+  return clock_time() / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_runicast(struct runicast_conn *c, rimeaddr_t *from, uint8_t seqno)
+{
+  int n;
+
+  memcpy(&n, packetbuf_dataptr(), sizeof(n));
+  if(packetbuf_datalen() != sizeof(n) || n != received) {
+    ERROR("receiver: got packet %d, expected %d\n", n, received);
+  }
+  received++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sent_runicast(struct runicast_conn *c, rimeaddr_t *to, uint8_t rxmit)
+{
+  sent++;
+  rexmits += rxmit - 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+timedout_runicast(struct runicast_conn *c, rimeaddr_t *to, uint8_t rxmit)
+{
+  timedout++;
+}
+/*---------------------------------------------------------------------------*/
+static const struct runicast_callbacks callbacks = {
+  recv_runicast, sent_runicast, timedout_runicast
+};
+/*---------------------------------------------------------------------------*/
+static void
+run(int timeout)
+{
+  radio_sim_poll(timeout);
+  etimer_request_poll();
+  while(process_run() > 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_node(int fd, int id, int autoack)
+{
+  rimeaddr_t addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[0] = id;
+  rimeaddr_set_node_addr(&addr);
+  process_init();
+  process_start(&etimer_process, NULL);
+  ctimer_init();
+  radio_sim_init(fd, autoack);
+  rime_init(nullmac_init(&radio_sim_driver));
+  runicast_open(&conn, CHANNEL, &callbacks);
+}
+/*---------------------------------------------------------------------------*/
+static int
+receiver(int fd, int autoack)
+{
+  start_node(fd, 2, autoack);
+  while(radio_sim_poll(1000) >= 0) {
+    run(0);
+  }
+  if(received != PACKETS) {
+    ERROR("receiver: got %d packets\n", received);
+  }
+  if(rimestats.acktx != (autoack && RUNICAST_CONF_MAC_ACK ? 0 : PACKETS)) {
+    ERROR("receiver: sent %lu runicast ACKs\n", rimestats.acktx);
+  }
+  printf("receiver auto-ACK %d: %d packets, %lu runicast ACKs, "
+	 "%lu link-layer ACKs, %d errors\n", autoack, received,
+	 rimestats.acktx, radio_sim_stats.acktx, errors);
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+sender(int fd)
+{
+  rimeaddr_t to;
+  int n;
+
+  start_node(fd, 1, RUNICAST_CONF_MAC_ACK);
+  memset(&to, 0, sizeof(to));
+  to.u8[0] = 2;
+  for(n = 0; n < PACKETS && errors == 0; n++) {
+    packetbuf_copyfrom(&n, sizeof(n));
+    if(!runicast_send(&conn, &to, MAX_REXMITS)) {
+      ERROR("sender: cannot send packet %d\n", n);
+      break;
+    }
+    while(runicast_is_transmitting(&conn)) {
+      run(10);
+    }
+    if(rexmits > 0 || timedout > 0) {
+      ERROR("sender: packet %d %s\n", n,
+	    timedout ? "timed out" : "was retransmitted");
+    }
+  }
+  printf("sender MAC ACK %d: %d packets ACKed, %lu link-layer ACKs, "
+	 "%d errors\n", RUNICAST_CONF_MAC_ACK, sent, radio_sim_stats.ackrx,
+	 errors);
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char *argv[])
+{
+  int fds[2], status, autoack;
+  pid_t pid;
+
+  autoack = argc > 1 ? atoi(argv[1]) : 0;
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0) {
+    perror("socketpair");
+    return 1;
+  }
+  fflush(stdout);
+  pid = fork();
+  if(pid < 0) {
+    perror("fork");
+    return 1;
+  }
+  if(pid == 0) {
+    close(fds[0]);
+    exit(receiver(fds[1], autoack));
+  }
+  close(fds[1]);
+  status = sender(fds[0]);
+  close(fds[0]);
+  if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+     WEXITSTATUS(status) != 0) {
+    status = 1;
+  }
+  return status != 0 || errors != 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Print the Rime statistics frames written by rimestats_export()
+ * \author
+ *         Adam Dunkels <adam@sics.se>
+ *
+ *         Reads a serial port log on standard input, skips everything
+ *         that is not a statistics frame, and prints each frame. With
+ *         -d, the counters of each frame are printed as the difference
+ *         from the previous frame of the same node.
+ *
+ *         Build with: cc -o rimestats-print rimestats-print.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FORMAT_VERSION 1
+#define MAX_FRAME 4096
+#define MAX_NODES 64
+
+/* The names of the counters, in the order of struct rimestats and
+   struct rimestats_link. Frames with more counters than there are
+   names print the rest by number. */
+static const char *global_names[] = {
+  "tx", "rx",
+  "reliabletx", "reliablerx", "rexmit", "acktx", "noacktx", "ackrx",
+  "timedout", "badackrx",
+  "toolong", "tooshort", "badsynch", "badcrc",
+  "contentiondrop", "sendingdrop",
+  "lltx", "llrx",
+  "xmemspill", "xmemrefill", "xmemdrop",
+  "dupcachehit", "dupcachemiss",
+  "llrxoverflow"
+};
+static const char *link_names[] = {
+  "tx", "rx", "reliabletx", "reliablerx", "rexmit", "timedout", "ackrx"
+};
+#define NAMES(a) (sizeof(a) / sizeof(a[0]))
+
+struct node {
+  unsigned char addr[8];
+  int addrlen;
+  int len;
+  unsigned char frame[MAX_FRAME];
+};
+
+static struct node nodes[MAX_NODES];
+static int num_nodes;
+static int delta;
+
+/*---------------------------------------------------------------------------*/
+static unsigned short
+crc16_add(unsigned char b, unsigned short acc)
+{
+  acc ^= b;
+  acc  = (acc >> 8) | (acc << 8);
+  acc ^= (acc & 0xff00) << 4;
+  acc ^= (acc >> 8) >> 4;
+  acc ^= (acc & 0xff00) >> 5;
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+get(const unsigned char *p, int len)
+{
+  unsigned long v;
+
+  v = 0;
+  while(len-- > 0) {
+    v = (v << 8) | p[len];
+  }
+  return v;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_addr(const unsigned char *addr, int len)
+{
+  int i;
+
+  for(i = 0; i < len; ++i) {
+    printf(i == 0 ? "%d" : ".%d", addr[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_counters(const char *names[], int num_names,
+	       const unsigned char *p, const unsigned char *prev,
+	       int n, int size)
+{
+  int i;
+  unsigned long v, mask;
+
+  mask = size == 4 ? 0xffffffffUL : 0xffffUL;
+  for(i = 0; i < n; ++i) {
+    v = get(p + i * size, size);
+    if(prev != NULL) {
+      v = (v - get(prev + i * size, size)) & mask;
+    }
+    if(i < num_names) {
+      printf(" %s %lu", names[i], v);
+    } else {
+      printf(" %d %lu", i, v);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_histogram(const char *name, const unsigned char *p,
+		const unsigned char *prev, int bins, int min, int step)
+{
+  int i;
+  unsigned long v;
+
+  printf("    %s", name);
+  for(i = 0; i < bins; ++i) {
+    v = get(p + i * 2, 2);
+    if(prev != NULL) {
+      v = (v - get(prev + i * 2, 2)) & 0xffff;
+    }
+    if(step == 0) {
+      printf(" %d%s:%lu", i, i == bins - 1 ? "+" : "", v);
+    } else if(i == bins - 1) {
+      printf(" %d+:%lu", min + i * step, v);
+    } else {
+      printf(" %d:%lu", min + i * step, v);
+    }
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+/* Find the same neighbor or channel in the previous frame of a
+   node. */
+static const unsigned char *
+find_prev(const unsigned char *prev, int prevlen, const unsigned char *key,
+	  int keylen, int first, int num, int size)
+{
+  int i;
+
+  if(prev == NULL) {
+    return NULL;
+  }
+  for(i = 0; i < num; ++i) {
+    if(first + (i + 1) * size <= prevlen &&
+       memcmp(prev + first + i * size, key, keylen) == 0) {
+      return prev + first + i * size + keylen;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_frame(const unsigned char *f, int len)
+{
+  int globals, counters, bins, neighbors, channels, addrlen;
+  int rssi_min, rssi_step, lqi_min, lqi_step;
+  int i, pos, nsize, csize, first_neighbor, first_channel;
+  const unsigned char *prev, *p;
+  int prevlen;
+  struct node *node;
+
+  globals = f[0];
+  counters = f[1];
+  bins = f[2];
+  neighbors = f[3];
+  channels = f[4];
+  addrlen = f[5];
+  rssi_min = (signed char)f[6];
+  rssi_step = f[7];
+  lqi_min = (signed char)f[8];
+  lqi_step = f[9];
+  pos = 10;
+
+  /* Find the previous frame of the node. */
+  prev = NULL;
+  prevlen = 0;
+  node = NULL;
+  for(i = 0; i < num_nodes; ++i) {
+    if(nodes[i].addrlen == addrlen &&
+       memcmp(nodes[i].addr, f + pos, addrlen) == 0) {
+      node = &nodes[i];
+      break;
+    }
+  }
+  if(node != NULL && delta &&
+     node->frame[0] == f[0] && node->frame[1] == f[1] &&
+     node->frame[2] == f[2] && node->frame[5] == f[5]) {
+    prev = node->frame;
+    prevlen = node->len;
+  }
+
+  printf("node ");
+  print_addr(f + pos, addrlen);
+  pos += addrlen;
+  printf(" time %lu%s\n", get(f + pos, 4), prev != NULL ? " delta" : "");
+  pos += 4;
+
+  printf(" ");
+  print_counters(global_names, NAMES(global_names), f + pos,
+		 prev != NULL ? prev + pos : NULL, globals, 4);
+  printf("\n");
+  pos += globals * 4;
+
+  nsize = addrlen + (counters + 3 * bins) * 2;
+  first_neighbor = pos;
+  for(i = 0; i < neighbors; ++i) {
+    p = find_prev(prev, prevlen, f + pos, addrlen, first_neighbor,
+		  prev != NULL ? prev[3] : 0, nsize);
+    printf("  neighbor ");
+    print_addr(f + pos, addrlen);
+    pos += addrlen;
+    print_counters(link_names, NAMES(link_names), f + pos, p, counters, 2);
+    printf("\n");
+    pos += counters * 2;
+    p = p != NULL ? p + counters * 2 : NULL;
+    print_histogram("rssi", f + pos, p, bins, rssi_min, rssi_step);
+    pos += bins * 2;
+    p = p != NULL ? p + bins * 2 : NULL;
+    print_histogram("lqi", f + pos, p, bins, lqi_min, lqi_step);
+    pos += bins * 2;
+    p = p != NULL ? p + bins * 2 : NULL;
+    print_histogram("rexmits", f + pos, p, bins, 0, 0);
+    pos += bins * 2;
+  }
+
+  csize = (1 + counters) * 2;
+  first_channel = first_neighbor +
+    (prev != NULL ? prev[3] : 0) * nsize;
+  for(i = 0; i < channels; ++i) {
+    p = find_prev(prev, prevlen, f + pos, 2, first_channel,
+		  prev != NULL ? prev[4] : 0, csize);
+    printf("  channel %lu", get(f + pos, 2));
+    pos += 2;
+    print_counters(link_names, NAMES(link_names), f + pos, p, counters, 2);
+    printf("\n");
+    pos += counters * 2;
+  }
+
+  if(node == NULL && num_nodes < MAX_NODES) {
+    node = &nodes[num_nodes++];
+    memcpy(node->addr, f + 10, addrlen);
+    node->addrlen = addrlen;
+  }
+  if(node != NULL) {
+    memcpy(node->frame, f, len);
+    node->len = len;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The length of a frame, from its first bytes after the version. */
+static int
+frame_len(const unsigned char *f)
+{
+  return 10 + f[5] + 4 + f[0] * 4 +
+    f[3] * (f[5] + (f[1] + 3 * f[2]) * 2) +
+    f[4] * (1 + f[1]) * 2 + 2;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char *argv[])
+{
+  static unsigned char f[MAX_FRAME];
+  int c, state, len, need, i;
+  unsigned short crc;
+
+  if(argc > 1 && strcmp(argv[1], "-d") == 0) {
+    delta = 1;
+  } else if(argc > 1) {
+    fprintf(stderr, "usage: %s [-d] < log\n", argv[0]);
+    exit(1);
+  }
+
+  state = len = need = 0;
+  while((c = getchar()) != EOF) {
+    switch(state) {
+    case 0:
+      state = c == 'R' ? 1 : 0;
+      break;
+    case 1:
+      state = c == 'S' ? 2 : (c == 'R' ? 1 : 0);
+      break;
+    case 2:
+      state = c == FORMAT_VERSION ? 3 : (c == 'R' ? 1 : 0);
+      len = 0;
+      need = 10;
+      break;
+    case 3:
+      f[len++] = c;
+      if(len == 10) {
+	need = frame_len(f);
+	if(need > MAX_FRAME) {
+	  state = 0;
+	}
+      } else if(len == need) {
+	crc = 0;
+	for(i = 0; i < len - 2; ++i) {
+	  crc = crc16_add(f[i], crc);
+	}
+	if(crc == get(f + len - 2, 2)) {
+	  print_frame(f, len);
+	} else {
+	  fprintf(stderr, "rimestats-print: bad CRC, frame skipped\n");
+	}
+	state = 0;
+      }
+      break;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
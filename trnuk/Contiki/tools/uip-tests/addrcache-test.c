@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host test and benchmark of uip-addrcache
+ *
+ *         Drives a cache of ENTRIES entries with a long random
+ *         sequence of adds, lookups, refreshes, removals and ticks,
+ *         and checks every result against a simple model: lookups,
+ *         eviction of the least recently added or refreshed entry,
+ *         lazy aging, and the periodic sweep. Part of the addresses
+ *         hash to the same few slots, to exercise long probe
+ *         sequences and removal from them. Then it checks ARP through
+ *         uip_arp, and measures the cost of a lookup in a full cache
+ *         against a linear scan of the same table, as uip_arp did
+ *         before. Build it with several values of ENTRIES, see the
+ *         Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net/uip.h"
+#include "net/uip_arp.h"
+#include "net/uip-addrcache.h"
+
+#ifndef ENTRIES
+#define ENTRIES 8
+#endif
+
+#define MAXAGE  20
+#define STEPS   400000
+#define KEYS    (3 * ENTRIES)
+#define ROUNDS  1000000
+#define RUNS    5
+#define ORDER   4096
+
+struct entry {
+  u32_t pad;
+  uip_ipaddr_t ipaddr;
+};
+
+static struct entry entries[ENTRIES];
+UIP_ADDRCACHE(cache, struct entry, entries, ipaddr, MAXAGE);
+
+/* The model of the cache. Slot i mirrors entries[i]. */
+static struct {
+  u8_t used;
+  int key;
+  u16_t time;
+  unsigned long seq;
+} model[ENTRIES];
+static u16_t model_now;
+static u8_t model_hand;
+static unsigned long seq;
+
+static uip_ipaddr_t keys[KEYS];
+static int errors;
+
+#define ERROR(...) do { if(errors++ < 10) printf(__VA_ARGS__); } while(0)
+/*---------------------------------------------------------------------------*/
+void
+tcpip_uipcall(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_keys(void)
+{
+  int k;
+  u16_t v;
+
+  for(k = 0; k < KEYS; k++) {
+    if(k % 2 == 0) {
+      /* These all hash to slots 0 to 3. */
+      v = k + 1;
+      keys[k].u16[0] = v;
+      keys[k].u16[1] = v ^ (k % 4);
+    } else {
+      uip_ipaddr(&keys[k], 10, rand() & 0xff, rand() & 0xff, k & 0xff);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+model_find(int key)
+{
+  int i;
+
+  for(i = 0; i < ENTRIES; i++) {
+    if(model[i].used && model[i].key == key) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+model_aged(int i)
+{
+  return cache.maxage != 0 &&
+    (u16_t)(model_now - model[i].time) >= cache.maxage;
+}
+/*---------------------------------------------------------------------------*/
+static int
+model_lru(void)
+{
+  int i, lru;
+
+  lru = -1;
+  for(i = 0; i < ENTRIES; i++) {
+    if(model[i].used && (lru < 0 || model[i].seq < model[lru].seq)) {
+      lru = i;
+    }
+  }
+  return lru;
+}
+/*---------------------------------------------------------------------------*/
+static int
+model_nfree(void)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < ENTRIES; i++) {
+    n += !model[i].used;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_add(int key)
+{
+  struct entry *e;
+  int i, expect;
+
+  expect = model_find(key);
+  e = uip_addrcache_add(&cache, &keys[key]);
+  i = e - entries;
+  if(expect >= 0) {
+    if(i != expect) {
+      ERROR("add: existing address got entry %d, not %d\n", i, expect);
+    }
+  } else if(model_nfree() > 0) {
+    if(model[i].used) {
+      ERROR("add: entry %d was in use while others were free\n", i);
+    }
+  } else if(i != (expect = model_lru())) {
+    ERROR("add: evicted entry %d, not the least recent %d\n", i, expect);
+  }
+  if(!uip_ipaddr_cmp(&e->ipaddr, &keys[key])) {
+    ERROR("add: address not set\n");
+  }
+  model[i].used = 1;
+  model[i].key = key;
+  model[i].time = model_now;
+  model[i].seq = ++seq;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_lookup(int key)
+{
+  struct entry *e;
+  int expect;
+
+  expect = model_find(key);
+  e = uip_addrcache_lookup(&cache, &keys[key]);
+  if(expect >= 0 && model_aged(expect)) {
+    model[expect].used = 0;
+    expect = -1;
+  }
+  if(expect < 0 ? e != NULL : e != &entries[expect]) {
+    ERROR("lookup: got entry %d, not %d\n",
+	  e == NULL ? -1 : (int)(e - entries), expect);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_refresh(int i)
+{
+  uip_addrcache_refresh(&cache, &entries[i]);
+  if(model[i].used) {
+    model[i].time = model_now;
+    model[i].seq = ++seq;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_remove(int i)
+{
+  uip_addrcache_remove(&cache, &entries[i]);
+  model[i].used = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_periodic(void)
+{
+  int i;
+
+  uip_addrcache_periodic(&cache);
+  model_now++;
+  if(cache.maxage != 0) {
+    i = model_hand;
+    model_hand = (i + 1) % ENTRIES;
+    if(model[i].used && model_aged(i)) {
+      model[i].used = 0;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_all(void)
+{
+  int k;
+
+  if(cache.nfree != model_nfree()) {
+    ERROR("%d free entries, not %d\n", cache.nfree, model_nfree());
+  }
+  for(k = 0; k < KEYS; k++) {
+    test_lookup(k);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_cache(u16_t maxage)
+{
+  int n, op;
+
+  cache.maxage = maxage;
+  uip_addrcache_init(&cache);
+  memset(model, 0, sizeof(model));
+  model_now = model_hand = 0;
+
+  for(n = 0; n < STEPS; n++) {
+    op = rand() % 16;
+    if(op < 6) {
+      test_add(rand() % KEYS);
+    } else if(op < 11) {
+      test_lookup(rand() % KEYS);
+    } else if(op < 12) {
+      test_refresh(rand() % ENTRIES);
+    } else if(op < 13) {
+      test_remove(rand() % ENTRIES);
+    } else {
+      test_periodic();
+    }
+    if(n % 10000 == 0) {
+      check_all();
+    }
+  }
+  check_all();
+
+  /* Entries that are never looked up again are dropped by the sweep
+     within the maximum age and one round of the hand. */
+  if(maxage != 0) {
+    for(n = 0; n < maxage + ENTRIES; n++) {
+      test_periodic();
+    }
+    if(cache.nfree != ENTRIES) {
+      ERROR("%d entries left after the sweep\n", ENTRIES - cache.nfree);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* ARP through uip_arp. These mirror the private headers of uip_arp.c. */
+struct arp_hdr {
+  struct uip_eth_hdr ethhdr;
+  u16_t hwtype;
+  u16_t protocol;
+  u8_t hwlen;
+  u8_t protolen;
+  u16_t opcode;
+  struct uip_eth_addr shwaddr;
+  uip_ipaddr_t sipaddr;
+  struct uip_eth_addr dhwaddr;
+  uip_ipaddr_t dipaddr;
+};
+
+struct ethip_hdr {
+  struct uip_eth_hdr ethhdr;
+  u8_t vhl, tos, len[2], ipid[2], ipoffset[2], ttl, proto;
+  u16_t ipchksum;
+  uip_ipaddr_t srcipaddr, destipaddr;
+};
+
+#define ARPBUF ((struct arp_hdr *)&uip_buf[0])
+#define IPBUF  ((struct ethip_hdr *)&uip_buf[0])
+/*---------------------------------------------------------------------------*/
+static void
+arp_reply(u8_t host)
+{
+  memset(uip_buf, 0, sizeof(struct arp_hdr));
+  ARPBUF->ethhdr.type = HTONS(UIP_ETHTYPE_ARP);
+  ARPBUF->opcode = HTONS(2);
+  ARPBUF->shwaddr.addr[0] = 2;
+  ARPBUF->shwaddr.addr[5] = host;
+  uip_ipaddr(&ARPBUF->sipaddr, 10, 0, 0, host);
+  uip_ipaddr_copy(&ARPBUF->dipaddr, &uip_hostaddr);
+  uip_len = sizeof(struct arp_hdr);
+  uip_arp_arpin();
+}
+/*---------------------------------------------------------------------------*/
+/* Returns 1 if a packet to the host is sent to its Ethernet address,
+   and 0 if uip_arp_out() sends an ARP request for it instead. */
+static int
+arp_resolves(u8_t host)
+{
+  memset(uip_buf, 0, sizeof(struct ethip_hdr));
+  IPBUF->vhl = 0x45;
+  uip_ipaddr(&IPBUF->destipaddr, 10, 0, 0, host);
+  uip_len = UIP_IPUDPH_LEN;
+  uip_arp_out();
+  if(IPBUF->ethhdr.type == HTONS(UIP_ETHTYPE_IP)) {
+    if(IPBUF->ethhdr.dest.addr[0] != 2 || IPBUF->ethhdr.dest.addr[5] != host) {
+      ERROR("arp: wrong Ethernet address for host %d\n", host);
+    }
+    return 1;
+  }
+  if(uip_len != sizeof(struct arp_hdr) || ARPBUF->opcode != HTONS(1)) {
+    ERROR("arp: neither a packet nor a request for host %d\n", host);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_arp(void)
+{
+  int i;
+
+  uip_init();
+  uip_arp_init();
+  uip_ipaddr(&uip_hostaddr, 10, 0, 0, 1);
+  uip_ipaddr(&uip_netmask, 255, 255, 255, 0);
+
+  if(arp_resolves(2)) {
+    ERROR("arp: host resolved before any reply\n");
+  }
+  arp_reply(2);
+
+  /* An entry expires after UIP_ARP_MAXAGE timer calls. */
+  for(i = 0; i < UIP_ARP_MAXAGE - 1; i++) {
+    uip_arp_timer();
+  }
+  if(!arp_resolves(2)) {
+    ERROR("arp: entry expired early\n");
+  }
+  uip_arp_timer();
+  if(arp_resolves(2)) {
+    ERROR("arp: entry did not expire after %d ticks\n", UIP_ARP_MAXAGE);
+  }
+
+  /* A new reply restarts the age of an entry. */
+  arp_reply(2);
+  for(i = 0; i < UIP_ARP_MAXAGE - 1; i++) {
+    uip_arp_timer();
+  }
+  arp_reply(2);
+  uip_arp_timer();
+  if(!arp_resolves(2)) {
+    ERROR("arp: refreshed entry expired\n");
+  }
+
+  /* With a full table, the least recently updated host is evicted. */
+  uip_arp_init();
+  for(i = 0; i < UIP_ARPTAB_SIZE; i++) {
+    arp_reply(2 + i);
+  }
+  arp_reply(2);
+  arp_reply(2 + UIP_ARPTAB_SIZE);
+  if(!arp_resolves(2) || arp_resolves(3)) {
+    ERROR("arp: evicted the wrong host\n");
+  }
+  for(i = 0; i <= UIP_ARPTAB_SIZE; i++) {
+    if(i != 1 && !arp_resolves(2 + i)) {
+      ERROR("arp: host %d lost\n", 2 + i);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static double
+elapsed(struct timespec *start, struct timespec *end)
+{
+  return ((end->tv_sec - start->tv_sec) * 1e9 +
+	  (end->tv_nsec - start->tv_nsec)) / ROUNDS;
+}
+/*---------------------------------------------------------------------------*/
+static struct entry *
+linear_lookup(uip_ipaddr_t *ipaddr)
+{
+  int i;
+
+  for(i = 0; i < ENTRIES; i++) {
+    if(uip_ipaddr_cmp(&entries[i].ipaddr, ipaddr)) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+benchmark(void)
+{
+  static uip_ipaddr_t hits[ENTRIES], misses[ENTRIES];
+  static u8_t order[ORDER];
+  struct timespec start, end;
+  double hit, miss, linear, ns;
+  int i, n, run, found;
+
+  /* A full cache of random addresses, which never age. */
+  cache.maxage = 0;
+  uip_addrcache_init(&cache);
+  for(i = 0; i < ENTRIES; i++) {
+    uip_ipaddr(&hits[i], 10, rand() & 0xff, rand() & 0xff, rand() & 0xff);
+    uip_ipaddr(&misses[i], 172, rand() & 0xff, rand() & 0xff, rand() & 0xff);
+    uip_addrcache_add(&cache, &hits[i]);
+  }
+  for(n = 0; n < ORDER; n++) {
+    order[n] = rand() % ENTRIES;
+  }
+
+  /* The best of several runs is reported, to filter out noise from
+     the rest of the host. */
+  hit = miss = linear = 0;
+  found = 0;
+  for(run = 0; run < RUNS; run++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(n = 0; n < ROUNDS; n++) {
+      found += uip_addrcache_lookup(&cache, &hits[order[n % ORDER]]) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = elapsed(&start, &end);
+    hit = (run == 0 || ns < hit) ? ns : hit;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(n = 0; n < ROUNDS; n++) {
+      found += uip_addrcache_lookup(&cache, &misses[order[n % ORDER]]) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = elapsed(&start, &end);
+    miss = (run == 0 || ns < miss) ? ns : miss;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(n = 0; n < ROUNDS; n++) {
+      found += linear_lookup(&hits[order[n % ORDER]]) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = elapsed(&start, &end);
+    linear = (run == 0 || ns < linear) ? ns : linear;
+  }
+  if(found != 2 * RUNS * ROUNDS) {
+    ERROR("benchmark: %d of %d lookups hit\n", found, 2 * RUNS * ROUNDS);
+  }
+
+  printf("%3d entries: %5.1f ns per hit, %5.1f ns per miss, "
+	 "%5.1f ns per linear scan hit",
+	 ENTRIES, hit, miss, linear);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  make_keys();
+  test_cache(MAXAGE);
+  test_cache(0);
+  test_arp();
+  benchmark();
+  printf(", %d errors\n", errors);
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
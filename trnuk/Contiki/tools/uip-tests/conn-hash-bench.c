@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host test and benchmark of the TCP demultiplexing in uIP
+ *
+ *         Opens UIP_CONNS connections to a listening port through
+ *         real handshakes, replaces connections with reset and new
+ *         SYNs, and checks that every segment reaches the connection
+ *         it belongs to. Then it measures the time uip_input() takes
+ *         for segments to random connections. Build it with and
+ *         without UIP_CONF_TCP_CONN_HASH, see the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net/uip.h"
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+#define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#define ROUNDS 500000
+#define RUNS   5
+#define ORDER  4096
+#define CHURN  2000
+
+struct peer {
+  uip_ipaddr_t addr;
+  u16_t port;
+  u32_t seq, ack;
+  struct uip_conn *conn;
+};
+
+static struct peer peers[UIP_CONNS];
+static u16_t next_port = 1024;
+static int errors;
+/*---------------------------------------------------------------------------*/
+void
+tcpip_uipcall(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static u32_t
+get32(const u8_t *b)
+{
+  return ((u32_t)b[0] << 24) | ((u32_t)b[1] << 16) | (b[2] << 8) | b[3];
+}
+/*---------------------------------------------------------------------------*/
+static void
+put32(u8_t *b, u32_t v)
+{
+  b[0] = v >> 24;
+  b[1] = v >> 16;
+  b[2] = v >> 8;
+  b[3] = v;
+}
+/*---------------------------------------------------------------------------*/
+static void
+segment(struct peer *p, u8_t flags)
+{
+  memset(uip_buf, 0, UIP_IPTCPH_LEN);
+  BUF->vhl = 0x45;
+  BUF->len[1] = UIP_IPTCPH_LEN;
+  BUF->ttl = 64;
+  BUF->proto = UIP_PROTO_TCP;
+  uip_ipaddr_copy(&BUF->srcipaddr, &p->addr);
+  uip_ipaddr_copy(&BUF->destipaddr, &uip_hostaddr);
+  BUF->ipchksum = ~(uip_ipchksum());
+  BUF->srcport = p->port;
+  BUF->destport = HTONS(80);
+  put32(BUF->seqno, p->seq);
+  put32(BUF->ackno, p->ack);
+  BUF->tcpoffset = 5 << 4;
+  BUF->flags = flags;
+  BUF->wnd[0] = 4;
+  BUF->tcpchksum = ~(uip_tcpchksum());
+  uip_len = UIP_IPTCPH_LEN;
+}
+/*---------------------------------------------------------------------------*/
+/* Opens a connection from a peer with a new address and port. */
+static void
+open_peer(struct peer *p)
+{
+  uip_ipaddr(&p->addr, 10, 1, rand() & 0xff, rand() & 0xff);
+  p->port = htons(next_port++);
+  if(next_port == 0) {
+    next_port = 1024;
+  }
+  p->seq = rand();
+  p->ack = 0;
+  segment(p, TCP_SYN);
+  uip_input();
+  if(uip_len == 0 || (BUF->flags & (TCP_SYN | TCP_ACK)) != (TCP_SYN | TCP_ACK)) {
+    printf("no SYN-ACK for a new connection\n");
+    exit(1);
+  }
+  p->conn = uip_conn;
+  p->seq++;
+  p->ack = get32(BUF->seqno) + 1;
+  segment(p, TCP_ACK);
+  uip_input();
+  if(uip_conn != p->conn || p->conn->tcpstateflags != UIP_ESTABLISHED) {
+    printf("handshake did not complete\n");
+    exit(1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_all(void)
+{
+  int i;
+
+  for(i = 0; i < UIP_CONNS; i++) {
+    segment(&peers[i], TCP_ACK);
+    uip_input();
+    if(uip_conn != peers[i].conn) {
+      errors++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  static u8_t packets[UIP_CONNS][UIP_IPTCPH_LEN];
+  static u8_t order[ORDER];
+  struct timespec start, end;
+  double ns, best;
+  int i, n, run;
+
+  uip_init();
+  uip_ipaddr(&uip_hostaddr, 10, 0, 0, 1);
+  uip_listen(HTONS(80));
+
+  for(i = 0; i < UIP_CONNS; i++) {
+    open_peer(&peers[i]);
+  }
+  check_all();
+
+  /* A SYN to a port with no listener gets a reset. */
+  segment(&peers[0], TCP_SYN);
+  BUF->destport = HTONS(81);
+  BUF->tcpchksum = 0;
+  BUF->tcpchksum = ~(uip_tcpchksum());
+  uip_input();
+  if(uip_len == 0 || (BUF->flags & TCP_RST) == 0) {
+    printf("no reset for a SYN to a closed port\n");
+    errors++;
+  }
+
+  /* Reset random connections and let new peers take their slots. */
+  for(n = 0; n < CHURN; n++) {
+    i = rand() % UIP_CONNS;
+    segment(&peers[i], TCP_RST | TCP_ACK);
+    uip_input();
+    open_peer(&peers[i]);
+    if(n % 100 == 0) {
+      check_all();
+    }
+  }
+  check_all();
+
+  for(i = 0; i < UIP_CONNS; i++) {
+    segment(&peers[i], TCP_ACK);
+    memcpy(packets[i], uip_buf, UIP_IPTCPH_LEN);
+  }
+  for(n = 0; n < ORDER; n++) {
+    order[n] = rand() % UIP_CONNS;
+  }
+  /* The best of several runs is reported, to filter out noise from
+     the rest of the host. */
+  best = 0;
+  for(run = 0; run < RUNS; run++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(n = 0; n < ROUNDS; n++) {
+      i = order[n % ORDER];
+      memcpy(uip_buf, packets[i], UIP_IPTCPH_LEN);
+      uip_len = UIP_IPTCPH_LEN;
+      uip_input();
+      if(uip_conn != peers[i].conn) {
+	errors++;
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+	  (end.tv_nsec - start.tv_nsec)) / ROUNDS;
+    if(run == 0 || ns < best) {
+      best = ns;
+    }
+  }
+
+  printf("%3d connections, %s: %6.1f ns per segment, %d errors\n",
+	 UIP_CONNS, UIP_TCP_CONN_HASH ? "hash index" : "linear scan",
+	 best, errors);
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Host fuzz test and benchmark of the 802.15.4 frame parser
+ *
+ *         Random frames, of random lengths and with random FCFs, are
+ *         parsed with frame802154_parse_view() and frame802154_parse()
+ *         and with the parser that they replaced, old_parse() below.
+ *         The parsers must agree on the header length and on every
+ *         field, except that the old parser took the aux security
+ *         header for payload. The new parsers get each frame in a
+ *         buffer of exactly its length, so that a build with
+ *         SANITIZE catches reads past its end; the old parser read
+ *         past the end of short frames, and gets a padded copy.
+ *         Random headers are also built with frame802154_create() and
+ *         must parse back to the same fields.
+ *
+ *         Then each parser is timed on the frame shapes that
+ *         sicslowmac sends and receives. See the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net/mac/frame802154.h"
+
+#ifndef FRAMES
+#define FRAMES 100000
+#endif /* FRAMES */
+
+#ifndef BENCH_ROUNDS
+#define BENCH_ROUNDS 0
+#endif /* BENCH_ROUNDS */
+
+#define MAXLEN 127
+
+static const uint8_t aux_lens[4] = { 5, 6, 10, 14 };
+
+static unsigned long frames, parsed, secured, errors;
+
+#define ERROR(...) do { if(errors++ < 10) printf(__VA_ARGS__); } while(0)
+/*---------------------------------------------------------------------------*/
+/* frame802154_parse() as it was before frame802154_parse_view(). It
+   does not parse the aux security header, and reads past the end of
+   frames that are too short for their addresses. */
+static uint8_t
+old_parse(uint8_t *data, uint8_t len, frame802154_t *pf)
+{
+  uint8_t *p;
+  frame802154_fcf_t fcf;
+  uint8_t c;
+
+  if(len < 3) {
+    return 0;
+  }
+
+  p = data;
+
+  /* decode the FCF */
+  fcf.frame_type = p[0] & 7;
+  fcf.security_enabled = (p[0] >> 3) & 1;
+  fcf.frame_pending = (p[0] >> 4) & 1;
+  fcf.ack_required = (p[0] >> 5) & 1;
+  fcf.panid_compression = (p[0] >> 6) & 1;
+
+  fcf.dest_addr_mode = (p[1] >> 2) & 3;
+  fcf.frame_version = (p[1] >> 4) & 3;
+  fcf.src_addr_mode = (p[1] >> 6) & 3;
+
+  /* copy fcf and seqNum */
+  pf->fcf = fcf;
+  pf->seq = p[2];
+  p += 3;                             /* Skip first three bytes */
+
+  /* Destination address, if any */
+  if(fcf.dest_addr_mode) {
+    /* Destination PAN */
+    pf->dest_pid = p[0] + (p[1] << 8);
+    p += 2;
+
+    /* Destination address */
+    if(fcf.dest_addr_mode == FRAME802154_SHORTADDRMODE) {
+      rimeaddr_copy(&(pf->dest_addr), &rimeaddr_null);
+      pf->dest_addr.u8[0] = p[1];
+      pf->dest_addr.u8[1] = p[0];
+      p += 2;
+    } else if(fcf.dest_addr_mode == FRAME802154_LONGADDRMODE) {
+      for(c = 0; c < 8; c++) {
+        pf->dest_addr.u8[c] = p[7 - c];
+      }
+      p += 8;
+    }
+  } else {
+    rimeaddr_copy(&(pf->dest_addr), &rimeaddr_null);
+    pf->dest_pid = 0;
+  }
+
+  /* Source address, if any */
+  if(fcf.src_addr_mode) {
+    /* Source PAN */
+    if(!fcf.panid_compression) {
+      pf->src_pid = p[0] + (p[1] << 8);
+      p += 2;
+    } else {
+      pf->src_pid = pf->dest_pid;
+    }
+
+    /* Source address */
+    if(fcf.src_addr_mode == FRAME802154_SHORTADDRMODE) {
+      rimeaddr_copy(&(pf->src_addr), &rimeaddr_null);
+      pf->src_addr.u8[0] = p[1];
+      pf->src_addr.u8[1] = p[0];
+      p += 2;
+    } else if(fcf.src_addr_mode == FRAME802154_LONGADDRMODE) {
+      for(c = 0; c < 8; c++) {
+        pf->src_addr.u8[c] = p[7 - c];
+      }
+      p += 8;
+    }
+  } else {
+    rimeaddr_copy(&(pf->src_addr), &rimeaddr_null);
+    pf->src_pid = 0;
+  }
+
+  /* header length */
+  c = p - data;
+  /* payload length */
+  pf->payload_len = len - c;
+  /* payload */
+  pf->payload = p;
+
+  /* return header length if successful */
+  return c > len ? 0 : c;
+}
+/*---------------------------------------------------------------------------*/
+static int
+same_fields(const frame802154_t *a, const frame802154_t *b)
+{
+  return memcmp(&a->fcf, &b->fcf, sizeof(a->fcf)) == 0 &&
+    a->seq == b->seq &&
+    a->dest_pid == b->dest_pid && a->src_pid == b->src_pid &&
+    rimeaddr_cmp(&a->dest_addr, &b->dest_addr) &&
+    rimeaddr_cmp(&a->src_addr, &b->src_addr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+fuzz(void)
+{
+  static uint8_t padded[MAXLEN + 32];
+  frame802154_t old, new;
+  frame802154_view_t v;
+  uint8_t *data, old_len, view_len, new_len, aux_len;
+  int len, i;
+
+  /* Most frames have a valid FCF, so that most of them get past the
+     address fields. */
+  len = rand() % (MAXLEN + 1);
+  data = malloc(len > 0 ? len : 1);
+  for(i = 0; i < len; i++) {
+    data[i] = rand();
+  }
+  if(len >= 2 && rand() % 4 != 0) {
+    data[1] |= 0x88;
+  }
+  memset(padded, 0, sizeof(padded));
+  memcpy(padded, data, len);
+  memset(&old, 0, sizeof(old));
+  memset(&new, 0, sizeof(new));
+  frames++;
+
+  old_len = old_parse(padded, len, &old);
+  view_len = frame802154_parse_view(data, len, &v);
+  new_len = frame802154_parse(data, len, &new);
+  if(view_len != new_len) {
+    ERROR("frame %lu: view %u, parse %u\n", frames, view_len, new_len);
+  }
+
+  if(len < 3 || !(data[0] & 0x08) || old_len == 0) {
+    /* The parsers must agree. */
+    if(old_len != new_len) {
+      ERROR("frame %lu: header of %u bytes, expected %u\n", frames,
+            new_len, old_len);
+    } else if(new_len != 0 &&
+              (!same_fields(&old, &new) || old.payload_len != new.payload_len ||
+               new.payload != data + new_len)) {
+      ERROR("frame %lu: the fields differ\n", frames);
+    }
+  } else {
+    /* The aux security header follows the addresses. */
+    aux_len = old_len < len ? aux_lens[(data[old_len] >> 3) & 3] : 0;
+    if(old_len >= len || old_len + aux_len > len) {
+      if(new_len != 0) {
+        ERROR("frame %lu: the aux header does not fit, but parses\n", frames);
+      }
+    } else if(new_len != old_len + aux_len || v.aux_hdr != old_len) {
+      ERROR("frame %lu: header of %u bytes, expected %u\n", frames,
+            new_len, old_len + aux_len);
+    } else if(!same_fields(&old, &new) ||
+              new.aux_hdr.security_control.security_level !=
+              (data[old_len] & 7) ||
+              new.aux_hdr.frame_counter !=
+              (data[old_len + 1] | ((uint32_t)data[old_len + 2] << 8) |
+               ((uint32_t)data[old_len + 3] << 16) |
+               ((uint32_t)data[old_len + 4] << 24)) ||
+              memcmp(new.aux_hdr.key, data + old_len + 5, aux_len - 5) != 0) {
+      ERROR("frame %lu: the fields differ\n", frames);
+    } else {
+      secured++;
+    }
+  }
+  if(new_len != 0) {
+    parsed++;
+  }
+  free(data);
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_addr(rimeaddr_t *addr, uint8_t mode)
+{
+  int i;
+
+  rimeaddr_copy(addr, &rimeaddr_null);
+  if(mode == FRAME802154_SHORTADDRMODE) {
+    addr->u8[0] = rand();
+    addr->u8[1] = rand();
+  } else if(mode == FRAME802154_LONGADDRMODE) {
+    for(i = 0; i < RIMEADDR_SIZE; i++) {
+      addr->u8[i] = rand();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+round_trip(void)
+{
+  static uint8_t buf[MAXLEN];
+  frame802154_t p, q;
+  uint8_t len;
+  int i;
+
+  memset(&p, 0, sizeof(p));
+  p.fcf.frame_type = rand() & 7;
+  p.fcf.security_enabled = rand() & 1;
+  p.fcf.frame_pending = rand() & 1;
+  p.fcf.ack_required = rand() & 1;
+  p.fcf.dest_addr_mode = (rand() & 1) ? 2 + (rand() & 1) : 0;
+  p.fcf.src_addr_mode = (rand() & 1) ? 2 + (rand() & 1) : 0;
+  p.fcf.frame_version = rand() & 1;
+  p.seq = rand();
+  if(p.fcf.dest_addr_mode) {
+    p.dest_pid = rand();
+    random_addr(&p.dest_addr, p.fcf.dest_addr_mode);
+  }
+  if(p.fcf.src_addr_mode) {
+    p.src_pid = rand() & 1 ? p.dest_pid : (uint16_t)rand();
+    random_addr(&p.src_addr, p.fcf.src_addr_mode);
+  }
+  if(p.fcf.security_enabled) {
+    p.aux_hdr.security_control.security_level = rand() & 7;
+    p.aux_hdr.security_control.key_id_mode = rand() & 3;
+    p.aux_hdr.frame_counter = rand() ^ ((uint32_t)rand() << 16);
+    for(i = 0; i < sizeof(p.aux_hdr.key); i++) {
+      p.aux_hdr.key[i] = rand();
+    }
+  }
+
+  len = frame802154_create(&p, buf, sizeof(buf));
+  frames++;
+  memset(&q, 0, sizeof(q));
+  if(len == 0 || len != frame802154_hdrlen(&p) ||
+     frame802154_parse(buf, len, &q) != len) {
+    ERROR("round trip %lu: header of %u bytes\n", frames, len);
+    return;
+  }
+  /* frame802154_create() sets the PAN ID compression bit itself. */
+  p.fcf.panid_compression = q.fcf.panid_compression;
+  if(p.fcf.dest_addr_mode == 0 && p.fcf.src_addr_mode != 0) {
+    p.dest_pid = 0;
+  }
+  if(!same_fields(&p, &q) || q.payload_len != 0 ||
+     (p.fcf.security_enabled &&
+      (q.aux_hdr.security_control.security_level !=
+       p.aux_hdr.security_control.security_level ||
+       q.aux_hdr.security_control.key_id_mode !=
+       p.aux_hdr.security_control.key_id_mode ||
+       q.aux_hdr.frame_counter != p.aux_hdr.frame_counter ||
+       memcmp(q.aux_hdr.key, p.aux_hdr.key,
+              aux_lens[p.aux_hdr.security_control.key_id_mode] - 5) != 0))) {
+    ERROR("round trip %lu: the fields differ\n", frames);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if BENCH_ROUNDS
+static volatile uint8_t sink;
+/*---------------------------------------------------------------------------*/
+static double
+ns_per_round(const struct timespec *start)
+{
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return ((end.tv_sec - start->tv_sec) * 1e9 +
+          (end.tv_nsec - start->tv_nsec)) / BENCH_ROUNDS;
+}
+/*---------------------------------------------------------------------------*/
+/* Times the parsers on a frame with a header of the given shape and
+   a payload of 40 bytes. The view is timed with the two addresses
+   copied out of it, as sicslowmac does. */
+static void
+bench(const char *name, uint8_t fcf0, uint8_t fcf1)
+{
+  static uint8_t buf[MAXLEN];
+  frame802154_t f;
+  frame802154_view_t v;
+  struct timespec start;
+  rimeaddr_t src, dest;
+  double old_ns, view_ns, parse_ns;
+  uint8_t len;
+  long i;
+
+  for(i = 0; i < sizeof(buf); i++) {
+    buf[i] = rand();
+  }
+  buf[0] = fcf0;
+  buf[1] = fcf1;
+  buf[3 + 2 + 8 + 2 + 8] = 0x05;        /* aux header with key id mode 0 */
+  len = frame802154_parse_view(buf, sizeof(buf), &v) + 40;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < BENCH_ROUNDS; i++) {
+    sink += old_parse(buf, len, &f);
+  }
+  old_ns = ns_per_round(&start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < BENCH_ROUNDS; i++) {
+    sink += frame802154_parse_view(buf, len, &v);
+    FRAME802154_VIEW_DEST_ADDR(&v, &dest);
+    FRAME802154_VIEW_SRC_ADDR(&v, &src);
+    sink += dest.u8[0] + src.u8[0];
+  }
+  view_ns = ns_per_round(&start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < BENCH_ROUNDS; i++) {
+    sink += frame802154_parse(buf, len, &f);
+  }
+  parse_ns = ns_per_round(&start);
+
+  printf("%-32s old parse %5.1f ns, view %5.1f ns, parse %5.1f ns\n",
+         name, old_ns, view_ns, parse_ns);
+}
+#endif /* BENCH_ROUNDS */
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  unsigned long i;
+
+  for(i = 0; i < FRAMES; i++) {
+    fuzz();
+  }
+  printf("%lu random frames: %lu parse, %lu with an aux header, "
+         "%lu errors\n", frames, parsed, secured, errors);
+  frames = 0;
+  for(i = 0; i < FRAMES; i++) {
+    round_trip();
+  }
+  printf("%lu create and parse round trips, %lu errors\n", frames, errors);
+
+#if BENCH_ROUNDS
+  bench("short/short, one PAN ID", 0x41, 0x88);
+  bench("long/long, one PAN ID", 0x41, 0xcc);
+  bench("long/long, two PAN IDs", 0x01, 0xcc);
+  bench("long/long, two PAN IDs, secured", 0x09, 0xdc);
+#endif /* BENCH_ROUNDS */
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
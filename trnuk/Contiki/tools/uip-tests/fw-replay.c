@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host trace-replay test and benchmark of uip-fw
+ *
+ *         Registers NETIFS interfaces: /16 networks, and /24 networks
+ *         nested in half of them. A trace of packets between random
+ *         hosts is generated, in which some packets are copies of
+ *         one of the last few packets, as when a neighbour
+ *         retransmits. The trace is replayed through uip_fw_forward()
+ *         once to check that each packet leaves on the interface with
+ *         the longest matching prefix, or on the default interface,
+ *         and that no new packet is taken for a duplicate. Then the
+ *         replay is timed.
+ *
+ *         Build it with UIP_CONF_FW_NETIFS of 1 to get the linear
+ *         interface walk, and with UIP_CONF_FWCACHE_WAYS equal to
+ *         UIP_CONF_FWCACHE_SIZE to get a fully associative cache, as
+ *         uip-fw had before. See the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net/uip.h"
+#include "net/uip-fw.h"
+
+#define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#define TRACE_LEN   100000
+#define RUNS        5
+#define FLOWS       200
+#define DUP_PERCENT 5
+#define DUP_WINDOW  8
+
+/* uip_fw_periodic() is called every PERIODIC packets. */
+#define PERIODIC    500
+
+struct trace_packet {
+  uip_ipaddr_t src, dest;
+  u16_t ipid;
+  u8_t dup;
+  s8_t netif;           /* The expected interface, -1 for the default. */
+};
+
+static struct uip_fw_netif netifs[NETIFS], defaultnetif;
+static u8_t netif_len[NETIFS];
+static struct trace_packet trace[TRACE_LEN];
+/*---------------------------------------------------------------------------*/
+/* No packet in the trace is for this host. */
+void
+tcpip_uipcall(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static u8_t
+output(void)
+{
+  return UIP_FW_OK;
+}
+/*---------------------------------------------------------------------------*/
+/* The interface with the longest prefix that holds an address. */
+static int
+reference_netif(const uip_ipaddr_t *addr)
+{
+  int i, best;
+
+  best = -1;
+  for(i = 0; i < NETIFS; i++) {
+    if((addr->u16[0] & netifs[i].netmask.u16[0]) ==
+       (netifs[i].ipaddr.u16[0] & netifs[i].netmask.u16[0]) &&
+       (addr->u16[1] & netifs[i].netmask.u16[1]) ==
+       (netifs[i].ipaddr.u16[1] & netifs[i].netmask.u16[1]) &&
+       (best < 0 || netif_len[i] > netif_len[best])) {
+      best = i;
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+static void
+setup(void)
+{
+  int i;
+
+  uip_fw_init();
+  uip_ipaddr(&uip_hostaddr, 192, 168, 0, 1);
+
+  /* The /16 networks are registered first. uip_fw_register() puts
+     the latest interface first in its list, so the linear walk also
+     finds the longest prefix. */
+  for(i = 0; i < NETIFS; i++) {
+    if(i < (NETIFS + 1) / 2) {
+      uip_ipaddr(&netifs[i].ipaddr, 10, i, 0, 1);
+      uip_ipaddr(&netifs[i].netmask, 255, 255, 0, 0);
+      netif_len[i] = 16;
+    } else {
+      uip_ipaddr(&netifs[i].ipaddr, 10, i - (NETIFS + 1) / 2, 1, 1);
+      uip_ipaddr(&netifs[i].netmask, 255, 255, 255, 0);
+      netif_len[i] = 24;
+    }
+    netifs[i].output = output;
+    uip_fw_register(&netifs[i]);
+  }
+  defaultnetif.output = output;
+  uip_fw_default(&defaultnetif);
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_trace(void)
+{
+  static uip_ipaddr_t flow_src[FLOWS], flow_dest[FLOWS];
+  static u16_t flow_ipid[FLOWS];
+  int i, f;
+
+  for(f = 0; f < FLOWS; f++) {
+    uip_ipaddr(&flow_src[f], 172, 16, rand() & 0xff, rand() & 0xff);
+    /* Some destinations are outside every network. */
+    uip_ipaddr(&flow_dest[f], 10, rand() % ((NETIFS + 1) / 2 + 2),
+	       rand() % 3, rand() & 0xff);
+    flow_ipid[f] = rand();
+  }
+
+  for(i = 0; i < TRACE_LEN; i++) {
+    if(i > DUP_WINDOW && rand() % 100 < DUP_PERCENT) {
+      trace[i] = trace[i - 1 - rand() % DUP_WINDOW];
+      trace[i].dup = 1;
+      continue;
+    }
+    /* A few flows carry most of the traffic. */
+    f = rand() % FLOWS;
+    if(rand() % 4 != 0) {
+      f %= FLOWS / 10;
+    }
+    uip_ipaddr_copy(&trace[i].src, &flow_src[f]);
+    uip_ipaddr_copy(&trace[i].dest, &flow_dest[f]);
+    trace[i].ipid = flow_ipid[f]++;
+    trace[i].dup = 0;
+    trace[i].netif = reference_netif(&trace[i].dest);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+load(const struct trace_packet *p)
+{
+  memset(uip_buf, 0, UIP_IPUDPH_LEN);
+  BUF->vhl = 0x45;
+  BUF->len[1] = UIP_IPUDPH_LEN;
+  BUF->ipid[0] = p->ipid >> 8;
+  BUF->ipid[1] = p->ipid & 0xff;
+  BUF->ttl = 64;
+  BUF->proto = UIP_PROTO_UDP;
+  uip_ipaddr_copy(&BUF->srcipaddr, &p->src);
+  uip_ipaddr_copy(&BUF->destipaddr, &p->dest);
+  BUF->ipchksum = ~(uip_ipchksum());
+  uip_len = UIP_IPUDPH_LEN;
+}
+/*---------------------------------------------------------------------------*/
+/* The index of the interface whose sent counter has moved, or -1 for
+   the default interface, or -2 if the packet was not sent. */
+static int
+sent_on(uip_stats_t *before)
+{
+  int i, sent;
+
+  sent = -2;
+  for(i = 0; i < NETIFS; i++) {
+    if(netifs[i].stats.sent != before[i]) {
+      sent = i;
+    }
+    before[i] = netifs[i].stats.sent;
+  }
+  if(defaultnetif.stats.sent != before[NETIFS]) {
+    sent = -1;
+  }
+  before[NETIFS] = defaultnetif.stats.sent;
+  return sent;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  static uip_stats_t before[NETIFS + 1];
+  struct timespec start, end;
+  double ns, best;
+  int i, n, run, wrong, dropped, dups, dups_dropped;
+
+  /* The trace needs the interfaces to find the expected ones. */
+  setup();
+  make_trace();
+
+  /* Check the replay. */
+  wrong = dropped = dups = dups_dropped = 0;
+  memset(before, 0, sizeof(before));
+  for(i = 0; i < TRACE_LEN; i++) {
+    if(i % PERIODIC == 0) {
+      uip_fw_periodic();
+    }
+    load(&trace[i]);
+    uip_fw_forward();
+    n = sent_on(before);
+    if(trace[i].dup) {
+      dups++;
+      if(n == -2) {
+	dups_dropped++;
+      }
+    } else if(n == -2) {
+      dropped++;
+    } else if(n != trace[i].netif) {
+      wrong++;
+    }
+  }
+
+  /* Time the replay. The best of several runs is reported. */
+  best = 0;
+  for(run = 0; run < RUNS; run++) {
+    setup();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(i = 0; i < TRACE_LEN; i++) {
+      if(i % PERIODIC == 0) {
+	uip_fw_periodic();
+      }
+      load(&trace[i]);
+      uip_fw_forward();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+	  (end.tv_nsec - start.tv_nsec)) / TRACE_LEN;
+    if(run == 0 || ns < best) {
+      best = ns;
+    }
+  }
+
+  printf("%3d interfaces, %s, cache %d/%d-way: %6.1f ns per packet, "
+	 "%d%% of duplicates dropped, %d misrouted, %d new packets dropped\n",
+	 NETIFS, UIP_CONF_FW_NETIFS < NETIFS ? "linear walk" : "trie       ",
+	 UIP_CONF_FWCACHE_SIZE, UIP_CONF_FWCACHE_WAYS, best,
+	 100 * dups_dropped / dups, wrong, dropped);
+  return wrong != 0 || dropped != 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host test and benchmark of the HC01 header compression
+ *
+ *         IPv6 headers of random shapes are compressed and then
+ *         uncompressed, and must come back unchanged. The test is
+ *         built with and without the fast path of the common UDP
+ *         shape: the build without it writes every compressed header
+ *         to a file, and the build with it must produce the same bytes.
+ *         Then each of a few typical shapes is compressed and
+ *         uncompressed ROUNDS times and timed. See the Makefile.
+ *
+ *         sicslowpan.c is included rather than linked, so that its
+ *         header compression functions can be called directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "net/sicslowpan.c"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#define CYCLES() 0
+#endif
+
+#define HEADERS 200000
+#define ROUNDS  2000000
+#define MAX_PAYLOAD 32
+
+enum {
+  SHAPE_LL_SHORT_PORTS,
+  SHAPE_LL,
+  SHAPE_GLOBAL,
+  SHAPE_HOP_LIMIT,
+  SHAPE_MULTICAST,
+  SHAPE_ICMP,
+  SHAPES
+};
+
+static const char *shape_names[SHAPES] = {
+  "link-local UDP, short ports",
+  "link-local UDP",
+  "global UDP through context 1",
+  "link-local UDP, hop limit 7",
+  "multicast UDP",
+  "link-local ICMPv6",
+};
+
+static const rimeaddr_t addr_a = {{0x00, 0x12, 0x74, 0x01, 0x02, 0x03, 0x04, 0x05}};
+static const rimeaddr_t addr_b = {{0x00, 0x12, 0x74, 0x09, 0x08, 0x07, 0x06, 0x05}};
+
+static u8_t orig[UIP_BUFSIZE];
+static unsigned long headers, fast, errors;
+
+u8_t uip_buf[UIP_BUFSIZE + 2];
+u16_t uip_len;
+uip_lladdr_t uip_lladdr;
+
+#define ERROR(...) do { if(errors++ < 10) printf(__VA_ARGS__); } while(0)
+/*---------------------------------------------------------------------------*/
+clock_time_t
+clock_time(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+tcpip_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+tcpip_set_outputfunc(u8_t (*f)(uip_lladdr_t *))
+{
+}
+/*---------------------------------------------------------------------------*/
+/* As in uip-netif.c, for 8-byte link-layer addresses. */
+void
+uip_netif_addr_autoconf_set(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr)
+{
+  memcpy(ipaddr->u8 + 8, lladdr, 8);
+  ipaddr->u8[8] ^= 0x02;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_receive_function(void (*f)(const struct mac_driver *d))
+{
+}
+/*---------------------------------------------------------------------------*/
+static const struct mac_driver stub_mac = {
+  "stub", NULL, NULL, NULL, set_receive_function, NULL, NULL
+};
+/*---------------------------------------------------------------------------*/
+static void
+set_addr(uip_ipaddr_t *ipaddr, u8_t prefix, const rimeaddr_t *addr)
+{
+  memset(ipaddr, 0, sizeof(*ipaddr));
+  if(prefix == 0xfe) {
+    ipaddr->u8[0] = 0xfe;
+    ipaddr->u8[1] = 0x80;
+  } else {
+    ipaddr->u8[0] = prefix;
+    ipaddr->u8[1] = prefix;
+  }
+  uip_netif_addr_autoconf_set(ipaddr, (uip_lladdr_t *)addr);
+}
+/*---------------------------------------------------------------------------*/
+/* Builds a packet of the shape from addr_a to addr_b in uip_buf. */
+static void
+make_packet(int shape, int payload)
+{
+  int i;
+
+  memset(uip_buf, 0, UIP_LLH_LEN + UIP_IPUDPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  UIP_IP_BUF->ttl = 64;
+  set_addr(&UIP_IP_BUF->srcipaddr, shape == SHAPE_GLOBAL ? 0xaa : 0xfe,
+           &addr_a);
+  set_addr(&UIP_IP_BUF->destipaddr, shape == SHAPE_GLOBAL ? 0xaa : 0xfe,
+           &addr_b);
+  if(shape == SHAPE_LL_SHORT_PORTS) {
+    UIP_UDP_BUF->srcport = HTONS(SICSLOWPAN_UDP_PORT_MIN + 1);
+    UIP_UDP_BUF->destport = HTONS(SICSLOWPAN_UDP_PORT_MIN + 2);
+  } else {
+    UIP_UDP_BUF->srcport = HTONS(5683);
+    UIP_UDP_BUF->destport = HTONS(5683);
+  }
+  UIP_UDP_BUF->udpchksum = HTONS(0x1234);
+  if(shape == SHAPE_HOP_LIMIT) {
+    UIP_IP_BUF->ttl = 7;
+  } else if(shape == SHAPE_MULTICAST) {
+    uip_create_linklocal_allnodes_mcast(&UIP_IP_BUF->destipaddr);
+  } else if(shape == SHAPE_ICMP) {
+    UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  }
+
+  for(i = 0; i < payload; i++) {
+    uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN + i] = rand();
+  }
+  uip_len = UIP_IPUDPH_LEN + payload;
+  UIP_IP_BUF->len[0] = 0;
+  UIP_IP_BUF->len[1] = uip_len - UIP_IPH_LEN;
+  if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
+    memcpy(&UIP_UDP_BUF->udplen, UIP_IP_BUF->len, 2);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Changes fields of the packet at random, so that some packets stay in
+   the shape of the fast path and some leave it by a single field. */
+static void
+mutate(void)
+{
+  int r = rand();
+
+  if(r & 0x0001) {
+    UIP_IP_BUF->tcflow = rand() & 1 ? 0x05 : 0x50;
+  }
+  if(r & 0x0002) {
+    UIP_IP_BUF->flow = rand();
+  }
+  if(r & 0x0004) {
+    UIP_IP_BUF->vtc = 0x6a;
+  }
+  if(r & 0x0008) {
+    UIP_IP_BUF->ttl = rand() & 1 ? 1 : 255;
+  }
+  if(r & 0x0010) {
+    UIP_IP_BUF->srcipaddr.u8[15] ^= 1;
+  }
+  if(r & 0x0020) {
+    UIP_IP_BUF->destipaddr.u8[15] ^= 1;
+  }
+  if(r & 0x0040) {
+    memset(UIP_IP_BUF->destipaddr.u8 + 8, 0, 7);
+  }
+  if(r & 0x0080) {
+    UIP_IP_BUF->srcipaddr.u8[0] = UIP_IP_BUF->srcipaddr.u8[1] = 0xaa;
+  }
+  if(r & 0x0100) {
+    memset(UIP_IP_BUF->destipaddr.u8, 0x20, 8);
+  }
+  if(r & 0x0200 && UIP_IP_BUF->proto == UIP_PROTO_UDP) {
+    UIP_UDP_BUF->srcport = HTONS(SICSLOWPAN_UDP_PORT_MIN + (rand() & 15));
+    UIP_UDP_BUF->destport = HTONS(SICSLOWPAN_UDP_PORT_MIN + (rand() & 15));
+  }
+  if(r & 0x0400 && UIP_IP_BUF->proto == UIP_PROTO_UDP) {
+    UIP_UDP_BUF->destport = HTONS(SICSLOWPAN_UDP_PORT_MIN + 16);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Compresses the header in uip_buf into the packetbuf, and puts the
+   rest of the packet after it, as output() does. */
+static void
+compress(void)
+{
+  packetbuf_clear();
+  rime_ptr = packetbuf_dataptr();
+  rime_hdr_len = 0;
+  uncomp_hdr_len = 0;
+  compress_hdr_hc01((rimeaddr_t *)&addr_b);
+  memcpy(rime_ptr + rime_hdr_len, &uip_buf[UIP_LLH_LEN + uncomp_hdr_len],
+         uip_len - uncomp_hdr_len);
+  packetbuf_set_datalen(rime_hdr_len + uip_len - uncomp_hdr_len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &addr_a);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &addr_b);
+}
+/*---------------------------------------------------------------------------*/
+static void
+uncompress(u16_t ip_len)
+{
+  rime_ptr = packetbuf_dataptr();
+  rime_hdr_len = 0;
+  uncomp_hdr_len = 0;
+  uncompress_hdr_hc01(ip_len);
+}
+/*---------------------------------------------------------------------------*/
+/* Compresses and uncompresses the packet in uip_buf, and checks the
+   compressed header against the file of the generic build. */
+static void
+round_trip(FILE *f)
+{
+  u8_t hdr[2 + UIP_IPUDPH_LEN + 8], ref[sizeof(hdr)];
+  u8_t len, hdr_len;
+  u16_t ip_len;
+
+  headers++;
+  memcpy(orig, &uip_buf[UIP_LLH_LEN], uip_len);
+#if HC01_FAST
+  packetbuf_clear();
+  rime_ptr = packetbuf_dataptr();
+  fast += compress_hdr_hc01_fast((rimeaddr_t *)&addr_b);
+#endif /* HC01_FAST */
+  compress();
+  len = rime_hdr_len;
+  hdr_len = uncomp_hdr_len;
+
+  hdr[0] = len;
+  hdr[1] = hdr_len;
+  memcpy(hdr + 2, rime_ptr, len);
+  if(f != NULL && !HC01_FAST) {
+    fwrite(hdr, 1, len + 2, f);
+  } else if(f != NULL) {
+    if(fread(ref, 1, 2, f) != 2 || ref[0] != len || ref[1] != hdr_len ||
+       fread(ref + 2, 1, len, f) != len || memcmp(hdr, ref, len + 2) != 0) {
+      ERROR("header %lu: compressed differently than without the fast path\n",
+            headers);
+    }
+  }
+
+  /* Uncompress it as a whole packet or as a first fragment. */
+  memset(uip_buf, 0xee, UIP_LLH_LEN + UIP_IPUDPH_LEN);
+  ip_len = rand() & 1 ? 0 : uip_len;
+  uncompress(ip_len);
+  if(rime_hdr_len != len || uncomp_hdr_len != hdr_len) {
+    ERROR("header %lu: uncompressed %u into %u bytes, compressed %u into %u\n",
+          headers, rime_hdr_len, uncomp_hdr_len, hdr_len, len);
+  } else if(memcmp(&uip_buf[UIP_LLH_LEN], orig, hdr_len) != 0) {
+    ERROR("header %lu: does not uncompress to the original\n", headers);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(int shape)
+{
+  struct timespec start, end;
+  unsigned long long cycles[2];
+  double ns[2];
+  long i;
+
+  make_packet(shape, 8);
+  compress();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  cycles[0] = CYCLES();
+  for(i = 0; i < ROUNDS; i++) {
+    rime_hdr_len = 0;
+    uncomp_hdr_len = 0;
+    compress_hdr_hc01((rimeaddr_t *)&addr_b);
+  }
+  cycles[0] = CYCLES() - cycles[0];
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ns[0] = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  cycles[1] = CYCLES();
+  for(i = 0; i < ROUNDS; i++) {
+    uncompress(0);
+  }
+  cycles[1] = CYCLES() - cycles[1];
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ns[1] = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+  printf("%-30s %2u bytes: compress %5.1f ns %4.0f cycles, "
+         "uncompress %5.1f ns %4.0f cycles\n",
+         shape_names[shape], rime_hdr_len,
+         ns[0] / ROUNDS, (double)cycles[0] / ROUNDS,
+         ns[1] / ROUNDS, (double)cycles[1] / ROUNDS);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  FILE *f;
+  int i;
+
+  f = NULL;
+  if(argc > 1) {
+    f = fopen(argv[1], HC01_FAST ? "rb" : "wb");
+    if(f == NULL) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+  sicslowpan_init(&stub_mac);
+  memcpy(&uip_lladdr, &addr_a, sizeof(uip_lladdr));
+
+  for(i = 0; i < HEADERS; i++) {
+    make_packet(rand() % SHAPES, rand() % (MAX_PAYLOAD + 1));
+    if(rand() & 1) {
+      mutate();
+    }
+    round_trip(f);
+  }
+  if(f != NULL) {
+    fclose(f);
+  }
+  if(HC01_FAST && (fast == 0 || fast == headers)) {
+    ERROR("%lu of %lu headers on the fast path\n", fast, headers);
+  }
+
+  printf("%s: %lu headers, %lu on the fast path, %lu errors\n",
+         HC01_FAST ? "fast path" : "generic", headers, fast, errors);
+  for(i = 0; i < SHAPES; i++) {
+    bench(i);
+  }
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
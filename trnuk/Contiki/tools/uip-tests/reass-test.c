@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host test of IP fragment reassembly with several contexts
+ *
+ *         SOURCES hosts send UDP packets of random sizes to this
+ *         host, all with the same sequence of fragment identifiers.
+ *         Each packet is cut into fragments that arrive out of order,
+ *         some fragments are sent twice or overlap their neighbours,
+ *         and some are lost. The fragments of all hosts are
+ *         interleaved and fed to uip_input(). Every step is checked
+ *         against a model with UIP_REASS_CONTEXTS contexts that drops
+ *         the packet that was started first when it needs a context
+ *         and none is free: packets must be delivered intact and
+ *         exactly when the model completes them, and the reassembly
+ *         statistics must agree with the model's count of started,
+ *         completed, evicted and timed-out packets.
+ *
+ *         The same file tests uip.c and, when built with
+ *         UIP_CONF_IPV6, uip6.c. For IPv6 the clock and the
+ *         reassembly timer are simulated, and the neighbor discovery,
+ *         ICMPv6 and interface functions are stubs. See the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "net/uip.h"
+
+#if UIP_CONF_IPV6
+#include "net/uip-icmp6.h"
+#include "net/uip-nd6.h"
+#include "net/uip-netif.h"
+#include "sys/etimer.h"
+#endif /* UIP_CONF_IPV6 */
+
+#define SOURCES   6
+#define PACKETS   3000        /* per source */
+#define MAXFRAGS  (UIP_BUFSIZE / 8 + 4)
+#define PORT      7000
+
+#define DUP_PERCENT     20    /* packets with a fragment sent twice */
+#define OVERLAP_PERCENT 30    /* packets with an overlapping fragment */
+#define LOSS_PERCENT    5     /* packets with a lost fragment */
+#define IDLE_PERMILLE   5     /* fragments followed by a quiet period */
+
+#define IPBUF  ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UDPBUF ((struct uip_udpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#if UIP_CONF_IPV6
+#define FRAGBUF ((struct uip_frag_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#define FRAG_HLEN (UIP_IPH_LEN + UIP_FRAGH_LEN)
+/* The simulated clock advances by TICK every TICK_FRAGS fragments, so
+   several packets may start in the same tick. */
+#define TICK       200
+#define TICK_FRAGS 4
+#define IDLE_TICKS (UIP_REASS_MAXAGE / 4 * CLOCK_SECOND / TICK)
+#define TIMEOUT (UIP_REASS_MAXAGE * CLOCK_SECOND)
+#else /* UIP_CONF_IPV6 */
+#define FRAG_HLEN UIP_IPH_LEN
+/* A round of uip_periodic() calls is made every ROUND fragments. */
+#define ROUND   20
+#define IDLE_TICKS (UIP_REASS_MAXAGE / 4)
+#endif /* UIP_CONF_IPV6 */
+
+/* The largest payload that fits the reassembly buffer. */
+#define MAXPAYLOAD (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPH_LEN)
+
+struct frag {
+  u16_t offset, len;
+  u8_t last;
+};
+
+struct source {
+  uip_ipaddr_t addr;
+  u16_t id;
+  u16_t len;
+  u16_t sent;
+  struct frag frags[MAXFRAGS];
+  int nfrags, next;
+};
+
+static struct source sources[SOURCES];
+
+/* The model of the reassembly contexts. */
+static struct {
+  u8_t used;
+  int src;
+  u16_t id;
+  int len;                      /* -1 until the last fragment is seen */
+  unsigned long seq;
+  unsigned long age;
+  u8_t covered[MAXPAYLOAD];
+} model[UIP_REASS_CONTEXTS];
+static unsigned long seq;
+static unsigned long started, done, evicted, timedout, delivered;
+
+/* What the model expects from the current fragment, and what
+   tcpip_uipcall() got. */
+static int expect_src, expect_len;
+static int got, got_len;
+static uip_ipaddr_t got_addr;
+static u8_t got_data[MAXPAYLOAD];
+
+static unsigned long frags, errors;
+
+#define ERROR(...) do { if(errors++ < 10) printf(__VA_ARGS__); } while(0)
+/*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6
+static clock_time_t now;
+static u8_t reass_timer_on;
+extern struct etimer uip_reass_timer;
+static uip_ipaddr_t myaddr;
+struct uip_netif uip_netif_physical_if;
+
+clock_time_t
+clock_time(void)
+{
+  return now;
+}
+void
+etimer_set(struct etimer *et, clock_time_t interval)
+{
+  et->timer.start = now;
+  et->timer.interval = interval;
+  reass_timer_on = 1;
+}
+void
+etimer_stop(struct etimer *et)
+{
+  reass_timer_on = 0;
+}
+struct uip_netif_addr *
+uip_netif_addr_lookup(uip_ipaddr_t *ipaddr, u8_t length, uip_netif_type type)
+{
+  static struct uip_netif_addr a;
+
+  return uip_ipaddr_cmp(ipaddr, &myaddr) ? &a : NULL;
+}
+u8_t
+uip_netif_is_addr_my_solicited(uip_ipaddr_t *ipaddr)
+{
+  return 0;
+}
+void uip_netif_init(void) {}
+void uip_netif_select_src(uip_ipaddr_t *src, uip_ipaddr_t *dst) {}
+void uip_nd6_init(void) {}
+void uip_nd6_io_ns_input(void) {}
+void uip_nd6_io_na_input(void) {}
+void uip_nd6_io_ra_input(void) {}
+void uip_icmp6_echo_request_input(void) {}
+void uip_icmp6_error_output(u8_t type, u8_t code, u32_t param) {}
+#endif /* UIP_CONF_IPV6 */
+/*---------------------------------------------------------------------------*/
+void
+tcpip_uipcall(void)
+{
+  if(uip_udp_conn != NULL && uip_newdata()) {
+    got++;
+    got_len = uip_datalen();
+    uip_ipaddr_copy(&got_addr, &IPBUF->srcipaddr);
+    memcpy(got_data, uip_appdata, got_len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static u8_t
+pattern(int src, u16_t id, int i)
+{
+  return src * 31 + id * 7 + i;
+}
+/*---------------------------------------------------------------------------*/
+/* Cut the next packet of a source into fragments. */
+static void
+next_packet(struct source *s)
+{
+  struct frag *f, t;
+  int i, j, offset;
+
+  s->id++;
+  s->len = UIP_UDPH_LEN + 1 + rand() % (MAXPAYLOAD - UIP_UDPH_LEN);
+  s->nfrags = 0;
+  for(offset = 0; offset < s->len; offset += f->len) {
+    f = &s->frags[s->nfrags++];
+    f->offset = offset;
+    f->len = 8 * (1 + rand() % 6);
+    f->last = offset + f->len >= s->len;
+    if(f->last) {
+      f->len = s->len - offset;
+    }
+  }
+  if(s->nfrags > 1 && rand() % 100 < OVERLAP_PERCENT) {
+    /* A fragment that covers two neighbours. */
+    i = rand() % (s->nfrags - 1);
+    f = &s->frags[s->nfrags++];
+    f->offset = s->frags[i].offset;
+    f->len = s->frags[i].len + s->frags[i + 1].len;
+    f->last = s->frags[i + 1].last;
+  }
+  if(rand() % 100 < DUP_PERCENT) {
+    s->frags[s->nfrags] = s->frags[rand() % s->nfrags];
+    s->nfrags++;
+  }
+  if(s->nfrags > 1 && rand() % 100 < LOSS_PERCENT) {
+    i = rand() % s->nfrags;
+    s->frags[i] = s->frags[--s->nfrags];
+  }
+  for(i = s->nfrags - 1; i > 0; i--) {
+    j = rand() % (i + 1);
+    t = s->frags[i];
+    s->frags[i] = s->frags[j];
+    s->frags[j] = t;
+  }
+  s->next = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Put a fragment of the current packet of a source into uip_buf. */
+static void
+load(int src, const struct frag *f)
+{
+  struct source *s = &sources[src];
+  u8_t *p;
+  int i, len;
+
+  memset(uip_buf, 0, UIP_LLH_LEN + FRAG_HLEN);
+  len = FRAG_HLEN + f->len;
+#if UIP_CONF_IPV6
+  IPBUF->vtc = 0x60;
+  IPBUF->len[0] = (len - UIP_IPH_LEN) >> 8;
+  IPBUF->len[1] = (len - UIP_IPH_LEN) & 0xff;
+  IPBUF->proto = UIP_PROTO_FRAG;
+  IPBUF->ttl = 64;
+  uip_ipaddr_copy(&IPBUF->srcipaddr, &s->addr);
+  uip_ipaddr_copy(&IPBUF->destipaddr, &myaddr);
+  FRAGBUF->next = UIP_PROTO_UDP;
+  FRAGBUF->offsetresmore = htons(f->offset | (f->last ? 0 : 1));
+  FRAGBUF->id = s->id;
+#else /* UIP_CONF_IPV6 */
+  IPBUF->vhl = 0x45;
+  IPBUF->len[0] = len >> 8;
+  IPBUF->len[1] = len & 0xff;
+  IPBUF->ipid[0] = s->id >> 8;
+  IPBUF->ipid[1] = s->id & 0xff;
+  IPBUF->ipoffset[0] = (f->offset >> 11) | (f->last ? 0 : 0x20);
+  IPBUF->ipoffset[1] = f->offset >> 3;
+  IPBUF->ttl = 64;
+  IPBUF->proto = UIP_PROTO_UDP;
+  uip_ipaddr_copy(&IPBUF->srcipaddr, &s->addr);
+  uip_ipaddr_copy(&IPBUF->destipaddr, &uip_hostaddr);
+  IPBUF->ipchksum = ~(uip_ipchksum());
+#endif /* UIP_CONF_IPV6 */
+
+  /* The payload starts with the UDP header. */
+  p = &uip_buf[UIP_LLH_LEN + FRAG_HLEN];
+  for(i = f->offset; i < f->offset + f->len; i++) {
+    switch(i) {
+    case 0: *p++ = 0; break;
+    case 1: *p++ = src; break;
+    case 2: *p++ = PORT >> 8; break;
+    case 3: *p++ = PORT & 0xff; break;
+    case 4: *p++ = s->len >> 8; break;
+    case 5: *p++ = s->len & 0xff; break;
+    case 6: case 7: *p++ = 0; break;
+    default: *p++ = pattern(src, s->id, i); break;
+    }
+  }
+  uip_len = UIP_LLH_LEN + len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+model_free(int c)
+{
+  model[c].used = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+model_age(void)
+{
+  int c;
+
+  for(c = 0; c < UIP_REASS_CONTEXTS; c++) {
+    if(!model[c].used) {
+      continue;
+    }
+#if UIP_CONF_IPV6
+    if(now - model[c].age >= TIMEOUT) {
+#else /* UIP_CONF_IPV6 */
+    if(--model[c].age == 0) {
+#endif /* UIP_CONF_IPV6 */
+      timedout++;
+      model_free(c);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Let a clock tick, or a periodic round, pass in uIP and the model. */
+static void
+tick(void)
+{
+#if UIP_CONF_IPV6
+  now += TICK;
+  while(reass_timer_on &&
+	now - uip_reass_timer.timer.start >= uip_reass_timer.timer.interval) {
+    /* Like tcpip.c, call uip_reass_over() when the timer expires. */
+    reass_timer_on = 0;
+    uip_reass_over();
+  }
+#else /* UIP_CONF_IPV6 */
+  int i;
+
+  for(i = 0; i < UIP_CONNS; i++) {
+    uip_periodic(i);
+  }
+#endif /* UIP_CONF_IPV6 */
+  model_age();
+}
+/*---------------------------------------------------------------------------*/
+static void
+model_fragment(int src, const struct frag *f)
+{
+  struct source *s = &sources[src];
+  int c, free, oldest, i;
+
+#if !UIP_CONF_IPV6
+  if(f->offset == 0 && f->last) {
+    /* Not a fragment in IPv4, so it bypasses reassembly. */
+    expect_src = src;
+    expect_len = f->len;
+    return;
+  }
+#endif /* !UIP_CONF_IPV6 */
+
+  free = oldest = -1;
+  for(c = 0; c < UIP_REASS_CONTEXTS; c++) {
+    if(!model[c].used) {
+      free = c;
+    } else if(model[c].src == src && model[c].id == s->id) {
+      break;
+    } else if(oldest < 0 || model[c].seq < model[oldest].seq) {
+      oldest = c;
+    }
+  }
+  if(c == UIP_REASS_CONTEXTS) {
+    if(free >= 0) {
+      c = free;
+    } else {
+      c = oldest;
+      evicted++;
+    }
+    started++;
+    model[c].used = 1;
+    model[c].src = src;
+    model[c].id = s->id;
+    model[c].len = -1;
+    model[c].seq = ++seq;
+#if UIP_CONF_IPV6
+    model[c].age = now;
+#else /* UIP_CONF_IPV6 */
+    model[c].age = UIP_REASS_MAXAGE;
+#endif /* UIP_CONF_IPV6 */
+    memset(model[c].covered, 0, sizeof(model[c].covered));
+  }
+
+  memset(&model[c].covered[f->offset], 1, f->len);
+  if(f->last) {
+    model[c].len = f->offset + f->len;
+  }
+  if(model[c].len < 0) {
+    return;
+  }
+  for(i = 0; i < model[c].len; i++) {
+    if(!model[c].covered[i]) {
+      return;
+    }
+  }
+  done++;
+  model_free(c);
+  expect_src = src;
+  expect_len = model[c].len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_delivery(void)
+{
+  struct source *s;
+  int i;
+
+  if(expect_src < 0) {
+    if(got) {
+      ERROR("fragment %lu: unexpected packet delivered\n", frags);
+    }
+    return;
+  }
+  delivered++;
+  if(!got) {
+    ERROR("fragment %lu: complete packet from source %d not delivered\n",
+	  frags, expect_src);
+    return;
+  }
+  s = &sources[expect_src];
+  if(!uip_ipaddr_cmp(&got_addr, &s->addr) ||
+     got_len != expect_len - UIP_UDPH_LEN) {
+    ERROR("fragment %lu: delivered the wrong packet\n", frags);
+    return;
+  }
+  for(i = UIP_UDPH_LEN; i < expect_len; i++) {
+    if(got_data[i - UIP_UDPH_LEN] != pattern(expect_src, s->id, i)) {
+      ERROR("fragment %lu: corrupt data at offset %d\n", frags, i);
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  struct uip_udp_conn *conn;
+  struct source *s;
+  int i, src, active;
+
+  uip_init();
+#if UIP_CONF_IPV6
+  uip_ip6addr(&myaddr, 0x2001, 0xdb8, 0, 0, 0, 0, 0, 1);
+#else /* UIP_CONF_IPV6 */
+  uip_ipaddr(&uip_hostaddr, 10, 0, 0, 1);
+#endif /* UIP_CONF_IPV6 */
+  conn = uip_udp_new(NULL, 0);
+  uip_udp_bind(conn, HTONS(PORT));
+
+  for(src = 0; src < SOURCES; src++) {
+#if UIP_CONF_IPV6
+    uip_ip6addr(&sources[src].addr, 0x2001, 0xdb8, 0, 0, 0, 0, 0, 2 + src);
+#else /* UIP_CONF_IPV6 */
+    uip_ipaddr(&sources[src].addr, 10, 0, 0, 2 + src);
+#endif /* UIP_CONF_IPV6 */
+    /* All sources use the same identifiers. */
+    sources[src].id = 1000;
+    next_packet(&sources[src]);
+  }
+
+  for(active = SOURCES; active > 0; frags++) {
+#if UIP_CONF_IPV6
+    if(frags % TICK_FRAGS == 0) {
+      tick();
+    }
+#else /* UIP_CONF_IPV6 */
+    if(frags % ROUND == 0) {
+      tick();
+    }
+#endif /* UIP_CONF_IPV6 */
+    if(rand() % 1000 < IDLE_PERMILLE) {
+      /* A quarter of the maximum age passes without fragments, so
+	 that contexts that miss a fragment time out. */
+      for(i = 0; i < IDLE_TICKS; i++) {
+	tick();
+      }
+    }
+
+    do {
+      src = rand() % SOURCES;
+      s = &sources[src];
+    } while(s->sent == PACKETS);
+
+    expect_src = -1;
+    model_fragment(src, &s->frags[s->next]);
+    got = 0;
+    load(src, &s->frags[s->next]);
+    uip_input();
+    check_delivery();
+
+    if(++s->next == s->nfrags) {
+      if(++s->sent == PACKETS) {
+	active--;
+      } else {
+	next_packet(s);
+      }
+    }
+  }
+
+  if(uip_stat.reass.started != (uip_stats_t)started ||
+     uip_stat.reass.done != (uip_stats_t)done ||
+     uip_stat.reass.evicted != (uip_stats_t)evicted ||
+     uip_stat.reass.timeout != (uip_stats_t)timedout) {
+    ERROR("statistics: started %u/%lu, done %u/%lu, "
+	  "evicted %u/%lu, timed out %u/%lu\n",
+	  uip_stat.reass.started, started, uip_stat.reass.done, done,
+	  uip_stat.reass.evicted, evicted, uip_stat.reass.timeout, timedout);
+  }
+
+  printf("%s, %d contexts: %lu fragments, %lu of %d packets delivered, "
+	 "%lu evicted, %lu timed out, %lu errors\n",
+	 UIP_CONF_IPV6 ? "IPv6" : "IPv4", UIP_REASS_CONTEXTS, frags,
+	 delivered, SOURCES * PACKETS, evicted, timedout, errors);
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
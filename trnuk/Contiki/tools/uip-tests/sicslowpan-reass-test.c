@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Host test of 6lowpan fragment reassembly
+ *
+ *         SOURCES nodes send IPv6 packets of random sizes to this
+ *         node, all with the same sequence of datagram tags. Each
+ *         packet is cut into a FRAG1 and FRAGN fragments that arrive
+ *         out of order, some fragments are sent twice, and some are
+ *         lost, also in the same packet. The fragments of all nodes
+ *         are interleaved and fed to the input function of sicslowpan
+ *         through a stub MAC driver. Every fragment is checked against
+ *         a model with SICSLOWPAN_CONF_REASS_BUFS buffers: a packet
+ *         must be delivered intact exactly when the model has every
+ *         8-byte unit of it, a fragment whose units the model has
+ *         already seen must be ignored, and the reassembly statistics
+ *         must agree with the model. See the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "net/uip.h"
+#include "net/rime.h"
+#include "net/sicslowpan.h"
+
+#define SOURCES   4
+#define PACKETS   4000        /* per source */
+#define MAXFRAGS  (UIP_BUFSIZE / 8 + 2)
+#define UNITS     ((UIP_BUFSIZE + 7) / 8)
+
+#define DUP_PERCENT  30       /* packets with a fragment sent twice */
+#define LOSS_PERCENT 10       /* packets with a lost fragment */
+
+/* The clock advances by TICK for each fragment, so that packets that
+   are never completed time out unless they are evicted first. */
+#define TICK    10
+#define TIMEOUT (SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND)
+
+struct frag {
+  u16_t offset, len;
+};
+
+struct source {
+  rimeaddr_t addr;
+  u16_t tag;
+  u16_t size;
+  struct frag frags[MAXFRAGS + 1];
+  int nfrags, next;
+  u8_t dup, lost;
+};
+
+static struct source sources[SOURCES];
+
+/* The model of the reassembly buffers, in the order of reass_bufs. */
+static struct {
+  u16_t size;
+  int src;
+  u16_t tag;
+  clock_time_t start;
+  u8_t units[UNITS];
+  int received;
+} model[SICSLOWPAN_CONF_REASS_BUFS];
+static unsigned long started, done, evicted, timedout, dups;
+
+/* Packets that were delivered although a fragment was sent twice,
+   and packets that had a fragment sent twice and one lost. */
+static unsigned long dup_done, dup_lost;
+
+static clock_time_t now;
+static void (*receive)(const struct mac_driver *d);
+
+/* What tcpip_input() got. */
+static int got, got_len;
+static u8_t got_data[UIP_BUFSIZE];
+
+static unsigned long frags, errors;
+
+u8_t uip_buf[UIP_BUFSIZE + 2];
+u16_t uip_len;
+uip_lladdr_t uip_lladdr;
+struct rimestats rimestats;
+
+#define ERROR(...) do { if(errors++ < 10) printf(__VA_ARGS__); } while(0)
+/*---------------------------------------------------------------------------*/
+clock_time_t
+clock_time(void)
+{
+  return now;
+}
+/*---------------------------------------------------------------------------*/
+void
+tcpip_input(void)
+{
+  got++;
+  got_len = uip_len;
+  memcpy(got_data, uip_buf, uip_len);
+}
+/*---------------------------------------------------------------------------*/
+void
+tcpip_set_outputfunc(u8_t (*f)(uip_lladdr_t *))
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_receive_function(void (*f)(const struct mac_driver *d))
+{
+  receive = f;
+}
+/*---------------------------------------------------------------------------*/
+static const struct mac_driver stub_mac = {
+  "stub", NULL, NULL, NULL, set_receive_function, NULL, NULL
+};
+/*---------------------------------------------------------------------------*/
+static u8_t
+pattern(int src, u16_t tag, int i)
+{
+  return (u8_t)(src * 37 + tag * 11 + i * 3 + (i >> 8));
+}
+/*---------------------------------------------------------------------------*/
+/* Cuts the next packet of a source into fragments, shuffles them, and
+   sends one of them twice or loses one. */
+static void
+next_packet(int src)
+{
+  struct source *s = &sources[src];
+  struct frag f;
+  u16_t offset, len;
+  int i, j;
+
+  s->tag++;
+  s->size = UIP_IPH_LEN + 1 + rand() % (UIP_BUFSIZE - UIP_IPH_LEN);
+  s->nfrags = 0;
+  offset = 0;
+  while(offset < s->size) {
+    if(offset == 0) {
+      /* The FRAG1 carries the IPv6 header and a few units more. */
+      len = UIP_IPH_LEN + 8 * (1 + rand() % 7);
+    } else {
+      len = 8 * (1 + rand() % 12);
+    }
+    if(offset + len > s->size) {
+      len = s->size - offset;
+    }
+    s->frags[s->nfrags].offset = offset;
+    s->frags[s->nfrags].len = len;
+    s->nfrags++;
+    offset += len;
+  }
+  for(i = s->nfrags - 1; i > 0; i--) {
+    j = rand() % (i + 1);
+    f = s->frags[i];
+    s->frags[i] = s->frags[j];
+    s->frags[j] = f;
+  }
+
+  s->dup = s->lost = 0;
+  if(rand() % 100 < DUP_PERCENT) {
+    /* The copy goes anywhere after the original. */
+    i = rand() % s->nfrags;
+    j = i + 1 + rand() % (s->nfrags - i);
+    memmove(&s->frags[j + 1], &s->frags[j],
+            (s->nfrags - j) * sizeof(struct frag));
+    s->frags[j] = s->frags[i];
+    s->nfrags++;
+    s->dup = 1;
+  }
+  if(s->nfrags > 1 + s->dup && rand() % 100 < LOSS_PERCENT) {
+    /* A fragment that was not sent twice is lost. */
+    do {
+      i = rand() % s->nfrags;
+      for(j = 0; j < s->nfrags; j++) {
+        if(j != i && s->frags[j].offset == s->frags[i].offset) {
+          break;
+        }
+      }
+    } while(j < s->nfrags);
+    memmove(&s->frags[i], &s->frags[i + 1],
+            (s->nfrags - i - 1) * sizeof(struct frag));
+    s->nfrags--;
+    s->lost = 1;
+  }
+  if(s->dup && s->lost) {
+    dup_lost++;
+  }
+  s->next = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_frag(int src, const struct frag *f)
+{
+  struct source *s = &sources[src];
+  u8_t *p;
+  int i, hdr;
+
+  packetbuf_clear();
+  p = packetbuf_dataptr();
+  if(f->offset == 0) {
+    p[0] = (SICSLOWPAN_DISPATCH_FRAG1 | (s->size >> 8));
+    hdr = SICSLOWPAN_FRAG1_HDR_LEN;
+    p[hdr++] = SICSLOWPAN_DISPATCH_IPV6;
+  } else {
+    p[0] = (SICSLOWPAN_DISPATCH_FRAGN | (s->size >> 8));
+    p[SICSLOWPAN_FRAG1_HDR_LEN] = f->offset >> 3;
+    hdr = SICSLOWPAN_FRAGN_HDR_LEN;
+  }
+  p[1] = s->size & 0xff;
+  p[2] = s->tag >> 8;
+  p[3] = s->tag & 0xff;
+  for(i = 0; i < f->len; i++) {
+    p[hdr + i] = pattern(src, s->tag, f->offset + i);
+  }
+  packetbuf_set_datalen(hdr + f->len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &s->addr);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &rimeaddr_node_addr);
+}
+/*---------------------------------------------------------------------------*/
+/* Finds the buffer of a fragment in the model, in the same way as
+   reass_lookup(). */
+static int
+model_lookup(int src)
+{
+  struct source *s = &sources[src];
+  int i, oldest;
+
+  oldest = -1;
+  for(i = 0; i < SICSLOWPAN_CONF_REASS_BUFS; i++) {
+    if(model[i].size != 0 && now - model[i].start >= TIMEOUT) {
+      timedout++;
+      model[i].size = 0;
+    }
+    if(model[i].size == 0) {
+      oldest = i;
+    } else if(model[i].size == s->size && model[i].tag == s->tag &&
+              model[i].src == src) {
+      return i;
+    } else if(oldest < 0 ||
+              (model[oldest].size != 0 &&
+               now - model[i].start > now - model[oldest].start)) {
+      oldest = i;
+    }
+  }
+
+  i = oldest;
+  if(model[i].size != 0) {
+    evicted++;
+  }
+  started++;
+  model[i].size = s->size;
+  model[i].src = src;
+  model[i].tag = s->tag;
+  model[i].start = now;
+  model[i].received = 0;
+  memset(model[i].units, 0, sizeof(model[i].units));
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the next fragment of a source, and returns 1 when the model
+   expects the packet to be delivered. */
+static int
+send_frag(int src)
+{
+  struct source *s = &sources[src];
+  const struct frag *f;
+  int b, u, first, end;
+
+  f = &s->frags[s->next++];
+  make_frag(src, f);
+  now += TICK;
+  frags++;
+
+  b = model_lookup(src);
+  first = f->offset / 8;
+  end = (f->offset + f->len + 7) / 8;
+  for(u = first; u < end; u++) {
+    if(model[b].units[u]) {
+      dups++;
+      receive(&stub_mac);
+      return 0;
+    }
+  }
+  for(u = first; u < end; u++) {
+    model[b].units[u] = 1;
+  }
+  model[b].received += end - first;
+  receive(&stub_mac);
+  if(model[b].received == (s->size + 7) / 8) {
+    model[b].size = 0;
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(int src, int expect)
+{
+  struct source *s = &sources[src];
+  int i;
+
+  if(got != expect) {
+    ERROR("source %d tag %u: %s after fragment %d of %d\n", src, s->tag,
+          expect ? "not delivered" : "delivered", s->next, s->nfrags);
+    return;
+  }
+  if(!expect) {
+    return;
+  }
+  if(got_len != s->size) {
+    ERROR("source %d tag %u: length %d, expected %u\n", src, s->tag,
+          got_len, s->size);
+    return;
+  }
+  for(i = 0; i < got_len; i++) {
+    if(got_data[i] != pattern(src, s->tag, i)) {
+      ERROR("source %d tag %u: bad byte %d\n", src, s->tag, i);
+      return;
+    }
+  }
+  done++;
+  if(s->dup) {
+    dup_done++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  unsigned long left;
+  int src;
+
+  rimeaddr_node_addr.u8[0] = 0xff;
+  for(src = 0; src < SOURCES; src++) {
+    sources[src].addr.u8[0] = src + 1;
+    next_packet(src);
+  }
+  sicslowpan_init(&stub_mac);
+
+  left = (unsigned long)SOURCES * PACKETS;
+  while(left > 0) {
+    src = rand() % SOURCES;
+    got = 0;
+    check(src, send_frag(src));
+    if(sources[src].next == sources[src].nfrags) {
+      next_packet(src);
+      left--;
+    }
+  }
+
+  if(sicslowpan_reass_stat.frags != (uip_stats_t)frags ||
+     sicslowpan_reass_stat.started != (uip_stats_t)started ||
+     sicslowpan_reass_stat.done != (uip_stats_t)done ||
+     sicslowpan_reass_stat.timeout != (uip_stats_t)timedout ||
+     sicslowpan_reass_stat.evicted != (uip_stats_t)evicted ||
+     sicslowpan_reass_stat.dup != (uip_stats_t)dups ||
+     sicslowpan_reass_stat.drop != 0) {
+    ERROR("statistics: frags %u/%lu started %u/%lu done %u/%lu "
+          "timeout %u/%lu evicted %u/%lu dup %u/%lu drop %u\n",
+          sicslowpan_reass_stat.frags, frags,
+          sicslowpan_reass_stat.started, started,
+          sicslowpan_reass_stat.done, done,
+          sicslowpan_reass_stat.timeout, timedout,
+          sicslowpan_reass_stat.evicted, evicted,
+          sicslowpan_reass_stat.dup, dups,
+          sicslowpan_reass_stat.drop);
+  }
+  if(dup_done == 0 || dup_lost == 0 || dups == 0) {
+    ERROR("the test did not cover duplicate fragments\n");
+  }
+
+  printf("%d buffers: %lu fragments, %lu packets done, %lu with a "
+         "duplicate, %lu with a duplicate and a loss, %lu duplicates "
+         "ignored, %lu evicted, %lu timed out, %lu errors\n",
+         SICSLOWPAN_CONF_REASS_BUFS, frags, done, dup_done, dup_lost, dups,
+         evicted, timedout, errors);
+  return errors != 0;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2009, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Host loopback benchmark of the uIP TCP sender
+ *
+ *         A uIP server sends a byte stream over a simulated link to a
+ *         receiver in this file, which acknowledges every segment and
+ *         keeps segments that arrive out of order. The link has a
+ *         fixed delay and bit rate and drops a given share of the
+ *         data segments. Time is simulated in milliseconds, with
+ *         uip_periodic() called every half second as tcpip does.
+ *
+ *         The program reports the throughput and checks that every
+ *         byte arrives intact and that the connection is closed with
+ *         a FIN after the last byte. Build it with and without
+ *         UIP_CONF_TCP_SNDBUF_SEGS, see the Makefile.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "net/uip.h"
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_ACK 0x10
+
+#define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#define STREAM_LEN     (64 * 1024L)
+#define DELAY_MS       50    /* One way. */
+#define BYTES_PER_MS   32    /* About 250 kbit/s. */
+#define PERIODIC_MS    500
+#define TIMEOUT_MS     (1000 * 1000L)
+#define PEER_WINDOW    4096
+
+#define QUEUE_LEN      64
+
+struct packet {
+  long arrival;
+  u16_t len;
+  u8_t data[UIP_BUFSIZE];
+};
+
+/* The two directions of the link. */
+struct link {
+  struct packet queue[QUEUE_LEN];
+  int head, count;
+  long free_at;
+};
+
+static struct link to_peer, to_uip;
+static long now;
+static int loss_percent;
+
+/* The state of the receiver. */
+static u32_t peer_iss = 1000, rcv_base, rcv_nxt;
+static u8_t received[STREAM_LEN];
+static long delivered, all_delivered_at = -1, fin_at = -1;
+static int bad_bytes;
+
+/* The state of the sending application. */
+static long app_queued, app_acked;
+static u16_t app_last;
+static int app_closed, app_rexmits;
+static struct uip_conn *conn;
+/*---------------------------------------------------------------------------*/
+static u8_t
+stream_byte(long offset)
+{
+  return (u8_t)(offset ^ (offset >> 8) ^ 0x5a);
+}
+/*---------------------------------------------------------------------------*/
+static u32_t
+get32(const u8_t *b)
+{
+  return ((u32_t)b[0] << 24) | ((u32_t)b[1] << 16) | (b[2] << 8) | b[3];
+}
+/*---------------------------------------------------------------------------*/
+static void
+put32(u8_t *b, u32_t v)
+{
+  b[0] = v >> 24;
+  b[1] = v >> 16;
+  b[2] = v >> 8;
+  b[3] = v;
+}
+/*---------------------------------------------------------------------------*/
+static void
+app_send(long offset, u16_t len)
+{
+  u8_t *d;
+  u16_t i;
+
+  d = uip_appdata;
+  for(i = 0; i < len; i++) {
+    d[i] = stream_byte(offset + i);
+  }
+  uip_send(uip_appdata, len);
+}
+/*---------------------------------------------------------------------------*/
+/* The application. Without the send buffer it keeps one segment in
+   flight and regenerates it when uIP asks for a retransmission. */
+void
+tcpip_uipcall(void)
+{
+  u16_t len;
+
+  if(uip_closed() || uip_aborted() || uip_timedout()) {
+    return;
+  }
+#if UIP_TCP_SNDBUF_SEGS > 0
+  if(uip_connected()) {
+    uip_sndbuf_enable();
+  }
+  if(uip_rexmit()) {
+    app_rexmits++;
+    return;
+  }
+  if(app_queued < STREAM_LEN && uip_mss() > 0) {
+    len = uip_mss();
+    if(len > STREAM_LEN - app_queued) {
+      len = STREAM_LEN - app_queued;
+    }
+    app_send(app_queued, len);
+    app_queued += len;
+  }
+  if(app_queued == STREAM_LEN && !app_closed) {
+    /* The FIN waits for the buffered data to be acknowledged. */
+    uip_close();
+    app_closed = 1;
+  }
+#else /* UIP_TCP_SNDBUF_SEGS > 0 */
+  if(uip_acked()) {
+    app_acked += app_last;
+    app_last = 0;
+  }
+  if(uip_rexmit()) {
+    app_rexmits++;
+    app_send(app_acked, app_last);
+    return;
+  }
+  if(uip_connected() || uip_acked() || uip_poll()) {
+    if(app_acked < STREAM_LEN) {
+      len = uip_mss();
+      if(len > STREAM_LEN - app_acked) {
+	len = STREAM_LEN - app_acked;
+      }
+      app_send(app_acked, len);
+      app_last = len;
+    } else if(!app_closed) {
+      uip_close();
+      app_closed = 1;
+    }
+  }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+}
+/*---------------------------------------------------------------------------*/
+static void
+link_send(struct link *l, const u8_t *data, u16_t len)
+{
+  struct packet *p;
+
+  if(l->count == QUEUE_LEN) {
+    return;
+  }
+  if(l->free_at < now) {
+    l->free_at = now;
+  }
+  l->free_at += (len + BYTES_PER_MS - 1) / BYTES_PER_MS;
+  p = &l->queue[(l->head + l->count) % QUEUE_LEN];
+  p->arrival = l->free_at + DELAY_MS;
+  p->len = len;
+  memcpy(p->data, data, len);
+  l->count++;
+}
+/*---------------------------------------------------------------------------*/
+static struct packet *
+link_receive(struct link *l)
+{
+  struct packet *p;
+
+  if(l->count == 0 || l->queue[l->head].arrival > now) {
+    return NULL;
+  }
+  p = &l->queue[l->head];
+  l->head = (l->head + 1) % QUEUE_LEN;
+  l->count--;
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+/* Puts what uIP left in uip_buf on the link, unless the link loses
+   it. Only data segments are lost. */
+static void
+uip_buf_send(void)
+{
+  if(uip_len <= UIP_IPTCPH_LEN || rand() % 100 >= loss_percent) {
+    link_send(&to_peer, uip_buf, uip_len);
+  }
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Sends what uIP has produced, and polls the connection again while
+   the send buffer has room, as tcpip does. */
+static void
+uip_output(void)
+{
+  if(uip_len > 0) {
+    uip_buf_send();
+#if UIP_TCP_SNDBUF_SEGS > 0
+    while(conn != NULL && uip_sndbuf_more(conn)) {
+      uip_poll_conn(conn);
+      if(uip_len == 0) {
+	break;
+      }
+      uip_buf_send();
+    }
+#endif /* UIP_TCP_SNDBUF_SEGS > 0 */
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+peer_send(u8_t flags, u32_t seq, u32_t ack)
+{
+  u16_t len;
+
+  memset(uip_buf, 0, UIP_IPTCPH_LEN + 4);
+  len = UIP_IPTCPH_LEN;
+  BUF->tcpoffset = 5 << 4;
+  if(flags & TCP_SYN) {
+    /* Announce an MSS as large as uIP can take. */
+    BUF->optdata[0] = 2;
+    BUF->optdata[1] = 4;
+    BUF->optdata[2] = (UIP_BUFSIZE - UIP_IPTCPH_LEN) >> 8;
+    BUF->optdata[3] = (UIP_BUFSIZE - UIP_IPTCPH_LEN) & 0xff;
+    BUF->tcpoffset = 6 << 4;
+    len += 4;
+  }
+  BUF->vhl = 0x45;
+  BUF->len[0] = len >> 8;
+  BUF->len[1] = len & 0xff;
+  BUF->ttl = 64;
+  BUF->proto = UIP_PROTO_TCP;
+  uip_ipaddr(&BUF->srcipaddr, 10, 0, 0, 2);
+  uip_ipaddr_copy(&BUF->destipaddr, &uip_hostaddr);
+  BUF->ipchksum = ~(uip_ipchksum());
+  BUF->srcport = HTONS(1234);
+  BUF->destport = HTONS(80);
+  put32(BUF->seqno, seq);
+  put32(BUF->ackno, ack);
+  BUF->flags = flags;
+  BUF->wnd[0] = PEER_WINDOW >> 8;
+  BUF->wnd[1] = PEER_WINDOW & 0xff;
+  BUF->tcpchksum = ~(uip_tcpchksum());
+  link_send(&to_uip, uip_buf, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+peer_input(struct packet *p)
+{
+  struct uip_tcpip_hdr *h;
+  u32_t seq;
+  long offset, i;
+  u16_t len;
+
+  h = (struct uip_tcpip_hdr *)p->data;
+  seq = get32(h->seqno);
+  len = p->len - UIP_IPH_LEN - (h->tcpoffset >> 4) * 4;
+
+  if(h->flags & TCP_SYN) {
+    rcv_base = rcv_nxt = seq + 1;
+    peer_send(TCP_ACK, peer_iss + 1, rcv_nxt);
+    return;
+  }
+
+  /* Keep everything within the window, in order or not. */
+  offset = (long)(seq - rcv_base);
+  for(i = 0; i < len; i++) {
+    if(offset + i < 0 || offset + i >= STREAM_LEN ||
+       offset + i >= (long)(rcv_nxt - rcv_base) + PEER_WINDOW) {
+      continue;
+    }
+    if(!received[offset + i]) {
+      received[offset + i] = 1;
+      if(((u8_t *)h)[p->len - len + i] != stream_byte(offset + i)) {
+	bad_bytes++;
+      }
+    }
+  }
+  while(rcv_nxt - rcv_base < STREAM_LEN && received[rcv_nxt - rcv_base]) {
+    rcv_nxt++;
+  }
+  delivered = rcv_nxt - rcv_base;
+  if(delivered == STREAM_LEN && all_delivered_at < 0) {
+    all_delivered_at = now;
+  }
+  if((h->flags & TCP_FIN) && seq + len == rcv_nxt &&
+     delivered == STREAM_LEN) {
+    rcv_nxt++;
+    if(fin_at < 0) {
+      fin_at = now;
+    }
+  }
+  peer_send(TCP_ACK, peer_iss + 1, rcv_nxt);
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(int loss)
+{
+  struct packet *p;
+
+  loss_percent = loss;
+  srand(1);
+  memset(&to_peer, 0, sizeof(to_peer));
+  memset(&to_uip, 0, sizeof(to_uip));
+  memset(received, 0, sizeof(received));
+  now = 0;
+  delivered = 0;
+  all_delivered_at = fin_at = -1;
+  bad_bytes = 0;
+  app_queued = app_acked = 0;
+  app_last = 0;
+  app_closed = app_rexmits = 0;
+
+  uip_init();
+  uip_ipaddr(&uip_hostaddr, 10, 0, 0, 1);
+  uip_listen(HTONS(80));
+  conn = NULL;
+
+  peer_send(TCP_SYN, peer_iss, 0);
+  for(now = 0; now < TIMEOUT_MS && fin_at < 0; now++) {
+    while((p = link_receive(&to_uip)) != NULL) {
+      memcpy(uip_buf, p->data, p->len);
+      uip_len = p->len;
+      uip_input();
+      if(conn == NULL && uip_conn != NULL && uip_conn->lport == HTONS(80)) {
+	conn = uip_conn;
+      }
+      uip_output();
+    }
+    while((p = link_receive(&to_peer)) != NULL) {
+      peer_input(p);
+    }
+    if(now % PERIODIC_MS == 0 && conn != NULL) {
+      uip_periodic_conn(conn);
+      uip_output();
+    }
+  }
+
+  if(all_delivered_at < 0 || fin_at < 0 || bad_bytes > 0 ||
+     (UIP_TCP_SNDBUF_SEGS > 0 && app_rexmits > 0)) {
+    printf("send buffer %2d, loss %2d%%: FAILED, delivered %ld bytes, "
+	   "fin %s, %d bad bytes, %d application retransmissions\n",
+	   UIP_TCP_SNDBUF_SEGS, loss, delivered, fin_at < 0 ? "no" : "yes",
+	   bad_bytes, app_rexmits);
+    exit(1);
+  }
+  printf("send buffer %2d, loss %2d%%: %6.2f kbyte/s\n",
+	 UIP_TCP_SNDBUF_SEGS, loss,
+	 (double)STREAM_LEN / all_delivered_at);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(void)
+{
+  run(0);
+  run(1);
+  run(5);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/